@@ -7,13 +7,19 @@
 
 /// Header includes.
 #if (DM_INCL & DM_INCL_HEADER_INCLUDES)
+    #include <new>                   // placement-new
     #include "../misc.h"
     #include "../allocatori.h"
+    #include "allocator_config.h"    // DM_ALLOC_MAX_TAGS
     #include "../datastructures/array.h"
     #include "../datastructures/handlealloc.h"
     #include "../datastructures/bitarray.h"
+    #include "../datastructures/hashmap.h" // dm::HashMapGrowable
 
     #include <dm/mutex.h> // dm::Mutex //TODO: move this to IMPL INCLUDE.
+    #include <dm/atomic.h> // dm::atomicCompareAndSwapPtr() //TODO: move this to IMPL INCLUDE.
+    #include <dm/hash.h>   // dm::hashWy64() //TODO: move this to IMPL INCLUDE.
+    #include <dm/timer.h>  // dm::getHPCounter() //TODO: move this to IMPL INCLUDE.
 #endif // (DM_INCL & DM_INCL_HEADER_INCLUDES)
 
 /// Header body.
@@ -29,6 +35,98 @@ namespace DM_NAMESPACE
     extern StackAllocatorI* stackAlloc;  // Used for temporary allocations.
     extern AllocatorI*      mainAlloc;   // Default allocator.
 
+    struct AllocStats
+    {
+        enum Path
+        {
+            Segregated,
+            Heap,
+            Stack,
+            Static,
+            External,
+
+            PathCount
+        };
+
+        // Bytes are block sizes as reported by allocSizeOf(), live bytes of a path are 'm_allocBytes - m_freeBytes'.
+        // Stack and static memory is released in bulk, its frees are not counted.
+        uint64_t m_allocCount[PathCount];
+        uint64_t m_allocBytes[PathCount];
+        uint64_t m_freeCount[PathCount];
+        uint64_t m_freeBytes[PathCount];
+        uint64_t m_overflowCount;    // Segregated lists full -> heap, heap full -> external, stack full -> overflow chunk.
+        uint64_t m_remoteFreeCount;  // Small blocks handed back to the cache of the thread that allocated them.
+        uint64_t m_reallocCopyCount; // Realloc that had to move the allocation.
+        uint64_t m_reallocCopyBytes;
+        uint64_t m_externalBytes;    // Currently held by external allocations, including headers and page rounding.
+
+        uint64_t m_tagBytes[DM_ALLOC_MAX_TAGS]; // Currently held per tag, see TaggedAllocator.
+        uint64_t m_tagAllocCount[DM_ALLOC_MAX_TAGS];
+        uint64_t m_tagFreeCount[DM_ALLOC_MAX_TAGS];
+    };
+
+    ///
+    /// Snapshot file, see allocDumpSnapshot(). Header followed by 'm_numExtents' extents, in address order per region.
+    /// Offsets are relative to the beginning of the arena, or of the chunk for heap extents with a non-zero 'm_chunk'.
+    ///
+    struct AllocSnapshotHeader
+    {
+        enum { Version = 1 };
+
+        char     m_magic[4]; // "DMSS"
+        uint32_t m_version;
+        uint64_t m_arenaSize;
+        uint64_t m_smallestRegion; // Heap free slots are grouped in power of two regions starting from this size.
+        uint32_t m_numRegions;
+        uint32_t m_numExtents;
+    };
+
+    struct AllocSnapshotExtent
+    {
+        enum Kind
+        {
+            Static,
+            Segregated,
+            Stack,
+            Heap,
+            Unused, // Between the stack and the heap.
+
+            KindCount
+        };
+
+        uint64_t m_offset;
+        uint64_t m_size;
+        uint8_t  m_kind;
+        uint8_t  m_used;
+        uint16_t m_chunk; // Zero for the arena, chunk index plus one otherwise.
+        uint32_t m_class; // Size class of segregated extents.
+    };
+
+    /// Called when a tag crosses its soft budget, or when an allocation is refused because of the hard budget.
+    typedef void (*AllocBudgetFn)(uint8_t _tag, uint64_t _bytes, bool _hardLimit, void* _userData);
+
+    ///
+    /// Forwards to '_parent' and accounts all of its allocations to a tag, for example one per subsystem.
+    /// Multiple tagged allocators can share the same tag. Each allocation carries a 16 byte header.
+    ///
+    /// Usage:
+    ///     dm::TaggedAllocator cacheAlloc(TagCache, dm::mainAlloc);
+    ///     dm::allocSetTagBudget(TagCache, DM_MEGABYTES(48), DM_MEGABYTES(64), onBudget);
+    ///
+    struct TaggedAllocator : public AllocatorI
+    {
+        TaggedAllocator(uint8_t _tag, AllocatorI* _parent)
+        {
+            m_parent = _parent;
+            m_tag    = _tag;
+        }
+
+        virtual void* realloc(void* _ptr, size_t _size, size_t _align, const char* _file, size_t _line);
+
+        AllocatorI* m_parent;
+        uint8_t     m_tag;
+    };
+
     bool             allocInit();
     bool             allocContains(void* _ptr);
     size_t           allocSizeOf(void* _ptr);
@@ -36,9 +134,88 @@ namespace DM_NAMESPACE
     StackAllocatorI* allocCreateStack(size_t _size);
     StackAllocatorI* allocSplitStack(size_t _awayfromStackPtr, size_t _preferedSize);
     void             allocFreeStack(StackAllocatorI* _stackAlloc);
+    void             allocFlushRemoteFrees();
+    void             allocPrefault(size_t _heapBytes, uint32_t _numThreads, bool _populate = true); // Call right after allocInit(). '_populate' false touches every page instead of MADV_POPULATE_WRITE.
+
+    /// Independent allocator with its own arena, segregated lists and heap, '_size' bytes big plus segregated lists.
+    /// Lists are scaled down to take at most a quarter of '_size'. Once the arena is full, chunks are added as for the main allocator.
+    /// Releasing it drops all of its allocations at once, freeing the arena and its chunks. There is no external fallback.
+    AllocatorI*      allocCreateInstance(size_t _size);
+    void             allocReleaseInstance(AllocatorI* _instance);
+
+    /// Allocator backed by a file mapped at a fixed address (posix only). All of its state, heap metadata included,
+    /// lives inside the mapping, so a restarted process of the same build can map it again and find its allocations intact.
+    /// '_size' is used only when the file is created. '_restored' is set to true when existing contents were picked up.
+    /// Returns NULL if the file cannot be mapped at '_address' or was created by an incompatible build.
+    AllocatorI*      allocOpenPersistent(const char* _path, void* _address, size_t _size, bool* _restored = NULL);
+    void             allocClosePersistent(AllocatorI* _persistent); // Flushes and unmaps.
+    void*            allocPersistentRoot(AllocatorI* _persistent);  // Entry point to the data, kept across restarts.
+    void             allocSetPersistentRoot(AllocatorI* _persistent, void* _root);
     void             allocPrintStats();
+    void             allocGetStats(AllocStats& _stats); // Sum of all per-thread counters.
+    void             allocSetTagBudget(uint8_t _tag, uint64_t _soft, uint64_t _hard, AllocBudgetFn _fn = NULL, void* _userData = NULL); // Zero means no budget.
+    uint64_t         allocTagBytes(uint8_t _tag);  // Currently held by the tag.
+    void             allocProfilerStart(uint64_t _sampleBytes); // Average distance between samples in bytes, zero stops sampling.
+    bool             allocProfilerDump(const char* _path);      // Live bytes per call site, biggest first.
+    bool             allocDumpSnapshot(const char* _path);      // Used and free extents of every region, see AllocSnapshotHeader.
     bool             allocDestroyed();
 
+    /// Segregated list that fits 'SizeT' bytes, resolved at compile time. Equals to the number of lists if none fits.
+    /// Usage: AllocSizeClass<sizeof(Foo)>::Index
+    template <size_t SizeT>
+    struct AllocSizeClass
+    {
+        enum
+        {
+            Index = 0
+            #define DM_SMALL_ALLOC_DEF(_idx, _size, _num) \
+                + (SizeT > size_t(_size))
+            #include "allocator_config.h"
+            , // Index.
+        };
+    };
+
+    /// Skips the size class lookup and the virtual call, the list is known at compile time down to the list alloc.
+    /// Falls back to the regular path if the list is full. Instantiated for every AllocSizeClass<>::Index.
+    template <uint8_t SizeClassT>
+    void*            allocSizeClass(size_t _size);
+    void             allocFree(void* _ptr);
+    void*            allocRealloc(void* _ptr, size_t _size); // Same as mainAlloc, without the virtual call.
+
+    /// Binds containers to the main allocator at compile time, see AllocatorIPolicy.
+    /// Usage: dm::Array<Foo, dm::MainAllocPolicy> array; array.init(64);
+    struct MainAllocPolicy
+    {
+        DM_INLINE void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* /*_file*/, size_t /*_line*/)
+        {
+            return allocRealloc(_ptr, _size);
+        }
+
+        DM_INLINE void bind(AllocatorI* /*_allocator*/)
+        {
+        }
+    };
+
+    /// Usage:
+    ///     Foo* foo = dm::allocT<Foo>();
+    ///     dm::freeT(foo);
+    template <typename Ty>
+    DM_INLINE Ty* allocT()
+    {
+        void* mem = allocSizeClass<AllocSizeClass<sizeof(Ty)>::Index>(sizeof(Ty));
+        return (NULL != mem) ? ::new (mem) Ty() : NULL;
+    }
+
+    template <typename Ty>
+    DM_INLINE void freeT(Ty* _obj)
+    {
+        if (NULL != _obj)
+        {
+            _obj->~Ty();
+            allocFree(_obj);
+        }
+    }
+
 } // namespace DM_NAMESPACE
 #   endif // DM_ALLOCATOR_H_HEADER_GUARD
 #endif // (DM_INCL & DM_INCL_HEADER_BODY)
@@ -56,6 +233,17 @@ namespace DM_NAMESPACE
     #   include <smmintrin.h>               // _mm_cmpeq_epi64()
     #endif // defined(__SSE4_1__)
 
+    #if DM_PLATFORM_LINUX
+    #   include <execinfo.h>                 // backtrace()
+    #endif // DM_PLATFORM_LINUX
+
+    #if DM_PLATFORM_POSIX
+    #   include <sys/mman.h>                 // mmap(), mremap(), munmap()
+    #   include <sys/stat.h>                 // fstat()
+    #   include <fcntl.h>                    // open()
+    #   include <unistd.h>                   // sysconf(), ftruncate()
+    #endif // DM_PLATFORM_POSIX
+
     #include <dm/misc.h>                    // DM_MEGABYTES
     #include <dm/compiletime.h>             // dm::Log<>::value
     #include <dm/datastructures/array.h>    // dm::Array
@@ -70,17 +258,195 @@ namespace DM_NAMESPACE
     #endif
 
     #if DM_ALLOCATOR
+        ///
+        /// Counters are per-thread and updated without atomics or locks.
+        /// Each thread takes a free slot on its first update and gives it back on exit, reading sums up all slots.
+        /// Threads above DM_ALLOC_COUNTERS_MAX_THREADS share the last slot and update it atomically.
+        ///
+        #if DM_ALLOC_COUNTERS
+            static AllocStats s_threadCounters[DM_ALLOC_COUNTERS_MAX_THREADS+1];
+            static uint32_t   s_threadCountersTaken[DM_ALLOC_COUNTERS_MAX_THREADS];
+            static DM_THREAD_LOCAL AllocStats* s_counters = NULL;
+
+            static AllocStats* const s_sharedCounters = &s_threadCounters[DM_ALLOC_COUNTERS_MAX_THREADS];
+
+            #if DM_PLATFORM_POSIX
+                static pthread_key_t  s_countersKey;
+                static pthread_once_t s_countersKeyOnce = PTHREAD_ONCE_INIT;
+
+                /// Thread exit, counts stay in the slot for the next thread to add to.
+                static void releaseThreadCounters(void* _counters)
+                {
+                    // Anything the thread frees after this point, in other destructors, goes to the shared slot.
+                    s_counters = s_sharedCounters;
+
+                    const uint32_t idx = uint32_t((AllocStats*)_counters - s_threadCounters);
+                    dm::atomicStoreRelease(&s_threadCountersTaken[idx], 0);
+                }
+
+                static void createCountersKey()
+                {
+                    pthread_key_create(&s_countersKey, releaseThreadCounters);
+                }
+            #endif // DM_PLATFORM_POSIX
+
+            static AllocStats* takeThreadCounters()
+            {
+                for (uint32_t ii = 0; ii < DM_ALLOC_COUNTERS_MAX_THREADS; ++ii)
+                {
+                    if (0 == dm::atomicLoadAcquire(&s_threadCountersTaken[ii])
+                    &&  0 == dm::atomicCompareAndSwap(&s_threadCountersTaken[ii], 0, 1))
+                    {
+                        #if DM_PLATFORM_POSIX
+                            pthread_once(&s_countersKeyOnce, createCountersKey);
+                            pthread_setspecific(s_countersKey, &s_threadCounters[ii]);
+                        #endif // DM_PLATFORM_POSIX
+
+                        return &s_threadCounters[ii];
+                    }
+                }
+
+                return s_sharedCounters;
+            }
+
+            static DM_INLINE AllocStats* threadCounters()
+            {
+                if (DM_UNLIKELY(NULL == s_counters))
+                {
+                    s_counters = takeThreadCounters();
+                }
+
+                return s_counters;
+            }
+
+            static DM_INLINE void counterAdd(AllocStats* _counters, uint64_t& _counter, uint64_t _add)
+            {
+                if (DM_UNLIKELY(s_sharedCounters == _counters))
+                {
+                    dm::atomicFetchAndAdd((volatile uint64_t*)&_counter, _add);
+                }
+                else
+                {
+                    _counter += _add;
+                }
+            }
+
+            #define DM_ALLOC_COUNT_ALLOC(_path, _size) do { AllocStats* counters = threadCounters(); counterAdd(counters, counters->m_allocCount[AllocStats::_path], 1); counterAdd(counters, counters->m_allocBytes[AllocStats::_path], _size); } while (0)
+            #define DM_ALLOC_COUNT_FREE(_path, _size)  do { AllocStats* counters = threadCounters(); counterAdd(counters, counters->m_freeCount[AllocStats::_path], 1); counterAdd(counters, counters->m_freeBytes[AllocStats::_path], _size); } while (0)
+            #define DM_ALLOC_COUNT_RESIZE(_path, _prev, _curr) do { AllocStats* counters = threadCounters(); if ((_curr) > (_prev)) { counterAdd(counters, counters->m_allocBytes[AllocStats::_path], uint64_t(_curr) - uint64_t(_prev)); } else { counterAdd(counters, counters->m_freeBytes[AllocStats::_path], uint64_t(_prev) - uint64_t(_curr)); } } while (0)
+            #define DM_ALLOC_COUNT_OVERFLOW()          do { AllocStats* counters = threadCounters(); counterAdd(counters, counters->m_overflowCount, 1); } while (0)
+            #define DM_ALLOC_COUNT_REMOTE_FREE()       do { AllocStats* counters = threadCounters(); counterAdd(counters, counters->m_remoteFreeCount, 1); } while (0)
+            #define DM_ALLOC_COUNT_REALLOC_COPY(_size) do { AllocStats* counters = threadCounters(); counterAdd(counters, counters->m_reallocCopyCount, 1); counterAdd(counters, counters->m_reallocCopyBytes, _size); } while (0)
+            #define DM_ALLOC_COUNT_EXTERNAL(_prev, _curr) do { AllocStats* counters = threadCounters(); counterAdd(counters, counters->m_externalBytes, uint64_t(_curr) - uint64_t(_prev)); } while (0)
+            #define DM_ALLOC_COUNT_TAG_ALLOC(_tag, _size) do { AllocStats* counters = threadCounters(); counterAdd(counters, counters->m_tagAllocCount[_tag], 1); counterAdd(counters, counters->m_tagBytes[_tag], _size); } while (0)
+            #define DM_ALLOC_COUNT_TAG_FREE(_tag, _size)  do { AllocStats* counters = threadCounters(); counterAdd(counters, counters->m_tagFreeCount[_tag], 1); counterAdd(counters, counters->m_tagBytes[_tag], uint64_t(0) - uint64_t(_size)); } while (0)
+            #define DM_ALLOC_COUNT_TAG_RESIZE(_tag, _prev, _curr) do { AllocStats* counters = threadCounters(); counterAdd(counters, counters->m_tagBytes[_tag], uint64_t(_curr) - uint64_t(_prev)); } while (0)
+        #else
+            #define DM_ALLOC_COUNT_ALLOC(_path, _size)
+            #define DM_ALLOC_COUNT_FREE(_path, _size)
+            #define DM_ALLOC_COUNT_RESIZE(_path, _prev, _curr)
+            #define DM_ALLOC_COUNT_OVERFLOW()
+            #define DM_ALLOC_COUNT_REMOTE_FREE()
+            #define DM_ALLOC_COUNT_REALLOC_COPY(_size)
+            #define DM_ALLOC_COUNT_EXTERNAL(_prev, _curr)
+            #define DM_ALLOC_COUNT_TAG_ALLOC(_tag, _size)
+            #define DM_ALLOC_COUNT_TAG_FREE(_tag, _size)
+            #define DM_ALLOC_COUNT_TAG_RESIZE(_tag, _prev, _curr)
+        #endif //DM_ALLOC_COUNTERS
+
+        static void gatherStats(AllocStats& _stats)
+        {
+            memset(&_stats, 0, sizeof(AllocStats));
+
+            #if DM_ALLOC_COUNTERS
+                for (uint32_t ii = 0; ii < DM_ALLOC_COUNTERS_MAX_THREADS+1; ++ii)
+                {
+                    const uint64_t* src = (const uint64_t*)&s_threadCounters[ii];
+                    uint64_t*       dst = (uint64_t*)&_stats;
+                    for (uint32_t jj = 0; jj < sizeof(AllocStats)/sizeof(uint64_t); ++jj)
+                    {
+                        dst[jj] += src[jj];
+                    }
+                }
+            #endif //DM_ALLOC_COUNTERS
+        }
+
+        /// Extents are gathered while regions are locked and written out once they are not.
+        /// Storage comes from the c-runtime, the arena is locked while it grows.
+        struct SnapshotExtents
+        {
+            SnapshotExtents()
+            {
+                m_extents = NULL;
+                m_count   = 0;
+                m_max     = 0;
+                m_failed  = false;
+            }
+
+            ~SnapshotExtents()
+            {
+                ::free(m_extents);
+            }
+
+            void add(uint64_t _offset, uint64_t _size, uint8_t _kind, bool _used, uint16_t _chunk = 0, uint32_t _class = 0)
+            {
+                if (0 == _size)
+                {
+                    return;
+                }
+
+                if (m_count == m_max)
+                {
+                    const uint32_t max = DM_MAX(m_max*2, uint32_t(1024));
+                    AllocSnapshotExtent* extents = (AllocSnapshotExtent*)::realloc(m_extents, max*sizeof(AllocSnapshotExtent));
+                    if (NULL == extents)
+                    {
+                        m_failed = true;
+                        return;
+                    }
+
+                    m_extents = extents;
+                    m_max     = max;
+                }
+
+                AllocSnapshotExtent& extent = m_extents[m_count++];
+                extent.m_offset = _offset;
+                extent.m_size   = _size;
+                extent.m_kind   = _kind;
+                extent.m_used   = uint8_t(_used);
+                extent.m_chunk  = _chunk;
+                extent.m_class  = _class;
+            }
+
+            AllocSnapshotExtent* m_extents;
+            uint32_t m_count;
+            uint32_t m_max;
+            bool     m_failed;
+        };
+
+        #if DM_ALLOC_THREAD_CACHES
+            // Calling thread's cache in the main arena, zero until it takes one. See SegregatedLists::ThreadCache.
+            static DM_THREAD_LOCAL uint32_t s_threadCacheIdx = 0;
+
+            #if DM_PLATFORM_POSIX
+                static pthread_key_t  s_threadCacheKey;
+                static pthread_once_t s_threadCacheKeyOnce = PTHREAD_ONCE_INIT;
+            #endif // DM_PLATFORM_POSIX
+        #endif // DM_ALLOC_THREAD_CACHES
+
         struct Memory
         {
             Memory()
             {
-                #if DM_ALLOC_PRINT_STATS
-                m_externalAlloc = 0;
-                m_externalFree  = 0;
-                m_externalSize  = 0;
-                #endif //DM_ALLOC_PRINT_STATS
+                m_remoteFrees = NULL;
+                m_chunkCount   = 0;
+                m_isInstance   = false;
+                m_isPersistent = false;
             }
 
+            struct Heap;
+            struct ArenaChunk;
+
             ///
             ///  Memory:
             ///
@@ -94,6 +460,8 @@ namespace DM_NAMESPACE
             ///  Stack - Stack grows forward.
             ///  Heap  - Heap grows backward.
             ///
+            ///  Once the heap is full, further chunks with a heap of their own are added on demand, see ArenaChunk.
+            ///
 
             #ifndef DM_MEM_SIZE_FUNC
                 #define DM_MEM_SIZE_FUNC memSize
@@ -113,15 +481,40 @@ namespace DM_NAMESPACE
                 const size_t customSize = DM_MEM_SIZE_FUNC();
                 const size_t size = DM_MAX(DM_MEM_MIN_SIZE, customSize);
 
+                initArena(size, DM_MEM_STATIC_STORAGE_SIZE, 0);
+                m_external.init();
+
+                #if DM_ALLOC_THREAD_CACHES
+                    m_segregatedLists.enableThreadCaches();
+                #endif // DM_ALLOC_THREAD_CACHES
+
+                return false; // return value is not important.
+            }
+
+            bool initArena(size_t _size, size_t _staticStorageSize, uint8_t _listsShift)
+            {
                 // Alloc.
-                m_orig = ::calloc(1, size);
+                m_orig = ::calloc(1, _size);
+                if (NULL == m_orig)
+                {
+                    return false;
+                }
+
+                DM_PRINT_MEM_STATS("Init: Allocating %u.%uMB - (0x%p)", dm::U_UMB(_size), m_orig);
 
-                DM_PRINT_MEM_STATS("Init: Allocating %u.%uMB - (0x%p)", dm::U_UMB(size), m_orig);
+                initRegions(m_orig, _size, _staticStorageSize, _listsShift);
+
+                return true;
+            }
 
+            /// Sets up all memory regions inside '_mem'. Memory is expected to be zeroed.
+            /// Segregated lists take SegregatedLists::regionSize('_listsShift') of it.
+            void initRegions(void* _mem, size_t _size, size_t _staticStorageSize, uint8_t _listsShift)
+            {
                 // Align.
                 void*  alignedPtr;
                 size_t alignedSize;
-                dm::alignPtrAndSize(alignedPtr, alignedSize, m_orig, size, DM_NATURAL_ALIGNMENT);
+                dm::alignPtrAndSize(alignedPtr, alignedSize, _mem, _size, DM_NATURAL_ALIGNMENT);
 
                 // Assign.
                 m_memory = alignedPtr;
@@ -129,8 +522,8 @@ namespace DM_NAMESPACE
 
                 // Init memory regions.
                 void* ptr = m_memory;
-                ptr = m_staticStorage.init(ptr, DM_MEM_STATIC_STORAGE_SIZE);
-                ptr = m_segregatedLists.init(ptr, SegregatedLists::DataSize);
+                ptr = m_staticStorage.init(ptr, _staticStorageSize);
+                ptr = m_segregatedLists.init(ptr, SegregatedLists::regionSize(_listsShift), _listsShift);
 
                 void* end = (void*)((uint8_t*)m_memory + m_size);
                 m_stackPtr = (uint8_t*)dm::alignPtrNext(ptr, DM_NATURAL_ALIGNMENT);
@@ -139,7 +532,39 @@ namespace DM_NAMESPACE
                 m_stack.init(&m_stackPtr, &m_heapEnd);
                 m_heap.init(&m_stackPtr, &m_heapEnd);
 
-                return false; // return value is not important.
+                m_stackOverflowAlloc.m_memory = this;
+                m_stack.setOverflowAllocator(&m_stackOverflowAlloc);
+            }
+
+            /// Rebuilds process-local state of a Memory mapped again by a new process, see allocOpenPersistent().
+            /// Everything else (regions, free slots, segregated bitmaps) is kept as is.
+            void restore()
+            {
+                ::new (&m_heap.m_mutex) dm::LwMutex();
+                m_segregatedLists.restore();
+                ::new (&m_chunkMutex) dm::LwMutex();
+
+                ::new (&m_stackOverflowAlloc) StackOverflowAllocator();
+                m_stackOverflowAlloc.m_memory = this;
+
+                // Mapping is at the same address, frees left pending by the previous process still point into it.
+                flushRemoteFrees();
+            }
+
+            /// Drops the arena and all chunks, regardless of allocations still alive.
+            /// Does not depend on the number of allocations, only on the number of chunks (at most DM_MEM_MAX_CHUNKS).
+            void release()
+            {
+                for (uint32_t ii = 0, end = m_chunkCount; ii < end; ++ii)
+                {
+                    m_chunks[ii]->~ArenaChunk();
+                    ::free(m_chunks[ii]);
+                }
+                m_chunkCount = 0;
+                m_remoteFrees = NULL;
+
+                ::free(m_orig);
+                m_orig = NULL;
             }
 
             void printStats()
@@ -149,10 +574,89 @@ namespace DM_NAMESPACE
                 m_stack.printStats();
                 m_segregatedLists.printStats();
                 m_heap.printStats();
-                printf("External: alloc/free %u.%u, total %u.%uMB\n\n", m_externalAlloc, m_externalFree, dm::U_UMB(m_externalSize));
+                printf("Chunks: %u/%u\n\n", m_chunkCount, DM_MEM_MAX_CHUNKS);
+
+                AllocStats stats;
+                gatherStats(stats);
+                printf("External: alloc/free %llu/%llu, total %u.%uMB, held %u.%uMB\n\n"
+                      , (unsigned long long)stats.m_allocCount[AllocStats::External]
+                      , (unsigned long long)stats.m_freeCount[AllocStats::External]
+                      , dm::U_UMB(stats.m_allocBytes[AllocStats::External])
+                      , dm::U_UMB(stats.m_externalBytes)
+                      );
+                printf("Overflow fallbacks: %llu, Realloc copies: %llu (%u.%uMB)\n\n"
+                      , (unsigned long long)stats.m_overflowCount
+                      , (unsigned long long)stats.m_reallocCopyCount
+                      , dm::U_UMB(stats.m_reallocCopyBytes)
+                      );
                 #endif //DM_ALLOC_PRINT_STATS
             }
 
+            /// Each region is locked only while its extents are gathered, the snapshot is not atomic across regions.
+            /// The file is written after all locks are released.
+            bool dumpSnapshot(const char* _path)
+            {
+                SnapshotExtents extents;
+                const uint8_t* base = (const uint8_t*)m_memory;
+
+                // Static storage.
+                const uint8_t* staticPtr = m_staticStorage.m_ptr;
+                extents.add(0, uint64_t(staticPtr - base), AllocSnapshotExtent::Static, true);
+                extents.add(uint64_t(staticPtr - base), m_staticStorage.available(), AllocSnapshotExtent::Static, false);
+
+                // Segregated lists.
+                m_segregatedLists.snapshot(extents, base);
+
+                // Stack and the space left between stack and heap.
+                {
+                    dm::LwMutexScope lock(m_heap.m_mutex);
+
+                    const uint8_t* stackBegin = (const uint8_t*)m_stack.begin();
+                    extents.add(uint64_t(stackBegin - base), uint64_t(m_stackPtr - stackBegin), AllocSnapshotExtent::Stack, true);
+                    extents.add(uint64_t(m_stackPtr - base), uint64_t(*m_heap.m_end - m_stackPtr), AllocSnapshotExtent::Unused, false);
+
+                    m_heap.snapshot(extents, base, 0);
+                }
+
+                // Chunks.
+                for (uint32_t ii = 0, end = dm::atomicLoadAcquire(&m_chunkCount); ii < end; ++ii)
+                {
+                    ArenaChunk* chunk = m_chunks[ii];
+                    dm::LwMutexScope lock(chunk->m_heap.m_mutex);
+
+                    const uint8_t* chunkBase = chunk->m_begin;
+                    extents.add(0, uint64_t(*chunk->m_heap.m_end - chunkBase), AllocSnapshotExtent::Unused, false, uint16_t(ii+1));
+
+                    chunk->m_heap.snapshot(extents, chunkBase, uint16_t(ii+1));
+                }
+
+                if (extents.m_failed)
+                {
+                    return false;
+                }
+
+                FILE* file = fopen(_path, "wb");
+                if (NULL == file)
+                {
+                    return false;
+                }
+
+                AllocSnapshotHeader header;
+                memcpy(header.m_magic, "DMSS", 4);
+                header.m_version        = AllocSnapshotHeader::Version;
+                header.m_arenaSize      = m_size;
+                header.m_smallestRegion = Heap::SmallestRegion;
+                header.m_numRegions     = Heap::NumRegions;
+                header.m_numExtents     = extents.m_count;
+                fwrite(&header, sizeof(header), 1, file);
+                fwrite(extents.m_extents, sizeof(AllocSnapshotExtent), extents.m_count, file);
+
+                const bool ok = (0 == ferror(file));
+                fclose(file);
+
+                return ok;
+            }
+
             void destroy()
             {
                 // Do not call free, let it stay until the very end of execution. OS will clean it up.
@@ -178,12 +682,14 @@ namespace DM_NAMESPACE
 
             void* externalAlloc(size_t _size)
             {
-                void* ptr = ::malloc(_size);
+                void* ptr = m_external.alloc(_size);
+                if (NULL == ptr)
+                {
+                    return NULL;
+                }
 
-                #if DM_ALLOC_PRINT_STATS
-                m_externalAlloc++;
-                m_externalSize += _size;
-                #endif //DM_ALLOC_PRINT_STATS
+                DM_ALLOC_COUNT_ALLOC(External, _size);
+                DM_ALLOC_COUNT_EXTERNAL(0, ExternalMemory::getFootprint(ExternalMemory::getHeader(ptr)));
 
                 DM_PRINT_EXT("EXTERNAL ALLOC: %u.%uMB - (0x%p)", dm::U_UMB(_size), ptr);
 
@@ -197,36 +703,85 @@ namespace DM_NAMESPACE
                     return NULL;
                 }
 
+                if (NULL != dm::atomicLoadAcquirePtr(&m_remoteFrees))
+                {
+                    flushRemoteFrees();
+                }
+
                 void* ptr;
 
                 // Try small alloc.
                 if (_size <= SegregatedLists::BiggestSize)
                 {
-                    ptr = m_segregatedLists.alloc(_size);
+                    const uint8_t sizeClass = m_segregatedLists.sizeClass(_size);
+                    ptr = m_segregatedLists.allocIdx(sizeClass, _size);
                     if (NULL != ptr)
                     {
+                        DM_ALLOC_COUNT_ALLOC(Segregated, m_segregatedLists.classSize(sizeClass));
                         return ptr;
                     }
+
+                    DM_ALLOC_COUNT_OVERFLOW();
                 }
 
                 // Try heap alloc.
                 ptr = m_heap.alloc(_size);
                 if (NULL != ptr)
                 {
+                    DM_ALLOC_COUNT_ALLOC(Heap, Heap::blockSize(ptr));
+                    return ptr;
+                }
+
+                // Try chunk alloc.
+                ptr = chunkAlloc(_size);
+                if (NULL != ptr)
+                {
+                    DM_ALLOC_COUNT_ALLOC(Heap, Heap::blockSize(ptr));
                     return ptr;
                 }
 
+                DM_ALLOC_COUNT_OVERFLOW();
+
+                // Instances are released in bulk, they cannot own external memory.
+                if (m_isInstance)
+                {
+                    return NULL;
+                }
+
                 // External alloc.
                 ptr = externalAlloc(_size);
 
                 return ptr;
             }
 
+            /// Size class resolved at compile time, see allocT().
+            template <uint8_t SizeClassT>
+            void* allocSizeClass(size_t _size)
+            {
+                if (SizeClassT < SegregatedLists::Count)
+                {
+                    if (NULL != dm::atomicLoadAcquirePtr(&m_remoteFrees))
+                    {
+                        flushRemoteFrees();
+                    }
+
+                    void* ptr = m_segregatedLists.template allocIdx<SizeClassT>(_size);
+                    if (NULL != ptr)
+                    {
+                        DM_ALLOC_COUNT_ALLOC(Segregated, m_segregatedLists.classSize(SizeClassT));
+                        return ptr;
+                    }
+                }
+
+                return this->alloc(_size);
+            }
+
             void* stackAlloc(size_t _size)
             {
                 void* ptr = m_stack.alloc(_size);
                 if (NULL != ptr)
                 {
+                    DM_ALLOC_COUNT_ALLOC(Stack, _size);
                     return ptr;
                 }
 
@@ -235,12 +790,15 @@ namespace DM_NAMESPACE
 
             void* staticAlloc(size_t _size)
             {
+                DM_ALLOC_COUNT_ALLOC(Static, _size);
+
                 return m_staticStorage.alloc(_size);
             }
 
             bool contains(void* _ptr)
             {
-                return (m_memory <= _ptr && _ptr <= ((uint8_t*)m_memory + m_size));
+                return (m_memory <= _ptr && _ptr <= ((uint8_t*)m_memory + m_size))
+                    || (NULL != findChunk(_ptr));
             }
 
             // Realloc.
@@ -254,12 +812,15 @@ namespace DM_NAMESPACE
                 }
 
                 // Handle heap allocation.
-                const bool fromHeap = m_heap.contains(_ptr);
+                Heap* heap = findHeap(_ptr);
+                const bool fromHeap = (NULL != heap);
                 if (fromHeap)
                 {
-                    void* ptr = m_heap.realloc(_ptr, _size);
+                    const size_t prevSize = heap->getSize(_ptr);
+                    void* ptr = heap->realloc(_ptr, _size);
                     if (NULL != ptr)
                     {
+                        DM_ALLOC_COUNT_RESIZE(Heap, prevSize, heap->getSize(ptr));
                         return ptr;
                     }
                 }
@@ -267,8 +828,18 @@ namespace DM_NAMESPACE
                 // Handle external pointer.
                 if (!this->contains(_ptr))
                 {
-                    void* ptr = ::realloc(_ptr, _size);
+                    ExternalMemory::Header* header = m_external.find(_ptr);
+                    const size_t prevSize      = (NULL != header) ? size_t(header->m_size) : 0;
+                    const size_t prevFootprint = (NULL != header) ? ExternalMemory::getFootprint(header) : 0;
+
+                    void* ptr = m_external.realloc(_ptr, _size, header);
                     DM_PRINT_EXT("EXTERNAL REALLOC: %u.%uMB - (0x%p - 0x%p)", dm::U_UMB(_size), _ptr, ptr);
+                    if (NULL != ptr && NULL != header)
+                    {
+                        DM_ALLOC_COUNT_RESIZE(External, prevSize, _size);
+                        DM_ALLOC_COUNT_EXTERNAL(prevFootprint, ExternalMemory::getFootprint(ExternalMemory::getHeader(ptr)));
+                    }
+
                     return ptr;
                 }
 
@@ -276,18 +847,14 @@ namespace DM_NAMESPACE
                 void* newPtr = this->alloc(_size);
                 if (NULL == newPtr)
                 {
-                    newPtr = externalAlloc(_size);
-                    if (NULL == newPtr)
-                    {
-                        return NULL;
-                    }
+                    return NULL;
                 }
 
                 // Get size of current allocation.
                 size_t currSize = 0;
                 if (fromHeap)
                 {
-                    currSize = m_heap.getSize(_ptr);
+                    currSize = heap->getSize(_ptr);
                 }
                 else if (m_segregatedLists.contains(_ptr))
                 {
@@ -304,6 +871,8 @@ namespace DM_NAMESPACE
                 const size_t minSize = dm::min(currSize, _size);
                 memcpy(newPtr, _ptr, minSize);
 
+                DM_ALLOC_COUNT_REALLOC_COPY(minSize);
+
                 // Free original pointer.
                 this->free(_ptr);
 
@@ -335,72 +904,401 @@ namespace DM_NAMESPACE
             {
                 if (this->contains(_ptr))
                 {
-                    if (m_segregatedLists.contains(_ptr))
+                    const bool fromLists = m_segregatedLists.contains(_ptr);
+                    Heap*      heap      = fromLists ? NULL : findHeap(_ptr);
+                    const bool fromHeap  = (NULL != heap);
+
+                    // Free right away unless another thread holds the lock, in that case leave it to the next allocation.
+                    if (fromLists)
                     {
-                        m_segregatedLists.free(_ptr);
+                        uint32_t size;
+                        if (m_segregatedLists.tryFree(_ptr, size))
+                        {
+                            DM_ALLOC_COUNT_FREE(Segregated, size);
+                        }
+                        else
+                        {
+                            pushRemoteFree(_ptr);
+                        }
                     }
-                    else if (m_heap.contains(_ptr))
+                    else if (fromHeap)
                     {
-                        m_heap.free(_ptr);
+                        const size_t size = Heap::blockSize(_ptr);
+                        if (heap->tryFree(_ptr))
+                        {
+                            DM_ALLOC_COUNT_FREE(Heap, size);
+                        }
+                        else
+                        {
+                            pushRemoteFree(_ptr);
+                        }
                     }
                 }
                 else // external pointer
                 {
                     DM_PRINT_EXT("~EXTERNAL FREE: (0x%p)", _ptr);
 
-                    #if DM_ALLOC_PRINT_STATS
-                    m_externalFree++;
-                    #endif //DM_ALLOC_PRINT_STATS
+                    ExternalMemory::Header* header = m_external.detach(_ptr);
+                    if (NULL != header)
+                    {
+                        DM_ALLOC_COUNT_FREE(External, size_t(header->m_size));
+                        DM_ALLOC_COUNT_EXTERNAL(ExternalMemory::getFootprint(header), 0);
+                    }
 
-                    ::free(_ptr);
+                    m_external.free(_ptr, header);
                 }
             }
 
-            // Stack.
+            // Remote free.
             //-----
 
-            bool fromStackRegion(void* _ptr)
-            {
-                return (m_stack.begin() <= _ptr && _ptr < m_heapEnd);
-            }
+            ///
+            /// Lock-free list of pointers whose free found the segregated lists or heap locked by another thread.
+            /// Small blocks of the main arena mostly go back to the owning thread cache instead, see SegregatedLists::ThreadCache.
+            /// This list takes heap blocks, blocks of instances and of threads without a cache.
+            /// Link to the next element is written into the freed block itself.
+            /// Any allocating thread takes the whole list at once and frees it under the locks, so there is no ABA problem.
+            ///
 
-            void stackPush()
+            void pushRemoteFree(void* _ptr)
             {
-                m_stack.push();
-            }
+                void** next = (void**)_ptr;
+                void*  head = dm::atomicLoadAcquirePtr(&m_remoteFrees);
+                for (;;)
+                {
+                    *next = head;
 
-            void stackPop()
-            {
-                m_stack.pop();
+                    void* prev = dm::atomicCompareAndSwapPtr(&m_remoteFrees, head, _ptr);
+                    if (prev == head)
+                    {
+                        break;
+                    }
+                    head = prev;
+                }
+
+                DM_PRINT_EXT("Remote free: (0x%p)", _ptr);
             }
 
-            uint8_t* stackAdvance(size_t _size)
+            void flushRemoteFrees()
             {
-                m_stackPtr += _size;
-                return m_stackPtr;
+                #if DM_ALLOC_THREAD_CACHES
+                    m_segregatedLists.flushThreadCache();
+                #endif // DM_ALLOC_THREAD_CACHES
+
+                void* ptr = dm::atomicExchangePtr(&m_remoteFrees, NULL);
+                while (NULL != ptr)
+                {
+                    void* next = *(void**)ptr;
+
+                    if (m_segregatedLists.contains(ptr))
+                    {
+                        const uint32_t size = m_segregatedLists.free(ptr);
+                        DM_ALLOC_COUNT_FREE(Segregated, size);
+                        DM_UNUSED(size);
+                    }
+                    else
+                    {
+                        DM_ALLOC_COUNT_FREE(Heap, Heap::blockSize(ptr));
+                        findHeap(ptr)->free(ptr);
+                    }
+
+                    ptr = next;
+                }
             }
 
-            // Other.
+            // Chunks.
             //-----
 
-            size_t getSize(void* _ptr)
+            ///
+            /// Chunks sorted by address, one array per chunk count.
+            /// An array is written once before its count is published and never changes afterwards,
+            /// so lookups can binary search it without taking the lock.
+            ///
+            ArenaChunk** chunkIndex(uint32_t _count)
             {
-                if (m_segregatedLists.contains(_ptr))
-                {
-                    return m_segregatedLists.getSize(_ptr);
-                }
-                else if (m_heap.contains(_ptr))
+                return &m_chunkIndex[_count*(_count-1)/2];
+            }
+
+            ArenaChunk* findChunk(void* _ptr)
+            {
+                // Pairs with the release store in chunkAlloc(), chunks below the count are fully initialized.
+                const uint32_t count = dm::atomicLoadAcquire(&m_chunkCount);
+                if (0 == count)
                 {
-                    return m_heap.getSize(_ptr);
+                    return NULL;
                 }
-                else if (m_stack.contains(_ptr))
+
+                // Last chunk that begins at or below '_ptr'.
+                ArenaChunk** sorted = chunkIndex(count);
+                uint32_t beg = 0;
+                uint32_t end = count;
+                while (end - beg > 1)
                 {
-                    return m_stack.getSize(_ptr);
+                    const uint32_t mid = (beg + end)/2;
+                    if (sorted[mid]->m_begin <= _ptr)
+                    {
+                        beg = mid;
+                    }
+                    else
+                    {
+                        end = mid;
+                    }
                 }
-                else // external pointer
+
+                return sorted[beg]->contains(_ptr) ? sorted[beg] : NULL;
+            }
+
+            Heap* findHeap(void* _ptr)
+            {
+                if (m_heap.contains(_ptr))
                 {
-                    return 0;
+                    return &m_heap;
+                }
+
+                ArenaChunk* chunk = findChunk(_ptr);
+                return (NULL != chunk) ? &chunk->m_heap : NULL;
+            }
+
+            void* chunkAlloc(size_t _size)
+            {
+                // Chunks are not part of the mapped file, persistent memory cannot grow.
+                if (m_isPersistent)
+                {
+                    return NULL;
+                }
+
+                // Newest chunks first, they are most likely to have space.
+                const uint32_t count = dm::atomicLoadAcquire(&m_chunkCount);
+                for (uint32_t ii = count; ii--; )
+                {
+                    void* ptr = m_chunks[ii]->m_heap.alloc(_size);
+                    if (NULL != ptr)
+                    {
+                        return ptr;
+                    }
+                }
+
+                dm::LwMutexScope lock(m_chunkMutex);
+
+                // Another thread might have added chunks in the meantime.
+                for (uint32_t ii = count, end = m_chunkCount; ii < end; ++ii)
+                {
+                    void* ptr = m_chunks[ii]->m_heap.alloc(_size);
+                    if (NULL != ptr)
+                    {
+                        return ptr;
+                    }
+                }
+
+                if (m_chunkCount >= DM_MEM_MAX_CHUNKS)
+                {
+                    return NULL;
+                }
+
+                const size_t chunkSize = DM_MAX(size_t(DM_MEM_CHUNK_SIZE), _size + DM_MEGABYTES(1));
+                ArenaChunk* chunk = ArenaChunk::create(chunkSize);
+                if (NULL == chunk)
+                {
+                    return NULL;
+                }
+
+                DM_PRINT_MEM_STATS("Chunk %d: Allocating %u.%uMB - (0x%p)", m_chunkCount, dm::U_UMB(chunkSize), chunk);
+
+                // Previous index with the new chunk inserted in address order.
+                const uint32_t curr = m_chunkCount;
+                ArenaChunk** sorted = chunkIndex(curr + 1);
+                uint32_t dst = 0;
+                if (0 != curr)
+                {
+                    ArenaChunk** prev = chunkIndex(curr);
+                    for (uint32_t ii = 0; ii < curr && prev[ii]->m_begin < chunk->m_begin; ++ii)
+                    {
+                        sorted[dst++] = prev[ii];
+                    }
+                    for (uint32_t ii = dst; ii < curr; ++ii)
+                    {
+                        sorted[ii+1] = prev[ii];
+                    }
+                }
+                sorted[dst] = chunk;
+
+                // Publish the chunk only once it is fully initialized, lookups do not take the lock.
+                m_chunks[curr] = chunk;
+                dm::atomicStoreRelease(&m_chunkCount, curr + 1);
+
+                return chunk->m_heap.alloc(_size);
+            }
+
+            // Prefault.
+            //-----
+
+            ///
+            /// Pays first-touch page faults upfront, split across '_numThreads' threads.
+            /// Covers static storage, segregated lists and the first '_heapBytes' of the heap.
+            /// Uses MADV_POPULATE_WRITE if '_populate' is set and the kernel supports it, otherwise writes to every page.
+            ///
+            void prefault(size_t _heapBytes, uint32_t _numThreads, bool _populate)
+            {
+                PrefaultJob job[MaxPrefaultThreads];
+                const uint32_t numThreads = DM_MAX(1u, DM_MIN(_numThreads, uint32_t(MaxPrefaultThreads)));
+
+                // Heap grows backward from the end of the arena.
+                uint8_t* heapBegin = (uint8_t*)m_heap.m_begin;
+                uint8_t* heapLimit = m_stackPtr;
+                const size_t heapBytes = DM_MIN(_heapBytes, size_t(heapBegin - heapLimit));
+
+                for (uint32_t ii = 0; ii < numThreads; ++ii)
+                {
+                    job[ii].m_begin[0] = (uint8_t*)m_memory; // Static storage and segregated lists.
+                    job[ii].m_end[0]   = (uint8_t*)m_stack.begin();
+                    job[ii].m_begin[1] = heapBegin - heapBytes;
+                    job[ii].m_end[1]   = heapBegin;
+                    job[ii].m_idx      = ii;
+                    job[ii].m_num      = numThreads;
+                    job[ii].m_populate = _populate;
+                }
+
+                #if DM_PLATFORM_POSIX
+                    pthread_t threads[MaxPrefaultThreads];
+                    uint32_t numStarted = 0;
+                    for (uint32_t ii = 1; ii < numThreads; ++ii)
+                    {
+                        if (0 != pthread_create(&threads[numStarted], NULL, prefaultFunc, &job[ii]))
+                        {
+                            prefaultFunc(&job[ii]);
+                            continue;
+                        }
+                        numStarted++;
+                    }
+
+                    prefaultFunc(&job[0]);
+
+                    for (uint32_t ii = 0; ii < numStarted; ++ii)
+                    {
+                        pthread_join(threads[ii], NULL);
+                    }
+                #else
+                    for (uint32_t ii = 0; ii < numThreads; ++ii)
+                    {
+                        prefaultFunc(&job[ii]);
+                    }
+                #endif // DM_PLATFORM_POSIX
+            }
+
+            enum { MaxPrefaultThreads = 64 };
+
+            struct PrefaultJob
+            {
+                uint8_t* m_begin[2];
+                uint8_t* m_end[2];
+                uint32_t m_idx;
+                uint32_t m_num;
+                bool     m_populate;
+            };
+
+            static size_t pageSize()
+            {
+                #if DM_PLATFORM_POSIX
+                    static const size_t s_pageSize = size_t(::sysconf(_SC_PAGESIZE));
+                    return s_pageSize;
+                #else
+                    return 4096;
+                #endif // DM_PLATFORM_POSIX
+            }
+
+            static void prefaultRange(uint8_t* _begin, uint8_t* _end, bool _populate)
+            {
+                #if DM_PLATFORM_LINUX && defined(MADV_POPULATE_WRITE)
+                    uint8_t* begin = (uint8_t*)dm::alignPtrPrev(_begin, pageSize());
+                    if (_populate && 0 == ::madvise(begin, size_t(_end - begin), MADV_POPULATE_WRITE))
+                    {
+                        return;
+                    }
+                #else
+                    DM_UNUSED(_populate);
+                #endif // DM_PLATFORM_LINUX && defined(MADV_POPULATE_WRITE)
+
+                // Atomic add of zero causes a write fault without racing with other writers. First page may be partial.
+                uint8_t* ptr = (uint8_t*)dm::alignPtrNext(_begin, sizeof(int32_t));
+                while (ptr + sizeof(int32_t) <= _end)
+                {
+                    dm::atomicFetchAndAdd((volatile int32_t*)ptr, 0);
+                    ptr = (uint8_t*)dm::alignPtrPrev(ptr, pageSize()) + pageSize();
+                }
+            }
+
+            static void* prefaultFunc(void* _job)
+            {
+                const PrefaultJob* job = (const PrefaultJob*)_job;
+                for (uint32_t ii = 0; ii < 2; ++ii)
+                {
+                    const size_t size = size_t(job->m_end[ii] - job->m_begin[ii]);
+                    const size_t part = dm::alignSizeNext(size/job->m_num + 1, pageSize());
+
+                    uint8_t* beg = job->m_begin[ii] + DM_MIN(part*job->m_idx, size);
+                    uint8_t* end = job->m_begin[ii] + DM_MIN(part*(job->m_idx+1), size);
+                    if (beg < end)
+                    {
+                        prefaultRange(beg, end, job->m_populate);
+                    }
+                }
+
+                return NULL;
+            }
+
+            // Stack.
+            //-----
+
+            bool fromStackRegion(void* _ptr)
+            {
+                return (m_stack.begin() <= _ptr && _ptr < m_heapEnd);
+            }
+
+            bool fromStack(void* _ptr)
+            {
+                return fromStackRegion(_ptr) || m_stack.contains(_ptr);
+            }
+
+            void stackPush()
+            {
+                m_stack.push();
+            }
+
+            void stackPop()
+            {
+                m_stack.pop();
+            }
+
+            uint8_t* stackAdvance(size_t _size)
+            {
+                m_stackPtr += _size;
+                return m_stackPtr;
+            }
+
+            // Other.
+            //-----
+
+            size_t getSize(void* _ptr)
+            {
+                if (m_segregatedLists.contains(_ptr))
+                {
+                    return m_segregatedLists.getSize(_ptr);
+                }
+                else if (m_stack.contains(_ptr)) // Before heap, stack overflow chunks live inside heap allocations.
+                {
+                    return m_stack.getSize(_ptr);
+                }
+                else if (Heap* heap = findHeap(_ptr))
+                {
+                    return heap->getSize(_ptr);
                 }
+                else if (!this->contains(_ptr)) // external pointer
+                {
+                    const ExternalMemory::Header* header = m_external.find(_ptr);
+                    return (NULL != header) ? size_t(header->m_size) : 0;
+                }
+
+                return 0;
             }
 
             size_t remainingStaticMemory() const
@@ -542,14 +1440,37 @@ namespace DM_NAMESPACE
                     #undef DM_SIZE_FOR
                         , // ListsSize.
 
+                    NumSpans = ListsSize/sizeof(uint64_t), // Spans are the 64 slots behind one bitmap word. Upper bound, also marks 'no span'.
+
                     #define DM_SMALL_ALLOC_CONFIG
                     #include "allocator_config.h"
                     Count       = DM_SMALL_ALLOC_COUNT,
                     BiggestSize = DM_SMALL_ALLOC_BIGGEST_SIZE,
                     Steps = dm::Log<2,BiggestSize>::value + 1,
 
+                    MaxCaches      = DM_ALLOC_THREAD_CACHE_MAX_THREADS+1, // Cache zero stands for shared spans.
+                    CacheMaxSize   = DM_ALLOC_THREAD_CACHE_MAX_SIZE,
+                    MinCachedSpans = 4,
                 };
 
+                #if DM_ALLOC_THREAD_CACHES
+                ///
+                /// Small blocks of the main arena go through per-thread caches.
+                /// A cache owns spans. Free slots of an owned span are marked used in the shared bitmap and kept in the span's mask
+                /// instead, so the owner allocates and frees them without the lock. Other threads free into the owner's lock-free
+                /// MPSC list, which the owner drains on its next allocation. Spans are claimed and given back under the lock,
+                /// a span that is all free is given back once its owner has another one, all of them when the owner exits.
+                /// Threads above DM_ALLOC_THREAD_CACHE_MAX_THREADS and lists of blocks above DM_ALLOC_THREAD_CACHE_MAX_SIZE use the shared bitmap only.
+                ///
+                struct ThreadCache
+                {
+                    void* volatile    m_remoteFrees; // Linked through the freed blocks, see pushCacheFree().
+                    volatile uint32_t m_taken;
+                    uint32_t          m_spans[Count]; // Owned spans with free slots, linked through m_spanNext/m_spanPrev.
+                    SegregatedLists*  m_lists;
+                };
+                #endif // DM_ALLOC_THREAD_CACHES
+
                 SegregatedLists()
                 {
                     #if DM_ALLOC_PRINT_STATS
@@ -560,19 +1481,56 @@ namespace DM_NAMESPACE
                     #endif //DM_ALLOC_PRINT_STATS
                 }
 
-                void* init(void* _mem, size_t _size)
+                ///
+                /// Memory taken by lists with the configured slot counts shifted right by '_shift'.
+                /// Slots come first, then the bitmaps and the span arrays, so the struct itself does not grow with the lists.
+                ///
+                static size_t regionSize(uint8_t _shift)
+                {
+                    size_t   size     = 0;
+                    uint32_t numSpans = 0;
+                    #define DM_SMALL_ALLOC_DEF(_idx, _size, _num) \
+                        size     += size_t(_size)*(uint32_t(_num)>>_shift); \
+                        numSpans += dm::BitArrayExt::numSlotsFor(uint32_t(_num)>>_shift);
+                    #include "allocator_config.h"
+
+                    size += numSpans*sizeof(uint64_t);
+                    #if DM_ALLOC_THREAD_CACHES
+                        size += numSpans*(sizeof(uint64_t) + 2*sizeof(uint32_t) + sizeof(uint8_t));
+                    #endif // DM_ALLOC_THREAD_CACHES
+
+                    return dm::alignSizeNext(size, DM_NATURAL_ALIGNMENT);
+                }
+
+                /// Smallest shift that keeps the lists within a quarter of '_size', see allocCreateInstance().
+                static uint8_t shiftFor(size_t _size)
+                {
+                    uint8_t shift = 0;
+                    while (shift < 31 && regionSize(shift) > _size/4)
+                    {
+                        ++shift;
+                    }
+
+                    return shift;
+                }
+
+                void* init(void* _mem, size_t _size, uint8_t _shift)
                 {
                     void*  alignedPtr;
                     size_t alignedSize;
                     dm::alignPtrAndSize(alignedPtr, alignedSize, _mem, _size, DM_NATURAL_ALIGNMENT);
 
-                    m_mem = alignedPtr;
-                    m_totalSize = alignedSize;
-                    CS_CHECK(m_totalSize == DataSize
+                    CS_CHECK(alignedSize == regionSize(_shift)
                            , "SegregatedLists::init | Not enough data allocated %u.%uMB / %u.%uMB"
-                           , dm::U_UMB(m_totalSize), dm::U_UMB(DataSize)
+                           , dm::U_UMB(alignedSize), dm::U_UMB(regionSize(_shift))
                            );
-                    DM_PRINT_MEM_STATS("Init: Using %u.%uMB for segregated lists", dm::U_UMB(DataSize));
+
+                    m_mem = alignedPtr;
+                    m_totalSize = 0;
+                    #define DM_SMALL_ALLOC_DEF(_idx, _size, _num) \
+                        m_totalSize += size_t(_size)*(uint32_t(_num)>>_shift);
+                    #include "allocator_config.h"
+                    DM_PRINT_MEM_STATS("Init: Using %u.%uMB for segregated lists", dm::U_UMB(alignedSize));
 
                     #define DM_SMALL_ALLOC_DEF(_idx, _size, _num) \
                         m_sizes[_idx] = Size ## _idx;
@@ -591,9 +1549,9 @@ namespace DM_NAMESPACE
                         m_powToIdx[ii] = idx;
                     }
 
-                    uint8_t* ptr = (uint8_t*)m_allocsData;
+                    uint8_t* ptr = (uint8_t*)m_mem + m_totalSize;
                     #define DM_SMALL_ALLOC_DEF(_idx, _size, _num) \
-                        ptr += m_allocs[_idx].init(Num ## _idx, ptr);
+                        ptr += m_allocs[_idx].init(uint32_t(Num ## _idx)>>_shift, ptr);
                     #include "allocator_config.h"
 
                     m_begin[0] = (uint8_t*)m_mem;
@@ -603,18 +1561,74 @@ namespace DM_NAMESPACE
                         m_begin[ii] = (uint8_t*)m_begin[prev] + m_sizes[prev]*m_allocs[prev].max();
                     }
 
+                    #if DM_ALLOC_THREAD_CACHES
+                        dm_staticAssert(DM_ALLOC_THREAD_CACHE_MAX_THREADS <= 255);
+
+                        m_threadCached = false;
+                        uint32_t numSpans = 0;
+                        for (uint32_t ii = 0; ii < Count; ++ii)
+                        {
+                            m_spanBase[ii]  = numSpans;
+                            m_claimLast[ii] = 0;
+                            m_cached[ii]    = (m_sizes[ii] <= CacheMaxSize && m_allocs[ii].numSlots() >= MinCachedSpans);
+                            numSpans += m_allocs[ii].numSlots();
+                        }
+
+                        m_spanFree  = (uint64_t*)ptr;
+                        m_spanNext  = (uint32_t*)(m_spanFree + numSpans);
+                        m_spanPrev  = m_spanNext + numSpans;
+                        m_spanOwner = (volatile uint8_t*)(m_spanPrev + numSpans);
+                    #endif // DM_ALLOC_THREAD_CACHES
+
                     return (uint8_t*)alignedPtr + alignedSize;
                 }
 
                 void* alloc(size_t _size)
+                {
+                    return allocIdx(sizeClass(_size), _size);
+                }
+
+                /// List index for '_size'.
+                uint8_t sizeClass(size_t _size) const
                 {
                     CS_CHECK(_size <= BiggestSize, "Requested size is bigger than the largest supported size!");
 
-                    // Get list index.
                     const uint32_t sizePow2 = dm::nextPowTwo(uint32_t(_size));
                     const uint32_t pow = cnttz_u32(sizePow2);
                     CS_CHECK(pow < Steps, "Error! Sizes are probably not well defined.");
-                    const uint8_t idx = m_powToIdx[pow];
+
+                    return m_powToIdx[pow];
+                }
+
+                /// Block size of list '_idx'.
+                uint32_t classSize(uint8_t _idx) const
+                {
+                    return m_sizes[_idx];
+                }
+
+                /// List index known at compile time, see Memory::allocSizeClass().
+                template <uint8_t IdxT>
+                void* allocIdx(size_t _size)
+                {
+                    return allocIdx(IdxT, _size);
+                }
+
+                DM_INLINE void* allocIdx(uint8_t _idx, size_t _size)
+                {
+                    DM_UNUSED(_size);
+                    CS_CHECK(_idx < Count && _size <= m_sizes[_idx], "SegregatedLists::allocIdx | Size %zuB does not fit list %u.", _size, _idx);
+                    const uint8_t idx = _idx;
+
+                    #if DM_ALLOC_THREAD_CACHES
+                    if (m_threadCached && m_cached[idx])
+                    {
+                        ThreadCache* cache = threadCache();
+                        if (NULL != cache)
+                        {
+                            return cacheAlloc(*cache, idx);
+                        }
+                    }
+                    #endif // DM_ALLOC_THREAD_CACHES
 
                     // Allocate if there is an empty slot.
                     m_mutex.lock();
@@ -656,29 +1670,43 @@ namespace DM_NAMESPACE
                     }
                 }
 
-                void free(void* _ptr)
+                /// Returns the block size.
+                uint32_t free(void* _ptr)
                 {
-                    for (uint8_t ii = Count; ii--; )
-                    {
-                        if (_ptr >= m_begin[ii])
-                        {
-                            const size_t   dist = (uint8_t*)_ptr - (uint8_t*)m_begin[ii];
-                            const uint32_t slot = uint32_t(dist/m_sizes[ii]);
-                            m_mutex.lock();
-                            m_allocs[ii].unset(slot);
-                            m_mutex.unlock();
+                    uint32_t size;
+                    freeSlot(_ptr, true, size);
+                    return size;
+                }
 
-                            DM_PRINT_SMALL("~Small free: slot %u %u.%uKB %d/%d - (0x%p)"
-                                          , slot
-                                          , dm::U_UKB(m_sizes[ii])
-                                          , m_allocs[ii].count(), m_allocs[ii].max()
-                                          , _ptr
-                                          );
+                /// Returns false without freeing if another thread holds the lock, '_blockSize' is set either way.
+                /// Blocks of a span owned by a thread cache never need it.
+                bool tryFree(void* _ptr, uint32_t& _blockSize)
+                {
+                    return freeSlot(_ptr, false, _blockSize);
+                }
 
-                            return;
-                        }
+                #if DM_ALLOC_THREAD_CACHES
+                /// Main arena only, called once before any allocation.
+                void enableThreadCaches()
+                {
+                    m_threadCached = true;
+                }
+
+                /// Frees blocks other threads handed back to the calling thread's cache.
+                void flushThreadCache()
+                {
+                    if (m_threadCached && 0 != s_threadCacheIdx && MaxCaches != s_threadCacheIdx)
+                    {
+                        drainCache(m_caches[s_threadCacheIdx]);
                     }
                 }
+                #endif // DM_ALLOC_THREAD_CACHES
+
+                /// Reconstructs the mutex, see Memory::restore().
+                void restore()
+                {
+                    ::new (&m_mutex) dm::LwMutex();
+                }
 
                 size_t getSize(void* _ptr) const
                 {
@@ -698,6 +1726,35 @@ namespace DM_NAMESPACE
                     return (m_mem <= _ptr && _ptr < ((uint8_t*)m_mem + m_totalSize));
                 }
 
+                /// One extent per run of used or free slots, for each list.
+                /// Free slots cached by the calling thread are reported free, the ones cached by other threads used.
+                void snapshot(SnapshotExtents& _extents, const uint8_t* _base)
+                {
+                    dm::LwMutexScope lock(m_mutex);
+
+                    for (uint8_t ii = 0; ii < Count; ++ii)
+                    {
+                        const uint64_t offset = uint64_t((const uint8_t*)m_begin[ii] - _base);
+                        const uint32_t max    = m_allocs[ii].max();
+
+                        uint32_t runBegin = 0;
+                        bool     runUsed  = (0 != max) && isUsed(ii, 0);
+                        for (uint32_t slot = 1; slot <= max; ++slot)
+                        {
+                            const bool used = (slot != max) && isUsed(ii, slot);
+                            if (slot == max || used != runUsed)
+                            {
+                                _extents.add(offset + uint64_t(runBegin)*m_sizes[ii]
+                                           , uint64_t(slot - runBegin)*m_sizes[ii]
+                                           , AllocSnapshotExtent::Segregated, runUsed, 0, ii
+                                           );
+                                runBegin = slot;
+                                runUsed  = used;
+                            }
+                        }
+                    }
+                }
+
                 #if DM_ALLOC_PRINT_STATS
                 void printStats()
                 {
@@ -713,39 +1770,416 @@ namespace DM_NAMESPACE
                               , ii, dm::U_UKB(m_sizes[ii]), used, max, m_overflow[ii], m_totalUsed[ii]);
                     }
                     printf("\t-------------------------\n");
-                    printf("\tTotal: %u.%uMB / %u.%uMB\n\n", dm::U_UMB(totalSize), dm::U_UMB(DataSize));
+                    printf("\tTotal: %u.%uMB / %u.%uMB\n\n", dm::U_UMB(totalSize), dm::U_UMB(m_totalSize));
                 }
                 #endif //DM_ALLOC_PRINT_STATS
 
             private:
-                void*       m_mem;
-                size_t      m_totalSize;
-                dm::LwMutex m_mutex;
-                // Lists:
-                uint32_t        m_sizes[Count];
-                void*           m_begin[Count];
-                uint8_t         m_powToIdx[Steps];
-                dm::BitArrayExt m_allocs[Count];
-                uint8_t         m_allocsData[ListsSize];
+                bool isUsed(uint8_t _list, uint32_t _slot)
+                {
+                    #if DM_ALLOC_THREAD_CACHES
+                    if (m_threadCached && m_cached[_list])
+                    {
+                        const uint32_t span = m_spanBase[_list] + (_slot>>6);
+                        if (0 != s_threadCacheIdx && s_threadCacheIdx == m_spanOwner[span])
+                        {
+                            return 0 == (m_spanFree[span] & (UINT64_C(1)<<(_slot&63)));
+                        }
+                    }
+                    #endif // DM_ALLOC_THREAD_CACHES
 
-                #if DM_ALLOC_PRINT_STATS
-                uint32_t m_totalUsed[Count];
-                uint32_t m_overflow[Count];
-                #endif //DM_ALLOC_PRINT_STATS
-            };
+                    return m_allocs[_list].isSet(_slot);
+                }
 
-            struct Heap
-            {
-                #define DM_HEAP_ARRAY_IMPL (DM_ALLOCATOR_UNDERLYING_IMPL_ARRAY == DM_ALLOCATOR_UNDERLYING_IMPL)
+                bool freeSlot(void* _ptr, bool _wait, uint32_t& _blockSize)
+                {
+                    uint8_t  list;
+                    uint32_t slot;
+                    slotOf(_ptr, list, slot);
+                    _blockSize = m_sizes[list];
 
-                #if DM_HEAP_ARRAY_IMPL
-                #   define DM_UsedMask    0x8000000000000000UL
-                #   define DM_UsedShift   63UL
-                #   define DM_SizeMask    0x7fffffffffffffffUL
-                #   define DM_SizeShift   0UL
-                #else
-                #   define DM_UsedMask    0x8000000000000000UL
-                #   define DM_UsedShift   63UL
+                    for (;;)
+                    {
+                        #if DM_ALLOC_THREAD_CACHES
+                        if (freeToOwner(_ptr, list, slot))
+                        {
+                            return true;
+                        }
+                        #endif // DM_ALLOC_THREAD_CACHES
+
+                        if (_wait)
+                        {
+                            m_mutex.lock();
+                        }
+                        else if (!m_mutex.tryLock())
+                        {
+                            return false;
+                        }
+
+                        #if DM_ALLOC_THREAD_CACHES
+                        // Span was claimed meanwhile, owners change only under the lock.
+                        if (DM_UNLIKELY(m_threadCached && m_cached[list] && 0 != m_spanOwner[m_spanBase[list] + (slot>>6)]))
+                        {
+                            m_mutex.unlock();
+                            continue;
+                        }
+                        #endif // DM_ALLOC_THREAD_CACHES
+
+                        m_allocs[list].unset(slot);
+                        m_mutex.unlock();
+
+                        DM_PRINT_SMALL("~Small free: slot %u %u.%uKB %d/%d - (0x%p)"
+                                      , slot
+                                      , dm::U_UKB(m_sizes[list])
+                                      , m_allocs[list].count(), m_allocs[list].max()
+                                      , _ptr
+                                      );
+
+                        return true;
+                    }
+                }
+
+                #if DM_ALLOC_THREAD_CACHES
+                ThreadCache* threadCache()
+                {
+                    uint32_t idx = s_threadCacheIdx;
+                    if (DM_UNLIKELY(0 == idx))
+                    {
+                        idx = takeThreadCache();
+                        s_threadCacheIdx = idx;
+                    }
+
+                    return (MaxCaches != idx) ? &m_caches[idx] : NULL;
+                }
+
+                uint32_t takeThreadCache()
+                {
+                    for (uint32_t ii = 1; ii < MaxCaches; ++ii)
+                    {
+                        ThreadCache& cache = m_caches[ii];
+                        if (0 == dm::atomicLoadAcquire(&cache.m_taken)
+                        &&  0 == dm::atomicCompareAndSwap(&cache.m_taken, 0, 1))
+                        {
+                            for (uint8_t list = 0; list < Count; ++list)
+                            {
+                                cache.m_spans[list] = NumSpans;
+                            }
+                            cache.m_lists = this;
+
+                            // Frees left in the list by the previous owner are drained on the first allocation.
+                            #if DM_PLATFORM_POSIX
+                                pthread_once(&s_threadCacheKeyOnce, createThreadCacheKey);
+                                pthread_setspecific(s_threadCacheKey, &cache);
+                            #endif // DM_PLATFORM_POSIX
+
+                            return ii;
+                        }
+                    }
+
+                    return MaxCaches;
+                }
+
+                #if DM_PLATFORM_POSIX
+                static void createThreadCacheKey()
+                {
+                    pthread_key_create(&s_threadCacheKey, releaseThreadCache);
+                }
+
+                static void releaseThreadCache(void* _cache)
+                {
+                    ThreadCache* cache = (ThreadCache*)_cache;
+                    cache->m_lists->abandonCache(*cache);
+                }
+                #endif // DM_PLATFORM_POSIX
+
+                /// Thread exit. Gives all spans back and frees whatever other threads handed back meanwhile.
+                void abandonCache(ThreadCache& _cache)
+                {
+                    // Anything the thread frees after this point, in other destructors, goes through the shared bitmap.
+                    s_threadCacheIdx = MaxCaches;
+
+                    const uint32_t idx = uint32_t(&_cache - m_caches);
+                    {
+                        dm::LwMutexScope lock(m_mutex);
+                        for (uint8_t list = 0; list < Count; ++list)
+                        {
+                            for (uint32_t bucket = 0, end = m_allocs[list].numSlots(); m_cached[list] && bucket < end; ++bucket)
+                            {
+                                const uint32_t span = m_spanBase[list] + bucket;
+                                if (idx == m_spanOwner[span])
+                                {
+                                    m_allocs[list].bits()[bucket] &= ~m_spanFree[span];
+                                    m_spanFree[span]  = 0;
+                                    m_spanOwner[span] = 0;
+                                }
+                            }
+                        }
+                    }
+
+                    // Pairs with pushCacheFree(), either this drain or the pushing thread sees the pushed block.
+                    dm::atomicStoreRelease(&_cache.m_taken, 0);
+                    dm::memoryBarrier();
+                    freeAll(dm::atomicExchangePtr(&_cache.m_remoteFrees, NULL));
+                }
+
+                bool freeToOwner(void* _ptr, uint8_t _list, uint32_t _slot)
+                {
+                    if (!m_threadCached || !m_cached[_list])
+                    {
+                        return false;
+                    }
+
+                    const uint32_t span  = m_spanBase[_list] + (_slot>>6);
+                    const uint32_t owner = m_spanOwner[span];
+                    if (0 == owner)
+                    {
+                        return false;
+                    }
+
+                    // Only the owner gives its spans away, so the span stays its own during this call.
+                    if (owner == s_threadCacheIdx)
+                    {
+                        cacheFree(m_caches[owner], _list, span, _slot&63);
+                    }
+                    else
+                    {
+                        pushCacheFree(m_caches[owner], _ptr);
+                        DM_ALLOC_COUNT_REMOTE_FREE();
+                    }
+
+                    return true;
+                }
+
+                /// Link to the next element is written into the freed block itself.
+                /// Owner takes the whole list at once, so there is no ABA problem.
+                void pushCacheFree(ThreadCache& _cache, void* _ptr)
+                {
+                    void** next = (void**)_ptr;
+                    void*  head = dm::atomicLoadAcquirePtr(&_cache.m_remoteFrees);
+                    for (;;)
+                    {
+                        *next = head;
+
+                        void* prev = dm::atomicCompareAndSwapPtr(&_cache.m_remoteFrees, head, _ptr);
+                        if (prev == head)
+                        {
+                            break;
+                        }
+                        head = prev;
+                    }
+
+                    // Owner exited meanwhile and will not drain it anymore. Its spans are shared again.
+                    if (0 == dm::atomicLoadAcquire(&_cache.m_taken))
+                    {
+                        freeAll(dm::atomicExchangePtr(&_cache.m_remoteFrees, NULL));
+                    }
+                }
+
+                void drainCache(ThreadCache& _cache)
+                {
+                    const uint32_t idx = uint32_t(&_cache - m_caches);
+
+                    void* ptr = dm::atomicExchangePtr(&_cache.m_remoteFrees, NULL);
+                    while (NULL != ptr)
+                    {
+                        void* next = *(void**)ptr;
+
+                        uint8_t  list;
+                        uint32_t slot;
+                        slotOf(ptr, list, slot);
+
+                        const uint32_t span = m_spanBase[list] + (slot>>6);
+                        if (idx == m_spanOwner[span])
+                        {
+                            cacheFree(_cache, list, span, slot&63);
+                        }
+                        else
+                        {
+                            // Handed to the previous owner of this cache.
+                            free(ptr);
+                        }
+
+                        ptr = next;
+                    }
+                }
+
+                void freeAll(void* _list)
+                {
+                    while (NULL != _list)
+                    {
+                        void* next = *(void**)_list;
+                        free(_list);
+                        _list = next;
+                    }
+                }
+
+                void* cacheAlloc(ThreadCache& _cache, uint8_t _list)
+                {
+                    if (NULL != dm::atomicLoadAcquirePtr(&_cache.m_remoteFrees))
+                    {
+                        drainCache(_cache);
+                    }
+
+                    uint32_t span = _cache.m_spans[_list];
+                    if (NumSpans == span)
+                    {
+                        span = claimSpan(_cache, _list);
+                        if (NumSpans == span)
+                        {
+                            return NULL;
+                        }
+                    }
+
+                    uint64_t& mask = m_spanFree[span];
+                    const uint32_t bit = uint32_t(cnttz_u64(mask));
+                    mask &= mask-1;
+                    if (0 == mask)
+                    {
+                        unlinkSpan(_cache, _list, span);
+                    }
+
+                    const uint32_t slot = ((span - m_spanBase[_list])<<6) + bit;
+                    return (uint8_t*)m_begin[_list] + slot*m_sizes[_list];
+                }
+
+                void cacheFree(ThreadCache& _cache, uint8_t _list, uint32_t _span, uint32_t _bit)
+                {
+                    uint64_t& mask = m_spanFree[_span];
+                    if (0 == mask)
+                    {
+                        linkSpan(_cache, _list, _span);
+                    }
+                    mask |= UINT64_C(1)<<_bit;
+
+                    // All free and not the only span left, give it back so that other threads can use it.
+                    if (mask == spanSlots(_list, _span)
+                    && (_cache.m_spans[_list] != _span || NumSpans != m_spanNext[_span]))
+                    {
+                        unlinkSpan(_cache, _list, _span);
+
+                        dm::LwMutexScope lock(m_mutex);
+                        m_allocs[_list].bits()[_span - m_spanBase[_list]] &= ~mask;
+                        mask = 0;
+                        m_spanOwner[_span] = 0;
+                    }
+                }
+
+                /// Takes the free slots of the next span that has any. Owned spans have none in the shared bitmap.
+                uint32_t claimSpan(ThreadCache& _cache, uint8_t _list)
+                {
+                    dm::LwMutexScope lock(m_mutex);
+
+                    uint64_t* bits = m_allocs[_list].bits();
+                    const uint32_t numSlots = m_allocs[_list].numSlots();
+                    for (uint32_t ii = 0, bucket = m_claimLast[_list]; ii < numSlots; ++ii, bucket = (bucket+1 == numSlots) ? 0 : bucket+1)
+                    {
+                        const uint32_t span = m_spanBase[_list] + bucket;
+                        const uint64_t mask = ~bits[bucket] & spanSlots(_list, span);
+                        if (0 != mask)
+                        {
+                            bits[bucket] |= mask;
+                            m_spanFree[span]  = mask;
+                            m_spanOwner[span] = uint8_t(&_cache - m_caches);
+                            m_claimLast[_list] = bucket;
+                            linkSpan(_cache, _list, span);
+
+                            return span;
+                        }
+                    }
+
+                    return NumSpans;
+                }
+
+                /// Slots of the span that exist, the last span of a list can be partial.
+                uint64_t spanSlots(uint8_t _list, uint32_t _span)
+                {
+                    const uint32_t end = m_allocs[_list].max() - ((_span - m_spanBase[_list])<<6);
+                    return (end >= 64) ? UINT64_MAX : (UINT64_C(1)<<end)-1;
+                }
+
+                void linkSpan(ThreadCache& _cache, uint8_t _list, uint32_t _span)
+                {
+                    const uint32_t head = _cache.m_spans[_list];
+                    m_spanPrev[_span] = NumSpans;
+                    m_spanNext[_span] = head;
+                    if (NumSpans != head)
+                    {
+                        m_spanPrev[head] = _span;
+                    }
+                    _cache.m_spans[_list] = _span;
+                }
+
+                void unlinkSpan(ThreadCache& _cache, uint8_t _list, uint32_t _span)
+                {
+                    const uint32_t prev = m_spanPrev[_span];
+                    const uint32_t next = m_spanNext[_span];
+                    if (NumSpans != prev)
+                    {
+                        m_spanNext[prev] = next;
+                    }
+                    else
+                    {
+                        _cache.m_spans[_list] = next;
+                    }
+
+                    if (NumSpans != next)
+                    {
+                        m_spanPrev[next] = prev;
+                    }
+                }
+                #endif // DM_ALLOC_THREAD_CACHES
+
+                void slotOf(void* _ptr, uint8_t& _list, uint32_t& _slot) const
+                {
+                    uint8_t ii = Count-1;
+                    while (ii > 0 && _ptr < m_begin[ii])
+                    {
+                        --ii;
+                    }
+
+                    _list = ii;
+                    _slot = uint32_t(((uint8_t*)_ptr - (uint8_t*)m_begin[ii])/m_sizes[ii]);
+                }
+
+                void*       m_mem;
+                size_t      m_totalSize;
+                dm::LwMutex m_mutex;
+                // Lists:
+                uint32_t        m_sizes[Count];
+                void*           m_begin[Count];
+                uint8_t         m_powToIdx[Steps];
+                dm::BitArrayExt m_allocs[Count]; // Bitmaps live behind the slots, see regionSize().
+
+                #if DM_ALLOC_THREAD_CACHES
+                bool             m_threadCached;
+                bool             m_cached[Count];
+                uint32_t         m_spanBase[Count];  // First span of each list.
+                uint32_t         m_claimLast[Count]; // Where the last claim found free slots.
+                volatile uint8_t* m_spanOwner; // Cache index, zero for shared spans.
+                uint64_t*         m_spanFree;  // Free slots, owner only.
+                uint32_t*         m_spanNext;
+                uint32_t*         m_spanPrev;
+                ThreadCache      m_caches[MaxCaches];
+                #endif // DM_ALLOC_THREAD_CACHES
+
+                #if DM_ALLOC_PRINT_STATS
+                uint32_t m_totalUsed[Count];
+                uint32_t m_overflow[Count];
+                #endif //DM_ALLOC_PRINT_STATS
+            };
+
+            struct Heap
+            {
+                #define DM_HEAP_ARRAY_IMPL (DM_ALLOCATOR_UNDERLYING_IMPL_ARRAY == DM_ALLOCATOR_UNDERLYING_IMPL)
+
+                #if DM_HEAP_ARRAY_IMPL
+                #   define DM_UsedMask    0x8000000000000000UL
+                #   define DM_UsedShift   63UL
+                #   define DM_SizeMask    0x7fffffffffffffffUL
+                #   define DM_SizeShift   0UL
+                #else
+                #   define DM_UsedMask    0x8000000000000000UL
+                #   define DM_UsedShift   63UL
                 #   define DM_HandleMask  0x7fff000000000000UL
                 #   define DM_HandleShift 48UL
                 #   define DM_HandleMax   (DM_HandleMask>>DM_HandleShift)
@@ -770,7 +2204,6 @@ namespace DM_NAMESPACE
                     NumRegions        = DM_ALLOC_NUM_REGIONS,
                     NumSubRegions     = DM_ALLOC_NUM_SUB_REGIONS,
                     SmallestRegion    = DM_ALLOC_SMALLEST_REGION,
-                    BiggestRegion     = DM_ALLOC_SMALLEST_REGION<<(DM_ALLOC_NUM_REGIONS-1),
                     SmallestRegionPwr = dm::Log<2,(SmallestRegion>>20ul)>::value,
 
                     #define DM_ALLOC_DEF(_regionIdx, _num) \
@@ -786,6 +2219,9 @@ namespace DM_NAMESPACE
                     #endif //!DM_HEAP_ARRAY_IMPL
                 };
 
+                // Does not fit in an enum.
+                static const uint64_t BiggestRegion = DM_ALLOC_BIGGEST_REGION;
+
                 void init(uint8_t** _stackPtr, uint8_t** _heap)
                 {
                     m_begin    = *_heap;
@@ -950,10 +2386,10 @@ namespace DM_NAMESPACE
                     }
                 }
 
-                uint16_t getSlotGroup(uint32_t _size)
+                uint16_t getSlotGroup(uint64_t _size)
                 {
-                    const uint32_t sizePwrTwo   = dm::nextPowTwo(_size);
-                    const uint32_t sizePwrTwoMB = sizePwrTwo >> 20;
+                    const uint64_t sizePwrTwo   = dm::nextPowTwo(_size);
+                    const uint64_t sizePwrTwoMB = sizePwrTwo >> 20;
 
                     if (0 == sizePwrTwoMB)
                     {
@@ -961,15 +2397,15 @@ namespace DM_NAMESPACE
                     }
 
                     // Determine region.
-                    const uint32_t region = dm::max(0, int32_t(cnttz_u32(sizePwrTwoMB)) - SmallestRegionPwr);
+                    const uint32_t region = dm::max(0, int32_t(cnttz_u64(sizePwrTwoMB)) - SmallestRegionPwr);
 
                     // Determine subRegion.
                     uint32_t subRegion = 0;
-                    const uint32_t leftover = sizePwrTwo - _size;
+                    const uint64_t leftover = sizePwrTwo - _size;
                     if (0 != leftover)
                     {
-                        const uint32_t subRegionSize = (sizePwrTwo - (sizePwrTwo>>1))/NumSubRegions;
-                        subRegion = leftover/subRegionSize;
+                        const uint64_t subRegionSize = (sizePwrTwo - (sizePwrTwo>>1))/NumSubRegions;
+                        subRegion = uint32_t(leftover/subRegionSize);
                     }
 
                     // Determine slot group.
@@ -980,7 +2416,7 @@ namespace DM_NAMESPACE
                     return uint16_t(slotGroup);
                 }
 
-                void addFreeSpace(void* _ptr, uint32_t _size)
+                void addFreeSpace(void* _ptr, uint64_t _size)
                 {
                     DM_CHECK(_size >= HeaderFooterSize, "Error _size param is invalid.");
 
@@ -988,7 +2424,7 @@ namespace DM_NAMESPACE
 
                     #if DM_HEAP_ARRAY_IMPL
                         const uint16_t count = m_freeSlotsCount[group];
-                        const uint16_t max   = m_freeSlotsMax[group/NumRegions];
+                        const uint16_t max   = m_freeSlotsMax[getRegion(group)];
                         //TODO: Print warning if count >= max.
                         if (max > count)
                         {
@@ -998,7 +2434,7 @@ namespace DM_NAMESPACE
                             m_freeSlotsSize[group][last] = _size;
                             m_freeSlotsPtr [group][last] = _ptr;
                         }
-                        writeHeaderFooter(_ptr, (uint64_t)_size, false);
+                        writeHeaderFooter(_ptr, _size, false);
                     #else
                         //TODO: Print warning if count >= max.
                         if (m_freeSlots[group].count() < m_freeSlots[group].max())
@@ -1009,19 +2445,19 @@ namespace DM_NAMESPACE
                             freeSlot->m_size = _size;
                             freeSlot->m_ptr  = _ptr;
                             const uint16_t handle = m_freeSlots[group].getHandleOf(freeSlot);
-                            writeHeaderFooter(_ptr, (uint64_t)_size, group, handle, false);
+                            writeHeaderFooter(_ptr, _size, group, handle, false);
                         }
                         else
                         {
-                            writeHeaderFooter(_ptr, (uint64_t)_size, group, DM_HandleMax, false);
+                            writeHeaderFooter(_ptr, _size, group, DM_HandleMax, false);
                         }
                     #endif //DM_HEAP_ARRAY_IMPL
                 }
 
                 void addBigFreeSpace(void* _ptr, uint64_t _size)
                 {
-                    CS_CHECK(m_bigFreeSlotsCount < 32
-                           , "There are not enough slots big allocations. %d/%d", m_bigFreeSlotsCount, 32);
+                    CS_CHECK(m_bigFreeSlotsCount < MaxBigFreeSlots
+                           , "There are not enough slots big allocations. %d/%d", m_bigFreeSlotsCount, MaxBigFreeSlots);
 
                     const uint32_t last = m_bigFreeSlotsCount++;
                     m_bigFreeSlotsSize[last] = _size;
@@ -1033,7 +2469,7 @@ namespace DM_NAMESPACE
                 {
                     if (_size <= BiggestRegion)
                     {
-                        addFreeSpace(_ptr, uint32_t(_size));
+                        addFreeSpace(_ptr, _size);
                     }
                     else
                     {
@@ -1062,7 +2498,7 @@ namespace DM_NAMESPACE
                 }
 
                 #if DM_HEAP_ARRAY_IMPL
-                    bool removeFreeSpaceRef(void* _ptr, uint32_t _size)
+                    bool removeFreeSpaceRef(void* _ptr, uint64_t _size)
                     {
                         uint16_t group = getSlotGroup(_size);
                         do
@@ -1082,7 +2518,7 @@ namespace DM_NAMESPACE
                         return false;
                     }
 
-                    bool removeFreeSpaceSSE(void* _ptr, uint32_t _size)
+                    bool removeFreeSpaceSSE(void* _ptr, uint64_t _size)
                     {
                         const __m128i ptrsplat = _mm_set1_epi64x(int64_t(_ptr));
 
@@ -1119,7 +2555,7 @@ namespace DM_NAMESPACE
                         return false;
                     }
 
-                    bool removeFreeSpace(void* _ptr, uint32_t _size)
+                    bool removeFreeSpace(void* _ptr, uint64_t _size)
                     {
                         return removeFreeSpaceSSE(_ptr, _size);
                     }
@@ -1289,7 +2725,7 @@ namespace DM_NAMESPACE
                     return *usedSize;
                 }
 
-                void* consumeFreeSpace(uint32_t _group, uint32_t _idx, uint32_t _slotSize, uint32_t _consume)
+                void* consumeFreeSpace(uint32_t _group, uint32_t _idx, uint64_t _slotSize, uint64_t _consume)
                 {
                     #if DM_HEAP_ARRAY_IMPL
                         void* beg = m_freeSlotsPtr[_group][_idx];
@@ -1298,11 +2734,11 @@ namespace DM_NAMESPACE
                     #endif //DM_HEAP_ARRAY_IMPL
                     void* ptr;
 
-                    const uint32_t remainingSize = _slotSize - _consume;
+                    const uint64_t remainingSize = _slotSize - _consume;
                     if (remainingSize > MinimalSlotSize)
                     {
                         // Consume.
-                        ptr = writeHeaderFooter(beg, uint64_t(_consume));
+                        ptr = writeHeaderFooter(beg, _consume);
                         removeFreeSlot(_group, _idx);
 
                         // Leftover.
@@ -1312,7 +2748,7 @@ namespace DM_NAMESPACE
                     else
                     {
                         // Consume entire slot.
-                        ptr = writeHeaderFooter(beg, uint64_t(_slotSize));
+                        ptr = writeHeaderFooter(beg, _slotSize);
                         removeFreeSlot(_group, _idx);
                     }
 
@@ -1321,18 +2757,28 @@ namespace DM_NAMESPACE
 
                 void* consumeBigFreeSpace(uint32_t _idx, uint64_t _consume)
                 {
-                    // Consume.
                     void* beg = m_bigFreeSlotsPtr[_idx];
+                    const uint64_t remainingSize = m_bigFreeSlotsSize[_idx] - _consume;
+
+                    if (remainingSize <= MinimalSlotSize)
+                    {
+                        // Consume entire slot.
+                        void* ptr = writeHeaderFooter(beg, m_bigFreeSlotsSize[_idx]);
+                        removeBigFreeSlot(_idx);
+
+                        return ptr;
+                    }
+
+                    // Consume.
                     void* ptr = writeHeaderFooter(beg, _consume);
 
                     // Leftover.
                     void* next = (uint8_t*)beg + _consume;
-                    const uint64_t remainingSize = m_bigFreeSlotsSize[_idx] - _consume;
 
                     if (remainingSize <= BiggestRegion)
                     {
                         removeBigFreeSlot(_idx);
-                        addBigFreeSpace(next, remainingSize);
+                        addFreeSpace(next, remainingSize);
                     }
                     else
                     {
@@ -1365,24 +2811,25 @@ namespace DM_NAMESPACE
                     // Search for free space.
                     if (totalSize <= BiggestRegion)
                     {
-                        uint16_t group = getSlotGroup(uint32_t(totalSize));
+                        uint16_t group = getSlotGroup(totalSize);
                         do
                         {
                             #if DM_HEAP_ARRAY_IMPL
                                 const uint16_t count = m_freeSlotsCount[group];
-                                const __m128i totalSizeSplat = _mm_set1_epi32(uint32_t(totalSize));
+                                const __m128i totalSizeSplat = _mm_set1_epi64x(int64_t(totalSize));
 
                                 uint16_t ii = 0;
-                                for (uint16_t end = ((count>>2)<<2); ii < end; ii+=4)
+                                for (uint16_t end = ((count>>1)<<1); ii < end; ii+=2)
                                 {
+                                    // Sizes fit in 63 bits, (totalSize - slotSize) is negative when slot is bigger.
                                     const __m128i  sizes = _mm_load_si128((__m128i*)&m_freeSlotsSize[group][ii]);
-                                    const __m128i  cmp   = _mm_cmpgt_epi32(sizes, totalSizeSplat);
-                                    const uint32_t mask  = _mm_movemask_epi8(cmp);
+                                    const __m128i  diff  = _mm_sub_epi64(totalSizeSplat, sizes);
+                                    const uint32_t mask  = _mm_movemask_pd(_mm_castsi128_pd(diff));
                                     if (mask != 0)
                                     {
-                                        const int32_t idx = ii + (cnttz_u32(mask)/4);
-                                        const uint32_t slotSize = m_freeSlotsSize[group][idx];
-                                        void* ptr = consumeFreeSpace(group, idx, uint32_t(slotSize), uint32_t(totalSize));
+                                        const int32_t idx = ii + cnttz_u32(mask);
+                                        const uint64_t slotSize = m_freeSlotsSize[group][idx];
+                                        void* ptr = consumeFreeSpace(group, idx, slotSize, totalSize);
 
                                         return ptr;
                                     }
@@ -1390,10 +2837,10 @@ namespace DM_NAMESPACE
 
                                 for (uint16_t end = count; ii < end; ++ii)
                                 {
-                                    const uint32_t slotSize = m_freeSlotsSize[group][ii];
-                                    if (slotSize >= uint32_t(totalSize))
+                                    const uint64_t slotSize = m_freeSlotsSize[group][ii];
+                                    if (slotSize >= totalSize)
                                     {
-                                        void* ptr = consumeFreeSpace(group, ii, uint32_t(slotSize), uint32_t(totalSize));
+                                        void* ptr = consumeFreeSpace(group, ii, slotSize, totalSize);
 
                                         return ptr;
                                     }
@@ -1403,9 +2850,9 @@ namespace DM_NAMESPACE
                                 for (uint16_t ii = 0, end = freeSlotList.count(); ii < end; ++ii)
                                 {
                                     FreeSlot& slot = freeSlotList[ii];
-                                    if (slot.m_size > uint32_t(totalSize))
+                                    if (slot.m_size > totalSize)
                                     {
-                                        void* ptr = consumeFreeSpace(group, ii, slot.m_size, uint32_t(totalSize));
+                                        void* ptr = consumeFreeSpace(group, ii, slot.m_size, totalSize);
 
                                         return ptr;
                                     }
@@ -1498,7 +2945,7 @@ namespace DM_NAMESPACE
                                 if (rightTotalSize <= BiggestRegion)
                                 {
                                     #if DM_HEAP_ARRAY_IMPL
-                                        removeFreeSpace(rightBeg, uint32_t(rightTotalSize));
+                                        removeFreeSpace(rightBeg, rightTotalSize);
                                     #else
                                         const uint16_t group  = unpackGroup(rightHeader);
                                         const uint16_t handle = unpackHandle(rightHeader);
@@ -1537,7 +2984,26 @@ namespace DM_NAMESPACE
                 void free(void* _ptr)
                 {
                     dm::LwMutexScope lock(m_mutex);
+                    freeLocked(_ptr);
+                }
+
+                /// Returns false without freeing if another thread holds the lock.
+                bool tryFree(void* _ptr)
+                {
+                    if (!m_mutex.tryLock())
+                    {
+                        return false;
+                    }
+
+                    freeLocked(_ptr);
+                    m_mutex.unlock();
+
+                    return true;
+                }
 
+                /// Expects m_mutex to be held.
+                void freeLocked(void* _ptr)
+                {
                     void* beg = ptrToBegin(_ptr);
 
                     const uint64_t usedSize = readHeader(beg);
@@ -1558,7 +3024,7 @@ namespace DM_NAMESPACE
                         if (rightTotalSize <= BiggestRegion)
                         {
                             #if DM_HEAP_ARRAY_IMPL
-                                removeFreeSpace(rightBeg, uint32_t(rightTotalSize));
+                                removeFreeSpace(rightBeg, rightTotalSize);
                             #else
                                 const uint16_t group  = unpackGroup(rightHeader);
                                 const uint16_t handle = unpackHandle(rightHeader);
@@ -1596,7 +3062,7 @@ namespace DM_NAMESPACE
                             if (leftTotalSize <= BiggestRegion)
                             {
                                 #if DM_HEAP_ARRAY_IMPL
-                                    removeFreeSpace(leftBeg, uint32_t(leftTotalSize));
+                                    removeFreeSpace(leftBeg, leftTotalSize);
                                 #else
                                     const uint16_t group  = unpackGroup(leftHeader);
                                     const uint16_t handle = unpackHandle(leftHeader);
@@ -1625,6 +3091,29 @@ namespace DM_NAMESPACE
                     return size_t(size);
                 }
 
+                /// Same as getSize(), reads only the block header so the owning heap need not be known.
+                static size_t blockSize(const void* _ptr)
+                {
+                    const uint64_t header = *((const uint64_t*)_ptr-1);
+                    return size_t((header&DM_SizeMask)>>DM_SizeShift);
+                }
+
+                /// Walks all blocks, from the last heap alloc up to the beginning. Expects m_mutex to be held.
+                void snapshot(SnapshotExtents& _extents, const uint8_t* _base, uint16_t _chunk) const
+                {
+                    const uint8_t* ptr = *m_end + sizeof(uint64_t);
+                    const uint8_t* end = (const uint8_t*)m_begin - sizeof(uint64_t);
+                    while (ptr < end)
+                    {
+                        const uint64_t header    = readHeader(ptr);
+                        const uint64_t totalSize = unpackSize(header) + HeaderFooterSize;
+
+                        _extents.add(uint64_t(ptr - _base), totalSize, AllocSnapshotExtent::Heap, unpackUsed(header), _chunk);
+
+                        ptr += totalSize;
+                    }
+                }
+
                 size_t getRemainingSpace() const
                 {
                     return size_t((uint8_t*)*m_end - *m_stackPtr - sizeof(uint64_t)); //Between stack and heap.
@@ -1661,9 +3150,9 @@ namespace DM_NAMESPACE
                 #if DM_HEAP_ARRAY_IMPL
                     uint16_t m_freeSlotsMax[NumRegions];
 
-                    DM_ALIGN_DECL(16, uint32_t* m_freeSlotsSize[NumRegions*NumSubRegions]);
+                    DM_ALIGN_DECL(16, uint64_t* m_freeSlotsSize[NumRegions*NumSubRegions]);
                     #define DM_ALLOC_DEF(_regionIdx, _num) \
-                        DM_ALIGN_DECL(16, uint32_t m_freeSlotsSize ## _regionIdx [NumSubRegions][NumSlots ## _regionIdx]);
+                        DM_ALIGN_DECL(16, uint64_t m_freeSlotsSize ## _regionIdx [NumSubRegions][NumSlots ## _regionIdx]);
                     #include "allocator_config.h"
 
                     DM_ALIGN_DECL(16, void** m_freeSlotsPtr[NumRegions*NumSubRegions]);
@@ -1673,7 +3162,7 @@ namespace DM_NAMESPACE
                 #else
                     struct FreeSlot
                     {
-                        uint32_t m_size;
+                        uint64_t m_size;
                         void*    m_ptr;
                     };
                     typedef dm::List<FreeSlot> FreeSlotList;
@@ -1683,34 +3172,326 @@ namespace DM_NAMESPACE
                 #endif //DM_HEAP_ARRAY_IMPL
             };
 
-            StaticStorage   m_staticStorage;
-            SegregatedLists m_segregatedLists;
-            DynamicStack    m_stack;
-            Heap            m_heap;
-
-            uint8_t* m_stackPtr;
-            uint8_t* m_heapEnd;
-            void*    m_memory;
-            size_t   m_size;
-            void*    m_orig;
-            #if DM_ALLOC_PRINT_STATS
-            uint16_t m_externalAlloc;
-            uint16_t m_externalFree;
-            size_t   m_externalSize;
-            #endif //DM_ALLOC_PRINT_STATS
-        };
-        static Memory s_memory;
-
-        template <typename StackTy>
-        struct StackAllocatorImpl : StackAllocatorI
-        {
-            virtual ~StackAllocatorImpl()
-            {
-            }
-
-            virtual void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* /*_file*/, size_t /*_line*/) override
+            ///
+            /// Allocations made outside of the arena, once it is exhausted.
+            /// Each one is prefixed by a header holding its size.
+            /// Big ones get a dedicated mapping. It is grown by remapping pages, without copying, and returned to the OS on free.
+            ///
+            struct ExternalMemory
             {
-                if (NULL == _ptr) /// Malloc.
+                struct Header
+                {
+                    uint64_t m_size;   // Requested size.
+                    uint64_t m_mapped; // Size of the mapping, 0 if allocated with malloc().
+                };
+
+                enum
+                {
+                    HeaderSize = sizeof(Header),
+                };
+
+                ExternalMemory()
+                {
+                    m_initialized = false;
+                }
+
+                void init()
+                {
+                    m_blocks.init(64, &m_blocksAlloc);
+                    m_initialized = true;
+                }
+
+                /// Header of the block, NULL for pointers that did not come from here, those have no header and belong to the CRT.
+                /// Callers look the block up once and pass the header on, every lookup takes the lock.
+                Header* find(void* _ptr)
+                {
+                    if (!m_initialized)
+                    {
+                        return NULL;
+                    }
+
+                    dm::LwMutexScope lock(m_mutex);
+                    return (1 == m_blocks.find(_ptr)) ? getHeader(_ptr) : NULL;
+                }
+
+                /// Same as find(), takes the block out of the table as well.
+                Header* detach(void* _ptr)
+                {
+                    if (!m_initialized)
+                    {
+                        return NULL;
+                    }
+
+                    dm::LwMutexScope lock(m_mutex);
+                    return m_blocks.remove(_ptr) ? getHeader(_ptr) : NULL;
+                }
+
+                void* alloc(size_t _size)
+                {
+                    void* ptr = allocBlock(_size);
+                    if (NULL != ptr)
+                    {
+                        dm::LwMutexScope lock(m_mutex);
+                        m_blocks.insert(ptr, uint8_t(1));
+                    }
+
+                    return ptr;
+                }
+
+                /// '_header' comes from find().
+                void* realloc(void* _ptr, size_t _size, Header* _header)
+                {
+                    if (NULL == _header)
+                    {
+                        return ::realloc(_ptr, _size);
+                    }
+
+                    void* ptr = reallocBlock(_ptr, _size);
+                    if (NULL != ptr && ptr != _ptr)
+                    {
+                        dm::LwMutexScope lock(m_mutex);
+                        m_blocks.remove(_ptr);
+                        m_blocks.insert(ptr, uint8_t(1));
+                    }
+
+                    return ptr;
+                }
+
+                /// '_header' comes from detach().
+                void free(void* _ptr, Header* _header)
+                {
+                    if (NULL == _header)
+                    {
+                        ::free(_ptr);
+                        return;
+                    }
+
+                    freeBlock(_ptr);
+                }
+
+                static Header* getHeader(void* _ptr)
+                {
+                    return (Header*)_ptr - 1;
+                }
+
+                static size_t getFootprint(const Header* _header)
+                {
+                    return (0 != _header->m_mapped) ? size_t(_header->m_mapped) : size_t(_header->m_size + HeaderSize);
+                }
+
+            private:
+                void* allocBlock(size_t _size)
+                {
+                    #if DM_PLATFORM_POSIX
+                    if (_size >= DM_ALLOC_EXTERNAL_MAP_THRESHOLD)
+                    {
+                        return mapAlloc(_size);
+                    }
+                    #endif // DM_PLATFORM_POSIX
+
+                    Header* header = (Header*)::malloc(_size + HeaderSize);
+                    if (NULL == header)
+                    {
+                        return NULL;
+                    }
+
+                    header->m_size   = _size;
+                    header->m_mapped = 0;
+
+                    return header+1;
+                }
+
+                void* reallocBlock(void* _ptr, size_t _size)
+                {
+                    Header* header = getHeader(_ptr);
+
+                    #if DM_PLATFORM_POSIX
+                    if (0 != header->m_mapped)
+                    {
+                        const size_t mapped = mappingSize(_size);
+                        if (mapped == header->m_mapped)
+                        {
+                            header->m_size = _size;
+                            return _ptr;
+                        }
+
+                        #if DM_PLATFORM_LINUX
+                            void* mem = ::mremap(header, size_t(header->m_mapped), mapped, MREMAP_MAYMOVE);
+                            if (MAP_FAILED == mem)
+                            {
+                                return NULL;
+                            }
+
+                            header = (Header*)mem;
+                            header->m_size   = _size;
+                            header->m_mapped = mapped;
+
+                            return header+1;
+                        #endif // DM_PLATFORM_LINUX
+                    }
+
+                    if (0 != header->m_mapped || _size >= DM_ALLOC_EXTERNAL_MAP_THRESHOLD)
+                    {
+                        void* ptr = mapAlloc(_size);
+                        if (NULL == ptr)
+                        {
+                            return NULL;
+                        }
+
+                        memcpy(ptr, _ptr, size_t(dm::min(header->m_size, uint64_t(_size))));
+                        freeBlock(_ptr);
+
+                        return ptr;
+                    }
+                    #endif // DM_PLATFORM_POSIX
+
+                    header = (Header*)::realloc(header, _size + HeaderSize);
+                    if (NULL == header)
+                    {
+                        return NULL;
+                    }
+
+                    header->m_size = _size;
+
+                    return header+1;
+                }
+
+                void freeBlock(void* _ptr)
+                {
+                    Header* header = getHeader(_ptr);
+
+                    #if DM_PLATFORM_POSIX
+                    if (0 != header->m_mapped)
+                    {
+                        ::munmap(header, size_t(header->m_mapped));
+                        return;
+                    }
+                    #endif // DM_PLATFORM_POSIX
+
+                    ::free(header);
+                }
+
+                #if DM_PLATFORM_POSIX
+                static size_t mappingSize(size_t _size)
+                {
+                    static const size_t s_pageSize = size_t(::sysconf(_SC_PAGESIZE));
+                    return dm::alignSizeNext(_size + HeaderSize, s_pageSize);
+                }
+
+                void* mapAlloc(size_t _size)
+                {
+                    const size_t mapped = mappingSize(_size);
+
+                    void* mem = ::mmap(NULL, mapped, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+                    if (MAP_FAILED == mem)
+                    {
+                        return NULL;
+                    }
+
+                    Header* header = (Header*)mem;
+                    header->m_size   = _size;
+                    header->m_mapped = mapped;
+
+                    return header+1;
+                }
+                #endif // DM_PLATFORM_POSIX
+
+                dm::HashMapGrowable<sizeof(void*), uint8_t> m_blocks; // Only pointers in here have a header.
+                dm::CrtAllocator m_blocksAlloc;
+                dm::LwMutex      m_mutex;
+                bool             m_initialized;
+            };
+
+            ///
+            /// Additional arena memory with a heap of its own. Chunks live until exit, same as the main arena.
+            ///
+            struct ArenaChunk
+            {
+                static ArenaChunk* create(size_t _size)
+                {
+                    void* mem = ::calloc(1, sizeof(ArenaChunk) + _size + DM_NATURAL_ALIGNMENT);
+                    if (NULL == mem)
+                    {
+                        return NULL;
+                    }
+
+                    ArenaChunk* chunk = ::new (mem) ArenaChunk();
+
+                    uint8_t* beg = (uint8_t*)(chunk+1);
+                    uint8_t* end = beg + _size + DM_NATURAL_ALIGNMENT;
+                    chunk->m_begin    = (uint8_t*)dm::alignPtrNext(beg, DM_NATURAL_ALIGNMENT);
+                    chunk->m_end      = (uint8_t*)dm::alignPtrPrev(end, DM_NATURAL_ALIGNMENT);
+                    chunk->m_stackPtr = chunk->m_begin; // There is no stack, heap can take the whole chunk.
+                    chunk->m_heapEnd  = chunk->m_end;
+                    chunk->m_heap.init(&chunk->m_stackPtr, &chunk->m_heapEnd);
+
+                    return chunk;
+                }
+
+                bool contains(void* _ptr) const
+                {
+                    return (m_begin <= _ptr && _ptr < m_end);
+                }
+
+                Heap     m_heap;
+                uint8_t* m_begin;
+                uint8_t* m_end;
+                uint8_t* m_stackPtr;
+                uint8_t* m_heapEnd;
+            };
+
+            // Backs stack overflow chunks with regular allocations.
+            struct StackOverflowAllocator : AllocatorI
+            {
+                virtual void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* /*_file*/, size_t /*_line*/) override
+                {
+                    if (0 == _size)
+                    {
+                        m_memory->free(_ptr);
+                        return NULL;
+                    }
+
+                    DM_ALLOC_COUNT_OVERFLOW();
+
+                    return m_memory->alloc(_size);
+                }
+
+                Memory* m_memory;
+            };
+
+            StaticStorage   m_staticStorage;
+            SegregatedLists m_segregatedLists;
+            DynamicStack    m_stack;
+            Heap            m_heap;
+            ExternalMemory  m_external;
+            StackOverflowAllocator m_stackOverflowAlloc;
+
+            uint8_t* m_stackPtr;
+            uint8_t* m_heapEnd;
+            void*    m_memory;
+            size_t   m_size;
+            void*    m_orig;
+            void* volatile m_remoteFrees;
+
+            dm::LwMutex m_chunkMutex;
+            ArenaChunk* m_chunks[DM_MEM_MAX_CHUNKS]; // In order of creation.
+            ArenaChunk* m_chunkIndex[DM_MEM_MAX_CHUNKS*(DM_MEM_MAX_CHUNKS+1)/2];
+            volatile uint32_t m_chunkCount;
+            bool m_isInstance;
+            bool m_isPersistent;
+        };
+        static Memory s_memory;
+
+        template <typename StackTy>
+        struct StackAllocatorImpl : StackAllocatorI
+        {
+            virtual ~StackAllocatorImpl()
+            {
+            }
+
+            virtual void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* /*_file*/, size_t /*_line*/) override
+            {
+                if (NULL == _ptr) /// Malloc.
                 {
                     void* ptr = m_stack.alloc(_size);
                     if (NULL == ptr)
@@ -1791,6 +3572,7 @@ namespace DM_NAMESPACE
 
                 FixedStackAllocator* fixedStackAlloc = m_fixedStacks.addNew();
                 fixedStackAlloc->init(mem, _size);
+                fixedStackAlloc->m_stack.setOverflowAllocator(&s_memory.m_stackOverflowAlloc);
 
                 return (dm::StackAllocatorI*)fixedStackAlloc;
             }
@@ -1833,6 +3615,7 @@ namespace DM_NAMESPACE
                 // Init a new stack that will take the second split.
                 DynamicStackAllocator* stack = m_dynamicStacks.addNew();
                 stack->init(&s_memory.m_stackPtr, &s_memory.m_heapEnd);
+                stack->m_stack.setOverflowAllocator(&s_memory.m_stackOverflowAlloc);
 
                 DM_PRINT_STACK("Stack split: %u.%uMB and %u.%uMB."
                              , dm::U_UMB(s_memory.sizeBetweenStackAndHeap())
@@ -1912,6 +3695,7 @@ namespace DM_NAMESPACE
 
                     m_handleAlloc.free(handle);
                     m_objects[handle].~Ty();
+                    ::new (&m_objects[handle]) Ty(); // 'm_objects' destructor runs on every element.
                 }
 
                 void removeAll()
@@ -1919,6 +3703,7 @@ namespace DM_NAMESPACE
                     for (uint16_t ii = count(); ii--; )
                     {
                         m_objects[ii].~Ty();
+                        ::new (&m_objects[ii]) Ty();
                     }
                     m_handleAlloc.reset();
                     m_handles.reset();
@@ -2071,7 +3856,7 @@ namespace DM_NAMESPACE
                 }
                 else if (0 == _size) /// Free.
                 {
-                    if (!s_memory.fromStackRegion(_ptr))
+                    if (!s_memory.fromStack(_ptr))
                     {
                         s_memory.free(_ptr);
                     }
@@ -2118,78 +3903,474 @@ namespace DM_NAMESPACE
         };
         static StackAllocator s_stackAllocator;
 
-        struct MainAllocator : public AllocatorI
+        #if DM_ALLOC_PROFILER
+        ///
+        /// Sampling heap profiler. On average one allocation per 'm_interval' bytes is sampled.
+        /// Gaps between samples are geometrically distributed, so periodic allocation patterns cannot alias with sampling.
+        /// A sample of size S stands for S/(1-exp(-S/interval)) bytes, live estimates are aggregated per call site.
+        /// Call site is file/line when provided (DM_ALLOCATOR_DEBUG) plus a backtrace where available.
+        ///
+        static DM_THREAD_LOCAL int64_t  s_profilerBytesLeft = 0; // Until the next sample.
+        static DM_THREAD_LOCAL uint64_t s_profilerRng = 0;       // Zero until the thread's countdown is seeded.
+
+        struct HeapProfiler
         {
-            virtual ~MainAllocator()
+            enum
+            {
+                MaxSites   = DM_ALLOC_PROFILER_MAX_SITES,
+                MaxSamples = DM_ALLOC_PROFILER_MAX_SAMPLES,
+                MaxFrames  = DM_ALLOC_PROFILER_DEPTH,
+                MaxProbes  = 32,
+                SkipFrames = 2,
+            };
+
+            struct Site
+            {
+                const char* m_file;
+                uint32_t    m_line;
+                uint32_t    m_hash;
+                uint32_t    m_numFrames;
+                void*       m_frames[MaxFrames];
+                volatile int64_t m_liveBytes;
+                volatile int64_t m_liveCount;
+                volatile int64_t m_totalBytes;
+            };
+
+            struct Sample
             {
+                void* volatile m_ptr;
+                uint64_t       m_weight;
+                uint32_t       m_count;
+                uint32_t       m_site;
+            };
+
+            void start(uint64_t _interval)
+            {
+                m_interval = _interval;
+                if (0 != _interval)
+                {
+                    m_lastInterval = _interval;
+                }
             }
 
-            virtual void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* /*_file*/, size_t /*_line*/) override
+            DM_INLINE bool isRunning() const
             {
-                if (NULL == _ptr) /// Malloc.
+                return 0 != m_interval;
+            }
+
+            /// Cheap per-thread countdown, the rest of the work is done only for sampled allocations.
+            DM_INLINE void onAlloc(void* _ptr, size_t _size, const char* _file, size_t _line)
+            {
+                if (0 == m_interval || NULL == _ptr)
                 {
-                    return s_memory.alloc(_size);
+                    return;
                 }
-                else if (0 == _size) /// Free.
+
+                s_profilerBytesLeft -= int64_t(_size);
+                if (DM_UNLIKELY(s_profilerBytesLeft < 0))
                 {
-                    s_memory.free(_ptr);
-                    return NULL;
+                    if (DM_UNLIKELY(0 == s_profilerRng))
+                    {
+                        // First allocation of this thread, it gets a countdown of its own instead of being sampled for sure.
+                        s_profilerBytesLeft = nextInterval() - int64_t(_size);
+                        if (0 <= s_profilerBytesLeft)
+                        {
+                            return;
+                        }
+                    }
+
+                    s_profilerBytesLeft = nextInterval();
+                    addSample(_ptr, _size, _file, _line);
                 }
-                else /// Realloc.
+            }
+
+            DM_INLINE void onFree(void* _ptr)
+            {
+                Sample sample;
+                detach(_ptr, sample);
+            }
+
+            /// Takes the sample of '_ptr' out of the table, has to be done before '_ptr' is released.
+            /// Once released, another thread can get the same address and sample it.
+            DM_INLINE bool detach(void* _ptr, Sample& _sample)
+            {
+                if (0 == m_numLive || NULL == _ptr)
                 {
-                    return s_memory.realloc(_ptr, _size);
+                    return false;
                 }
+
+                return removeSample(_ptr, _sample);
             }
-        };
-        static MainAllocator s_mainAllocator;
 
-        #if 0 // Debug only.
-            struct StackAllocatorEmul : StackAllocatorI
+            /// Puts back a sample taken by detach(), for a block that turned out to stay alive.
+            void reattach(void* _ptr, const Sample& _sample)
             {
-                StackAllocatorEmul()
+                LwMutexScope lock(m_mutex);
+                insertSample(_ptr, _sample);
+            }
+
+            bool dump(const char* _path)
+            {
+                FILE* file = fopen(_path, "w");
+                if (NULL == file)
                 {
-                    #if DM_ALLOC_PRINT_STATS
-                    m_alloc   = 0;
-                    m_realloc = 0;
-                    #endif //DM_ALLOC_PRINT_STATS
+                    return false;
+                }
 
-                    m_stackFrame = 0;
-                    m_pointers.init(MaxStackFramesEstimate, &s_crtAllocator);
-                    for (uint32_t ii = MaxStackFramesEstimate; ii--; )
+                uint32_t* order = (uint32_t*)::malloc(MaxSites*sizeof(uint32_t));
+                uint32_t count = 0;
+
+                m_mutex.lock();
+                for (uint32_t ii = 0; ii < MaxSites; ++ii)
+                {
+                    if (0 != m_sites[ii].m_hash && 0 < m_sites[ii].m_liveBytes)
                     {
-                        m_pointers[ii].init(MaxPointersPerFrameEstiamte, &s_crtAllocator);
+                        order[count++] = ii;
                     }
                 }
+                m_mutex.unlock();
 
-                virtual ~StackAllocatorEmul()
+                // Biggest first.
+                for (uint32_t ii = 1; ii < count; ++ii)
                 {
-                    for (uint32_t ii = m_pointers.count(); ii--; )
+                    const uint32_t curr = order[ii];
+                    uint32_t jj = ii;
+                    for (; jj > 0 && m_sites[order[jj-1]].m_liveBytes < m_sites[curr].m_liveBytes; --jj)
                     {
-                        m_pointers[ii].destroy();
+                        order[jj] = order[jj-1];
                     }
-
-                    m_pointers.destroy();
+                    order[jj] = curr;
                 }
 
-                virtual void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* /*_file*/, size_t /*_line*/) override
+                fprintf(file, "# Heap profile, one sample per %llu bytes on average. Values are estimates.\n", (unsigned long long)m_lastInterval);
+                fprintf(file, "# live_bytes live_count total_bytes file:line backtrace\n");
+                for (uint32_t ii = 0; ii < count; ++ii)
                 {
-                    if (NULL == _ptr) /// Malloc.
+                    const Site& site = m_sites[order[ii]];
+                    fprintf(file, "%lld %lld %lld %s:%u"
+                           , (long long)site.m_liveBytes
+                           , (long long)site.m_liveCount
+                           , (long long)site.m_totalBytes
+                           , NULL != site.m_file ? site.m_file : "?"
+                           , site.m_line
+                           );
+                    for (uint32_t jj = 0; jj < site.m_numFrames; ++jj)
                     {
-                        #if DM_ALLOC_PRINT_STATS
-                        m_alloc++;
-                        #endif //DM_ALLOC_PRINT_STATS
+                        fprintf(file, " %p", site.m_frames[jj]);
+                    }
+                    fprintf(file, "\n");
+                }
 
-                        void* ptr = s_memory.alloc(_size);
-                        m_pointers[m_stackFrame].add(ptr);
+                ::free(order);
+                fclose(file);
 
-                        return ptr;
-                    }
-                    else if (0 == _size) /// Free.
-                    {
-                        return NULL;
-                    }
-                    else /// Realloc.
-                    {
+                return true;
+            }
+
+        private:
+            int64_t nextInterval()
+            {
+                uint64_t rng = s_profilerRng;
+                if (0 == rng)
+                {
+                    rng = (uint64_t(uintptr_t(&s_profilerRng)) ^ uint64_t(dm::getHPCounter()) ^ UINT64_C(0x9e3779b97f4a7c15)) | 1;
+                }
+
+                // Xorshift64.
+                rng ^= rng << 13;
+                rng ^= rng >> 7;
+                rng ^= rng << 17;
+                s_profilerRng = rng;
+
+                const double uniform = double((rng >> 11) + 1) * (1.0/9007199254740992.0); // (0, 1]
+                return int64_t(-log(uniform) * double(m_interval));
+            }
+
+            uint32_t findSite(const char* _file, size_t _line)
+            {
+                // Skip frames inside of the profiler.
+                void* raw[MaxFrames+SkipFrames];
+                void** frames = raw + SkipFrames;
+                uint32_t numFrames = 0;
+                #if DM_PLATFORM_LINUX
+                    const int32_t numRaw = backtrace(raw, MaxFrames+SkipFrames);
+                    numFrames = uint32_t(DM_MAX(numRaw - int32_t(SkipFrames), 0));
+                #endif // DM_PLATFORM_LINUX
+
+                const uint64_t seed = uint64_t(uintptr_t(_file)) ^ dm::hashMix64(uint64_t(_line));
+                const uint32_t hash = uint32_t(dm::hashWy64(frames, uint32_t(numFrames*sizeof(void*)), seed)) | 1; // Zero marks an empty slot.
+
+                LwMutexScope lock(m_mutex);
+
+                // Open addressing, last slot collects everything that does not fit.
+                uint32_t idx = hash%(MaxSites-1);
+                for (uint32_t ii = 0; ii < MaxSites-1; ++ii, idx = (idx+1)%(MaxSites-1))
+                {
+                    Site& site = m_sites[idx];
+                    if (0 == site.m_hash)
+                    {
+                        site.m_file      = _file;
+                        site.m_line      = uint32_t(_line);
+                        site.m_numFrames = numFrames;
+                        memcpy(site.m_frames, frames, numFrames*sizeof(void*));
+                        dm::writeBarrier();
+                        site.m_hash      = hash;
+                        return idx;
+                    }
+
+                    if (hash == site.m_hash
+                    &&  _file == site.m_file
+                    &&  uint32_t(_line) == site.m_line
+                    &&  numFrames == site.m_numFrames
+                    &&  0 == memcmp(frames, site.m_frames, numFrames*sizeof(void*)))
+                    {
+                        return idx;
+                    }
+                }
+
+                m_sites[MaxSites-1].m_hash = 1;
+                return MaxSites-1;
+            }
+
+            static uint32_t slotFor(void* _ptr)
+            {
+                uint64_t key = uint64_t(uintptr_t(_ptr));
+                key ^= key >> 33;
+                key *= UINT64_C(0xff51afd7ed558ccd);
+                key ^= key >> 33;
+
+                return uint32_t(key) & (MaxSamples-1);
+            }
+
+            void addSample(void* _ptr, size_t _size, const char* _file, size_t _line)
+            {
+                const double size = double(_size);
+                const double prob = 1.0 - exp(-size/double(m_interval));
+
+                Sample sample;
+                sample.m_weight = uint64_t(size/prob);
+                sample.m_count  = uint32_t(1.0/prob);
+                sample.m_site   = findSite(_file, _line);
+
+                LwMutexScope lock(m_mutex);
+                if (insertSample(_ptr, sample))
+                {
+                    dm::atomicFetchAndAdd(&m_sites[sample.m_site].m_totalBytes, int64_t(sample.m_weight));
+                }
+            }
+
+            /// Table changes are made under 'm_mutex', lookups of frees that were not sampled do not lock.
+            bool insertSample(void* _ptr, const Sample& _sample)
+            {
+                for (uint32_t ii = 0, slot = slotFor(_ptr); ii < MaxProbes; ++ii, slot = (slot+1)&(MaxSamples-1))
+                {
+                    Sample& sample = m_samples[slot];
+                    if (NULL == sample.m_ptr || Tombstone == sample.m_ptr)
+                    {
+                        sample.m_weight = _sample.m_weight;
+                        sample.m_count  = _sample.m_count;
+                        sample.m_site   = _sample.m_site;
+                        dm::writeBarrier();
+                        sample.m_ptr    = _ptr;
+                        dm::atomicFetchAndAdd(&m_numLive, 1u);
+
+                        Site& dst = m_sites[_sample.m_site];
+                        dm::atomicFetchAndAdd(&dst.m_liveBytes, int64_t(_sample.m_weight));
+                        dm::atomicFetchAndAdd(&dst.m_liveCount, int64_t(_sample.m_count));
+                        return true;
+                    }
+                }
+
+                // Table is too crowded around this slot, sample is dropped.
+                return false;
+            }
+
+            bool removeSample(void* _ptr, Sample& _sample)
+            {
+                for (uint32_t ii = 0, slot = slotFor(_ptr); ii < MaxProbes; ++ii, slot = (slot+1)&(MaxSamples-1))
+                {
+                    Sample& sample = m_samples[slot];
+                    void* curr = sample.m_ptr;
+                    if (NULL == curr)
+                    {
+                        return false;
+                    }
+
+                    if (_ptr == curr)
+                    {
+                        _sample = sample;
+
+                        Site& dst = m_sites[sample.m_site];
+                        dm::atomicFetchAndAdd(&dst.m_liveBytes, -int64_t(sample.m_weight));
+                        dm::atomicFetchAndAdd(&dst.m_liveCount, -int64_t(sample.m_count));
+                        dm::atomicFetchAndAdd(&m_numLive, uint32_t(-1));
+
+                        LwMutexScope lock(m_mutex);
+
+                        // A run of tombstones followed by an empty slot ends no probe sequence, lookups stop at the empty slot anyway.
+                        // Clearing it keeps frees of unsampled blocks from probing through stale tombstones.
+                        if (NULL == m_samples[(slot+1)&(MaxSamples-1)].m_ptr)
+                        {
+                            uint32_t clear = slot;
+                            do
+                            {
+                                m_samples[clear].m_ptr = NULL;
+                                clear = (clear-1)&(MaxSamples-1);
+                            } while (Tombstone == m_samples[clear].m_ptr);
+                        }
+                        else
+                        {
+                            sample.m_ptr = Tombstone;
+                        }
+
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            static void* const Tombstone;
+
+            LwMutex  m_mutex;
+            uint64_t m_interval;
+            uint64_t m_lastInterval; // Samples are kept after stopping, dump() still reports their interval.
+            volatile uint32_t m_numLive;
+            Site     m_sites[MaxSites];
+            Sample   m_samples[MaxSamples];
+        };
+        void* const HeapProfiler::Tombstone = (void*)UINTPTR_MAX;
+        static HeapProfiler s_heapProfiler;
+
+        #   define DM_ALLOC_PROFILE_ALLOC(_ptr, _size, _file, _line) s_heapProfiler.onAlloc(_ptr, _size, _file, _line)
+        #   define DM_ALLOC_PROFILE_FREE(_ptr)                       s_heapProfiler.onFree(_ptr)
+        #else
+        #   define DM_ALLOC_PROFILE_ALLOC(_ptr, _size, _file, _line)
+        #   define DM_ALLOC_PROFILE_FREE(_ptr)
+        #endif // DM_ALLOC_PROFILER
+
+        struct MainAllocator : public AllocatorI
+        {
+            virtual ~MainAllocator()
+            {
+            }
+
+            virtual void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* _file, size_t _line) override
+            {
+                DM_UNUSED(_file);
+                DM_UNUSED(_line);
+
+                if (NULL == _ptr) /// Malloc.
+                {
+                    void* ptr = s_memory.alloc(_size);
+                    DM_ALLOC_PROFILE_ALLOC(ptr, _size, _file, _line);
+                    return ptr;
+                }
+                else if (0 == _size) /// Free.
+                {
+                    DM_ALLOC_PROFILE_FREE(_ptr);
+                    s_memory.free(_ptr);
+                    return NULL;
+                }
+                else /// Realloc.
+                {
+                    #if DM_ALLOC_PROFILER
+                        // Realloc releases '_ptr', its sample has to be out of the table before that.
+                        HeapProfiler::Sample sample;
+                        const bool sampled = s_heapProfiler.detach(_ptr, sample);
+
+                        void* ptr = s_memory.realloc(_ptr, _size);
+                        if (NULL != ptr)
+                        {
+                            DM_ALLOC_PROFILE_ALLOC(ptr, _size, _file, _line);
+                        }
+                        else if (sampled)
+                        {
+                            // On failure '_ptr' is still alive, so is its sample.
+                            s_heapProfiler.reattach(_ptr, sample);
+                        }
+                        return ptr;
+                    #else
+                        return s_memory.realloc(_ptr, _size);
+                    #endif // DM_ALLOC_PROFILER
+                }
+            }
+        };
+        static MainAllocator s_mainAllocator;
+
+        struct MemoryInstance : public AllocatorI
+        {
+            virtual ~MemoryInstance()
+            {
+            }
+
+            virtual void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* /*_file*/, size_t /*_line*/) override
+            {
+                if (NULL == _ptr) /// Malloc.
+                {
+                    return m_memory.alloc(_size);
+                }
+                else if (0 == _size) /// Free.
+                {
+                    m_memory.free(_ptr);
+                    return NULL;
+                }
+                else /// Realloc.
+                {
+                    return m_memory.realloc(_ptr, _size);
+                }
+            }
+
+            Memory m_memory;
+        };
+
+        #if 0 // Debug only.
+            struct StackAllocatorEmul : StackAllocatorI
+            {
+                StackAllocatorEmul()
+                {
+                    #if DM_ALLOC_PRINT_STATS
+                    m_alloc   = 0;
+                    m_realloc = 0;
+                    #endif //DM_ALLOC_PRINT_STATS
+
+                    m_stackFrame = 0;
+                    m_pointers.init(MaxStackFramesEstimate, &s_crtAllocator);
+                    for (uint32_t ii = MaxStackFramesEstimate; ii--; )
+                    {
+                        m_pointers[ii].init(MaxPointersPerFrameEstiamte, &s_crtAllocator);
+                    }
+                }
+
+                virtual ~StackAllocatorEmul()
+                {
+                    for (uint32_t ii = m_pointers.count(); ii--; )
+                    {
+                        m_pointers[ii].destroy();
+                    }
+
+                    m_pointers.destroy();
+                }
+
+                virtual void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* /*_file*/, size_t /*_line*/) override
+                {
+                    if (NULL == _ptr) /// Malloc.
+                    {
+                        #if DM_ALLOC_PRINT_STATS
+                        m_alloc++;
+                        #endif //DM_ALLOC_PRINT_STATS
+
+                        void* ptr = s_memory.alloc(_size);
+                        m_pointers[m_stackFrame].add(ptr);
+
+                        return ptr;
+                    }
+                    else if (0 == _size) /// Free.
+                    {
+                        return NULL;
+                    }
+                    else /// Realloc.
+                    {
                         #if DM_ALLOC_PRINT_STATS
                         m_realloc++;
                         #endif //DM_ALLOC_PRINT_STATS
@@ -2252,8 +4433,140 @@ namespace DM_NAMESPACE
             static StackAllocatorEmul s_stackAllocatorEmul;
         #endif // 0
 
+    #else
+        #define DM_ALLOC_COUNT_TAG_ALLOC(_tag, _size)
+        #define DM_ALLOC_COUNT_TAG_FREE(_tag, _size)
+        #define DM_ALLOC_COUNT_TAG_RESIZE(_tag, _prev, _curr)
     #endif // !DM_ALLOCATOR
 
+    ///
+    /// Tag budgets. Per-thread counters cannot be checked on every allocation,
+    /// so tags with a budget also keep a shared atomic total.
+    ///
+    struct TagBudget
+    {
+        uint64_t      m_soft;
+        uint64_t      m_hard;
+        AllocBudgetFn m_fn;
+        void*         m_userData;
+        volatile int64_t m_bytes;
+        bool          m_enabled;
+    };
+    static TagBudget s_tagBudgets[DM_ALLOC_MAX_TAGS];
+
+    struct TaggedHeader
+    {
+        uint64_t m_size;
+        uint64_t m_tag;
+    };
+
+    /// Returns false if the hard budget does not allow '_size' more bytes.
+    static bool tagReserve(uint8_t _tag, uint64_t _size)
+    {
+        TagBudget& budget = s_tagBudgets[_tag];
+        if (!budget.m_enabled || 0 == _size)
+        {
+            return true;
+        }
+
+        const uint64_t curr = uint64_t(dm::atomicAddAndFetch(&budget.m_bytes, int64_t(_size)));
+        const uint64_t prev = curr - _size;
+
+        if (0 != budget.m_hard && curr > budget.m_hard)
+        {
+            dm::atomicSubAndFetch(&budget.m_bytes, int64_t(_size));
+
+            if (NULL != budget.m_fn)
+            {
+                budget.m_fn(_tag, curr, true, budget.m_userData);
+            }
+
+            return false;
+        }
+
+        if (0 != budget.m_soft && curr > budget.m_soft && prev <= budget.m_soft && NULL != budget.m_fn)
+        {
+            budget.m_fn(_tag, curr, false, budget.m_userData);
+        }
+
+        return true;
+    }
+
+    static void tagRelease(uint8_t _tag, uint64_t _size)
+    {
+        TagBudget& budget = s_tagBudgets[_tag];
+        if (budget.m_enabled)
+        {
+            dm::atomicSubAndFetch(&budget.m_bytes, int64_t(_size));
+        }
+    }
+
+    void* TaggedAllocator::realloc(void* _ptr, size_t _size, size_t _align, const char* _file, size_t _line)
+    {
+        DM_CHECK(m_tag < DM_ALLOC_MAX_TAGS, "TaggedAllocator::realloc() | Invalid tag %d", m_tag);
+
+        if (NULL == _ptr) /// Malloc.
+        {
+            if (!tagReserve(m_tag, _size))
+            {
+                return NULL;
+            }
+
+            TaggedHeader* header = (TaggedHeader*)m_parent->realloc(NULL, sizeof(TaggedHeader) + _size, _align, _file, _line);
+            if (NULL == header)
+            {
+                tagRelease(m_tag, _size);
+                return NULL;
+            }
+
+            header->m_size = _size;
+            header->m_tag  = m_tag;
+            DM_ALLOC_COUNT_TAG_ALLOC(m_tag, _size);
+
+            return header + 1;
+        }
+
+        TaggedHeader* header = (TaggedHeader*)_ptr - 1;
+        const uint64_t prevSize = header->m_size;
+        DM_CHECK(m_tag == header->m_tag, "TaggedAllocator::realloc() | Pointer belongs to tag %d, not %d", uint32_t(header->m_tag), m_tag);
+
+        if (0 == _size) /// Free.
+        {
+            DM_ALLOC_COUNT_TAG_FREE(m_tag, prevSize);
+            tagRelease(m_tag, prevSize);
+            m_parent->realloc(header, 0, _align, _file, _line);
+
+            return NULL;
+        }
+
+        /// Realloc.
+        if (_size > prevSize && !tagReserve(m_tag, _size - prevSize))
+        {
+            return NULL;
+        }
+
+        TaggedHeader* newHeader = (TaggedHeader*)m_parent->realloc(header, sizeof(TaggedHeader) + _size, _align, _file, _line);
+        if (NULL == newHeader)
+        {
+            if (_size > prevSize)
+            {
+                tagRelease(m_tag, _size - prevSize);
+            }
+
+            return NULL;
+        }
+
+        if (_size < prevSize)
+        {
+            tagRelease(m_tag, prevSize - _size);
+        }
+
+        newHeader->m_size = _size;
+        DM_ALLOC_COUNT_TAG_RESIZE(m_tag, prevSize, _size);
+
+        return newHeader + 1;
+    }
+
     bool allocInit()
     {
         #if DM_ALLOCATOR
@@ -2345,6 +4658,385 @@ namespace DM_NAMESPACE
         #endif //DM_ALLOCATOR
     }
 
+    void allocGetStats(AllocStats& _stats)
+    {
+        #if DM_ALLOCATOR
+            gatherStats(_stats);
+        #else
+            memset(&_stats, 0, sizeof(AllocStats));
+        #endif //DM_ALLOCATOR
+    }
+
+    template <uint8_t SizeClassT>
+    void* allocSizeClass(size_t _size)
+    {
+        #if DM_ALLOCATOR
+            void* ptr = s_memory.allocSizeClass<SizeClassT>(_size);
+            DM_ALLOC_PROFILE_ALLOC(ptr, _size, NULL, 0);
+            return ptr;
+        #else
+            return ::malloc(_size);
+        #endif //DM_ALLOCATOR
+    }
+
+    // Every index AllocSizeClass<> can resolve to, the last one is past all lists.
+    #define DM_SMALL_ALLOC_DEF(_idx, _size, _num) \
+        template void* allocSizeClass<_idx>(size_t);
+    #include "allocator_config.h"
+    template void* allocSizeClass<AllocSizeClass<SIZE_MAX>::Index>(size_t);
+
+    void allocFree(void* _ptr)
+    {
+        #if DM_ALLOCATOR
+            DM_ALLOC_PROFILE_FREE(_ptr);
+            s_memory.free(_ptr);
+        #else
+            ::free(_ptr);
+        #endif //DM_ALLOCATOR
+    }
+
+    void* allocRealloc(void* _ptr, size_t _size)
+    {
+        #if DM_ALLOCATOR
+            return s_mainAllocator.MainAllocator::realloc(_ptr, _size, 0, 0, 0);
+        #else
+            return g_crtAllocator.CrtAllocator::realloc(_ptr, _size, 0, 0, 0);
+        #endif //DM_ALLOCATOR
+    }
+
+    void allocSetTagBudget(uint8_t _tag, uint64_t _soft, uint64_t _hard, AllocBudgetFn _fn, void* _userData)
+    {
+        DM_CHECK(_tag < DM_ALLOC_MAX_TAGS, "allocSetTagBudget() | Invalid tag %d", _tag);
+
+        TagBudget& budget = s_tagBudgets[_tag];
+        if (!budget.m_enabled)
+        {
+            // Start from what the tag already holds.
+            budget.m_bytes = int64_t(allocTagBytes(_tag));
+        }
+
+        budget.m_soft     = _soft;
+        budget.m_hard     = _hard;
+        budget.m_fn       = _fn;
+        budget.m_userData = _userData;
+        dm::writeBarrier();
+        budget.m_enabled  = (0 != _soft || 0 != _hard);
+    }
+
+    uint64_t allocTagBytes(uint8_t _tag)
+    {
+        DM_CHECK(_tag < DM_ALLOC_MAX_TAGS, "allocTagBytes() | Invalid tag %d", _tag);
+
+        if (s_tagBudgets[_tag].m_enabled)
+        {
+            return uint64_t(s_tagBudgets[_tag].m_bytes);
+        }
+
+        AllocStats stats;
+        allocGetStats(stats);
+
+        return stats.m_tagBytes[_tag];
+    }
+
+    void allocProfilerStart(uint64_t _sampleBytes)
+    {
+        #if DM_ALLOCATOR && DM_ALLOC_PROFILER
+            s_heapProfiler.start(_sampleBytes);
+        #else
+            DM_UNUSED(_sampleBytes);
+        #endif // DM_ALLOCATOR && DM_ALLOC_PROFILER
+    }
+
+    bool allocProfilerDump(const char* _path)
+    {
+        #if DM_ALLOCATOR && DM_ALLOC_PROFILER
+            return s_heapProfiler.dump(_path);
+        #else
+            DM_UNUSED(_path);
+            return false;
+        #endif // DM_ALLOCATOR && DM_ALLOC_PROFILER
+    }
+
+    bool allocDumpSnapshot(const char* _path)
+    {
+        #if DM_ALLOCATOR
+            return s_memory.dumpSnapshot(_path);
+        #else
+            DM_UNUSED(_path);
+            return false;
+        #endif //DM_ALLOCATOR
+    }
+
+    void allocFlushRemoteFrees()
+    {
+        #if DM_ALLOCATOR
+            s_memory.flushRemoteFrees();
+        #endif //DM_ALLOCATOR
+    }
+
+    #if DM_ALLOCATOR && DM_PLATFORM_POSIX
+        ///
+        /// Persistent file layout:
+        ///
+        ///  Address                                                         Address+Size
+        ///    .________.__________________.________.__________________________.
+        ///    | Header | PersistentMemory | Memory | Arena ...                |
+        ///    |________|__________________|________|__________________________|
+        ///
+        struct PersistentHeader
+        {
+            enum { Version = 2 };
+
+            uint64_t m_magic;
+            uint64_t m_layout; // See persistentLayout(), guards against incompatible builds.
+            uint64_t m_size;
+            void*    m_address;
+            void*    m_root;
+        };
+
+        /// Stamp of everything the mapped Memory depends on. Two builds agreeing on sizeof(Memory)
+        /// can still differ in list sizes, region classes or block headers.
+        static uint64_t persistentLayout()
+        {
+            const uint64_t layout[] =
+            {
+                PersistentHeader::Version,
+                sizeof(void*),
+                sizeof(Memory),
+                Memory::SegregatedLists::DataSize,
+                Memory::SegregatedLists::ListsSize,
+                #define DM_SMALL_ALLOC_DEF(_idx, _size, _num) _size, _num,
+                #include "allocator_config.h"
+                #define DM_ALLOC_DEF(_regionIdx, _num) _num,
+                #include "allocator_config.h"
+                Memory::Heap::NumRegions,
+                Memory::Heap::SmallestRegion,
+                DM_ALLOC_NUM_SUB_REGIONS,
+                DM_ALLOC_MAX_BIG_FREE_SLOTS,
+                DM_NATURAL_ALIGNMENT,
+                DM_ALLOCATOR_UNDERLYING_IMPL,
+            };
+
+            return dm::hashWy64(layout, sizeof(layout));
+        }
+
+        struct PersistentMemory : public AllocatorI
+        {
+            virtual ~PersistentMemory()
+            {
+            }
+
+            virtual void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* /*_file*/, size_t /*_line*/) override
+            {
+                if (NULL == _ptr) /// Malloc.
+                {
+                    return m_memory->alloc(_size);
+                }
+                else if (0 == _size) /// Free.
+                {
+                    m_memory->free(_ptr);
+                    return NULL;
+                }
+                else /// Realloc.
+                {
+                    return m_memory->realloc(_ptr, _size);
+                }
+            }
+
+            PersistentHeader* m_header;
+            Memory*           m_memory;
+        };
+
+        static const uint64_t s_persistentMagic   = UINT64_C(0x32504d4d44); // "DMMP2"
+        #define DM_PERSISTENT_ALIGN(_size) (((_size)+63)&~size_t(63))
+        static const size_t   s_persistentWrapper = DM_PERSISTENT_ALIGN(sizeof(PersistentHeader));
+        static const size_t   s_persistentMemory  = s_persistentWrapper + DM_PERSISTENT_ALIGN(sizeof(PersistentMemory));
+        static const size_t   s_persistentArena   = s_persistentMemory  + DM_PERSISTENT_ALIGN(sizeof(Memory));
+        #undef DM_PERSISTENT_ALIGN
+    #endif // DM_ALLOCATOR && DM_PLATFORM_POSIX
+
+    AllocatorI* allocOpenPersistent(const char* _path, void* _address, size_t _size, bool* _restored)
+    {
+        #if DM_ALLOCATOR && DM_PLATFORM_POSIX
+            const int fd = ::open(_path, O_RDWR|O_CREAT, 0644);
+            if (-1 == fd)
+            {
+                return NULL;
+            }
+
+            struct stat st;
+            if (0 != ::fstat(fd, &st))
+            {
+                ::close(fd);
+                return NULL;
+            }
+
+            const bool   existing = (0 != st.st_size);
+            const size_t size     = existing ? size_t(st.st_size) : _size;
+
+            if (size < s_persistentArena + Memory::SegregatedLists::regionSize(0) + DM_MEGABYTES(1)
+            || (!existing && 0 != ::ftruncate(fd, off_t(size))))
+            {
+                ::close(fd);
+                return NULL;
+            }
+
+            int flags = MAP_SHARED;
+            #if defined(MAP_FIXED_NOREPLACE)
+                flags |= MAP_FIXED_NOREPLACE;
+            #endif // defined(MAP_FIXED_NOREPLACE)
+            void* mem = ::mmap(_address, size, PROT_READ|PROT_WRITE, flags, fd, 0);
+            ::close(fd);
+
+            if (MAP_FAILED == mem)
+            {
+                return NULL;
+            }
+
+            if (mem != _address)
+            {
+                ::munmap(mem, size);
+                return NULL;
+            }
+
+            PersistentHeader* header     = (PersistentHeader*)mem;
+            PersistentMemory* persistent = (PersistentMemory*)((uint8_t*)mem + s_persistentWrapper);
+            Memory*           memory     = (Memory*)((uint8_t*)mem + s_persistentMemory);
+
+            if (existing)
+            {
+                if (s_persistentMagic  != header->m_magic
+                ||  persistentLayout() != header->m_layout
+                ||  size               != header->m_size
+                ||  _address           != header->m_address)
+                {
+                    ::munmap(mem, size);
+                    return NULL;
+                }
+
+                memory->restore();
+            }
+            else
+            {
+                ::new (memory) Memory();
+                memory->m_isInstance   = true;
+                memory->m_isPersistent = true;
+                memory->initRegions((uint8_t*)mem + s_persistentArena, size - s_persistentArena, 0, 0);
+
+                header->m_layout  = persistentLayout();
+                header->m_size    = size;
+                header->m_address = _address;
+                header->m_root    = NULL;
+                header->m_magic   = s_persistentMagic;
+            }
+
+            // Vtable pointer is process specific, construct the wrapper every time.
+            ::new (persistent) PersistentMemory();
+            persistent->m_header = header;
+            persistent->m_memory = memory;
+
+            if (NULL != _restored)
+            {
+                *_restored = existing;
+            }
+
+            return persistent;
+        #else
+            DM_UNUSED(_path);
+            DM_UNUSED(_address);
+            DM_UNUSED(_size);
+            DM_UNUSED(_restored);
+            return NULL;
+        #endif // DM_ALLOCATOR && DM_PLATFORM_POSIX
+    }
+
+    void allocClosePersistent(AllocatorI* _persistent)
+    {
+        #if DM_ALLOCATOR && DM_PLATFORM_POSIX
+            PersistentMemory* persistent = (PersistentMemory*)_persistent;
+            PersistentHeader* header = persistent->m_header;
+            const size_t size = size_t(header->m_size);
+
+            // Frees pushed by other threads would be lost with the mapping, the blocks leaked in the file.
+            persistent->m_memory->flushRemoteFrees();
+
+            ::msync(header, size, MS_SYNC);
+            ::munmap(header, size);
+        #else
+            DM_UNUSED(_persistent);
+        #endif // DM_ALLOCATOR && DM_PLATFORM_POSIX
+    }
+
+    void* allocPersistentRoot(AllocatorI* _persistent)
+    {
+        #if DM_ALLOCATOR && DM_PLATFORM_POSIX
+            return ((PersistentMemory*)_persistent)->m_header->m_root;
+        #else
+            DM_UNUSED(_persistent);
+            return NULL;
+        #endif // DM_ALLOCATOR && DM_PLATFORM_POSIX
+    }
+
+    void allocSetPersistentRoot(AllocatorI* _persistent, void* _root)
+    {
+        #if DM_ALLOCATOR && DM_PLATFORM_POSIX
+            ((PersistentMemory*)_persistent)->m_header->m_root = _root;
+        #else
+            DM_UNUSED(_persistent);
+            DM_UNUSED(_root);
+        #endif // DM_ALLOCATOR && DM_PLATFORM_POSIX
+    }
+
+    void allocPrefault(size_t _heapBytes, uint32_t _numThreads, bool _populate)
+    {
+        #if DM_ALLOCATOR
+            s_memory.prefault(_heapBytes, _numThreads, _populate);
+        #else
+            DM_UNUSED(_heapBytes);
+            DM_UNUSED(_numThreads);
+            DM_UNUSED(_populate);
+        #endif //DM_ALLOCATOR
+    }
+
+    AllocatorI* allocCreateInstance(size_t _size)
+    {
+        #if DM_ALLOCATOR
+            void* mem = ::calloc(1, sizeof(MemoryInstance));
+            if (NULL == mem)
+            {
+                return NULL;
+            }
+
+            MemoryInstance* instance = ::new (mem) MemoryInstance();
+            instance->m_memory.m_isInstance = true;
+            // Lists scaled to the instance, so that small instances do not carry the main arena's lists.
+            const uint8_t listsShift = Memory::SegregatedLists::shiftFor(_size);
+            if (!instance->m_memory.initArena(_size + Memory::SegregatedLists::regionSize(listsShift), 0, listsShift))
+            {
+                instance->~MemoryInstance();
+                ::free(mem);
+                return NULL;
+            }
+
+            return instance;
+        #else
+            DM_UNUSED(_size);
+            return NULL;
+        #endif //DM_ALLOCATOR
+    }
+
+    void allocReleaseInstance(AllocatorI* _instance)
+    {
+        #if DM_ALLOCATOR
+            MemoryInstance* instance = (MemoryInstance*)_instance;
+            instance->m_memory.release();
+            instance->~MemoryInstance();
+            ::free(instance);
+        #else
+            DM_UNUSED(_instance);
+        #endif //DM_ALLOCATOR
+    }
+
     #if DM_ALLOCATOR
         AllocatorI*      staticAlloc = &s_staticAllocator;
         StackAllocatorI* stackAlloc  = &s_stackAllocator;
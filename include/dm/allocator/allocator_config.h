@@ -44,13 +44,20 @@ DM_ALLOC_DEF(6,  256) // for region:  128MB
 DM_ALLOC_DEF(7,  128) // for region:  256MB
 DM_ALLOC_DEF(8,   64) // for region:  512MB
 DM_ALLOC_DEF(9,   32) // for region: 1024MB
+DM_ALLOC_DEF(10,  16) // for region:    2GB
+DM_ALLOC_DEF(11,  16) // for region:    4GB
+DM_ALLOC_DEF(12,   8) // for region:    8GB
+DM_ALLOC_DEF(13,   8) // for region:   16GB
+DM_ALLOC_DEF(14,   4) // for region:   32GB
+DM_ALLOC_DEF(15,   4) // for region:   64GB -> DM_ALLOC_BIGGEST_REGION.
 /* -> DM_ALLOC_NUM_REGIONS */
 #undef DM_ALLOC_DEF
 
 #ifdef DM_ALLOC_CONFIG
-    #define DM_ALLOC_NUM_REGIONS        10
+    #define DM_ALLOC_NUM_REGIONS        16
     #define DM_ALLOC_NUM_SUB_REGIONS    8
     #define DM_ALLOC_SMALLEST_REGION    DM_MEGABYTES(2)
+    #define DM_ALLOC_BIGGEST_REGION     (uint64_t(DM_ALLOC_SMALLEST_REGION)<<(DM_ALLOC_NUM_REGIONS-1))
     #define DM_ALLOC_MAX_BIG_FREE_SLOTS 32
 #endif // DM_ALLOC_CONFIG
 #undef DM_ALLOC_CONFIG
@@ -75,6 +82,25 @@ DM_ALLOC_DEF(9,   32) // for region: 1024MB
     #   define DM_MEM_STATIC_STORAGE_SIZE DM_MEGABYTES(64)
     #endif // DM_MEM_STATIC_STORAGE_SIZE
 
+    // Arena chunks added once the heap is full. Bigger allocations get a chunk of their size.
+    #ifndef DM_MEM_CHUNK_SIZE
+    #   define DM_MEM_CHUNK_SIZE DM_MEGABYTES(256)
+    #endif // DM_MEM_CHUNK_SIZE
+
+    #ifndef DM_MEM_MAX_CHUNKS
+    #   define DM_MEM_MAX_CHUNKS 64
+    #endif // DM_MEM_MAX_CHUNKS
+
+    // Minimal size of a chunk chained when a stack runs out of space.
+    #ifndef DM_STACK_OVERFLOW_CHUNK_SIZE
+    #   define DM_STACK_OVERFLOW_CHUNK_SIZE DM_MEGABYTES(1)
+    #endif // DM_STACK_OVERFLOW_CHUNK_SIZE
+
+    // External allocations of this size or bigger get their own memory mapping (posix only).
+    #ifndef DM_ALLOC_EXTERNAL_MAP_THRESHOLD
+    #   define DM_ALLOC_EXTERNAL_MAP_THRESHOLD DM_KILOBYTES(256)
+    #endif // DM_ALLOC_EXTERNAL_MAP_THRESHOLD
+
     // To override default preallocated memory size:
     //     #define DM_MEM_SIZE_FUNC memSizeFunc
     //     size_t memSizeFunc() { return DM_GIGABYTES(1); }
@@ -90,6 +116,53 @@ DM_ALLOC_DEF(9,   32) // for region: 1024MB
         #define DM_NATURAL_ALIGNMENT 16
     #endif //DM_NATURAL_ALIGNMENT
 
+    // Always-on per-thread allocation counters, see allocGetStats().
+    #ifndef DM_ALLOC_COUNTERS
+        #define DM_ALLOC_COUNTERS 1
+    #endif //DM_ALLOC_COUNTERS
+
+    #ifndef DM_ALLOC_COUNTERS_MAX_THREADS
+        #define DM_ALLOC_COUNTERS_MAX_THREADS 64
+    #endif //DM_ALLOC_COUNTERS_MAX_THREADS
+
+    // Per-thread caches of small blocks in the main arena, cross-thread frees go back to the owning thread without locking.
+    #ifndef DM_ALLOC_THREAD_CACHES
+        #define DM_ALLOC_THREAD_CACHES 1
+    #endif //DM_ALLOC_THREAD_CACHES
+
+    // At most 255, threads above it allocate and free through the shared lists.
+    #ifndef DM_ALLOC_THREAD_CACHE_MAX_THREADS
+        #define DM_ALLOC_THREAD_CACHE_MAX_THREADS 64
+    #endif //DM_ALLOC_THREAD_CACHE_MAX_THREADS
+
+    // Lists of bigger blocks are not cached.
+    #ifndef DM_ALLOC_THREAD_CACHE_MAX_SIZE
+        #define DM_ALLOC_THREAD_CACHE_MAX_SIZE DM_KILOBYTES(1)
+    #endif //DM_ALLOC_THREAD_CACHE_MAX_SIZE
+
+    // Number of tags available to TaggedAllocator.
+    #ifndef DM_ALLOC_MAX_TAGS
+        #define DM_ALLOC_MAX_TAGS 16
+    #endif //DM_ALLOC_MAX_TAGS
+
+    // Sampling heap profiler, see allocProfilerStart(). Costs a per-thread countdown per allocation while running.
+    #ifndef DM_ALLOC_PROFILER
+        #define DM_ALLOC_PROFILER 1
+    #endif //DM_ALLOC_PROFILER
+
+    #ifndef DM_ALLOC_PROFILER_MAX_SITES
+        #define DM_ALLOC_PROFILER_MAX_SITES 4096
+    #endif //DM_ALLOC_PROFILER_MAX_SITES
+
+    // Power of two.
+    #ifndef DM_ALLOC_PROFILER_MAX_SAMPLES
+        #define DM_ALLOC_PROFILER_MAX_SAMPLES 16384
+    #endif //DM_ALLOC_PROFILER_MAX_SAMPLES
+
+    #ifndef DM_ALLOC_PROFILER_DEPTH
+        #define DM_ALLOC_PROFILER_DEPTH 8
+    #endif //DM_ALLOC_PROFILER_DEPTH
+
     #ifndef DM_ALLOC_PRINT_STATS
         #define DM_ALLOC_PRINT_STATS 0
     #endif //DM_ALLOC_PRINT_STATS
@@ -0,0 +1,290 @@
+/*
+ * Copyright 2016 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "../dm.h"
+
+/// Header includes.
+#if (DM_INCL & DM_INCL_HEADER_INCLUDES)
+    #include <stdint.h>
+    #include <string.h> // memmove()
+    #include "../platform.h"
+    #include "../check.h"
+    #include "../misc.h"  // dm::alignSizeNext()
+    #include "../timer.h" // dm::getHPCounter()
+    #include "../mutex.h" // dm::LwMutex
+    #include "../allocatori.h"
+    #include "../datastructures/handlealloc.h"
+#endif // (DM_INCL & DM_INCL_HEADER_INCLUDES)
+
+/// Header body.
+#if (DM_INCL & DM_INCL_HEADER_BODY)
+#   if (DM_INCL & DM_INCL_HEADER_BODY_OPT_REMOVE_HEADER_GUARD)
+#       undef DM_RELOCHEAP_H_HEADER_GUARD
+#   endif // if (DM_INCL & DM_INCL_HEADER_BODY_OPT_REMOVE_HEADER_GUARD)
+#   ifndef DM_RELOCHEAP_H_HEADER_GUARD
+#   define DM_RELOCHEAP_H_HEADER_GUARD
+namespace DM_NAMESPACE
+{
+    extern CrtAllocator g_crtAllocator;
+
+    ///
+    /// Heap of relocatable allocations, accessed through handles.
+    ///
+    ///  Begin                  Dest         Scan               Top          End
+    ///    .____.___.______.______|____________|_____.______.____|____________.
+    ///    |used|pin|used  |used  |  garbage   |used |free  |used|            |
+    ///    |____|___|______|______|____________|_____|______|____|____________|
+    ///
+    /// New allocations are always placed at the top. Free blocks are only marked as free.
+    /// compact() incrementally slides unpinned blocks towards the beginning, one block per step,
+    /// until the time budget is spent. Pinned blocks are not moved, the gap in front of them is kept as a free block.
+    /// A step moves a whole block with a single memmove() under the lock, so its cost grows with the block size.
+    /// compact() can overrun its budget by one step and other calls can wait that long for the lock, keep blocks small
+    /// where that matters.
+    /// Pointer returned by pin() is valid until the matching unpin().
+    ///
+    struct RelocHeap
+    {
+        enum
+        {
+            InvalidHandle = UINT32_MAX,
+            Alignment     = 16,
+        };
+
+        RelocHeap()
+        {
+            m_mem = NULL;
+            m_entries = NULL;
+        }
+
+        ~RelocHeap()
+        {
+            destroy();
+        }
+
+        void init(size_t _size, uint32_t _maxHandles, AllocatorI* _allocator = &g_crtAllocator)
+        {
+            m_allocator = _allocator;
+            m_size      = dm::alignSizePrev(_size, Alignment);
+            m_mem       = (uint8_t*)DM_ALIGNED_ALLOC(_allocator, m_size, Alignment);
+            m_entries   = (Entry*)DM_ALLOC(_allocator, _maxHandles*sizeof(Entry));
+            m_handles.init(_maxHandles, _allocator);
+
+            m_top  = 0;
+            m_used = 0;
+            m_scan = 0;
+            m_dest = 0;
+        }
+
+        void destroy()
+        {
+            if (NULL != m_mem)
+            {
+                DM_ALIGNED_FREE(m_allocator, m_mem, Alignment);
+                DM_FREE(m_allocator, m_entries);
+                m_handles.destroy();
+                m_mem = NULL;
+                m_entries = NULL;
+            }
+        }
+
+        uint32_t alloc(size_t _size)
+        {
+            LwMutexScope lock(m_mutex);
+
+            if (m_handles.count() >= m_handles.max())
+            {
+                return InvalidHandle;
+            }
+
+            const uint64_t totalSize = sizeof(BlockHeader) + dm::alignSizeNext(_size, Alignment);
+
+            // Compact synchronously if there is no room at the top.
+            for (uint8_t pass = 0; pass < 2 && (m_top + totalSize) > m_size; ++pass)
+            {
+                while (!compactStep()) {}
+            }
+
+            if ((m_top + totalSize) > m_size)
+            {
+                return InvalidHandle;
+            }
+
+            const uint32_t handle = m_handles.alloc();
+
+            BlockHeader* header = blockAt(m_top);
+            header->m_handle = handle;
+            header->m_size   = totalSize;
+
+            m_entries[handle].m_offset = m_top + sizeof(BlockHeader);
+            m_entries[handle].m_size   = _size;
+            m_entries[handle].m_pins   = 0;
+
+            m_top  += totalSize;
+            m_used += totalSize;
+
+            return handle;
+        }
+
+        void free(uint32_t _handle)
+        {
+            LwMutexScope lock(m_mutex);
+
+            DM_CHECK(m_handles.contains(_handle), "RelocHeap::free() | Invalid handle %d", _handle);
+            DM_CHECK(0 == m_entries[_handle].m_pins, "RelocHeap::free() | Freeing pinned allocation %d", _handle);
+
+            BlockHeader* header = blockAt(m_entries[_handle].m_offset - sizeof(BlockHeader));
+            header->m_handle = InvalidHandle;
+            m_used -= header->m_size;
+
+            m_handles.free(_handle);
+        }
+
+        void* pin(uint32_t _handle)
+        {
+            LwMutexScope lock(m_mutex);
+
+            DM_CHECK(m_handles.contains(_handle), "RelocHeap::pin() | Invalid handle %d", _handle);
+
+            Entry& entry = m_entries[_handle];
+            entry.m_pins++;
+
+            return m_mem + entry.m_offset;
+        }
+
+        void unpin(uint32_t _handle)
+        {
+            LwMutexScope lock(m_mutex);
+
+            DM_CHECK(0 < m_entries[_handle].m_pins, "RelocHeap::unpin() | Allocation %d is not pinned", _handle);
+
+            m_entries[_handle].m_pins--;
+        }
+
+        size_t sizeOf(uint32_t _handle)
+        {
+            return size_t(m_entries[_handle].m_size);
+        }
+
+        /// Runs compaction steps until '_budgetUs' microseconds pass.
+        /// Returns true if a full pass was completed.
+        bool compact(int64_t _budgetUs)
+        {
+            const int64_t end = dm::getHPCounter() + _budgetUs*dm::getHPFrequency()/INT64_C(1000000);
+            do
+            {
+                LwMutexScope lock(m_mutex);
+                if (compactStep())
+                {
+                    return true;
+                }
+            } while (dm::getHPCounter() < end);
+
+            return false;
+        }
+
+        size_t used() const
+        {
+            return size_t(m_used);
+        }
+
+        size_t available() const
+        {
+            return size_t(m_size - m_used);
+        }
+
+        /// Bytes that can be reclaimed by compaction.
+        size_t fragmented() const
+        {
+            return size_t(m_top - m_used);
+        }
+
+    private:
+        struct BlockHeader
+        {
+            uint32_t m_handle;
+            uint32_t m_reserved;
+            uint64_t m_size; // Including header.
+        };
+
+        struct Entry
+        {
+            uint64_t m_offset;
+            uint64_t m_size;
+            uint32_t m_pins;
+        };
+
+        BlockHeader* blockAt(uint64_t _offset)
+        {
+            return (BlockHeader*)(m_mem + _offset);
+        }
+
+        /// Processes a single block, moving it in one go. Returns true when a pass is completed. Expects m_mutex to be held.
+        bool compactStep()
+        {
+            if (m_scan >= m_top)
+            {
+                m_top  = m_dest;
+                m_scan = 0;
+                m_dest = 0;
+
+                return true;
+            }
+
+            BlockHeader* header = blockAt(m_scan);
+            const uint64_t size = header->m_size;
+
+            if (InvalidHandle == header->m_handle)
+            {
+                // Free block, becomes part of the garbage.
+                m_scan += size;
+            }
+            else if (0 != m_entries[header->m_handle].m_pins)
+            {
+                // Pinned block, keep garbage in front of it as a free block.
+                if (m_dest != m_scan)
+                {
+                    BlockHeader* gap = blockAt(m_dest);
+                    gap->m_handle = InvalidHandle;
+                    gap->m_size   = m_scan - m_dest;
+                }
+
+                m_scan += size;
+                m_dest  = m_scan;
+            }
+            else
+            {
+                // Slide block down.
+                if (m_dest != m_scan)
+                {
+                    const uint32_t handle = header->m_handle;
+                    memmove(blockAt(m_dest), header, size_t(size));
+                    m_entries[handle].m_offset = m_dest + sizeof(BlockHeader);
+                }
+
+                m_scan += size;
+                m_dest += size;
+            }
+
+            return false;
+        }
+
+        LwMutex  m_mutex;
+        uint8_t* m_mem;
+        uint64_t m_size;
+        uint64_t m_top;
+        uint64_t m_used;
+        uint64_t m_scan;
+        uint64_t m_dest;
+        Entry*   m_entries;
+        HandleAlloc<uint32_t> m_handles;
+        AllocatorI* m_allocator;
+    };
+
+} // namespace DM_NAMESPACE
+#   endif // DM_RELOCHEAP_H_HEADER_GUARD
+#endif // (DM_INCL & DM_INCL_HEADER_BODY)
+
+/* vim: set sw=4 ts=4 expandtab: */
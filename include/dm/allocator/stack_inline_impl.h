@@ -10,16 +10,14 @@ void* alloc(size_t _size)
     uint8_t* curr = getStackPtr();
 
     // Determine required space for header.
-    const uint8_t* aligned    = (uint8_t*)dm::alignPtrNext(curr, DM_NATURAL_ALIGNMENT);
-    const uint8_t  spaceAvail = uint8_t(aligned-curr);
-    const uint8_t  headerSize = spaceAvail < Header ? uint8_t(HeaderAligned) : spaceAvail;
+    const uint8_t headerSize = headerSizeFor(curr);
 
     // Check for availability.
     const int64_t advance = _size + headerSize;
     if (advance > available())
     {
         DM_PRINT_STACK("Stack alloc: Stack full. Requested: %llu.%lluMB Available: %llu.%llu", dm::U_UMB(_size), dm::U_UMB(available()));
-        return NULL;
+        return overflowAlloc(_size);
     }
 
     // Advance stack.
@@ -49,27 +47,40 @@ void* realloc(void* _ptr, size_t _size)
         const size_t allocSize = readSize(_ptr);
         const int64_t diff = int64_t(_size - allocSize);
 
+        // Last allocation is either on the stack or in the current overflow chunk.
+        const bool inChunk = (NULL != m_chunk && chunkContains(m_chunk, _ptr));
+        const int64_t avail = inChunk ? int64_t(m_chunk->m_end - m_chunk->m_ptr) : available();
+
         // Check availability.
-        if (diff > available())
+        if (diff <= avail)
         {
-            DM_PRINT_STACK("Stack realloc: Stack full. Realloc requested: %llu.%lluMB Available: %llu.%llu", dm::U_UMB(diff), dm::U_UMB(available()));
-            return NULL;
+            // Reposition stack.
+            if (inChunk)
+            {
+                m_chunk->m_ptr += diff;
+            }
+            else
+            {
+                adjustStackPtr(diff);
+            }
+
+            // Write new size.
+            writeSize(_ptr, _size);
+
+            DM_PRINT_STACK("Stack realloc: %llu.%lluMB / %llu.%lluMB - (0x%p - 0x%p)", dm::U_UMB(diff), dm::U_UMB(available()), m_last, getStackPtr());
+
+            return _ptr;
         }
 
-        // Reposition stack.
-        adjustStackPtr(diff);
-
-        // Write new size.
-        writeSize(_ptr, _size);
-
-        DM_PRINT_STACK("Stack realloc: %llu.%lluMB / %llu.%lluMB - (0x%p - 0x%p)", dm::U_UMB(diff), dm::U_UMB(available()), m_last, getStackPtr());
-
-        return _ptr;
+        DM_PRINT_STACK("Stack realloc: Stack full. Realloc requested: %llu.%lluMB Available: %llu.%llu", dm::U_UMB(diff), dm::U_UMB(avail));
     }
-    else if (this->contains(_ptr))
+    else
     {
         DM_PRINT_STACK("Stack realloc: Called on a pointer other than the last one! (0x%p).", _ptr);
+    }
 
+    if (this->contains(_ptr))
+    {
         // Make a new allocation on the stack.
         void* newPtr = this->alloc(_size);
         if (NULL == newPtr)
@@ -80,7 +91,7 @@ void* realloc(void* _ptr, size_t _size)
 
         // Copy data.
         const size_t oldSize = readSize(_ptr);
-        memcpy(newPtr, _ptr, oldSize);
+        memcpy(newPtr, _ptr, dm::min(oldSize, _size));
 
         return newPtr;
     }
@@ -96,6 +107,8 @@ void push()
 {
     DM_CHECK(m_currFrame < MaxFrames, "Stack::push | Max stack allocations reached!");
 
+    m_frameChunk[m_currFrame]    = m_chunk;
+    m_frameChunkPtr[m_currFrame] = (NULL != m_chunk) ? m_chunk->m_ptr : NULL;
     m_frames[m_currFrame++] = getStackPtr();
     m_last = getStackPtr();
 
@@ -110,6 +123,7 @@ void pop()
     {
         --m_currFrame;
         setStackPtr((uint8_t*)m_frames[m_currFrame]);
+        releaseChunks(m_frameChunk[m_currFrame], m_frameChunkPtr[m_currFrame]);
         m_last = getStackPtr();
 
         DM_PRINT_STACK("Stack pop:  %d < \t %llu.%lluMB", m_currFrame, dm::U_UMB(available()));
@@ -118,7 +132,36 @@ void pop()
 
 bool contains(void* _ptr) const
 {
-    return (m_beg <= _ptr && _ptr < getStackPtr());
+    if (m_beg <= _ptr && _ptr < getStackPtr())
+    {
+        return true;
+    }
+
+    // Pointers outside of the overflow chunks bounds, heap pointers included, are rejected without walking the chunks.
+    if (NULL == m_chunk
+    ||  _ptr <  m_chunksBeg
+    ||  _ptr >= m_chunksEnd)
+    {
+        return false;
+    }
+
+    for (const Chunk* chunk = m_chunk; NULL != chunk; chunk = chunk->m_prev)
+    {
+        if (chunkContains(chunk, _ptr))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// Overflow chunks are taken from this allocator once the stack is full.
+/// They are released when the frame that caused them is popped.
+/// With no allocator set, alloc() returns NULL when the stack is full.
+void setOverflowAllocator(dm::AllocatorI* _allocator)
+{
+    m_overflowAlloc = _allocator;
 }
 
 size_t getSize(void* _ptr) const
@@ -150,8 +193,9 @@ size_t total()
 void printStats()
 {
     const size_t size = getStackPtr() - m_beg;
+
     printf("Stack:\n");
-    printf("\tPosition: %d, Size: %llu.%lluMB\n\n", m_currFrame, dm::U_UMB(size));
+    printf("\tPosition: %d, Size: %llu.%lluMB, Overflow chunks: %u\n\n", m_currFrame, dm::U_UMB(size), m_numChunks);
 }
 #endif //DM_ALLOC_PRINT_STATS
 
@@ -167,6 +211,131 @@ void init()
     m_last = getStackPtr();
     m_beg  = getStackPtr();
     m_currFrame = 0;
+    m_chunk = NULL;
+    m_chunksBeg = NULL;
+    m_chunksEnd = NULL;
+    m_numChunks = 0;
+    m_overflowAlloc = NULL;
+}
+
+struct Chunk
+{
+    Chunk*   m_prev;
+    uint8_t* m_ptr;
+    uint8_t* m_end;
+};
+
+static inline uint8_t headerSizeFor(uint8_t* _curr)
+{
+    const uint8_t* aligned    = (uint8_t*)dm::alignPtrNext(_curr, DM_NATURAL_ALIGNMENT);
+    const uint8_t  spaceAvail = uint8_t(aligned-_curr);
+    const uint8_t  headerSize = spaceAvail < Header ? uint8_t(HeaderAligned) : spaceAvail;
+
+    return headerSize;
+}
+
+static inline bool chunkContains(const Chunk* _chunk, void* _ptr)
+{
+    return ((uint8_t*)(_chunk+1) <= _ptr && _ptr < _chunk->m_ptr);
+}
+
+static void* chunkAlloc(Chunk* _chunk, size_t _size)
+{
+    const uint8_t headerSize = headerSizeFor(_chunk->m_ptr);
+    const int64_t advance = _size + headerSize;
+    if (advance > int64_t(_chunk->m_end - _chunk->m_ptr))
+    {
+        return NULL;
+    }
+
+    void* ptr = _chunk->m_ptr + headerSize;
+    writeSize(ptr, _size);
+    _chunk->m_ptr += advance;
+
+    return ptr;
+}
+
+void* overflowAlloc(size_t _size)
+{
+    // Try current chunk.
+    if (NULL != m_chunk)
+    {
+        void* ptr = chunkAlloc(m_chunk, _size);
+        if (NULL != ptr)
+        {
+            m_last = ptr;
+            return ptr;
+        }
+    }
+
+    if (NULL == m_overflowAlloc)
+    {
+        return NULL;
+    }
+
+    // Chain a new chunk.
+    const size_t required  = sizeof(Chunk) + HeaderAligned + DM_NATURAL_ALIGNMENT + _size;
+    const size_t chunkSize = DM_MAX(required, size_t(DM_STACK_OVERFLOW_CHUNK_SIZE));
+    Chunk* chunk = (Chunk*)DM_ALLOC(m_overflowAlloc, chunkSize);
+    if (NULL == chunk)
+    {
+        return NULL;
+    }
+
+    chunk->m_prev = m_chunk;
+    chunk->m_ptr  = (uint8_t*)(chunk+1);
+    chunk->m_end  = (uint8_t*)chunk + chunkSize;
+    m_chunk = chunk;
+    m_numChunks++;
+    updateChunksBounds();
+
+    void* ptr = chunkAlloc(chunk, _size);
+    m_last = ptr;
+
+    DM_PRINT_STACK("Stack overflow chunk: %llu.%lluMB - (0x%p)", dm::U_UMB(chunkSize), chunk);
+
+    return ptr;
+}
+
+void releaseChunks(Chunk* _chunk, uint8_t* _chunkPtr)
+{
+    if (m_chunk != _chunk)
+    {
+        while (m_chunk != _chunk)
+        {
+            Chunk* prev = m_chunk->m_prev;
+            DM_FREE(m_overflowAlloc, m_chunk);
+            m_chunk = prev;
+            m_numChunks--;
+        }
+
+        updateChunksBounds();
+    }
+
+    if (NULL != m_chunk)
+    {
+        m_chunk->m_ptr = _chunkPtr;
+    }
+}
+
+/// Bounds of all live chunks, for contains(). Walks the chunks, called only when they are added or released.
+void updateChunksBounds()
+{
+    m_chunksBeg = NULL;
+    m_chunksEnd = NULL;
+
+    for (const Chunk* chunk = m_chunk; NULL != chunk; chunk = chunk->m_prev)
+    {
+        if (NULL == m_chunksBeg || (uint8_t*)chunk < m_chunksBeg)
+        {
+            m_chunksBeg = (uint8_t*)chunk;
+        }
+
+        if (chunk->m_end > m_chunksEnd)
+        {
+            m_chunksEnd = chunk->m_end;
+        }
+    }
 }
 
 static inline void writeSize(void* _ptr, size_t _size)
@@ -187,5 +356,12 @@ void*     m_last;
 uint8_t*  m_beg;
 uint16_t  m_currFrame;
 void*     m_frames[MaxFrames];
+Chunk*    m_frameChunk[MaxFrames];
+uint8_t*  m_frameChunkPtr[MaxFrames];
+Chunk*    m_chunk;
+uint8_t*  m_chunksBeg;
+uint8_t*  m_chunksEnd;
+uint32_t  m_numChunks;
+dm::AllocatorI* m_overflowAlloc;
 
 /* vim: set sw=4 ts=4 expandtab: */
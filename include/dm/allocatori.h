@@ -185,6 +185,88 @@ namespace DM_NAMESPACE
     extern CrtCallocator     g_crtCallocator;
     extern CrtStackAllocator g_crtStackAllocator;
 
+    ///
+    /// Allocator policies, for containers that bind the allocator at compile time.
+    /// Container storage inherits the policy, so calls are resolved statically and stateless policies take no space.
+    ///
+    /// Expected interface:
+    ///
+    ///     struct AllocPolicy
+    ///     {
+    ///         void* realloc(void* _ptr, size_t _size, size_t _align, const char* _file, size_t _line); // Same as AllocatorI, works with DM_ALLOC() and friends.
+    ///         void bind(AllocatorI* _allocator); // Allocator passed to init(), ignored by stateless policies.
+    ///     };
+    ///
+
+    /// Stateful, forwards to the allocator passed to init(). Default for all containers.
+    struct AllocatorIPolicy
+    {
+        AllocatorIPolicy()
+        {
+            m_allocator = NULL;
+        }
+
+        DM_INLINE void* realloc(void* _ptr, size_t _size, size_t _align, const char* _file, size_t _line)
+        {
+            return m_allocator->realloc(_ptr, _size, _align, _file, _line);
+        }
+
+        DM_INLINE void bind(AllocatorI* _allocator)
+        {
+            m_allocator = _allocator;
+        }
+
+        AllocatorI* m_allocator;
+    };
+
+    struct CrtAllocPolicy
+    {
+        DM_INLINE void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* /*_file*/, size_t /*_line*/)
+        {
+            if (0 == _ptr)
+            {
+                return ::malloc(_size);
+            }
+            else if (0 == _size)
+            {
+                ::free(_ptr);
+                return NULL;
+            }
+            else
+            {
+                return ::realloc(_ptr, _size);
+            }
+        }
+
+        DM_INLINE void bind(AllocatorI* /*_allocator*/)
+        {
+        }
+    };
+
+    struct CrtCallocPolicy
+    {
+        DM_INLINE void* realloc(void* _ptr, size_t _size, size_t /*_align*/, const char* /*_file*/, size_t /*_line*/)
+        {
+            if (0 == _ptr)
+            {
+                return ::calloc(1, _size);
+            }
+            else if (0 == _size)
+            {
+                ::free(_ptr);
+                return NULL;
+            }
+            else
+            {
+                return ::realloc(_ptr, _size);
+            }
+        }
+
+        DM_INLINE void bind(AllocatorI* /*_allocator*/)
+        {
+        }
+    };
+
 } // namespace DM_NAMESPACE
 #   endif // DM_ALLOCATORI_H_HEADER_GUARD
 #endif // (DM_INCL & DM_INCL_HEADER_BODY)
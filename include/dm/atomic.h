@@ -0,0 +1,211 @@
+/*
+ * Copyright 2016 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+/*
+ * Adapted from: https://github.com/bkaradzic/bx/include/bx/cpu.h
+ * Copyright 2010-2016 Branimir Karadzic. All rights reserved.
+ * License: https://github.com/bkaradzic/bx#license-bsd-2-clause
+ */
+
+#include "dm.h"
+
+/// Header includes.
+#if (DM_INCL & DM_INCL_HEADER_INCLUDES)
+    #include <stdint.h>
+    #include "platform.h"
+
+    #if DM_COMPILER_MSVC
+    #   include <intrin.h>
+    #   pragma intrinsic(_ReadBarrier)
+    #   pragma intrinsic(_WriteBarrier)
+    #   pragma intrinsic(_ReadWriteBarrier)
+    #   pragma intrinsic(_InterlockedExchangeAdd)
+    #   pragma intrinsic(_InterlockedCompareExchange)
+    #   if DM_ARCH_64BIT
+    #       pragma intrinsic(_InterlockedExchangeAdd64)
+    #   endif // DM_ARCH_64BIT
+    #endif // DM_COMPILER_MSVC
+#endif // (DM_INCL & DM_INCL_HEADER_INCLUDES)
+
+/// Header body.
+#if (DM_INCL & DM_INCL_HEADER_BODY)
+#   if (DM_INCL & DM_INCL_HEADER_BODY_OPT_REMOVE_HEADER_GUARD)
+#       undef DM_ATOMIC_H_HEADER_GUARD
+#   endif // if (DM_INCL & DM_INCL_HEADER_BODY_OPT_REMOVE_HEADER_GUARD)
+#   ifndef DM_ATOMIC_H_HEADER_GUARD
+#   define DM_ATOMIC_H_HEADER_GUARD
+namespace DM_NAMESPACE
+{
+    DM_INLINE void readBarrier()
+    {
+        #if DM_COMPILER_MSVC
+            _ReadBarrier();
+        #else
+            asm volatile("":::"memory");
+        #endif // DM_COMPILER_MSVC
+    }
+
+    DM_INLINE void writeBarrier()
+    {
+        #if DM_COMPILER_MSVC
+            _WriteBarrier();
+        #else
+            asm volatile("":::"memory");
+        #endif // DM_COMPILER_MSVC
+    }
+
+    DM_INLINE void readWriteBarrier()
+    {
+        #if DM_COMPILER_MSVC
+            _ReadWriteBarrier();
+        #else
+            asm volatile("":::"memory");
+        #endif // DM_COMPILER_MSVC
+    }
+
+    DM_INLINE void memoryBarrier()
+    {
+        #if DM_COMPILER_MSVC
+            _mm_mfence();
+        #else
+            __sync_synchronize();
+        #endif // DM_COMPILER_MSVC
+    }
+
+    DM_INLINE int32_t atomicFetchAndAdd(volatile int32_t* _ptr, int32_t _add)
+    {
+        #if DM_COMPILER_MSVC
+            return _InterlockedExchangeAdd((volatile long*)_ptr, _add);
+        #else
+            return __sync_fetch_and_add(_ptr, _add);
+        #endif // DM_COMPILER_MSVC
+    }
+
+    DM_INLINE uint32_t atomicFetchAndAdd(volatile uint32_t* _ptr, uint32_t _add)
+    {
+        return uint32_t(atomicFetchAndAdd((volatile int32_t*)_ptr, int32_t(_add)));
+    }
+
+    DM_INLINE int64_t atomicFetchAndAdd(volatile int64_t* _ptr, int64_t _add)
+    {
+        #if DM_COMPILER_MSVC
+            #if DM_ARCH_64BIT
+                return _InterlockedExchangeAdd64(_ptr, _add);
+            #else
+                int64_t oldVal;
+                int64_t newVal = *(int64_t volatile*)_ptr;
+                do
+                {
+                    oldVal = newVal;
+                    newVal = _InterlockedCompareExchange64(_ptr, oldVal + _add, oldVal);
+                } while (oldVal != newVal);
+                return oldVal;
+            #endif // DM_ARCH_64BIT
+        #else
+            return __sync_fetch_and_add(_ptr, _add);
+        #endif // DM_COMPILER_MSVC
+    }
+
+    DM_INLINE uint64_t atomicFetchAndAdd(volatile uint64_t* _ptr, uint64_t _add)
+    {
+        return uint64_t(atomicFetchAndAdd((volatile int64_t*)_ptr, int64_t(_add)));
+    }
+
+    template <typename Ty>
+    DM_INLINE Ty atomicAddAndFetch(volatile Ty* _ptr, Ty _add)
+    {
+        return atomicFetchAndAdd(_ptr, _add) + _add;
+    }
+
+    template <typename Ty>
+    DM_INLINE Ty atomicSubAndFetch(volatile Ty* _ptr, Ty _sub)
+    {
+        return atomicFetchAndAdd(_ptr, Ty(0)-_sub) - _sub;
+    }
+
+    /// Load that later loads and stores are not moved before. Pairs with atomicStoreRelease().
+    DM_INLINE uint32_t atomicLoadAcquire(const volatile uint32_t* _ptr)
+    {
+        #if DM_COMPILER_MSVC
+            const uint32_t val = *_ptr;
+            _ReadWriteBarrier();
+            return val;
+        #else
+            return __atomic_load_n(_ptr, __ATOMIC_ACQUIRE);
+        #endif // DM_COMPILER_MSVC
+    }
+
+    /// Store that earlier loads and stores are not moved after.
+    DM_INLINE void atomicStoreRelease(volatile uint32_t* _ptr, uint32_t _val)
+    {
+        #if DM_COMPILER_MSVC
+            _ReadWriteBarrier();
+            *_ptr = _val;
+        #else
+            __atomic_store_n(_ptr, _val, __ATOMIC_RELEASE);
+        #endif // DM_COMPILER_MSVC
+    }
+
+    DM_INLINE void* atomicLoadAcquirePtr(void* const volatile* _ptr)
+    {
+        #if DM_COMPILER_MSVC
+            void* val = *_ptr;
+            _ReadWriteBarrier();
+            return val;
+        #else
+            return __atomic_load_n(_ptr, __ATOMIC_ACQUIRE);
+        #endif // DM_COMPILER_MSVC
+    }
+
+    DM_INLINE void atomicStoreReleasePtr(void* volatile* _ptr, void* _val)
+    {
+        #if DM_COMPILER_MSVC
+            _ReadWriteBarrier();
+            *_ptr = _val;
+        #else
+            __atomic_store_n(_ptr, _val, __ATOMIC_RELEASE);
+        #endif // DM_COMPILER_MSVC
+    }
+
+    /// Returns the value stored at '_ptr' before the operation.
+    DM_INLINE int32_t atomicCompareAndSwap(volatile int32_t* _ptr, int32_t _old, int32_t _new)
+    {
+        #if DM_COMPILER_MSVC
+            return _InterlockedCompareExchange((volatile long*)_ptr, _new, _old);
+        #else
+            return __sync_val_compare_and_swap(_ptr, _old, _new);
+        #endif // DM_COMPILER_MSVC
+    }
+
+    DM_INLINE uint32_t atomicCompareAndSwap(volatile uint32_t* _ptr, uint32_t _old, uint32_t _new)
+    {
+        return uint32_t(atomicCompareAndSwap((volatile int32_t*)_ptr, int32_t(_old), int32_t(_new)));
+    }
+
+    /// Returns the value stored at '_ptr' before the operation.
+    DM_INLINE void* atomicCompareAndSwapPtr(void* volatile* _ptr, void* _old, void* _new)
+    {
+        #if DM_COMPILER_MSVC
+            return _InterlockedCompareExchangePointer(_ptr, _new, _old);
+        #else
+            return __sync_val_compare_and_swap(_ptr, _old, _new);
+        #endif // DM_COMPILER_MSVC
+    }
+
+    /// Returns the value stored at '_ptr' before the operation.
+    DM_INLINE void* atomicExchangePtr(void* volatile* _ptr, void* _new)
+    {
+        #if DM_COMPILER_MSVC
+            return _InterlockedExchangePointer(_ptr, _new);
+        #else
+            return __atomic_exchange_n(_ptr, _new, __ATOMIC_SEQ_CST);
+        #endif // DM_COMPILER_MSVC
+    }
+
+} // namespace DM_NAMESPACE
+#   endif // DM_ATOMIC_H_HEADER_GUARD
+#endif // (DM_INCL & DM_INCL_HEADER_BODY)
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -436,8 +436,9 @@ namespace DM_NAMESPACE
 
     extern CrtAllocator g_crtAllocator;
 
-    template <typename Ty>
-    struct ArrayStorage
+    /// Allocator is bound at compile time through 'AllocPolicyTy', see allocatori.h.
+    template <typename Ty, typename AllocPolicyTy = AllocatorIPolicy>
+    struct ArrayStorage : AllocPolicyTy
     {
         typedef Ty ElementType;
 
@@ -459,17 +460,16 @@ namespace DM_NAMESPACE
 
         void init(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
-            m_elements = (Ty*)DM_ALLOC(_allocator, _max*sizeof(Ty));
+            AllocPolicyTy::bind(_allocator);
+            m_elements = (Ty*)DM_ALLOC(this, _max*sizeof(Ty));
             m_max = _max;
-            m_allocator = _allocator;
         }
 
         void destroy()
         {
-            if (NULL != m_elements
-            &&  NULL != m_allocator)
+            if (NULL != m_elements)
             {
-                DM_FREE(m_allocator, m_elements);
+                DM_FREE(this, m_elements);
                 m_elements = NULL;
             }
         }
@@ -486,7 +486,7 @@ namespace DM_NAMESPACE
 
         bool resize(uint32_t _max)
         {
-            m_elements = (Ty*)DM_REALLOC(m_allocator, m_elements, _max*sizeof(Ty));
+            m_elements = (Ty*)DM_REALLOC(this, m_elements, _max*sizeof(Ty));
             m_max = _max;
 
             return true;
@@ -509,17 +509,16 @@ namespace DM_NAMESPACE
 
         Ty* m_elements;
         uint32_t m_max;
-        AllocatorI* m_allocator;
     };
 
     template <typename Ty, uint32_t MaxTy> struct ArrayT   : ArrayImpl< ArrayStorageT<Ty, MaxTy> > { };
     template <typename Ty>                 struct ArrayExt : ArrayImpl< ArrayStorageExt<Ty>      > { };
-    template <typename Ty>                 struct Array    : ArrayImpl< ArrayStorage<Ty>         > { };
+    template <typename Ty, typename AllocPolicyTy = AllocatorIPolicy> struct Array : ArrayImpl< ArrayStorage<Ty, AllocPolicyTy> > { };
     template <typename Ty>                 struct ArrayH   : ArrayExt<Ty> { AllocatorI* m_allocator; };
 
     template <typename Ty, uint32_t MaxTy> struct ObjArrayT   : ObjArrayImpl< ArrayStorageT<Ty, MaxTy> > { };
     template <typename Ty>                 struct ObjArrayExt : ObjArrayImpl< ArrayStorageExt<Ty>      > { };
-    template <typename Ty>                 struct ObjArray    : ObjArrayImpl< ArrayStorage<Ty>         > { };
+    template <typename Ty, typename AllocPolicyTy = AllocatorIPolicy> struct ObjArray : ObjArrayImpl< ArrayStorage<Ty, AllocPolicyTy> > { };
     template <typename Ty>                 struct ObjArrayH   : ObjArrayExt<Ty> { AllocatorI* m_allocator; };
 
 } // namespace DM_NAMESPACE
@@ -422,7 +422,9 @@ namespace DM_NAMESPACE
 
     extern CrtAllocator g_crtAllocator;
 
-    struct BitArrayStorage
+    /// Allocator is bound at compile time through 'AllocPolicyTy', see allocatori.h.
+    template <typename AllocPolicyTy>
+    struct BitArrayStorageA : AllocPolicyTy
     {
         static inline uint32_t numSlotsFor(uint32_t _max)
         {
@@ -434,29 +436,33 @@ namespace DM_NAMESPACE
             return numSlotsFor(_max)*sizeof(uint64_t);
         }
 
-        BitArrayStorage()
+        BitArrayStorageA()
         {
             m_bits = NULL;
             m_numSlots = 0;
             m_max = 0;
         }
 
+        ~BitArrayStorageA()
+        {
+            destroy();
+        }
+
         void init(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
-            void* mem = DM_ALLOC(_allocator, sizeFor(_max));
+            AllocPolicyTy::bind(_allocator);
+            void* mem = DM_ALLOC(this, sizeFor(_max));
 
             m_bits = (uint64_t*)mem;
             m_numSlots = numSlotsFor(_max);
             m_max = _max;
-
-            m_allocator = _allocator;
         }
 
         void destroy()
         {
             if (NULL != m_bits)
             {
-                DM_FREE(m_allocator, m_bits);
+                DM_FREE(this, m_bits);
                 m_bits = NULL;
             }
         }
@@ -479,9 +485,10 @@ namespace DM_NAMESPACE
         uint64_t* m_bits;
         uint32_t m_numSlots;
         uint32_t m_max;
-        AllocatorI* m_allocator;
     };
 
+    typedef BitArrayStorageA<AllocatorIPolicy> BitArrayStorage;
+
     template <uint32_t MaxTy>
     struct BitArrayT : BitArrayImpl<BitArrayStorageT<MaxTy> >
     {
@@ -506,9 +513,10 @@ namespace DM_NAMESPACE
         }
     };
 
-    struct BitArray : BitArrayImpl<BitArrayStorage>
+    template <typename AllocPolicyTy>
+    struct BitArrayA : BitArrayImpl< BitArrayStorageA<AllocPolicyTy> >
     {
-        typedef BitArrayImpl<BitArrayStorage> Base;
+        typedef BitArrayImpl< BitArrayStorageA<AllocPolicyTy> > Base;
 
         void init(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
@@ -517,6 +525,8 @@ namespace DM_NAMESPACE
         }
     };
 
+    struct BitArray : BitArrayA<AllocatorIPolicy> { };
+
     struct BitArrayH : BitArrayExt
     {
         AllocatorI* m_allocator;
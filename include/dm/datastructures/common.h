@@ -24,7 +24,7 @@ namespace DM_NAMESPACE
     template <typename DataStructureH>
     DM_INLINE DataStructureH* create(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
     {
-        uint8_t* ptr = (uint8_t*)DM_ALLOC(sizeof(DataStructureH) + DataStructureH::sizeFor(_max), _allocator);
+        uint8_t* ptr = (uint8_t*)DM_ALLOC(_allocator, sizeof(DataStructureH) + DataStructureH::sizeFor(_max));
 
         DataStructureH* dsb = ::new (ptr) DataStructureH();
         dsb->init(_max, ptr + sizeof(DataStructureH));
@@ -38,7 +38,7 @@ namespace DM_NAMESPACE
     {
         AllocatorI* allocator = _dsb->m_allocator;
         _dsb->~DataStructureH();
-        DM_FREE(_allocator, _dsb);
+        DM_FREE(allocator, _dsb);
     }
 } // namespace DM_NAMESPACE
 #   endif // DM_DATASTRUCTURES_COMMON_H_HEADER_GUARD
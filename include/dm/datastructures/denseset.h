@@ -210,8 +210,8 @@ namespace DM_NAMESPACE
 
     extern CrtCallocator g_crtCallocator;
 
-    template <typename ElemTy>
-    struct DenseSetStorage
+    template <typename ElemTy, typename AllocPolicyTy = AllocatorIPolicy>
+    struct DenseSetStorage : AllocPolicyTy
     {
         typedef ElemTy ElementType;
 
@@ -239,21 +239,21 @@ namespace DM_NAMESPACE
 
         void init(uint32_t _max, AllocatorI* _allocator = &g_crtCallocator)
         {
+            AllocPolicyTy::bind(_allocator);
+
             const uint32_t haSize = _max*sizeof(ElemTy);
-            void* mem = DM_ALLOC(_allocator, 2*haSize);
+            void* mem = DM_ALLOC(this, 2*haSize);
 
             m_max = _max;
             m_dense = (ElemTy*)mem;
             m_sparse = (ElemTy*)((uint8_t*)mem + haSize);
-
-            m_allocator = _allocator;
         }
 
         void destroy()
         {
             if (NULL != m_dense)
             {
-                DM_FREE(m_allocator, m_dense);
+                DM_FREE(this, m_dense);
                 m_dense = NULL;
                 m_sparse = NULL;
             }
@@ -278,13 +278,12 @@ namespace DM_NAMESPACE
         uint32_t m_max;
         ElemTy* m_dense;
         ElemTy* m_sparse;
-        AllocatorI* m_allocator;
     };
 
     template <uint32_t MaxT>                  struct DenseSetT   : DenseSetImpl< DenseSetStorageT<typename dm::bestfit_type<MaxT>::type, MaxT> > { };
     template <typename ElemTy, uint32_t MaxT> struct DenseSetTy  : DenseSetImpl< DenseSetStorageT<ElemTy, MaxT> > { };
     template <typename ElemTy>                struct DenseSetExt : DenseSetImpl< DenseSetStorageExt<ElemTy> > { };
-    template <typename ElemTy>                struct DenseSet    : DenseSetImpl< DenseSetStorage<ElemTy> > { };
+    template <typename ElemTy, typename AllocPolicyTy = AllocatorIPolicy> struct DenseSet : DenseSetImpl< DenseSetStorage<ElemTy, AllocPolicyTy> > { };
     template <typename ElemTy>                struct DenseSetH   : DenseSetExt<ElemTy> { AllocatorI* m_allocator; };
 
 } // namespace DM_NAMESPACE
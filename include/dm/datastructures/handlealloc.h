@@ -212,8 +212,8 @@ namespace DM_NAMESPACE
 
     extern CrtAllocator g_crtAllocator;
 
-    template <typename HandleTy=uint16_t>
-    struct HandleAllocStorage
+    template <typename HandleTy=uint16_t, typename AllocPolicyTy = AllocatorIPolicy>
+    struct HandleAllocStorage : AllocPolicyTy
     {
         typedef HandleTy HandleType;
 
@@ -236,21 +236,21 @@ namespace DM_NAMESPACE
 
         void initStorage(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
+            AllocPolicyTy::bind(_allocator);
+
             const uint32_t haSize = _max*sizeof(HandleType);
-            void* mem = DM_ALLOC(_allocator, 2*haSize);
+            void* mem = DM_ALLOC(this, 2*haSize);
 
             m_max = _max;
             m_handles = (HandleType*)mem;
             m_indices = (HandleType*)((uint8_t*)mem + haSize);
-
-            m_allocator = _allocator;
         }
 
         void destroy()
         {
             if (NULL != m_handles)
             {
-                DM_FREE(m_allocator, m_handles);
+                DM_FREE(this, m_handles);
                 m_handles = NULL;
                 m_indices = NULL;
             }
@@ -275,11 +275,10 @@ namespace DM_NAMESPACE
         uint32_t m_max;
         HandleType* m_handles;
         HandleType* m_indices;
-        AllocatorI* m_allocator;
     };
 
-    template <typename HandleTy=uint16_t>
-    struct HandleAllocStorageRes
+    template <typename HandleTy=uint16_t, typename AllocPolicyTy = AllocatorIPolicy>
+    struct HandleAllocStorageRes : AllocPolicyTy
     {
         typedef HandleTy HandleType;
 
@@ -302,20 +301,21 @@ namespace DM_NAMESPACE
 
         void initStorage(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
+            AllocPolicyTy::bind(_allocator);
+
             const uint32_t haSize = _max*sizeof(HandleType);
 
             m_max = _max;
-            m_handles = (HandleType*)DM_ALLOC(_allocator, haSize);
-            m_indices = (HandleType*)DM_ALLOC(_allocator, haSize);
-            m_allocator = _allocator;
+            m_handles = (HandleType*)DM_ALLOC(this, haSize);
+            m_indices = (HandleType*)DM_ALLOC(this, haSize);
         }
 
         void resize(uint32_t _newMax)
         {
             const uint32_t haSize = _newMax*sizeof(HandleType);
             m_max = _newMax;
-            m_handles = (HandleType*)DM_REALLOC(m_allocator, m_handles, haSize);
-            m_indices = (HandleType*)DM_REALLOC(m_allocator, m_indices, haSize);
+            m_handles = (HandleType*)DM_REALLOC(this, m_handles, haSize);
+            m_indices = (HandleType*)DM_REALLOC(this, m_indices, haSize);
         }
 
         void expand()
@@ -328,9 +328,9 @@ namespace DM_NAMESPACE
         {
             if (NULL != m_handles)
             {
-                DM_FREE(m_allocator, m_handles);
+                DM_FREE(this, m_handles);
                 m_handles = NULL;
-                DM_FREE(m_allocator, m_indices);
+                DM_FREE(this, m_indices);
                 m_indices = NULL;
             }
         }
@@ -354,7 +354,6 @@ namespace DM_NAMESPACE
         uint32_t m_max;
         HandleType* m_handles;
         HandleType* m_indices;
-        AllocatorI* m_allocator;
     };
 
     template <uint32_t MaxHandlesT>
@@ -382,10 +381,10 @@ namespace DM_NAMESPACE
         }
     };
 
-    template <typename HandleTy=uint16_t>
-    struct HandleAlloc : HandleAllocImpl< HandleAllocStorage<HandleTy> >
+    template <typename HandleTy=uint16_t, typename AllocPolicyTy = AllocatorIPolicy>
+    struct HandleAlloc : HandleAllocImpl< HandleAllocStorage<HandleTy, AllocPolicyTy> >
     {
-        typedef HandleAllocImpl< HandleAllocStorage<HandleTy> > Base;
+        typedef HandleAllocImpl< HandleAllocStorage<HandleTy, AllocPolicyTy> > Base;
 
         void init(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
@@ -394,10 +393,10 @@ namespace DM_NAMESPACE
         }
     };
 
-    template <typename HandleTy=uint16_t>
-    struct HandleAllocRes : HandleAllocImpl< HandleAllocStorageRes<HandleTy> >
+    template <typename HandleTy=uint16_t, typename AllocPolicyTy = AllocatorIPolicy>
+    struct HandleAllocRes : HandleAllocImpl< HandleAllocStorageRes<HandleTy, AllocPolicyTy> >
     {
-        typedef HandleAllocImpl< HandleAllocStorageRes<HandleTy> > Base;
+        typedef HandleAllocImpl< HandleAllocStorageRes<HandleTy, AllocPolicyTy> > Base;
 
         void init(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
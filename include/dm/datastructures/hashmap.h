@@ -8,11 +8,15 @@
 /// Header includes.
 #if (DM_INCL & DM_INCL_HEADER_INCLUDES)
     #include <stdint.h>
-    #include "../misc.h"  // nextPowTwo
+    #include "../misc.h"   // nextPowTwo
     #include "../check.h"
-    #include "../hash.h"
+    #include "../hash.h"   // WyHashPolicy
     #include "../compiletime.h"
+    #include "../bitops.h" // cnttz_u32, cnttz_u64
     #include "../allocatori.h"
+    #include "../atomic.h" // atomicCompareAndSwap
+    #include "../mutex.h"  // Mutex
+    #include <emmintrin.h> // __m128i
 #endif // (DM_INCL & DM_INCL_HEADER_INCLUDES)
 
 /// Header body.
@@ -24,7 +28,100 @@
 #   define DM_HASHMAP_H_HEADERGUARD
 namespace DM_NAMESPACE
 {
-    template <typename HashMapStorageTy>
+    ///
+    /// Key as stored by the maps. Keys shorter than KeyLen are zero padded.
+    /// Keys of 1, 2, 4 and 8 bytes are stored as integers, compared directly and hashed with HashPolicyTy::hashInt().
+    ///
+    template <uint8_t KeyLen>
+    struct HashMapKey
+    {
+        DM_INLINE void set(const void* _key, uint8_t _keyLen)
+        {
+            memcpy(m_bytes, _key, _keyLen);
+            memset(m_bytes+_keyLen, 0, KeyLen-_keyLen);
+        }
+
+        DM_INLINE bool equals(const HashMapKey& _other) const
+        {
+            return 0 == memcmp(m_bytes, _other.m_bytes, KeyLen);
+        }
+
+        template <typename HashPolicyTy>
+        DM_INLINE uint64_t hash() const
+        {
+            return HashPolicyTy::hash(m_bytes, KeyLen);
+        }
+
+        uint8_t m_bytes[KeyLen];
+    };
+
+    #define DM_HASHMAP_INTEGER_KEY(_ty)                              \
+        template <>                                                  \
+        struct HashMapKey<sizeof(_ty)>                               \
+        {                                                            \
+            DM_INLINE void set(const void* _key, uint8_t _keyLen)    \
+            {                                                        \
+                m_val = 0;                                           \
+                memcpy(&m_val, _key, _keyLen);                       \
+            }                                                        \
+                                                                     \
+            DM_INLINE bool equals(const HashMapKey& _other) const    \
+            {                                                        \
+                return m_val == _other.m_val;                        \
+            }                                                        \
+                                                                     \
+            template <typename HashPolicyTy>                         \
+            DM_INLINE uint64_t hash() const                          \
+            {                                                        \
+                return HashPolicyTy::hashInt(m_val);                 \
+            }                                                        \
+                                                                     \
+            _ty m_val;                                               \
+        }
+    DM_HASHMAP_INTEGER_KEY(uint8_t);
+    DM_HASHMAP_INTEGER_KEY(uint16_t);
+    DM_HASHMAP_INTEGER_KEY(uint32_t);
+    DM_HASHMAP_INTEGER_KEY(uint64_t);
+    #undef DM_HASHMAP_INTEGER_KEY
+
+    /// Bytes of the bitmap of used slots that HashMapImpl and ObjHashMapImpl storages keep in front of their slots.
+    /// Iteration reads it instead of the slots, 64 slots per word.
+    DM_INLINE uint32_t hashMapUsedBitsSize(uint32_t _max)
+    {
+        return ((_max+63)/64)*uint32_t(sizeof(uint64_t));
+    }
+
+    /// First set bit at or after '_idx', UINT32_MAX if there is none.
+    DM_INLINE uint32_t hashMapNextUsed(const uint64_t* _usedBits, uint32_t _max, uint32_t _idx)
+    {
+        if (_idx >= _max)
+        {
+            return UINT32_MAX;
+        }
+
+        const uint32_t numWords = (_max+63)/64;
+        uint32_t word = _idx/64;
+        uint64_t used = _usedBits[word] & (UINT64_MAX << (_idx%64));
+        while (0 == used)
+        {
+            if (++word == numWords)
+            {
+                return UINT32_MAX;
+            }
+
+            used = _usedBits[word];
+        }
+
+        return word*64 + uint32_t(cnttz_u64(used));
+    }
+
+    ///
+    /// Open addressing with Robin Hood ordering: an insert takes the slot of any entry that is closer to its home slot
+    /// than the inserted one, which keeps probe lengths short and even. m_used holds the probe distance plus one.
+    /// remove() shifts the following entries back by one slot, so there are no tombstones.
+    /// Inserts and removes move entries around, handles are valid only until the next one of those.
+    ///
+    template <typename HashMapStorageTy, typename HashPolicyTy = WyHashPolicy>
     struct HashMapImpl : HashMapStorageTy
     {
         /// Expected interface:
@@ -36,31 +133,39 @@ namespace DM_NAMESPACE
         ///
         ///         struct UsedKeyVal
         ///         {
-        ///             uint8_t m_used;
-        ///             uint8_t m_key[KeyLen];
-        ///             ValTy   m_val;
+        ///             HashMapKey<KeyLen> m_key;
+        ///             ValTy              m_val;
+        ///             uint8_t            m_used;
         ///         };
         ///
         ///         UsedKeyVal* ukv();
+        ///         uint64_t* usedBits(); // hashMapUsedBitsSize(max()) bytes.
         ///         uint32_t max():
         ///         uint32_t keyLen();
         ///     }
+        ///
+        /// HashPolicyTy selects the hash function, see WyHashPolicy.
         typedef typename HashMapStorageTy::ValueType ValTy;
         typedef typename HashMapStorageTy::UsedKeyVal Ukv;
+        typedef HashMapKey<HashMapStorageTy::KeyLen> Key;
         using HashMapStorageTy::ukv;
+        using HashMapStorageTy::usedBits;
         using HashMapStorageTy::max;
         using HashMapStorageTy::keyLen;
 
         enum
         {
-            Unused   = 0x00,
-            Used     = 0x0f,
-            FirstHit = 0xff,
+            Unused = 0x00,
+            Far    = 0xff, // Probe distance of 254 or more, computed from the key when needed.
             InvalidHandle = UINT32_MAX,
+
+            BatchSize = 64, // Keys in flight per findBatch()/insertBatch() pass.
+            PrefetchDistance = 1, // Used slots bitmap words (64 slots each) ahead of forEach().
         };
 
         HashMapImpl() : HashMapStorageTy()
         {
+            m_count = 0;
         }
 
         void init()
@@ -71,27 +176,23 @@ namespace DM_NAMESPACE
         void reset()
         {
             memset(ukv(), Unused, max()*sizeof(Ukv));
+            memset(usedBits(), 0, hashMapUsedBitsSize(max()));
+            m_count = 0;
+        }
+
+        uint32_t insert(const Key& _key, ValTy _val)
+        {
+            const uint32_t hash = uint32_t(_key.template hash<HashPolicyTy>());
+            return insertFrom(wrapAround(hash), _key, _val);
         }
 
         uint32_t insert(const void* _key, uint8_t _keyLen, ValTy _val)
         {
             DM_CHECK(_keyLen <= keyLen(), "HashMapImpl::insert() - Invalid key length | %d, %d", _keyLen, keyLen());
 
-            const uint32_t hash = dm::hash(_key, _keyLen);
-            uint32_t idx = wrapAround(hash);
-            const uint32_t firstHit = idx;
-            for (;;)
-            {
-                if (Unused == ukv()[idx].m_used)
-                {
-                    ukv()[idx].m_used = (idx == firstHit) ? FirstHit : Used;
-                    memcpy(&ukv()[idx].m_key, _key, _keyLen);
-                    memcpy(&ukv()[idx].m_val, &_val, sizeof(ValTy));
-                    return idx;
-                }
-
-                idx = wrapAround(idx+1);
-            }
+            Key key;
+            key.set(_key, _keyLen);
+            return insert(key, _val);
         }
 
         uint32_t insert(const char* _key, ValTy _val)
@@ -104,7 +205,9 @@ namespace DM_NAMESPACE
         {
             dm_staticAssert(sizeof(Ty) <= HashMapStorageTy::KeyLen);
 
-            return insert((const uint8_t*)&_key, sizeof(Ty), _val);
+            Key key;
+            key.set(&_key, sizeof(Ty));
+            return insert(key, _val);
         }
 
         struct IdxDuplicate
@@ -126,43 +229,66 @@ namespace DM_NAMESPACE
             }
         };
 
-        IdxDuplicate insertHandleDup(const void* _key, uint8_t _keyLen, ValTy _val)
+        IdxDuplicate insertHandleDup(const Key& _key, ValTy _val)
         {
-            DM_CHECK(_keyLen <= keyLen(), "HashMapImpl::insertHandleDup() - Invalid key length | %d, %d", _keyLen, keyLen());
+            IdxDuplicate result;
+            result.m_duplicate = 0;
 
-            const uint32_t hash = dm::hash(_key, _keyLen);
+            const uint32_t hash = uint32_t(_key.template hash<HashPolicyTy>());
             uint32_t idx = wrapAround(hash);
-            const uint32_t firstHit = idx;
+            uint32_t dist = 0;
             for (;;)
             {
-                const uint8_t usedFlag = ukv()[idx].m_used;
-
-                if (Unused == usedFlag)
+                if (Unused == ukv()[idx].m_used)
                 {
-                    // Insert new entry.
-
-                    ukv()[idx].m_used = (idx == firstHit) ? FirstHit : Used;
-                    memcpy(&ukv()[idx].m_key, _key, _keyLen);
-                    memcpy(&ukv()[idx].m_val, &_val, sizeof(ValTy));
+                    break;
+                }
 
-                    IdxDuplicate result;
-                    result.m_idx = idx;
-                    result.m_duplicate = 0;
-                    return result;
+                const uint32_t slotDist = distanceOf(idx);
+                if (slotDist < dist)
+                {
+                    // The key would have been placed here, so it is not in the map.
+                    break;
                 }
-                else if ((Used & usedFlag)                              // Used
-                     &&  0 == memcmp(_key, ukv()[idx].m_key, _keyLen))  // && key matches.
+                else if (slotDist == dist
+                     &&  ukv()[idx].m_key.equals(_key))
                 {
                     // Item already found.
 
-                    IdxDuplicate result;
                     result.m_idx = idx;
                     result.m_duplicate = 1;
                     return result;
                 }
 
                 idx = wrapAround(idx+1);
+                dist++;
+            }
+
+            if (m_count == max())
+            {
+                DM_CHECK(false, "HashMapImpl::insertHandleDup() - Map is full | %d", max());
+
+                result.m_idx = InvalidHandle;
+                return result;
             }
+
+            // Insert new entry.
+
+            Ukv entry;
+            entry.m_key = _key;
+            entry.m_val = _val;
+
+            result.m_idx = place(idx, dist, entry);
+            return result;
+        }
+
+        IdxDuplicate insertHandleDup(const void* _key, uint8_t _keyLen, ValTy _val)
+        {
+            DM_CHECK(_keyLen <= keyLen(), "HashMapImpl::insertHandleDup() - Invalid key length | %d, %d", _keyLen, keyLen());
+
+            Key key;
+            key.set(_key, _keyLen);
+            return insertHandleDup(key, _val);
         }
 
         IdxDuplicate insertHandleDup(const char* _key, ValTy _val)
@@ -174,42 +300,127 @@ namespace DM_NAMESPACE
         IdxDuplicate insertHandleDup(const Ty& _key, ValTy _val)
         {
             dm_staticAssert(sizeof(Ty) <= HashMapStorageTy::KeyLen);
-            return insertHandleDup((const uint8_t*)&_key, sizeof(Ty), _val);
+
+            Key key;
+            key.set(&_key, sizeof(Ty));
+            return insertHandleDup(key, _val);
+        }
+
+        uint32_t findHandleOf(const Key& _key)
+        {
+            const uint32_t hash = uint32_t(_key.template hash<HashPolicyTy>());
+            return findHandleFrom(wrapAround(hash), _key);
         }
 
         uint32_t findHandleOf(const void* _key, uint8_t _keyLen)
         {
             DM_CHECK(_keyLen <= keyLen(), "HashMapImpl::findHandleOf() - Invalid key length | %d, %d", _keyLen, keyLen());
 
-            const uint32_t hash = dm::hash(_key, _keyLen);
-            for (uint32_t idx = wrapAround(hash); true; idx = wrapAround(idx+1))
+            Key key;
+            key.set(_key, _keyLen);
+            return findHandleOf(key);
+        }
+
+        uint32_t findHandleOf(const char* _key)
+        {
+            return findHandleOf(_key, strlen(_key));
+        }
+
+        template <typename Ty>
+        uint32_t findHandleOf(const Ty& _key)
+        {
+            dm_staticAssert(sizeof(Ty) <= HashMapStorageTy::KeyLen);
+
+            Key key;
+            key.set(&_key, sizeof(Ty));
+            return findHandleOf(key);
+        }
+
+        /// Looks up '_count' keys, '_outHandles' receives InvalidHandle for keys not in the map.
+        /// Keys are hashed and their home slots prefetched BatchSize at a time before any probing, so the cache misses overlap.
+        void findBatch(const Key* _keys, uint32_t _count, uint32_t* _outHandles)
+        {
+            uint32_t home[BatchSize];
+            for (uint32_t begin = 0; begin < _count; begin += BatchSize)
             {
-                const uint8_t usedFlag = ukv()[idx].m_used;
-                if ((Used & usedFlag)                               // Used
-                &&  0 == memcmp(&ukv()[idx].m_key, _key, _keyLen))  // && key matches.
+                const uint32_t num = DM_MIN(_count-begin, uint32_t(BatchSize));
+
+                for (uint32_t ii = 0; ii < num; ++ii)
                 {
-                    return idx;                                     // Return idx;
+                    home[ii] = wrapAround(uint32_t(_keys[begin+ii].template hash<HashPolicyTy>()));
+                    DM_PREFETCH(&ukv()[home[ii]]);
                 }
-                else if (Unused == usedFlag)                        // Unused
+
+                for (uint32_t ii = 0; ii < num; ++ii)
                 {
-                    return InvalidHandle;                           // Return not found.
+                    _outHandles[begin+ii] = findHandleFrom(home[ii], _keys[begin+ii]);
                 }
             }
+        }
 
-            return InvalidHandle;
+        template <typename Ty>
+        void findBatch(const Ty* _keys, uint32_t _count, uint32_t* _outHandles)
+        {
+            dm_staticAssert(sizeof(Ty) <= HashMapStorageTy::KeyLen);
+
+            Key keys[BatchSize];
+            for (uint32_t begin = 0; begin < _count; begin += BatchSize)
+            {
+                const uint32_t num = DM_MIN(_count-begin, uint32_t(BatchSize));
+                for (uint32_t ii = 0; ii < num; ++ii)
+                {
+                    keys[ii].set(&_keys[begin+ii], sizeof(Ty));
+                }
+
+                findBatch(keys, num, &_outHandles[begin]);
+            }
         }
 
-        uint32_t findHandleOf(const char* _key)
+        /// Same as insert() for each key, with home slots prefetched like in findBatch().
+        /// Inserts move entries, so no handles are returned. Returns the number of keys inserted, less than '_count' once the map is full.
+        uint32_t insertBatch(const Key* _keys, const ValTy* _vals, uint32_t _count)
         {
-            return findHandleOf(_key, strlen(_key));
+            uint32_t home[BatchSize];
+            uint32_t inserted = 0;
+            for (uint32_t begin = 0; begin < _count; begin += BatchSize)
+            {
+                const uint32_t num = DM_MIN(_count-begin, uint32_t(BatchSize));
+
+                for (uint32_t ii = 0; ii < num; ++ii)
+                {
+                    home[ii] = wrapAround(uint32_t(_keys[begin+ii].template hash<HashPolicyTy>()));
+                    DM_PREFETCH(&ukv()[home[ii]]);
+                }
+
+                for (uint32_t ii = 0; ii < num; ++ii)
+                {
+                    inserted += (InvalidHandle != insertFrom(home[ii], _keys[begin+ii], _vals[begin+ii]));
+                }
+            }
+
+            return inserted;
         }
 
         template <typename Ty>
-        uint32_t findHandleOf(const Ty& _key)
+        uint32_t insertBatch(const Ty* _keys, const ValTy* _vals, uint32_t _count)
         {
             dm_staticAssert(sizeof(Ty) <= HashMapStorageTy::KeyLen);
 
-            return findHandleOf((const void*)&_key, sizeof(Ty));
+            uint32_t inserted = 0;
+
+            Key keys[BatchSize];
+            for (uint32_t begin = 0; begin < _count; begin += BatchSize)
+            {
+                const uint32_t num = DM_MIN(_count-begin, uint32_t(BatchSize));
+                for (uint32_t ii = 0; ii < num; ++ii)
+                {
+                    keys[ii].set(&_keys[begin+ii], sizeof(Ty));
+                }
+
+                inserted += insertBatch(keys, &_vals[begin], num);
+            }
+
+            return inserted;
         }
 
         ValTy getValueOf(uint32_t _handle)
@@ -217,12 +428,19 @@ namespace DM_NAMESPACE
             return ukv()[_handle].m_val;
         }
 
+        ValTy find(const Key& _key)
+        {
+            const uint32_t handle = findHandleOf(_key);
+            return (InvalidHandle != handle) ? getValueOf(handle) : dm::TyInfo<ValTy>::Max();
+        }
+
         ValTy find(const void* _key, uint8_t _keyLen)
         {
             DM_CHECK(_keyLen <= keyLen(), "HashMapImpl::find() - Invalid key length | %d, %d", _keyLen, keyLen());
 
-            const uint32_t handle = findHandleOf(_key, _keyLen);
-            return (InvalidHandle != handle) ? getValueOf(handle) : dm::TyInfo<ValTy>::Max();
+            Key key;
+            key.set(_key, _keyLen);
+            return find(key);
         }
 
         ValTy find(const char* _key)
@@ -234,31 +452,42 @@ namespace DM_NAMESPACE
         ValTy find(const Ty& _key)
         {
             dm_staticAssert(sizeof(Ty) <= HashMapStorageTy::KeyLen);
-            return find((const void*)&_key, sizeof(Ty));
+
+            Key key;
+            key.set(&_key, sizeof(Ty));
+            return find(key);
         }
 
-        bool remove(const void* _key, uint8_t _keyLen)
+        void removeAt(uint32_t _handle)
         {
-            DM_CHECK(_keyLen <= keyLen(), "HashMapImpl::remove() - Invalid key length | %d, %d", _keyLen, keyLen());
+            DM_CHECK(_handle < max() && Unused != ukv()[_handle].m_used, "HashMapImpl::removeAt() - Invalid handle | %d", _handle);
 
-            const uint32_t handle = findHandleOf(_key, _keyLen);
-            if (InvalidHandle != handle)
+            // Backward shift: move the following entries one slot closer to home, until an empty slot or an entry already at home.
+            uint32_t idx = _handle;
+            for (uint32_t next = wrapAround(idx+1); ; idx = next, next = wrapAround(next+1))
             {
-                const uint32_t begin = handle+1;
-                uint32_t end = begin;
-                while (ukv()[end].m_used == Used) { end++; }
-                const uint32_t count = end - begin;
-
-                if (0 == count)
-                {
-                    ukv()[handle].m_used = Unused;
-                }
-                else
+                const uint8_t used = ukv()[next].m_used;
+                if (Unused == used || 1 == used)
                 {
-                    memmove(&ukv()[handle], &ukv()[begin], count*sizeof(Ukv));
-                    ukv()[end].m_used = Unused;
+                    break;
                 }
 
+                const uint32_t dist = distanceOf(next);
+                ukv()[idx] = ukv()[next];
+                ukv()[idx].m_used = usedFlag(dist-1);
+            }
+
+            ukv()[idx].m_used = Unused;
+            usedBits()[idx/64] &= ~(UINT64_C(1) << (idx%64));
+            m_count--;
+        }
+
+        bool remove(const Key& _key)
+        {
+            const uint32_t handle = findHandleOf(_key);
+            if (InvalidHandle != handle)
+            {
+                removeAt(handle);
                 return true;
             }
             else
@@ -267,6 +496,15 @@ namespace DM_NAMESPACE
             }
         }
 
+        bool remove(const void* _key, uint8_t _keyLen)
+        {
+            DM_CHECK(_keyLen <= keyLen(), "HashMapImpl::remove() - Invalid key length | %d, %d", _keyLen, keyLen());
+
+            Key key;
+            key.set(_key, _keyLen);
+            return remove(key);
+        }
+
         bool remove(const char* _key)
         {
             return remove((const void*)_key, strlen(_key));
@@ -276,7 +514,59 @@ namespace DM_NAMESPACE
         bool remove(const Ty& _key)
         {
             dm_staticAssert(sizeof(Ty) <= HashMapStorageTy::KeyLen);
-            return remove((const void*)&_key, sizeof(Ty));
+
+            Key key;
+            key.set(&_key, sizeof(Ty));
+            return remove(key);
+        }
+
+        uint32_t count() const
+        {
+            return m_count;
+        }
+
+        /// Iteration in slot order:
+        ///     for (uint32_t handle = map.first(); map.InvalidHandle != handle; handle = map.next(handle)) { ... }
+        /// Inserts and removes move entries, iteration must not overlap them.
+        uint32_t first()
+        {
+            return nextUsed(0);
+        }
+
+        uint32_t next(uint32_t _handle)
+        {
+            return nextUsed(_handle+1);
+        }
+
+        const Key& getKeyOf(uint32_t _handle)
+        {
+            return ukv()[_handle].m_key;
+        }
+
+        /// Calls _func(const Key&, ValTy&) for every entry, in slot order. Must not insert or remove.
+        /// Walks the used slots bitmap, so empty slots are never read and 64 of them are skipped per word.
+        /// Used slots '_prefetchDistance' words ahead are prefetched once per cache line. The scan ends once count() entries were visited.
+        template <typename FuncTy>
+        void forEach(FuncTy _func, uint32_t _prefetchDistance = PrefetchDistance)
+        {
+            const uint64_t* bits = usedBits();
+            const uint32_t numWords = (max()+63)/64;
+
+            uint32_t left = m_count;
+            for (uint32_t word = 0; 0 != left; ++word)
+            {
+                if (word+_prefetchDistance < numWords)
+                {
+                    prefetchUsed(word+_prefetchDistance);
+                }
+
+                for (uint64_t used = bits[word]; 0 != used; used &= used-1)
+                {
+                    Ukv& ukvRef = ukv()[word*64 + uint32_t(cnttz_u64(used))];
+                    _func((const Key&)ukvRef.m_key, ukvRef.m_val);
+                    left--;
+                }
+            }
         }
 
     private:
@@ -284,6 +574,128 @@ namespace DM_NAMESPACE
         {
             return _v&(max()-1);
         }
+
+        uint32_t nextUsed(uint32_t _idx)
+        {
+            return hashMapNextUsed(usedBits(), max(), _idx);
+        }
+
+        /// Prefetches the cache lines holding the used slots of one bitmap word, each line once.
+        void prefetchUsed(uint32_t _word)
+        {
+            uintptr_t prevLine = 0;
+            for (uint64_t used = usedBits()[_word]; 0 != used; used &= used-1)
+            {
+                const uintptr_t line = uintptr_t(&ukv()[_word*64 + uint32_t(cnttz_u64(used))]) & ~uintptr_t(63);
+                if (line != prevLine)
+                {
+                    DM_PREFETCH((const void*)line);
+                    prevLine = line;
+                }
+            }
+        }
+
+        static inline uint8_t usedFlag(uint32_t _dist)
+        {
+            return uint8_t(DM_MIN(_dist+1, uint32_t(Far)));
+        }
+
+        /// Probe distance of a used slot from the home slot of its key.
+        inline uint32_t distanceOf(uint32_t _idx)
+        {
+            const uint8_t used = ukv()[_idx].m_used;
+            if (Far != used)
+            {
+                return used-1;
+            }
+
+            const uint32_t home = wrapAround(uint32_t(ukv()[_idx].m_key.template hash<HashPolicyTy>()));
+            return wrapAround(_idx-home);
+        }
+
+        uint32_t insertFrom(uint32_t _home, const Key& _key, ValTy _val)
+        {
+            if (m_count == max())
+            {
+                DM_CHECK(false, "HashMapImpl::insert() - Map is full | %d", max());
+                return InvalidHandle;
+            }
+
+            Ukv entry;
+            entry.m_key = _key;
+            entry.m_val = _val;
+
+            uint32_t idx = _home;
+            uint32_t dist = 0;
+            while (Unused != ukv()[idx].m_used
+               &&  distanceOf(idx) >= dist)
+            {
+                idx = wrapAround(idx+1);
+                dist++;
+            }
+
+            return place(idx, dist, entry);
+        }
+
+        uint32_t findHandleFrom(uint32_t _home, const Key& _key)
+        {
+            uint32_t idx = _home;
+            for (uint32_t dist = 0; dist < max(); ++dist, idx = wrapAround(idx+1))
+            {
+                if (Unused == ukv()[idx].m_used)            // Unused
+                {
+                    return InvalidHandle;                   // Return not found.
+                }
+
+                const uint32_t slotDist = distanceOf(idx);
+                if (slotDist < dist)                        // Closer to home than the key would be
+                {
+                    return InvalidHandle;                   // Return not found.
+                }
+                else if (slotDist == dist                   // Same home slot
+                     &&  ukv()[idx].m_key.equals(_key))     // && key matches.
+                {
+                    return idx;                             // Return idx;
+                }
+            }
+
+            return InvalidHandle;
+        }
+
+        /// Stores '_entry' at '_idx', probe distance '_dist', pushing richer entries further along. Returns where '_entry' ended up.
+        uint32_t place(uint32_t _idx, uint32_t _dist, Ukv _entry)
+        {
+            const uint32_t result = _idx;
+            for (;;)
+            {
+                if (Unused == ukv()[_idx].m_used)
+                {
+                    ukv()[_idx] = _entry;
+                    ukv()[_idx].m_used = usedFlag(_dist);
+                    usedBits()[_idx/64] |= UINT64_C(1) << (_idx%64);
+                    break;
+                }
+
+                const uint32_t slotDist = distanceOf(_idx);
+                if (slotDist < _dist)
+                {
+                    const Ukv displaced = ukv()[_idx];
+                    ukv()[_idx] = _entry;
+                    ukv()[_idx].m_used = usedFlag(_dist);
+
+                    _entry = displaced;
+                    _dist = slotDist;
+                }
+
+                _idx = wrapAround(_idx+1);
+                _dist++;
+            }
+
+            m_count++;
+            return result;
+        }
+
+        uint32_t m_count;
     };
 
     template <uint8_t KeyLength, typename ValTy/*arithmetic type*/, uint32_t MaxT_PowTwo>
@@ -298,9 +710,9 @@ namespace DM_NAMESPACE
 
         struct UsedKeyVal
         {
-            uint8_t m_used;
-            uint8_t m_key[KeyLen];
-            ValTy   m_val;
+            HashMapKey<KeyLen> m_key;
+            ValTy              m_val;
+            uint8_t            m_used;
         };
 
         UsedKeyVal* ukv()
@@ -308,6 +720,11 @@ namespace DM_NAMESPACE
             return m_ukv;
         }
 
+        uint64_t* usedBits()
+        {
+            return m_usedBits;
+        }
+
         uint32_t max()
         {
             return Max;
@@ -320,6 +737,7 @@ namespace DM_NAMESPACE
 
     private:
         UsedKeyVal m_ukv[Max];
+        uint64_t   m_usedBits[(Max+63)/64];
     };
 
     template <uint8_t KeyLength, typename ValTy/*arithmetic type*/>
@@ -330,21 +748,22 @@ namespace DM_NAMESPACE
 
         struct UsedKeyVal
         {
-            uint8_t m_used;
-            uint8_t m_key[KeyLen];
-            ValTy   m_val;
+            HashMapKey<KeyLen> m_key;
+            ValTy              m_val;
+            uint8_t            m_used;
         };
 
         static uint32_t sizeFor(uint32_t _maxPowTwo)
         {
             DM_CHECK(dm::isPowTwo(_maxPowTwo), "HashMapStorageExt::sizeFor() - Invalid value | %d", _maxPowTwo);
 
-            return _maxPowTwo*sizeof(UsedKeyVal);
+            return hashMapUsedBitsSize(_maxPowTwo) + _maxPowTwo*sizeof(UsedKeyVal);
         }
 
         HashMapStorageExt()
         {
             m_ukv = NULL;
+            m_usedBits = NULL;
             m_max = 0;
         }
 
@@ -353,7 +772,8 @@ namespace DM_NAMESPACE
             DM_CHECK(dm::isPowTwo(_maxPowTwo), "HashMapStorageExt::initStorage() - Invalid value | %d", _maxPowTwo);
 
             m_max = _maxPowTwo;
-            m_ukv = (UsedKeyVal*)_mem;
+            m_usedBits = (uint64_t*)_mem;
+            m_ukv = (UsedKeyVal*)(_mem + hashMapUsedBitsSize(_maxPowTwo));
 
             return (_mem + sizeFor(_maxPowTwo));
         }
@@ -363,6 +783,11 @@ namespace DM_NAMESPACE
             return m_ukv;
         }
 
+        uint64_t* usedBits()
+        {
+            return m_usedBits;
+        }
+
         uint32_t max()
         {
             return m_max;
@@ -375,34 +800,36 @@ namespace DM_NAMESPACE
 
     private:
         UsedKeyVal* m_ukv;
+        uint64_t* m_usedBits;
         uint32_t m_max;
     };
 
     extern CrtAllocator g_crtAllocator;
 
-    template <uint8_t KeyLength, typename ValTy/*arithmetic type*/>
-    struct HashMapStorage
+    template <uint8_t KeyLength, typename ValTy/*arithmetic type*/, typename AllocPolicyTy = AllocatorIPolicy>
+    struct HashMapStorage : AllocPolicyTy
     {
         enum { KeyLen = KeyLength };
         typedef ValTy ValueType;
 
         struct UsedKeyVal
         {
-            uint8_t m_used;
-            uint8_t m_key[KeyLen];
-            ValTy   m_val;
+            HashMapKey<KeyLen> m_key;
+            ValTy              m_val;
+            uint8_t            m_used;
         };
 
         static uint32_t sizeFor(uint32_t _maxPowTwo)
         {
             DM_CHECK(dm::isPowTwo(_maxPowTwo), "HashMapStorage::sizeFor() - Invalid value | %d", _maxPowTwo);
 
-            return _maxPowTwo*sizeof(UsedKeyVal);
+            return hashMapUsedBitsSize(_maxPowTwo) + _maxPowTwo*sizeof(UsedKeyVal);
         }
 
         HashMapStorage()
         {
             m_ukv = NULL;
+            m_usedBits = NULL;
             m_max = 0;
         }
 
@@ -415,18 +842,20 @@ namespace DM_NAMESPACE
         {
             DM_CHECK(dm::isPowTwo(_maxPowTwo), "HashMapStorage::initStorage() - Invalid value | %d", _maxPowTwo);
 
-            uint8_t* mem = (uint8_t*)DM_ALLOC(_allocator, sizeFor(_maxPowTwo));
+            AllocPolicyTy::bind(_allocator);
+            uint8_t* mem = (uint8_t*)DM_ALLOC(this, sizeFor(_maxPowTwo));
 
             m_max = _maxPowTwo;
-            m_ukv = (UsedKeyVal*)mem;
-            m_allocator = _allocator;
+            m_usedBits = (uint64_t*)mem;
+            m_ukv = (UsedKeyVal*)(mem + hashMapUsedBitsSize(_maxPowTwo));
         }
 
         void destroy()
         {
-            if (NULL != m_ukv)
+            if (NULL != m_usedBits)
             {
-                DM_FREE(m_allocator, m_ukv);
+                DM_FREE(this, m_usedBits);
+                m_usedBits = NULL;
                 m_ukv = NULL;
             }
         }
@@ -436,6 +865,11 @@ namespace DM_NAMESPACE
             return m_ukv;
         }
 
+        uint64_t* usedBits()
+        {
+            return m_usedBits;
+        }
+
         uint32_t max()
         {
             return m_max;
@@ -448,14 +882,14 @@ namespace DM_NAMESPACE
 
     private:
         UsedKeyVal* m_ukv;
+        uint64_t* m_usedBits;
         uint32_t m_max;
-        AllocatorI* m_allocator;
     };
 
-    template <uint8_t KeyLength, typename ValTy, uint32_t MaxT_PowTwo>
-    struct HashMapT : HashMapImpl< HashMapStorageT<KeyLength, ValTy, MaxT_PowTwo> >
+    template <uint8_t KeyLength, typename ValTy, uint32_t MaxT_PowTwo, typename HashPolicyTy = WyHashPolicy>
+    struct HashMapT : HashMapImpl< HashMapStorageT<KeyLength, ValTy, MaxT_PowTwo>, HashPolicyTy >
     {
-        typedef HashMapImpl< HashMapStorageT<KeyLength, ValTy, MaxT_PowTwo> > Base;
+        typedef HashMapImpl< HashMapStorageT<KeyLength, ValTy, MaxT_PowTwo>, HashPolicyTy > Base;
 
         HashMapT() : Base()
         {
@@ -463,10 +897,10 @@ namespace DM_NAMESPACE
         }
     };
 
-    template <uint8_t KeyLength, typename ValTy>
-    struct HashMapExt : HashMapImpl< HashMapStorageExt<KeyLength, ValTy> >
+    template <uint8_t KeyLength, typename ValTy, typename HashPolicyTy = WyHashPolicy>
+    struct HashMapExt : HashMapImpl< HashMapStorageExt<KeyLength, ValTy>, HashPolicyTy >
     {
-        typedef HashMapImpl< HashMapStorageExt<KeyLength, ValTy> > Base;
+        typedef HashMapImpl< HashMapStorageExt<KeyLength, ValTy>, HashPolicyTy > Base;
 
         uint8_t* init(uint32_t _maxPowTwo, uint8_t* _mem)
         {
@@ -476,10 +910,10 @@ namespace DM_NAMESPACE
         }
     };
 
-    template <uint8_t KeyLength, typename ValTy>
-    struct HashMap : HashMapImpl< HashMapStorage<KeyLength, ValTy> >
+    template <uint8_t KeyLength, typename ValTy, typename AllocPolicyTy = AllocatorIPolicy, typename HashPolicyTy = WyHashPolicy>
+    struct HashMap : HashMapImpl< HashMapStorage<KeyLength, ValTy, AllocPolicyTy>, HashPolicyTy >
     {
-        typedef HashMapImpl< HashMapStorage<KeyLength, ValTy> > Base;
+        typedef HashMapImpl< HashMapStorage<KeyLength, ValTy, AllocPolicyTy>, HashPolicyTy > Base;
 
         void init(uint32_t _maxPowTwo, AllocatorI* _allocator = &g_crtAllocator)
         {
@@ -488,12 +922,1443 @@ namespace DM_NAMESPACE
         }
     };
 
-    template <uint8_t KeyLength, typename ValTy>
-    struct HashMapH : HashMapExt<KeyLength, ValTy>
+    template <uint8_t KeyLength, typename ValTy, typename HashPolicyTy = WyHashPolicy>
+    struct HashMapH : HashMapExt<KeyLength, ValTy, HashPolicyTy>
     {
         AllocatorI* m_allocator;
     };
 
+    ///
+    /// HashMap that grows once occupancy reaches the max load factor.
+    /// Entries are moved to the new table incrementally, a few slots on every insert(), find() and remove(),
+    /// so no single call pays for a full rehash. Until moving is done, lookups check the new table first and then the old one.
+    /// insert() overwrites the value of an existing key.
+    ///
+    template <uint8_t KeyLength, typename ValTy/*arithmetic type*/, typename AllocPolicyTy = AllocatorIPolicy, typename HashPolicyTy = WyHashPolicy>
+    struct HashMapGrowable : AllocPolicyTy
+    {
+        enum
+        {
+            KeyLen = KeyLength,
+
+            Unused  = 0x00,
+            Used    = 0x0f,
+            Removed = 0xf0, // Probing goes over removed slots, they are dropped once the table is rebuilt.
+
+            MinMax         = 16,
+            MigratePerCall = 8, // Old table slots moved by each call at 75% max load, scaled up for lower ones, see init().
+        };
+        typedef ValTy ValueType;
+        typedef HashMapKey<KeyLen> Key;
+
+        struct UsedKeyVal
+        {
+            HashMapKey<KeyLen> m_key;
+            ValTy              m_val;
+            uint8_t            m_used;
+        };
+
+        HashMapGrowable()
+        {
+            m_curr.m_ukv = NULL;
+            m_prev.m_ukv = NULL;
+        }
+
+        ~HashMapGrowable()
+        {
+            destroy();
+        }
+
+        void init(uint32_t _maxPowTwo = MinMax, AllocatorI* _allocator = &g_crtAllocator, uint8_t _maxLoadPercent = 75)
+        {
+            DM_CHECK(dm::isPowTwo(_maxPowTwo), "HashMapGrowable::init() - Invalid value | %d", _maxPowTwo);
+            DM_CHECK(10 <= _maxLoadPercent && _maxLoadPercent <= 95, "HashMapGrowable::init() - Invalid load factor | %d", _maxLoadPercent);
+
+            AllocPolicyTy::bind(_allocator);
+            m_maxLoadPercent = _maxLoadPercent;
+            m_migrateIdx = 0;
+
+            // A rebuild at the same size leaves at least half of the allowed load to fill before the next grow,
+            // a table of 'max' slots has to be moved within max*load/2 calls. Three times that rate keeps a margin.
+            m_migratePerCall = DM_MAX(uint32_t(MigratePerCall), uint32_t(MigratePerCall*75 + _maxLoadPercent - 1)/_maxLoadPercent);
+
+            initTable(m_curr, DM_MAX(_maxPowTwo, uint32_t(MinMax)));
+            m_prev.m_ukv = NULL;
+            m_prev.m_max = 0;
+            m_prev.m_count = 0;
+            m_prev.m_removed = 0;
+        }
+
+        void destroy()
+        {
+            destroyTable(m_curr);
+            destroyTable(m_prev);
+        }
+
+        void reset()
+        {
+            destroyTable(m_prev);
+            memset(m_curr.m_ukv, Unused, m_curr.m_max*sizeof(UsedKeyVal));
+            m_curr.m_count = 0;
+            m_curr.m_removed = 0;
+        }
+
+        /// Returns true if the key was not in the map.
+        bool insert(const void* _key, uint8_t _keyLen, ValTy _val)
+        {
+            DM_CHECK(_keyLen <= KeyLen, "HashMapGrowable::insert() - Invalid key length | %d, %d", _keyLen, KeyLen);
+
+            Key key;
+            key.set(_key, _keyLen);
+            const uint32_t hash = uint32_t(key.template hash<HashPolicyTy>());
+
+            migrate();
+
+            UsedKeyVal* ukv = findIn(m_curr, key, hash);
+            if (NULL != ukv)
+            {
+                ukv->m_val = _val;
+                return false;
+            }
+
+            // Existing key in the old table goes to the new table right away.
+            bool found = false;
+            if (isGrowing())
+            {
+                ukv = findIn(m_prev, key, hash);
+                if (NULL != ukv)
+                {
+                    markRemoved(m_prev, ukv);
+                    found = true;
+                }
+            }
+
+            const uint64_t occupied = uint64_t(m_curr.m_count) + m_curr.m_removed + m_prev.m_count + 1;
+            if (occupied*100 > uint64_t(m_curr.m_max)*m_maxLoadPercent)
+            {
+                grow();
+            }
+
+            place(m_curr, key, hash, _val);
+
+            return !found;
+        }
+
+        bool insert(const char* _key, ValTy _val)
+        {
+            return insert((const uint8_t*)_key, strlen(_key), _val);
+        }
+
+        template <typename Ty>
+        bool insert(const Ty& _key, ValTy _val)
+        {
+            dm_staticAssert(sizeof(Ty) <= KeyLen);
+
+            return insert((const uint8_t*)&_key, sizeof(Ty), _val);
+        }
+
+        ValTy find(const void* _key, uint8_t _keyLen)
+        {
+            DM_CHECK(_keyLen <= KeyLen, "HashMapGrowable::find() - Invalid key length | %d, %d", _keyLen, KeyLen);
+
+            Key key;
+            key.set(_key, _keyLen);
+            const uint32_t hash = uint32_t(key.template hash<HashPolicyTy>());
+
+            migrate();
+
+            UsedKeyVal* ukv = findIn(m_curr, key, hash);
+            if (NULL == ukv && isGrowing())
+            {
+                ukv = findIn(m_prev, key, hash);
+            }
+
+            return (NULL != ukv) ? ukv->m_val : dm::TyInfo<ValTy>::Max();
+        }
+
+        ValTy find(const char* _key)
+        {
+            return find((const void*)_key, strlen(_key));
+        }
+
+        template <typename Ty>
+        ValTy find(const Ty& _key)
+        {
+            dm_staticAssert(sizeof(Ty) <= KeyLen);
+            return find((const void*)&_key, sizeof(Ty));
+        }
+
+        bool remove(const void* _key, uint8_t _keyLen)
+        {
+            DM_CHECK(_keyLen <= KeyLen, "HashMapGrowable::remove() - Invalid key length | %d, %d", _keyLen, KeyLen);
+
+            Key key;
+            key.set(_key, _keyLen);
+            const uint32_t hash = uint32_t(key.template hash<HashPolicyTy>());
+
+            migrate();
+
+            UsedKeyVal* ukv = findIn(m_curr, key, hash);
+            if (NULL != ukv)
+            {
+                markRemoved(m_curr, ukv);
+                return true;
+            }
+
+            if (isGrowing())
+            {
+                ukv = findIn(m_prev, key, hash);
+                if (NULL != ukv)
+                {
+                    markRemoved(m_prev, ukv);
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool remove(const char* _key)
+        {
+            return remove((const void*)_key, strlen(_key));
+        }
+
+        template <typename Ty>
+        bool remove(const Ty& _key)
+        {
+            dm_staticAssert(sizeof(Ty) <= KeyLen);
+            return remove((const void*)&_key, sizeof(Ty));
+        }
+
+        uint32_t count() const
+        {
+            return m_curr.m_count + m_prev.m_count;
+        }
+
+        uint32_t max() const
+        {
+            return m_curr.m_max;
+        }
+
+        /// Used and removed slots of the current table.
+        float loadFactor() const
+        {
+            return float(m_curr.m_count + m_curr.m_removed)/float(m_curr.m_max);
+        }
+
+        bool isGrowing() const
+        {
+            return (NULL != m_prev.m_ukv);
+        }
+
+    private:
+        struct Table
+        {
+            UsedKeyVal* m_ukv;
+            uint32_t    m_max;
+            uint32_t    m_count;
+            uint32_t    m_removed;
+        };
+
+        void initTable(Table& _table, uint32_t _max)
+        {
+            _table.m_ukv = (UsedKeyVal*)DM_ALLOC(this, _max*sizeof(UsedKeyVal));
+            _table.m_max = _max;
+            _table.m_count = 0;
+            _table.m_removed = 0;
+            memset(_table.m_ukv, Unused, _max*sizeof(UsedKeyVal));
+        }
+
+        void destroyTable(Table& _table)
+        {
+            if (NULL != _table.m_ukv)
+            {
+                DM_FREE(this, _table.m_ukv);
+                _table.m_ukv = NULL;
+                _table.m_count = 0;
+                _table.m_removed = 0;
+            }
+        }
+
+        static UsedKeyVal* findIn(Table& _table, const Key& _key, uint32_t _hash)
+        {
+            const uint32_t mask = _table.m_max-1;
+            uint32_t idx = _hash&mask;
+            for (uint32_t ii = _table.m_max; ii--; idx = (idx+1)&mask)
+            {
+                UsedKeyVal& ukv = _table.m_ukv[idx];
+                if (Used == ukv.m_used
+                &&  ukv.m_key.equals(_key))
+                {
+                    return &ukv;
+                }
+                else if (Unused == ukv.m_used)
+                {
+                    return NULL;
+                }
+            }
+
+            return NULL;
+        }
+
+        /// Expects the key not to be in the table and a free slot to exist.
+        static void place(Table& _table, const Key& _key, uint32_t _hash, ValTy _val)
+        {
+            const uint32_t mask = _table.m_max-1;
+            uint32_t idx = _hash&mask;
+            while (Used == _table.m_ukv[idx].m_used)
+            {
+                idx = (idx+1)&mask;
+            }
+
+            UsedKeyVal& ukv = _table.m_ukv[idx];
+            if (Removed == ukv.m_used)
+            {
+                _table.m_removed--;
+            }
+
+            ukv.m_used = Used;
+            ukv.m_key = _key;
+            ukv.m_val = _val;
+            _table.m_count++;
+        }
+
+        static void markRemoved(Table& _table, UsedKeyVal* _ukv)
+        {
+            _ukv->m_used = Removed;
+            _table.m_count--;
+            _table.m_removed++;
+        }
+
+        /// Moves up to m_migratePerCall slots of the old table.
+        void migrate()
+        {
+            migrate(m_migratePerCall);
+        }
+
+        void migrate(uint32_t _numSlots)
+        {
+            if (!isGrowing())
+            {
+                return;
+            }
+
+            const uint32_t end = DM_MIN(m_prev.m_max, m_migrateIdx+_numSlots);
+            for (; m_migrateIdx < end && 0 != m_prev.m_count; ++m_migrateIdx)
+            {
+                UsedKeyVal& ukv = m_prev.m_ukv[m_migrateIdx];
+                if (Used == ukv.m_used)
+                {
+                    place(m_curr, ukv.m_key, uint32_t(ukv.m_key.template hash<HashPolicyTy>()), ukv.m_val);
+
+                    // Keep the slot occupied, it may be on a probe path of an entry not yet moved.
+                    markRemoved(m_prev, &ukv);
+                }
+            }
+
+            if (m_migrateIdx == m_prev.m_max || 0 == m_prev.m_count)
+            {
+                destroyTable(m_prev);
+            }
+        }
+
+        void grow()
+        {
+            // Finish the previous one first. Safeguard only, m_migratePerCall moves the old table before the new one fills up.
+            if (isGrowing())
+            {
+                migrate(m_prev.m_max);
+            }
+
+            // Double if live entries take at least half of the allowed load, otherwise rebuild at the same size to drop removed slots.
+            const bool bigger = (uint64_t(m_curr.m_count)*200 >= uint64_t(m_curr.m_max)*m_maxLoadPercent);
+            const uint32_t max = bigger ? m_curr.m_max*2 : m_curr.m_max;
+
+            m_prev = m_curr;
+            m_migrateIdx = 0;
+            initTable(m_curr, max);
+
+            if (0 == m_prev.m_count)
+            {
+                destroyTable(m_prev);
+            }
+        }
+
+        Table    m_curr;
+        Table    m_prev;
+        uint32_t m_migrateIdx;
+        uint32_t m_migratePerCall;
+        uint8_t  m_maxLoadPercent;
+    };
+
+    ///
+    /// HashMap with a separate array of control bytes, one per slot (Swiss table style).
+    /// A used slot holds the low 7 bits of the key hash, probing compares 16 control bytes at once
+    /// and touches keys only on a fingerprint match, so it runs fine at 7/8 load. Grows by a full rehash.
+    ///
+    ///  Ctrl:  |h2|E |h2|h2|R |E |...|h2|  + first 16 bytes mirrored at the end, for unaligned group loads.
+    ///  Slots: |kv|  |kv|kv|  |  |...|kv|
+    ///
+    /// insert() overwrites the value of an existing key.
+    ///
+    template <uint8_t KeyLength, typename ValTy/*arithmetic type*/, typename AllocPolicyTy = AllocatorIPolicy, typename HashPolicyTy = WyHashPolicy>
+    struct HashMapSwiss : AllocPolicyTy
+    {
+        enum
+        {
+            KeyLen = KeyLength,
+
+            Empty   = 0x80,
+            Removed = 0xfe, // Both have the high bit set, used slots never do.
+
+            GroupSize = 16,
+            MinMax    = GroupSize,
+        };
+        typedef ValTy ValueType;
+        typedef HashMapKey<KeyLen> Key;
+
+        struct KeyVal
+        {
+            Key   m_key;
+            ValTy m_val;
+        };
+
+        HashMapSwiss()
+        {
+            m_ctrl = NULL;
+            m_slots = NULL;
+            m_max = 0;
+            m_count = 0;
+            m_removed = 0;
+        }
+
+        ~HashMapSwiss()
+        {
+            destroy();
+        }
+
+        void init(uint32_t _maxPowTwo = MinMax, AllocatorI* _allocator = &g_crtAllocator)
+        {
+            DM_CHECK(dm::isPowTwo(_maxPowTwo), "HashMapSwiss::init() - Invalid value | %d", _maxPowTwo);
+
+            AllocPolicyTy::bind(_allocator);
+            initTable(DM_MAX(_maxPowTwo, uint32_t(MinMax)));
+        }
+
+        void destroy()
+        {
+            if (NULL != m_ctrl)
+            {
+                DM_FREE(this, m_ctrl);
+                m_ctrl = NULL;
+                m_slots = NULL;
+            }
+        }
+
+        void reset()
+        {
+            memset(m_ctrl, Empty, m_max+GroupSize);
+            m_count = 0;
+            m_removed = 0;
+        }
+
+        /// Returns true if the key was not in the map.
+        bool insert(const void* _key, uint8_t _keyLen, ValTy _val)
+        {
+            DM_CHECK(_keyLen <= KeyLen, "HashMapSwiss::insert() - Invalid key length | %d, %d", _keyLen, KeyLen);
+
+            Key key;
+            key.set(_key, _keyLen);
+            const uint64_t hash = key.template hash<HashPolicyTy>();
+
+            const uint32_t idx = findIdx(key, hash);
+            if (UINT32_MAX != idx)
+            {
+                m_slots[idx].m_val = _val;
+                return false;
+            }
+
+            if ((uint64_t(m_count) + m_removed + 1)*8 > uint64_t(m_max)*7)
+            {
+                rehash();
+            }
+
+            place(key, hash, _val);
+
+            return true;
+        }
+
+        bool insert(const char* _key, ValTy _val)
+        {
+            return insert((const uint8_t*)_key, strlen(_key), _val);
+        }
+
+        template <typename Ty>
+        bool insert(const Ty& _key, ValTy _val)
+        {
+            dm_staticAssert(sizeof(Ty) <= KeyLen);
+
+            return insert((const uint8_t*)&_key, sizeof(Ty), _val);
+        }
+
+        ValTy find(const void* _key, uint8_t _keyLen)
+        {
+            DM_CHECK(_keyLen <= KeyLen, "HashMapSwiss::find() - Invalid key length | %d, %d", _keyLen, KeyLen);
+
+            Key key;
+            key.set(_key, _keyLen);
+
+            const uint32_t idx = findIdx(key, key.template hash<HashPolicyTy>());
+            return (UINT32_MAX != idx) ? m_slots[idx].m_val : dm::TyInfo<ValTy>::Max();
+        }
+
+        ValTy find(const char* _key)
+        {
+            return find((const void*)_key, strlen(_key));
+        }
+
+        template <typename Ty>
+        ValTy find(const Ty& _key)
+        {
+            dm_staticAssert(sizeof(Ty) <= KeyLen);
+            return find((const void*)&_key, sizeof(Ty));
+        }
+
+        bool remove(const void* _key, uint8_t _keyLen)
+        {
+            DM_CHECK(_keyLen <= KeyLen, "HashMapSwiss::remove() - Invalid key length | %d, %d", _keyLen, KeyLen);
+
+            Key key;
+            key.set(_key, _keyLen);
+
+            const uint32_t idx = findIdx(key, key.template hash<HashPolicyTy>());
+            if (UINT32_MAX == idx)
+            {
+                return false;
+            }
+
+            setCtrl(idx, Removed);
+            m_count--;
+            m_removed++;
+
+            return true;
+        }
+
+        bool remove(const char* _key)
+        {
+            return remove((const void*)_key, strlen(_key));
+        }
+
+        template <typename Ty>
+        bool remove(const Ty& _key)
+        {
+            dm_staticAssert(sizeof(Ty) <= KeyLen);
+            return remove((const void*)&_key, sizeof(Ty));
+        }
+
+        uint32_t count() const
+        {
+            return m_count;
+        }
+
+        uint32_t max() const
+        {
+            return m_max;
+        }
+
+        /// Used and removed slots.
+        float loadFactor() const
+        {
+            return float(m_count + m_removed)/float(m_max);
+        }
+
+        /// Calls _func(const Key&, ValTy&) for every entry, in slot order. Must not insert or remove.
+        /// Control bytes are checked GroupSize at a time, so empty stretches cost one compare per group.
+        /// Slots '_prefetchDistance' groups ahead are prefetched and the scan ends once count() entries were visited.
+        template <typename FuncTy>
+        void forEach(FuncTy _func, uint32_t _prefetchDistance = 2)
+        {
+            const uint32_t mask = m_max-1;
+
+            uint32_t left = m_count;
+            for (uint32_t pos = 0; 0 != left; pos += GroupSize)
+            {
+                const uint8_t* ahead = (const uint8_t*)&m_slots[(pos + _prefetchDistance*GroupSize)&mask];
+                for (uint32_t offset = 0; offset < GroupSize*sizeof(KeyVal); offset += 64)
+                {
+                    DM_PREFETCH(ahead + offset);
+                }
+
+                // Used slots have the high bit clear.
+                uint32_t used = uint32_t(~_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)&m_ctrl[pos])))&0xffff;
+                while (0 != used)
+                {
+                    KeyVal& slot = m_slots[pos + cnttz_u32(used)];
+                    _func((const Key&)slot.m_key, slot.m_val);
+                    left--;
+
+                    used &= used-1;
+                }
+            }
+        }
+
+    private:
+        static uint32_t sizeFor(uint32_t _max)
+        {
+            // Control bytes keep slots 16 byte aligned.
+            return _max + GroupSize + _max*sizeof(KeyVal);
+        }
+
+        void initTable(uint32_t _max)
+        {
+            m_ctrl  = (uint8_t*)DM_ALLOC(this, sizeFor(_max));
+            m_slots = (KeyVal*)(m_ctrl + _max + GroupSize);
+            m_max   = _max;
+            reset();
+        }
+
+        void setCtrl(uint32_t _idx, uint8_t _ctrl)
+        {
+            m_ctrl[_idx] = _ctrl;
+
+            // Mirror.
+            if (_idx < GroupSize)
+            {
+                m_ctrl[m_max + _idx] = _ctrl;
+            }
+        }
+
+        /// Groups are visited at triangular offsets, which covers the whole table for power of two sizes.
+        uint32_t findIdx(const Key& _key, uint64_t _hash) const
+        {
+            const uint32_t mask = m_max-1;
+            const __m128i h2    = _mm_set1_epi8(char(_hash&0x7f));
+            const __m128i empty = _mm_set1_epi8(char(Empty));
+
+            uint32_t pos = uint32_t(_hash>>7)&mask;
+            for (uint32_t step = GroupSize; step <= m_max + GroupSize; step += GroupSize)
+            {
+                const __m128i group = _mm_loadu_si128((const __m128i*)&m_ctrl[pos]);
+
+                uint32_t match = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(group, h2)));
+                while (0 != match)
+                {
+                    const uint32_t idx = (pos + cnttz_u32(match))&mask;
+                    if (m_slots[idx].m_key.equals(_key))
+                    {
+                        return idx;
+                    }
+
+                    match &= match-1;
+                }
+
+                if (0 != _mm_movemask_epi8(_mm_cmpeq_epi8(group, empty)))
+                {
+                    return UINT32_MAX;
+                }
+
+                pos = (pos + step)&mask;
+            }
+
+            return UINT32_MAX;
+        }
+
+        /// Expects the key not to be in the table and a free slot to exist.
+        void place(const Key& _key, uint64_t _hash, ValTy _val)
+        {
+            const uint32_t mask = m_max-1;
+
+            uint32_t pos = uint32_t(_hash>>7)&mask;
+            uint32_t free = uint32_t(_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)&m_ctrl[pos])));
+            for (uint32_t step = GroupSize; 0 == free; step += GroupSize)
+            {
+                pos  = (pos + step)&mask;
+                free = uint32_t(_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)&m_ctrl[pos])));
+            }
+
+            const uint32_t idx = (pos + cnttz_u32(free))&mask;
+            if (Removed == m_ctrl[idx])
+            {
+                m_removed--;
+            }
+
+            setCtrl(idx, uint8_t(_hash&0x7f));
+            m_slots[idx].m_key = _key;
+            m_slots[idx].m_val = _val;
+            m_count++;
+        }
+
+        /// Doubles if live entries take at least half of the table, otherwise rebuilds at the same size to drop removed slots.
+        void rehash()
+        {
+            uint8_t* ctrl  = m_ctrl;
+            KeyVal*  slots = m_slots;
+            const uint32_t max = m_max;
+
+            const bool bigger = (uint64_t(m_count)*16 >= uint64_t(m_max)*7);
+            initTable(bigger ? max*2 : max);
+
+            for (uint32_t ii = 0; ii < max; ++ii)
+            {
+                if (0 == (ctrl[ii]&0x80))
+                {
+                    place(slots[ii].m_key, slots[ii].m_key.template hash<HashPolicyTy>(), slots[ii].m_val);
+                }
+            }
+
+            DM_FREE(this, ctrl);
+        }
+
+        uint8_t* m_ctrl;
+        KeyVal*  m_slots;
+        uint32_t m_max;
+        uint32_t m_count;
+        uint32_t m_removed;
+    };
+
+    ///
+    /// HashMap for lookups shared between threads.
+    /// find() takes no locks: slots are claimed once with CAS and published with a release store of their state,
+    /// keys never move within a table and removed slots keep their key until the next resize.
+    /// insert() and remove() lock one of NumStripes mutexes picked by the key hash, so writers of the same key are serialized
+    /// while writers of different keys run in parallel. Resize locks all stripes, copies live entries to a new table and publishes it.
+    /// Readers count themselves in one of two epoch counters. After publishing, resize moves to the next epoch,
+    /// waits for the counter of the previous one to drain and frees the replaced table, so memory stays bounded under churn.
+    /// insert() overwrites the value of an existing key.
+    ///
+    template <uint8_t KeyLength, typename ValTy/*arithmetic type*/, typename AllocPolicyTy = AllocatorIPolicy, typename HashPolicyTy = WyHashPolicy>
+    struct HashMapConcurrent : AllocPolicyTy
+    {
+        enum
+        {
+            KeyLen = KeyLength,
+
+            Empty   = 0,
+            Busy    = 1, // Claimed, key and value are being written.
+            Used    = 2,
+            Removed = 3,
+
+            NumStripes = 64,
+            MinMax     = NumStripes*4, // Writers check the load before claiming a slot, leave room for one claim per stripe.
+        };
+        typedef ValTy ValueType;
+        typedef HashMapKey<KeyLen> Key;
+
+        HashMapConcurrent()
+        {
+            m_table = NULL;
+            m_count = 0;
+            m_epoch = 0;
+            m_readers[0].m_count = 0;
+            m_readers[1].m_count = 0;
+        }
+
+        ~HashMapConcurrent()
+        {
+            destroy();
+        }
+
+        void init(uint32_t _maxPowTwo = MinMax, AllocatorI* _allocator = &g_crtAllocator)
+        {
+            DM_CHECK(dm::isPowTwo(_maxPowTwo), "HashMapConcurrent::init() - Invalid value | %d", _maxPowTwo);
+
+            // Values are read while they are written, they have to fit a single store.
+            dm_staticAssert(sizeof(ValTy) <= sizeof(void*));
+
+            AllocPolicyTy::bind(_allocator);
+            m_table = createTable(DM_MAX(_maxPowTwo, uint32_t(MinMax)));
+            m_count = 0;
+        }
+
+        /// Not thread safe.
+        void destroy()
+        {
+            if (NULL != m_table)
+            {
+                DM_FREE(this, m_table);
+                m_table = NULL;
+            }
+        }
+
+        /// Returns true if the key was not in the map.
+        bool insert(const Key& _key, ValTy _val)
+        {
+            const uint64_t hash = _key.template hash<HashPolicyTy>();
+            Stripe& stripe = m_stripes[stripeOf(hash)];
+
+            for (;;)
+            {
+                stripe.m_mutex.lock();
+
+                Table* table = m_table;
+                if (isFull(table))
+                {
+                    stripe.m_mutex.unlock();
+                    grow();
+                    continue;
+                }
+
+                const uint32_t mask = table->m_max-1;
+                uint32_t idx = uint32_t(hash)&mask;
+                for (uint32_t ii = table->m_max; ii--; idx = (idx+1)&mask)
+                {
+                    Slot& slot = table->m_slots[idx];
+
+                    uint32_t state = atomicLoadAcquire(&slot.m_state);
+                    if (Empty == state)
+                    {
+                        state = atomicCompareAndSwap(&slot.m_state, uint32_t(Empty), uint32_t(Busy));
+                        if (Empty == state)
+                        {
+                            slot.m_key = _key;
+                            slot.m_val = _val;
+                            atomicStoreRelease(&slot.m_state, Used);
+
+                            atomicFetchAndAdd(&table->m_used, 1u);
+                            atomicFetchAndAdd(&m_count, 1u);
+
+                            stripe.m_mutex.unlock();
+                            return true;
+                        }
+
+                        // Claimed by a writer of a different key, it has a different stripe.
+                        state = atomicLoadAcquire(&slot.m_state);
+                    }
+
+                    if (Busy != state
+                    &&  slot.m_key.equals(_key))
+                    {
+                        slot.m_val = _val;
+
+                        const bool added = (Removed == state);
+                        if (added)
+                        {
+                            atomicStoreRelease(&slot.m_state, Used);
+                            atomicFetchAndAdd(&m_count, 1u);
+                        }
+
+                        stripe.m_mutex.unlock();
+                        return added;
+                    }
+                }
+
+                stripe.m_mutex.unlock();
+
+                DM_CHECK(false, "HashMapConcurrent::insert() - Map is full | %d", table->m_max);
+                return false;
+            }
+        }
+
+        bool insert(const void* _key, uint8_t _keyLen, ValTy _val)
+        {
+            DM_CHECK(_keyLen <= KeyLen, "HashMapConcurrent::insert() - Invalid key length | %d, %d", _keyLen, KeyLen);
+
+            Key key;
+            key.set(_key, _keyLen);
+            return insert(key, _val);
+        }
+
+        bool insert(const char* _key, ValTy _val)
+        {
+            return insert((const uint8_t*)_key, strlen(_key), _val);
+        }
+
+        template <typename Ty>
+        bool insert(const Ty& _key, ValTy _val)
+        {
+            dm_staticAssert(sizeof(Ty) <= KeyLen);
+
+            Key key;
+            key.set(&_key, sizeof(Ty));
+            return insert(key, _val);
+        }
+
+        /// Lock free.
+        ValTy find(const Key& _key) const
+        {
+            const uint64_t hash = _key.template hash<HashPolicyTy>();
+            ValTy result = dm::TyInfo<ValTy>::Max();
+
+            const uint32_t epoch = enterRead();
+            const Table* table = (const Table*)atomicLoadAcquirePtr((void* const volatile*)&m_table);
+
+            const uint32_t mask = table->m_max-1;
+            uint32_t idx = uint32_t(hash)&mask;
+            for (uint32_t ii = table->m_max; ii--; idx = (idx+1)&mask)
+            {
+                const Slot& slot = table->m_slots[idx];
+
+                const uint32_t state = atomicLoadAcquire(&slot.m_state);
+                if (Empty == state)
+                {
+                    break;
+                }
+                else if (Busy != state
+                     &&  slot.m_key.equals(_key))
+                {
+                    if (Used == state)
+                    {
+                        result = slot.m_val;
+                    }
+                    break;
+                }
+            }
+
+            leaveRead(epoch);
+
+            return result;
+        }
+
+        ValTy find(const void* _key, uint8_t _keyLen) const
+        {
+            DM_CHECK(_keyLen <= KeyLen, "HashMapConcurrent::find() - Invalid key length | %d, %d", _keyLen, KeyLen);
+
+            Key key;
+            key.set(_key, _keyLen);
+            return find(key);
+        }
+
+        ValTy find(const char* _key) const
+        {
+            return find((const void*)_key, strlen(_key));
+        }
+
+        template <typename Ty>
+        ValTy find(const Ty& _key) const
+        {
+            dm_staticAssert(sizeof(Ty) <= KeyLen);
+
+            Key key;
+            key.set(&_key, sizeof(Ty));
+            return find(key);
+        }
+
+        bool remove(const Key& _key)
+        {
+            const uint64_t hash = _key.template hash<HashPolicyTy>();
+            Stripe& stripe = m_stripes[stripeOf(hash)];
+            MutexScope lock(stripe.m_mutex);
+
+            Table* table = m_table;
+            const uint32_t mask = table->m_max-1;
+            uint32_t idx = uint32_t(hash)&mask;
+            for (uint32_t ii = table->m_max; ii--; idx = (idx+1)&mask)
+            {
+                Slot& slot = table->m_slots[idx];
+
+                const uint32_t state = atomicLoadAcquire(&slot.m_state);
+                if (Empty == state)
+                {
+                    break;
+                }
+                else if (Busy != state
+                     &&  slot.m_key.equals(_key))
+                {
+                    if (Used != state)
+                    {
+                        break;
+                    }
+
+                    atomicStoreRelease(&slot.m_state, Removed);
+                    atomicFetchAndAdd(&m_count, uint32_t(-1));
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool remove(const void* _key, uint8_t _keyLen)
+        {
+            DM_CHECK(_keyLen <= KeyLen, "HashMapConcurrent::remove() - Invalid key length | %d, %d", _keyLen, KeyLen);
+
+            Key key;
+            key.set(_key, _keyLen);
+            return remove(key);
+        }
+
+        bool remove(const char* _key)
+        {
+            return remove((const void*)_key, strlen(_key));
+        }
+
+        template <typename Ty>
+        bool remove(const Ty& _key)
+        {
+            dm_staticAssert(sizeof(Ty) <= KeyLen);
+
+            Key key;
+            key.set(&_key, sizeof(Ty));
+            return remove(key);
+        }
+
+        uint32_t count() const
+        {
+            return m_count;
+        }
+
+        uint32_t max() const
+        {
+            return m_table->m_max;
+        }
+
+    private:
+        struct Slot
+        {
+            volatile uint32_t m_state;
+            Key               m_key;
+            volatile ValTy    m_val;
+        };
+
+        struct Table
+        {
+            Slot*             m_slots;
+            uint32_t          m_max;
+            volatile uint32_t m_used; // Used and removed slots.
+        };
+
+        /// Padded so that writers on different stripes do not share a cache line.
+        struct Stripe
+        {
+            Mutex   m_mutex;
+            uint8_t m_pad[64 - sizeof(Mutex)%64];
+        };
+
+        /// Padded so that readers do not share a cache line with writers.
+        struct ReaderCount
+        {
+            volatile uint32_t m_count;
+            uint8_t           m_pad[64 - sizeof(uint32_t)];
+        };
+
+        static uint32_t stripeOf(uint64_t _hash)
+        {
+            // High bits, low bits pick the slot.
+            return uint32_t(_hash>>32)&(NumStripes-1);
+        }
+
+        Table* createTable(uint32_t _max)
+        {
+            Table* table = (Table*)DM_ALLOC(this, sizeof(Table) + _max*sizeof(Slot));
+            table->m_slots   = (Slot*)((uint8_t*)table + sizeof(Table));
+            table->m_max     = _max;
+            table->m_used    = 0;
+            memset((void*)table->m_slots, 0, _max*sizeof(Slot));
+
+            return table;
+        }
+
+        /// Used and removed slots over 3/4 of the table.
+        static bool isFull(const Table* _table)
+        {
+            return (uint64_t(atomicLoadAcquire(&_table->m_used)) + 1)*4 > uint64_t(_table->m_max)*3;
+        }
+
+        /// Counts the reader in the current epoch. Retries if the epoch moved on in between,
+        /// so that a resize waiting for the previous epoch to drain cannot miss a reader of the replaced table.
+        uint32_t enterRead() const
+        {
+            for (;;)
+            {
+                const uint32_t epoch = atomicLoadAcquire(&m_epoch);
+                atomicFetchAndAdd(&m_readers[epoch&1].m_count, 1u);
+                if (epoch == atomicLoadAcquire(&m_epoch))
+                {
+                    return epoch;
+                }
+
+                atomicFetchAndAdd(&m_readers[epoch&1].m_count, uint32_t(-1));
+            }
+        }
+
+        void leaveRead(uint32_t _epoch) const
+        {
+            atomicFetchAndAdd(&m_readers[_epoch&1].m_count, uint32_t(-1));
+        }
+
+        /// Doubles if live entries take at least a quarter of the table, otherwise rebuilds at the same size to drop removed slots.
+        void grow()
+        {
+            for (uint32_t ii = 0; ii < NumStripes; ++ii)
+            {
+                m_stripes[ii].m_mutex.lock();
+            }
+
+            // Another writer might have been first.
+            Table* full = m_table;
+            if (isFull(full))
+            {
+                const bool bigger = (uint64_t(m_count)*4 >= uint64_t(full->m_max));
+                Table* table = createTable(bigger ? full->m_max*2 : full->m_max);
+
+                const uint32_t mask = table->m_max-1;
+                for (uint32_t ii = 0; ii < full->m_max; ++ii)
+                {
+                    const Slot& src = full->m_slots[ii];
+                    if (Used == src.m_state)
+                    {
+                        uint32_t idx = uint32_t(src.m_key.template hash<HashPolicyTy>())&mask;
+                        while (Empty != table->m_slots[idx].m_state)
+                        {
+                            idx = (idx+1)&mask;
+                        }
+
+                        Slot& dst = table->m_slots[idx];
+                        dst.m_key   = src.m_key;
+                        dst.m_val   = src.m_val;
+                        dst.m_state = Used;
+                        table->m_used++;
+                    }
+                }
+
+                atomicStoreReleasePtr((void* volatile*)&m_table, table);
+
+                // Readers that started before the table was published are all counted in the epoch being left.
+                const uint32_t epoch = atomicFetchAndAdd(&m_epoch, 1u);
+                while (0 != atomicLoadAcquire(&m_readers[epoch&1].m_count))
+                {
+                    threadYield();
+                }
+
+                DM_FREE(this, full);
+            }
+
+            for (uint32_t ii = NumStripes; ii--; )
+            {
+                m_stripes[ii].m_mutex.unlock();
+            }
+        }
+
+        Table* volatile     m_table;
+        volatile uint32_t   m_count;
+        volatile uint32_t   m_epoch;
+        mutable ReaderCount m_readers[2];
+        Stripe              m_stripes[NumStripes];
+    };
+
+    ///
+    /// HashMap with string keys of any length.
+    /// Keys are copied into one contiguous arena, slots only hold the key offset, length and 32 bits of its hash,
+    /// so memory follows the total key size instead of max()*KeyLen. Hashes are compared before keys are read from the arena.
+    /// Robin Hood ordering with backward shift removes, like HashMapImpl, with probe distances taken from the cached hash.
+    /// Bytes of removed keys are reclaimed by compacting the arena once they make up half of it.
+    /// insert() overwrites the value of an existing key.
+    ///
+    template <typename ValTy/*arithmetic type*/, typename AllocPolicyTy = AllocatorIPolicy, typename HashPolicyTy = WyHashPolicy>
+    struct HashMapString : AllocPolicyTy
+    {
+        enum
+        {
+            Empty = UINT32_MAX, // Offset of an unused slot.
+
+            MinMax       = 16,
+            MinArenaSize = 256,
+        };
+        typedef ValTy ValueType;
+
+        HashMapString()
+        {
+            m_slots = NULL;
+            m_arena = NULL;
+            m_max = 0;
+            m_count = 0;
+            m_arenaSize = 0;
+            m_arenaUsed = 0;
+            m_arenaGarbage = 0;
+        }
+
+        ~HashMapString()
+        {
+            destroy();
+        }
+
+        void init(uint32_t _maxPowTwo = MinMax, uint32_t _arenaSize = MinArenaSize, AllocatorI* _allocator = &g_crtAllocator)
+        {
+            DM_CHECK(dm::isPowTwo(_maxPowTwo), "HashMapString::init() - Invalid value | %d", _maxPowTwo);
+
+            AllocPolicyTy::bind(_allocator);
+
+            m_max = DM_MAX(_maxPowTwo, uint32_t(MinMax));
+            m_slots = (Slot*)DM_ALLOC(this, m_max*sizeof(Slot));
+
+            m_arenaSize = DM_MAX(_arenaSize, uint32_t(MinArenaSize));
+            m_arena = (char*)DM_ALLOC(this, m_arenaSize);
+
+            reset();
+        }
+
+        void destroy()
+        {
+            if (NULL != m_slots)
+            {
+                DM_FREE(this, m_slots);
+                DM_FREE(this, m_arena);
+                m_slots = NULL;
+                m_arena = NULL;
+            }
+        }
+
+        void reset()
+        {
+            for (uint32_t ii = 0; ii < m_max; ++ii)
+            {
+                m_slots[ii].m_offset = Empty;
+            }
+            m_count = 0;
+            m_arenaUsed = 0;
+            m_arenaGarbage = 0;
+        }
+
+        /// Returns true if the key was not in the map.
+        bool insert(const char* _key, uint32_t _keyLen, ValTy _val)
+        {
+            const uint32_t hash = uint32_t(HashPolicyTy::hash(_key, _keyLen));
+
+            const uint32_t idx = findIdx(_key, _keyLen, hash);
+            if (Empty != idx)
+            {
+                m_slots[idx].m_val = _val;
+                return false;
+            }
+
+            if ((uint64_t(m_count) + 1)*4 > uint64_t(m_max)*3)
+            {
+                grow();
+            }
+
+            Slot slot;
+            slot.m_hash   = hash;
+            slot.m_offset = storeKey(_key, _keyLen);
+            slot.m_len    = _keyLen;
+            slot.m_val    = _val;
+            place(slot);
+
+            return true;
+        }
+
+        bool insert(const char* _key, ValTy _val)
+        {
+            return insert(_key, uint32_t(strlen(_key)), _val);
+        }
+
+        ValTy find(const char* _key, uint32_t _keyLen)
+        {
+            const uint32_t hash = uint32_t(HashPolicyTy::hash(_key, _keyLen));
+
+            const uint32_t idx = findIdx(_key, _keyLen, hash);
+            return (Empty != idx) ? m_slots[idx].m_val : dm::TyInfo<ValTy>::Max();
+        }
+
+        ValTy find(const char* _key)
+        {
+            return find(_key, uint32_t(strlen(_key)));
+        }
+
+        bool remove(const char* _key, uint32_t _keyLen)
+        {
+            const uint32_t hash = uint32_t(HashPolicyTy::hash(_key, _keyLen));
+
+            uint32_t idx = findIdx(_key, _keyLen, hash);
+            if (Empty == idx)
+            {
+                return false;
+            }
+
+            m_arenaGarbage += m_slots[idx].m_len + 1;
+
+            // Backward shift: move the following entries one slot closer to home, until an empty slot or an entry already at home.
+            for (uint32_t next = wrapAround(idx+1); ; idx = next, next = wrapAround(next+1))
+            {
+                if (Empty == m_slots[next].m_offset
+                ||  0 == distanceOf(next))
+                {
+                    break;
+                }
+
+                m_slots[idx] = m_slots[next];
+            }
+
+            m_slots[idx].m_offset = Empty;
+            m_count--;
+
+            return true;
+        }
+
+        bool remove(const char* _key)
+        {
+            return remove(_key, uint32_t(strlen(_key)));
+        }
+
+        uint32_t count() const
+        {
+            return m_count;
+        }
+
+        uint32_t max() const
+        {
+            return m_max;
+        }
+
+        /// Arena bytes taken by keys, including removed ones not yet compacted.
+        uint32_t keyBytes() const
+        {
+            return m_arenaUsed;
+        }
+
+    private:
+        struct Slot
+        {
+            uint32_t m_hash;
+            uint32_t m_offset;
+            uint32_t m_len;
+            ValTy    m_val;
+        };
+
+        inline uint32_t wrapAround(uint32_t _v) const
+        {
+            return _v&(m_max-1);
+        }
+
+        inline uint32_t distanceOf(uint32_t _idx) const
+        {
+            return wrapAround(_idx - m_slots[_idx].m_hash);
+        }
+
+        uint32_t findIdx(const char* _key, uint32_t _keyLen, uint32_t _hash) const
+        {
+            uint32_t idx = wrapAround(_hash);
+            for (uint32_t dist = 0; dist < m_max; ++dist, idx = wrapAround(idx+1))
+            {
+                const Slot& slot = m_slots[idx];
+                if (Empty == slot.m_offset
+                ||  distanceOf(idx) < dist)
+                {
+                    break;
+                }
+
+                if (_hash   == slot.m_hash
+                &&  _keyLen == slot.m_len
+                &&  0 == memcmp(&m_arena[slot.m_offset], _key, _keyLen))
+                {
+                    return idx;
+                }
+            }
+
+            return Empty;
+        }
+
+        /// Expects a free slot to exist.
+        void place(Slot _slot)
+        {
+            uint32_t idx = wrapAround(_slot.m_hash);
+            for (uint32_t dist = 0; ; ++dist, idx = wrapAround(idx+1))
+            {
+                if (Empty == m_slots[idx].m_offset)
+                {
+                    m_slots[idx] = _slot;
+                    break;
+                }
+
+                const uint32_t slotDist = distanceOf(idx);
+                if (slotDist < dist)
+                {
+                    dm::swap(m_slots[idx], _slot);
+                    dist = slotDist;
+                }
+            }
+
+            m_count++;
+        }
+
+        /// Appends the key and a terminating zero to the arena, returns its offset.
+        uint32_t storeKey(const char* _key, uint32_t _keyLen)
+        {
+            const uint64_t needed = uint64_t(m_arenaUsed) + _keyLen + 1;
+            if (needed > m_arenaSize)
+            {
+                if (m_arenaGarbage*2 >= m_arenaUsed
+                &&  needed - m_arenaGarbage <= m_arenaSize)
+                {
+                    compact(m_arenaSize);
+                }
+                else
+                {
+                    uint64_t size = uint64_t(m_arenaSize)*2;
+                    while (size < needed)
+                    {
+                        size *= 2;
+                    }
+                    DM_CHECK(size <= UINT32_MAX, "HashMapString::storeKey() - Key arena is over 4GB | %llu", (unsigned long long)size);
+
+                    compact(uint32_t(size));
+                }
+            }
+
+            const uint32_t offset = m_arenaUsed;
+            memcpy(&m_arena[offset], _key, _keyLen);
+            m_arena[offset+_keyLen] = '\0';
+            m_arenaUsed += _keyLen + 1;
+
+            return offset;
+        }
+
+        /// Moves live keys to a new arena of '_size' bytes, dropping removed ones.
+        void compact(uint32_t _size)
+        {
+            char* arena = (char*)DM_ALLOC(this, _size);
+
+            uint32_t used = 0;
+            for (uint32_t ii = 0; ii < m_max; ++ii)
+            {
+                Slot& slot = m_slots[ii];
+                if (Empty != slot.m_offset)
+                {
+                    memcpy(&arena[used], &m_arena[slot.m_offset], slot.m_len + 1);
+                    slot.m_offset = used;
+                    used += slot.m_len + 1;
+                }
+            }
+
+            DM_FREE(this, m_arena);
+            m_arena = arena;
+            m_arenaSize = _size;
+            m_arenaUsed = used;
+            m_arenaGarbage = 0;
+        }
+
+        void grow()
+        {
+            Slot* slots = m_slots;
+            const uint32_t max = m_max;
+
+            m_max = max*2;
+            m_slots = (Slot*)DM_ALLOC(this, m_max*sizeof(Slot));
+            for (uint32_t ii = 0; ii < m_max; ++ii)
+            {
+                m_slots[ii].m_offset = Empty;
+            }
+            m_count = 0;
+
+            for (uint32_t ii = 0; ii < max; ++ii)
+            {
+                if (Empty != slots[ii].m_offset)
+                {
+                    place(slots[ii]);
+                }
+            }
+
+            DM_FREE(this, slots);
+        }
+
+        Slot*    m_slots;
+        char*    m_arena;
+        uint32_t m_max;
+        uint32_t m_count;
+        uint32_t m_arenaSize;
+        uint32_t m_arenaUsed;
+        uint32_t m_arenaGarbage;
+    };
+
 } // namespace DM_NAMESPACE
 #   endif // DM_HASHMAP_H_HEADERGUARD
 #endif // (DM_INCL & DM_INCL_HEADER_BODY)
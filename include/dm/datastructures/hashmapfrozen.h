@@ -0,0 +1,642 @@
+/*
+ * Copyright 2016 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "../dm.h"
+
+/// Header includes.
+#if (DM_INCL & DM_INCL_HEADER_INCLUDES)
+    #include <stdint.h>
+    #include <stdio.h>     // fopen()
+    #include "../platform.h"
+    #include "../misc.h"   // DM_MAX
+    #include "../check.h"
+    #include "../hash.h"   // WyHashPolicy, hashFmix64()
+    #include "../compiletime.h" // TyInfo
+    #include "../bitops.h" // cntbits_u64
+    #include "../allocatori.h"
+    #include "hashmap.h"   // HashMapKey
+
+    #if DM_PLATFORM_POSIX
+    #   include <sys/mman.h> // mmap()
+    #   include <sys/stat.h> // fstat()
+    #   include <fcntl.h>    // open()
+    #   include <unistd.h>   // close()
+    #endif // DM_PLATFORM_POSIX
+#endif // (DM_INCL & DM_INCL_HEADER_INCLUDES)
+
+/// Header body.
+#if (DM_INCL & DM_INCL_HEADER_BODY)
+#   if (DM_INCL & DM_INCL_HEADER_BODY_OPT_REMOVE_HEADER_GUARD)
+#       undef DM_HASHMAPFROZEN_H_HEADERGUARD
+#   endif // if (DM_INCL & DM_INCL_HEADER_BODY_OPT_REMOVE_HEADER_GUARD)
+#   ifndef DM_HASHMAPFROZEN_H_HEADERGUARD
+#   define DM_HASHMAPFROZEN_H_HEADERGUARD
+namespace DM_NAMESPACE
+{
+    ///
+    /// Read-only map over a fixed key set, built once by HashMapFrozenBuilder and used in place by HashMapFrozen.
+    ///
+    /// Minimal perfect hash in the hash-and-displace style (CHD, PTHash): keys are split into buckets of about four,
+    /// each bucket gets the first 16-bit pilot that sends all of its keys to free positions out of count*5/4.
+    /// Positions are then ranked with a bitmap, so entries are stored densely, count of them.
+    /// A lookup is one pilot read, one bitmap word with its rank and one key compare.
+    ///
+    /// Serialized layout, offsets from the header start, sections 64 byte aligned:
+    ///     HashMapFrozenHeader
+    ///     uint16_t pilots[numBuckets]
+    ///     uint64_t words[numWords]    // Used positions.
+    ///     uint32_t ranks[numWords]    // Used positions before each word.
+    ///     Entry    entries[count]     // { HashMapKey<KeyLen> m_key; ValTy m_val; }
+    /// Values are native endian and the entry layout is checked by size, tables move between builds of the same platform.
+    ///
+    struct HashMapFrozenHeader
+    {
+        enum { Version = 1 };
+
+        char     m_magic[4]; // "DMPH"
+        uint32_t m_version;
+        uint32_t m_keyLen;
+        uint32_t m_entrySize;
+        uint32_t m_count;
+        uint32_t m_numBuckets;
+        uint32_t m_numPositions;
+        uint32_t m_numWords;
+        uint64_t m_seed;
+        uint64_t m_hashCheck; // Hash of a fixed string, tables built with a different hash policy are rejected.
+        uint64_t m_pilotsOffset;
+        uint64_t m_wordsOffset;
+        uint64_t m_ranksOffset;
+        uint64_t m_entriesOffset;
+        uint64_t m_size;
+    };
+
+    template <typename HashPolicyTy>
+    DM_INLINE uint64_t hashMapFrozenHashCheck()
+    {
+        return HashPolicyTy::hash("dm::HashMapFrozen", 17);
+    }
+
+    DM_INLINE uint32_t hashMapFrozenRange(uint32_t _val, uint32_t _range)
+    {
+        return uint32_t((uint64_t(_val)*_range)>>32);
+    }
+
+    DM_INLINE uint32_t hashMapFrozenPosition(uint64_t _hash, uint16_t _pilot, uint32_t _numPositions)
+    {
+        const uint64_t mixed = hashFmix64(_hash + (uint64_t(_pilot)+1)*UINT64_C(0x9e3779b97f4a7c15));
+        return hashMapFrozenRange(uint32_t(mixed>>32), _numPositions);
+    }
+
+    DM_INLINE uint64_t hashMapFrozenAlign(uint64_t _offset)
+    {
+        return (_offset+63)&~UINT64_C(63);
+    }
+
+    /// Section of '_bytes' at '_offset' lies after the header and within '_size', 8 byte aligned. Written without overflow for corrupted offsets.
+    DM_INLINE bool hashMapFrozenSectionFits(uint64_t _offset, uint64_t _bytes, uint64_t _size)
+    {
+        return (0 == (_offset&7))
+            && (sizeof(HashMapFrozenHeader) <= _offset)
+            && (_offset <= _size)
+            && (_bytes <= _size-_offset);
+    }
+
+    template <uint8_t KeyLength, typename ValTy/*arithmetic type*/, typename AllocPolicyTy = AllocatorIPolicy, typename HashPolicyTy = WyHashPolicy>
+    struct HashMapFrozenBuilder : AllocPolicyTy
+    {
+        enum
+        {
+            KeyLen = KeyLength,
+
+            MaxSeeds  = 16,
+            MaxPilots = UINT16_MAX+1,
+        };
+        typedef ValTy ValueType;
+        typedef HashMapKey<KeyLen> Key;
+
+        struct Entry
+        {
+            Key   m_key;
+            ValTy m_val;
+        };
+
+        HashMapFrozenBuilder()
+        {
+            m_entries = NULL;
+            m_count = 0;
+            m_max = 0;
+            m_blob = NULL;
+        }
+
+        ~HashMapFrozenBuilder()
+        {
+            destroy();
+        }
+
+        void init(uint32_t _reserve = 1024, AllocatorI* _allocator = &g_crtAllocator)
+        {
+            AllocPolicyTy::bind(_allocator);
+
+            m_max = DM_MAX(_reserve, uint32_t(16));
+            m_entries = (Entry*)DM_ALLOC(this, m_max*sizeof(Entry));
+            m_count = 0;
+        }
+
+        void destroy()
+        {
+            if (NULL != m_entries)
+            {
+                DM_FREE(this, m_entries);
+                m_entries = NULL;
+            }
+
+            freeBlob();
+        }
+
+        void add(const void* _key, uint8_t _keyLen, ValTy _val)
+        {
+            DM_CHECK(_keyLen <= KeyLen, "HashMapFrozenBuilder::add() - Invalid key length | %d, %d", _keyLen, KeyLen);
+
+            if (m_count == m_max)
+            {
+                m_max *= 2;
+                m_entries = (Entry*)DM_REALLOC(this, m_entries, m_max*sizeof(Entry));
+            }
+
+            m_entries[m_count].m_key.set(_key, _keyLen);
+            m_entries[m_count].m_val = _val;
+            m_count++;
+        }
+
+        void add(const char* _key, ValTy _val)
+        {
+            add((const uint8_t*)_key, strlen(_key), _val);
+        }
+
+        template <typename Ty>
+        void add(const Ty& _key, ValTy _val)
+        {
+            dm_staticAssert(sizeof(Ty) <= KeyLen);
+
+            add((const uint8_t*)&_key, sizeof(Ty), _val);
+        }
+
+        /// Computes the perfect hash and lays out the serialized table. Returns false for repeated keys.
+        bool build()
+        {
+            freeBlob();
+
+            for (uint32_t seed = 0; seed < MaxSeeds; ++seed)
+            {
+                const BuildResult result = tryBuild(hashFmix64(uint64_t(seed)+1));
+                if (Built == result)
+                {
+                    return true;
+                }
+                else if (Duplicate == result)
+                {
+                    return false;
+                }
+            }
+
+            DM_CHECK(false, "HashMapFrozenBuilder::build() - No seed worked | %d", m_count);
+            return false;
+        }
+
+        /// Serialized table, valid after build() until the next build() or destroy().
+        const void* data() const
+        {
+            return m_blob;
+        }
+
+        uint64_t size() const
+        {
+            return (NULL != m_blob) ? ((const HashMapFrozenHeader*)m_blob)->m_size : 0;
+        }
+
+        bool save(const char* _path) const
+        {
+            if (NULL == m_blob)
+            {
+                return false;
+            }
+
+            FILE* file = fopen(_path, "wb");
+            if (NULL == file)
+            {
+                return false;
+            }
+
+            const bool written = (1 == fwrite(m_blob, size_t(size()), 1, file));
+            return (0 == fclose(file)) && written;
+        }
+
+    private:
+        enum BuildResult
+        {
+            Built,
+            Duplicate,
+            Retry,
+        };
+
+        BuildResult tryBuild(uint64_t _seed)
+        {
+            const uint32_t count        = m_count;
+            const uint32_t numBuckets   = DM_MAX((count+3)/4, uint32_t(1));
+            const uint32_t numPositions = count + count/4 + 1;
+            const uint32_t numWords     = (numPositions+63)/64;
+
+            uint64_t* hashes    = (uint64_t*)DM_ALLOC(this, count*sizeof(uint64_t));
+            uint32_t* positions = (uint32_t*)DM_ALLOC(this, count*sizeof(uint32_t));
+            uint32_t* order     = (uint32_t*)DM_ALLOC(this, count*sizeof(uint32_t));        // Keys grouped by bucket.
+            uint32_t* begin     = (uint32_t*)DM_ALLOC(this, (numBuckets+1)*sizeof(uint32_t));
+            uint32_t* buckets   = (uint32_t*)DM_ALLOC(this, numBuckets*sizeof(uint32_t));   // Biggest first.
+            uint16_t* pilots    = (uint16_t*)DM_ALLOC(this, numBuckets*sizeof(uint16_t));
+            uint64_t* words     = (uint64_t*)DM_ALLOC(this, numWords*sizeof(uint64_t));
+            memset(begin, 0, (numBuckets+1)*sizeof(uint32_t));
+            memset(words, 0, numWords*sizeof(uint64_t));
+
+            // Group keys by bucket.
+            uint32_t maxBucketSize = 0;
+            for (uint32_t ii = 0; ii < count; ++ii)
+            {
+                hashes[ii] = hashFmix64(m_entries[ii].m_key.template hash<HashPolicyTy>() + _seed);
+                begin[hashMapFrozenRange(uint32_t(hashes[ii]), numBuckets)+1]++;
+            }
+            for (uint32_t ii = 0; ii < numBuckets; ++ii)
+            {
+                maxBucketSize = DM_MAX(maxBucketSize, begin[ii+1]);
+                begin[ii+1] += begin[ii];
+            }
+            for (uint32_t ii = 0; ii < count; ++ii)
+            {
+                const uint32_t bucket = hashMapFrozenRange(uint32_t(hashes[ii]), numBuckets);
+                order[begin[bucket]++] = ii;
+            }
+            for (uint32_t ii = numBuckets; ii--; )
+            {
+                begin[ii+1] = begin[ii];
+            }
+            begin[0] = 0;
+
+            // Sort buckets by size, descending. Big buckets are placed while most positions are free.
+            uint32_t* sizeBegin = (uint32_t*)DM_ALLOC(this, (maxBucketSize+2)*sizeof(uint32_t));
+            memset(sizeBegin, 0, (maxBucketSize+2)*sizeof(uint32_t));
+            for (uint32_t ii = 0; ii < numBuckets; ++ii)
+            {
+                sizeBegin[maxBucketSize - (begin[ii+1]-begin[ii]) + 1]++;
+            }
+            for (uint32_t ii = 0; ii <= maxBucketSize; ++ii)
+            {
+                sizeBegin[ii+1] += sizeBegin[ii];
+            }
+            for (uint32_t ii = 0; ii < numBuckets; ++ii)
+            {
+                buckets[sizeBegin[maxBucketSize - (begin[ii+1]-begin[ii])]++] = ii;
+            }
+            DM_FREE(this, sizeBegin);
+
+            BuildResult result = Built;
+            for (uint32_t ii = 0; ii < numBuckets && Built == result; ++ii)
+            {
+                const uint32_t bucket = buckets[ii];
+                const uint32_t first  = begin[bucket];
+                const uint32_t last   = begin[bucket+1];
+                pilots[bucket] = 0;
+
+                // Keys of equal hash can not be told apart by any pilot.
+                for (uint32_t jj = first; jj < last && Built == result; ++jj)
+                {
+                    for (uint32_t kk = jj+1; kk < last; ++kk)
+                    {
+                        if (hashes[order[jj]] == hashes[order[kk]])
+                        {
+                            result = m_entries[order[jj]].m_key.equals(m_entries[order[kk]].m_key) ? Duplicate : Retry;
+                            break;
+                        }
+                    }
+                }
+
+                uint32_t pilot = 0;
+                for (; pilot < MaxPilots && Built == result && first != last; ++pilot)
+                {
+                    uint32_t placed = first;
+                    for (; placed < last; ++placed)
+                    {
+                        const uint32_t pos = hashMapFrozenPosition(hashes[order[placed]], uint16_t(pilot), numPositions);
+                        const uint64_t bit = UINT64_C(1)<<(pos&63);
+                        if (0 != (words[pos>>6]&bit))
+                        {
+                            break;
+                        }
+
+                        words[pos>>6] |= bit;
+                        positions[order[placed]] = pos;
+                    }
+
+                    if (placed == last)
+                    {
+                        pilots[bucket] = uint16_t(pilot);
+                        break;
+                    }
+
+                    // Undo.
+                    for (uint32_t jj = first; jj < placed; ++jj)
+                    {
+                        const uint32_t pos = positions[order[jj]];
+                        words[pos>>6] &= ~(UINT64_C(1)<<(pos&63));
+                    }
+                }
+
+                if (MaxPilots == pilot)
+                {
+                    result = Retry;
+                }
+            }
+
+            if (Built == result)
+            {
+                writeBlob(_seed, numBuckets, numPositions, numWords, pilots, words, positions);
+            }
+
+            DM_FREE(this, words);
+            DM_FREE(this, pilots);
+            DM_FREE(this, buckets);
+            DM_FREE(this, begin);
+            DM_FREE(this, order);
+            DM_FREE(this, positions);
+            DM_FREE(this, hashes);
+
+            return result;
+        }
+
+        void writeBlob(uint64_t _seed
+                     , uint32_t _numBuckets
+                     , uint32_t _numPositions
+                     , uint32_t _numWords
+                     , const uint16_t* _pilots
+                     , const uint64_t* _words
+                     , const uint32_t* _positions
+                     )
+        {
+            HashMapFrozenHeader header;
+            memcpy(header.m_magic, "DMPH", 4);
+            header.m_version       = HashMapFrozenHeader::Version;
+            header.m_keyLen        = KeyLen;
+            header.m_entrySize     = sizeof(Entry);
+            header.m_count         = m_count;
+            header.m_numBuckets    = _numBuckets;
+            header.m_numPositions  = _numPositions;
+            header.m_numWords      = _numWords;
+            header.m_seed          = _seed;
+            header.m_hashCheck     = hashMapFrozenHashCheck<HashPolicyTy>();
+            header.m_pilotsOffset  = hashMapFrozenAlign(sizeof(HashMapFrozenHeader));
+            header.m_wordsOffset   = hashMapFrozenAlign(header.m_pilotsOffset + _numBuckets*sizeof(uint16_t));
+            header.m_ranksOffset   = hashMapFrozenAlign(header.m_wordsOffset  + _numWords*sizeof(uint64_t));
+            header.m_entriesOffset = hashMapFrozenAlign(header.m_ranksOffset  + _numWords*sizeof(uint32_t));
+            header.m_size          = hashMapFrozenAlign(header.m_entriesOffset + uint64_t(m_count)*sizeof(Entry));
+
+            m_blob = (uint8_t*)DM_ALLOC(this, size_t(header.m_size));
+            memset(m_blob, 0, size_t(header.m_size));
+            memcpy(m_blob, &header, sizeof(header));
+            memcpy(m_blob + header.m_pilotsOffset, _pilots, _numBuckets*sizeof(uint16_t));
+            memcpy(m_blob + header.m_wordsOffset,  _words,  _numWords*sizeof(uint64_t));
+
+            uint32_t* ranks = (uint32_t*)(m_blob + header.m_ranksOffset);
+            uint32_t rank = 0;
+            for (uint32_t ii = 0; ii < _numWords; ++ii)
+            {
+                ranks[ii] = rank;
+                rank += uint32_t(cntbits_u64(_words[ii]));
+            }
+
+            Entry* entries = (Entry*)(m_blob + header.m_entriesOffset);
+            for (uint32_t ii = 0; ii < m_count; ++ii)
+            {
+                const uint32_t pos = _positions[ii];
+                const uint64_t below = _words[pos>>6] & ((UINT64_C(1)<<(pos&63))-1);
+                memcpy(&entries[ranks[pos>>6] + cntbits_u64(below)], &m_entries[ii], sizeof(Entry));
+            }
+        }
+
+        void freeBlob()
+        {
+            if (NULL != m_blob)
+            {
+                DM_FREE(this, m_blob);
+                m_blob = NULL;
+            }
+        }
+
+        Entry*   m_entries;
+        uint32_t m_count;
+        uint32_t m_max;
+        uint8_t* m_blob;
+    };
+
+    template <uint8_t KeyLength, typename ValTy/*arithmetic type*/, typename HashPolicyTy = WyHashPolicy>
+    struct HashMapFrozen
+    {
+        enum { KeyLen = KeyLength };
+        typedef ValTy ValueType;
+        typedef HashMapKey<KeyLen> Key;
+        typedef typename HashMapFrozenBuilder<KeyLen, ValTy, AllocatorIPolicy, HashPolicyTy>::Entry Entry;
+
+        HashMapFrozen()
+        {
+            m_header = NULL;
+            m_mapped = NULL;
+            m_mappedSize = 0;
+        }
+
+        ~HashMapFrozen()
+        {
+            close();
+        }
+
+        /// Uses the table at '_mem' in place, it has to stay valid and 8 byte aligned.
+        /// Returns false if it is not a table, was written for a different key length, value type or hash policy,
+        /// or is truncated or its sections do not fit in it. Reads the header only, see validate() for the rest.
+        bool init(const void* _mem, uint64_t _size)
+        {
+            const HashMapFrozenHeader* header = (const HashMapFrozenHeader*)_mem;
+            if (_size < sizeof(HashMapFrozenHeader)
+            ||  0 != memcmp(header->m_magic, "DMPH", 4)
+            ||  HashMapFrozenHeader::Version != header->m_version
+            ||  KeyLen        != header->m_keyLen
+            ||  sizeof(Entry) != header->m_entrySize
+            ||  hashMapFrozenHashCheck<HashPolicyTy>() != header->m_hashCheck
+            ||  _size < header->m_size)
+            {
+                return false;
+            }
+
+            // Lookups index pilots by bucket, words and ranks by position/64 and entries by rank, all of it has to be inside.
+            const uint64_t size = header->m_size;
+            if (0 == header->m_numBuckets
+            ||  header->m_numPositions < header->m_count
+            ||  uint64_t(header->m_numWords)*64 < header->m_numPositions
+            ||  !hashMapFrozenSectionFits(header->m_pilotsOffset,  uint64_t(header->m_numBuckets)*sizeof(uint16_t), size)
+            ||  !hashMapFrozenSectionFits(header->m_wordsOffset,   uint64_t(header->m_numWords)*sizeof(uint64_t),   size)
+            ||  !hashMapFrozenSectionFits(header->m_ranksOffset,   uint64_t(header->m_numWords)*sizeof(uint32_t),   size)
+            ||  !hashMapFrozenSectionFits(header->m_entriesOffset, uint64_t(header->m_count)*sizeof(Entry),         size))
+            {
+                return false;
+            }
+
+            const uint8_t* mem = (const uint8_t*)_mem;
+            m_header  = header;
+            m_pilots  = (const uint16_t*)(mem + header->m_pilotsOffset);
+            m_words   = (const uint64_t*)(mem + header->m_wordsOffset);
+            m_ranks   = (const uint32_t*)(mem + header->m_ranksOffset);
+            m_entries = (const Entry*)   (mem + header->m_entriesOffset);
+
+            return true;
+        }
+
+        /// Walks the words and ranks sections of an initialized table, O(number of positions).
+        /// Returns false if a rank is off, so that a lookup could read an entry past the ones stored.
+        /// init() only checks that the sections are inside, call this too for tables from untrusted sources.
+        bool validate() const
+        {
+            // Ranks are the used positions before each word, 'count' used positions in total.
+            uint64_t rank = 0;
+            for (uint32_t ii = 0; ii < m_header->m_numWords; ++ii)
+            {
+                if (rank != m_ranks[ii])
+                {
+                    return false;
+                }
+
+                rank += cntbits_u64(m_words[ii]);
+            }
+
+            return rank == m_header->m_count;
+        }
+
+        /// Maps the file read-only and uses it in place, pages are loaded on first access. Posix only.
+        bool open(const char* _path)
+        {
+            close();
+
+            #if DM_PLATFORM_POSIX
+                const int fd = ::open(_path, O_RDONLY);
+                if (-1 == fd)
+                {
+                    return false;
+                }
+
+                struct stat st;
+                if (0 != ::fstat(fd, &st) || 0 == st.st_size)
+                {
+                    ::close(fd);
+                    return false;
+                }
+
+                void* mem = ::mmap(NULL, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+
+                if (MAP_FAILED == mem)
+                {
+                    return false;
+                }
+
+                m_mapped = mem;
+                m_mappedSize = uint64_t(st.st_size);
+
+                if (!init(mem, m_mappedSize))
+                {
+                    close();
+                    return false;
+                }
+
+                return true;
+            #else
+                DM_UNUSED(_path);
+                return false;
+            #endif // DM_PLATFORM_POSIX
+        }
+
+        void close()
+        {
+            #if DM_PLATFORM_POSIX
+                if (NULL != m_mapped)
+                {
+                    ::munmap(m_mapped, size_t(m_mappedSize));
+                }
+            #endif // DM_PLATFORM_POSIX
+
+            m_mapped = NULL;
+            m_mappedSize = 0;
+            m_header = NULL;
+        }
+
+        ValTy find(const Key& _key) const
+        {
+            const HashMapFrozenHeader* header = m_header;
+            if (0 == header->m_count)
+            {
+                return dm::TyInfo<ValTy>::Max();
+            }
+
+            const uint64_t hash   = hashFmix64(_key.template hash<HashPolicyTy>() + header->m_seed);
+            const uint32_t bucket = hashMapFrozenRange(uint32_t(hash), header->m_numBuckets);
+            const uint32_t pos    = hashMapFrozenPosition(hash, m_pilots[bucket], header->m_numPositions);
+
+            const uint64_t word = m_words[pos>>6];
+            const uint64_t bit  = UINT64_C(1)<<(pos&63);
+            if (0 == (word&bit))
+            {
+                return dm::TyInfo<ValTy>::Max();
+            }
+
+            const Entry& entry = m_entries[m_ranks[pos>>6] + uint32_t(cntbits_u64(word&(bit-1)))];
+            return entry.m_key.equals(_key) ? entry.m_val : dm::TyInfo<ValTy>::Max();
+        }
+
+        ValTy find(const void* _key, uint8_t _keyLen) const
+        {
+            DM_CHECK(_keyLen <= KeyLen, "HashMapFrozen::find() - Invalid key length | %d, %d", _keyLen, KeyLen);
+
+            Key key;
+            key.set(_key, _keyLen);
+            return find(key);
+        }
+
+        ValTy find(const char* _key) const
+        {
+            return find((const void*)_key, strlen(_key));
+        }
+
+        template <typename Ty>
+        ValTy find(const Ty& _key) const
+        {
+            dm_staticAssert(sizeof(Ty) <= KeyLen);
+
+            Key key;
+            key.set(&_key, sizeof(Ty));
+            return find(key);
+        }
+
+        uint32_t count() const
+        {
+            return m_header->m_count;
+        }
+
+    private:
+        const HashMapFrozenHeader* m_header;
+        const uint16_t* m_pilots;
+        const uint64_t* m_words;
+        const uint32_t* m_ranks;
+        const Entry*    m_entries;
+        void*           m_mapped;
+        uint64_t        m_mappedSize;
+    };
+
+} // namespace DM_NAMESPACE
+#   endif // DM_HASHMAPFROZEN_H_HEADERGUARD
+#endif // (DM_INCL & DM_INCL_HEADER_BODY)
+
+/* vim: set sw=4 ts=4 expandtab: */
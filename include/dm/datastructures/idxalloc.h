@@ -10,7 +10,7 @@
     #include <stdint.h>
     #include "../check.h"
     #include "../compiletime.h" // bestfit_type<>::type, TyInfo<>::Max()
-    #include "../ng/allocatori.h"
+    #include "../allocatori.h"
 #endif // (DM_INCL & DM_INCL_HEADER_INCLUDES)
 
 /// Header body.
@@ -185,8 +185,8 @@ namespace DM_NAMESPACE
 
     extern CrtAllocator g_crtAllocator;
 
-    template <typename IdxTy=uint16_t>
-    struct IdxAllocStorage
+    template <typename IdxTy=uint16_t, typename AllocPolicyTy = AllocatorIPolicy>
+    struct IdxAllocStorage : AllocPolicyTy
     {
         typedef IdxTy IdxType;
 
@@ -208,20 +208,20 @@ namespace DM_NAMESPACE
 
         void initStorage(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
+            AllocPolicyTy::bind(_allocator);
+
             const uint32_t idxSize = _max*sizeof(IdxType);
-            void* mem = dm_alloc(idxSize, _allocator);
+            void* mem = DM_ALLOC(this, idxSize);
 
             m_max = _max;
             m_indices = (IdxType*)mem;
-
-            m_allocator = _allocator;
         }
 
         void destroy()
         {
             if (NULL != m_indices)
             {
-                dm_free(m_indices, m_allocator);
+                DM_FREE(this, m_indices);
                 m_indices = NULL;
             }
         }
@@ -239,7 +239,6 @@ namespace DM_NAMESPACE
     private:
         uint32_t m_max;
         IdxType* m_indices;
-        AllocatorI* m_allocator;
     };
 
     template <uint32_t MaxHandlesT>
@@ -267,10 +266,10 @@ namespace DM_NAMESPACE
         }
     };
 
-    template <typename IdxTy=uint16_t>
-    struct IdxAlloc : IdxAllocImpl< IdxAllocStorage<IdxTy> >
+    template <typename IdxTy=uint16_t, typename AllocPolicyTy = AllocatorIPolicy>
+    struct IdxAlloc : IdxAllocImpl< IdxAllocStorage<IdxTy, AllocPolicyTy> >
     {
-        typedef IdxAllocImpl< IdxAllocStorage<IdxTy> > Base;
+        typedef IdxAllocImpl< IdxAllocStorage<IdxTy, AllocPolicyTy> > Base;
 
         void init(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
@@ -414,10 +414,15 @@ namespace DM_NAMESPACE
             m_elements = NULL;
         }
 
+        ~LinkedListStorage()
+        {
+            destroy();
+        }
+
         void initStorage(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
             const uint32_t totalSize = sizeFor(_max);
-            void* mem = dm_alloc(totalSize, _allocator);
+            void* mem = DM_ALLOC(_allocator, totalSize);
 
             uint8_t* elemBegin   = (uint8_t*)mem;
             uint8_t* handleBegin = (uint8_t*)mem + _max*sizeof(Elem);
@@ -433,7 +438,7 @@ namespace DM_NAMESPACE
         {
             if (NULL != m_elements)
             {
-                dm_free(m_elements, m_allocator);
+                DM_FREE(m_allocator, m_elements);
                 m_elements = NULL;
             }
         }
@@ -9,9 +9,12 @@
 #if (DM_INCL & DM_INCL_HEADER_INCLUDES)
     #include <stdint.h>
     #include "../check.h"
-    #include "../hash.h"
+    #include "../misc.h"    // DM_MIN
+    #include "../hash.h"    // WyHashPolicy
     #include "../compiletime.h"
-    #include "../ng/allocatori.h"
+    #include "../allocatori.h"
+    #include "../bitops.h"  // cnttz_u64
+    #include "hashmap.h"    // HashMapKey, hashMapUsedBitsSize()
 #endif // (DM_INCL & DM_INCL_HEADER_INCLUDES)
 
 /// Header body.
@@ -23,7 +26,11 @@
 #   define DM_OBJHASHMAP_H_HEADERGUARD
 namespace DM_NAMESPACE
 {
-    template <typename ObjHashMapStorage>
+    ///
+    /// Same probing as HashMapImpl: Robin Hood inserts, backward shift removes, m_used holds the probe distance plus one.
+    /// Objects are moved with memcpy when entries shift, pointers returned by insert() and find() are valid only until the next insert or remove.
+    ///
+    template <typename ObjHashMapStorage, typename HashPolicyTy = WyHashPolicy>
     struct ObjHashMapImpl : ObjHashMapStorage
     {
         /// Expected interface:
@@ -35,57 +42,74 @@ namespace DM_NAMESPACE
         ///
         ///         struct UsedKey
         ///         {
-        ///             uint8_t m_used;
-        ///             uint8_t m_key[KeyLen];
+        ///             HashMapKey<KeyLen> m_key;
+        ///             uint8_t            m_used;
         ///         };
         ///
         ///         UsedKey* uk();
         ///         ObjTy* objs();
+        ///         uint64_t* usedBits(); // hashMapUsedBitsSize(max()) bytes.
         ///         uint32_t max();
         ///         uint32_t keyLen();
         ///     };
         typedef typename ObjHashMapStorage::ObjectType ObjTy;
         typedef typename ObjHashMapStorage::UsedKey Uk;
+        typedef HashMapKey<ObjHashMapStorage::KeyLen> Key;
         using ObjHashMapStorage::uk;
         using ObjHashMapStorage::objs;
+        using ObjHashMapStorage::usedBits;
         using ObjHashMapStorage::max;
         using ObjHashMapStorage::keyLen;
 
         enum
         {
-            Unused   = 0x00,
-            Used     = 0x0f,
-            FirstHit = 0xff,
+            Unused = 0x00,
+            Far    = 0xff, // Probe distance of 254 or more, computed from the key when needed.
             InvalidHandle = UINT32_MAX,
+
+            PrefetchDistance = 1, // Used slots bitmap words (64 slots each) ahead of forEach().
         };
 
         ObjHashMapImpl() : ObjHashMapStorage()
         {
+            m_count = 0;
         }
 
         void init()
         {
             memset(uk(), Unused, max()*sizeof(Uk));
+            memset(usedBits(), 0, hashMapUsedBitsSize(max()));
+            m_count = 0;
         }
 
-        ObjTy* insert(const uint8_t* _key, uint8_t _keyLen)
+        ObjTy* insert(const Key& _key)
         {
-            DM_CHECK(_keyLen <= keyLen(), "ObjHashMapImpl::insert() - Invalid key length | %d, %d", _keyLen, keyLen());
+            if (m_count == max())
+            {
+                DM_CHECK(false, "ObjHashMapImpl::insert() - Map is full | %d", max());
+                return NULL;
+            }
 
-            const uint32_t hash = dm::hash(_key, _keyLen);
+            const uint32_t hash = uint32_t(_key.template hash<HashPolicyTy>());
             uint32_t idx = wrapAround(hash);
-            const uint32_t firstHit = idx;
-            for (;;)
+            uint32_t dist = 0;
+            while (Unused != uk()[idx].m_used
+               &&  distanceOf(idx) >= dist)
             {
-                if (Unused == uk()[idx].m_used)
-                {
-                    uk()[idx].m_used = (idx == firstHit) ? FirstHit : Used;
-                    memcpy(&uk()[idx].m_key, _key, _keyLen);
-                    return &objs()[idx];
-                }
-
                 idx = wrapAround(idx+1);
+                dist++;
             }
+
+            return place(idx, dist, _key);
+        }
+
+        ObjTy* insert(const uint8_t* _key, uint8_t _keyLen)
+        {
+            DM_CHECK(_keyLen <= keyLen(), "ObjHashMapImpl::insert() - Invalid key length | %d, %d", _keyLen, keyLen());
+
+            Key key;
+            key.set(_key, _keyLen);
+            return insert(key);
         }
 
         ObjTy* insert(const char* _key)
@@ -110,42 +134,62 @@ namespace DM_NAMESPACE
             };
         };
 
-        ObjDuplicate insertHandleDup(const uint8_t* _key, uint8_t _keyLen)
+        ObjDuplicate insertHandleDup(const Key& _key)
         {
-            DM_CHECK(_keyLen <= keyLen(), "ObjHashMapImpl::insertHandleDup() - Invalid key length | %d, %d", _keyLen, keyLen());
+            ObjDuplicate result;
+            result.m_duplicate = false;
 
-            const uint32_t hash = dm::hash(_key, _keyLen);
+            const uint32_t hash = uint32_t(_key.template hash<HashPolicyTy>());
             uint32_t idx = wrapAround(hash);
-            const uint32_t firstHit = idx;
+            uint32_t dist = 0;
             for (;;)
             {
-                const uint8_t usedFlag = uk()[idx].m_used;
-
-                if (Unused == usedFlag)
+                if (Unused == uk()[idx].m_used)
                 {
-                    // Insert new entry.
-
-                    uk()[idx].m_used = (idx == firstHit) ? FirstHit : Used;
-                    memcpy(&uk()[idx].m_key, _key, _keyLen);
+                    break;
+                }
 
-                    ObjDuplicate result;
-                    result.m_obj = &objs()[idx];
-                    result.m_duplicate = false;
-                    return result;
+                const uint32_t slotDist = distanceOf(idx);
+                if (slotDist < dist)
+                {
+                    // The key would have been placed here, so it is not in the map.
+                    break;
                 }
-                else if ((Used & usedFlag)                              // Used
-                     &&  0 == memcmp(_key, uk()[idx].m_key, _keyLen))  // && key matches.
+                else if (slotDist == dist
+                     &&  uk()[idx].m_key.equals(_key))
                 {
                     // Item already found.
 
-                    ObjDuplicate result;
                     result.m_obj = &objs()[idx];
                     result.m_duplicate = true;
                     return result;
                 }
 
                 idx = wrapAround(idx+1);
+                dist++;
+            }
+
+            if (m_count == max())
+            {
+                DM_CHECK(false, "ObjHashMapImpl::insertHandleDup() - Map is full | %d", max());
+
+                result.m_obj = NULL;
+                return result;
             }
+
+            // Insert new entry.
+
+            result.m_obj = place(idx, dist, _key);
+            return result;
+        }
+
+        ObjDuplicate insertHandleDup(const uint8_t* _key, uint8_t _keyLen)
+        {
+            DM_CHECK(_keyLen <= keyLen(), "ObjHashMapImpl::insertHandleDup() - Invalid key length | %d, %d", _keyLen, keyLen());
+
+            Key key;
+            key.set(_key, _keyLen);
+            return insertHandleDup(key);
         }
 
         ObjDuplicate insertHandleDup(const char* _key)
@@ -160,28 +204,41 @@ namespace DM_NAMESPACE
             return insertHandleDup((const uint8_t*)&_key, sizeof(Ty));
         }
 
-        ObjTy* find(const uint8_t* _key, uint8_t _keyLen)
+        ObjTy* find(const Key& _key)
         {
-            DM_CHECK(_keyLen <= keyLen(), "ObjHashMapImpl::find() - Invalid key length | %d, %d", _keyLen, keyLen());
-
-            const uint32_t hash = dm::hash(_key, _keyLen);
-            for (uint32_t idx = wrapAround(hash); true; idx = wrapAround(idx+1))
+            const uint32_t hash = uint32_t(_key.template hash<HashPolicyTy>());
+            uint32_t idx = wrapAround(hash);
+            for (uint32_t dist = 0; dist < max(); ++dist, idx = wrapAround(idx+1))
             {
-                const uint8_t usedFlag = uk()[idx].m_used;
-                if ((Used & usedFlag)                               // Used
-                &&  0 == memcmp(&uk()[idx].m_key, _key, _keyLen))   // && key matches.
+                if (Unused == uk()[idx].m_used)             // Unused
                 {
-                    return &objs()[idx];                            // Return ptr to objs.
+                    return NULL;                            // Return NULL.
                 }
-                else if (Unused == usedFlag)                        // Unused
+
+                const uint32_t slotDist = distanceOf(idx);
+                if (slotDist < dist)                        // Closer to home than the key would be
+                {
+                    return NULL;                            // Return NULL.
+                }
+                else if (slotDist == dist                   // Same home slot
+                     &&  uk()[idx].m_key.equals(_key))      // && key matches.
                 {
-                    return NULL;                                    // Return NULL.
+                    return &objs()[idx];                    // Return ptr to objs.
                 }
             }
 
             return NULL;
         }
 
+        ObjTy* find(const uint8_t* _key, uint8_t _keyLen)
+        {
+            DM_CHECK(_keyLen <= keyLen(), "ObjHashMapImpl::find() - Invalid key length | %d, %d", _keyLen, keyLen());
+
+            Key key;
+            key.set(_key, _keyLen);
+            return find(key);
+        }
+
         ObjTy* find(const char* _key)
         {
             return find((const uint8_t*)_key, strlen(_key));
@@ -195,33 +252,32 @@ namespace DM_NAMESPACE
             return find((const uint8_t*)&_key, sizeof(Ty));
         }
 
-        bool remove(const uint8_t* _key, uint8_t _keyLen)
+        bool remove(const Key& _key)
         {
-            DM_CHECK(_keyLen <= keyLen(), "ObjHashMapImpl::remove() - Invalid key length | %d, %d", _keyLen, keyLen());
-
-            ObjTy* obj = find(_key, _keyLen);
+            ObjTy* obj = find(_key);
             if (NULL != obj)
             {
-                const uint32_t handle = obj - objs();
-                const uint32_t begin = handle+1;
-                uint32_t end = begin;
-                while (uk()[end].m_used == Used) { end++; }
-                const uint32_t count = end - begin;
-
                 obj->~ObjTy();
 
-                if (0 == count)
+                // Backward shift: move the following entries one slot closer to home, until an empty slot or an entry already at home.
+                uint32_t idx = uint32_t(obj - objs());
+                for (uint32_t next = wrapAround(idx+1); ; idx = next, next = wrapAround(next+1))
                 {
-                    uk()[handle].m_used = Unused;
+                    const uint8_t used = uk()[next].m_used;
+                    if (Unused == used || 1 == used)
+                    {
+                        break;
+                    }
+
+                    const uint32_t dist = distanceOf(next);
+                    uk()[idx].m_key  = uk()[next].m_key;
+                    uk()[idx].m_used = usedFlag(dist-1);
+                    memcpy(&objs()[idx], &objs()[next], sizeof(ObjTy));
                 }
-                else
-                {
-                    objs()[handle].~ObjTy();
 
-                    memmove(&uk()[handle],   &uk()[begin],   count*sizeof(Uk));
-                    memmove(&objs()[handle], &objs()[begin], count*sizeof(ObjTy));
-                    uk()[end].m_used = Unused;
-                }
+                uk()[idx].m_used = Unused;
+                usedBits()[idx/64] &= ~(UINT64_C(1) << (idx%64));
+                m_count--;
 
                 return true;
             }
@@ -231,6 +287,15 @@ namespace DM_NAMESPACE
             }
         }
 
+        bool remove(const uint8_t* _key, uint8_t _keyLen)
+        {
+            DM_CHECK(_keyLen <= keyLen(), "ObjHashMapImpl::remove() - Invalid key length | %d, %d", _keyLen, keyLen());
+
+            Key key;
+            key.set(_key, _keyLen);
+            return remove(key);
+        }
+
         bool remove(const char* _key)
         {
             return remove((const uint8_t*)_key, strlen(_key));
@@ -243,11 +308,172 @@ namespace DM_NAMESPACE
             return remove((const uint8_t*)&_key, sizeof(Ty));
         }
 
+        uint32_t count() const
+        {
+            return m_count;
+        }
+
+        /// Iteration in slot order:
+        ///     for (uint32_t handle = map.first(); map.InvalidHandle != handle; handle = map.next(handle)) { ... }
+        /// Inserts and removes move entries, iteration must not overlap them.
+        uint32_t first()
+        {
+            return nextUsed(0);
+        }
+
+        uint32_t next(uint32_t _handle)
+        {
+            return nextUsed(_handle+1);
+        }
+
+        const Key& getKeyOf(uint32_t _handle)
+        {
+            return uk()[_handle].m_key;
+        }
+
+        ObjTy* getObjOf(uint32_t _handle)
+        {
+            return &objs()[_handle];
+        }
+
+        /// Calls _func(const Key&, ObjTy&) for every entry, in slot order. Must not insert or remove.
+        /// Walks the used slots bitmap like HashMapImpl::forEach(), keys and objects of used slots '_prefetchDistance' words ahead are prefetched once per cache line.
+        template <typename FuncTy>
+        void forEach(FuncTy _func, uint32_t _prefetchDistance = PrefetchDistance)
+        {
+            const uint64_t* bits = usedBits();
+            const uint32_t numWords = (max()+63)/64;
+
+            uint32_t left = m_count;
+            for (uint32_t word = 0; 0 != left; ++word)
+            {
+                if (word+_prefetchDistance < numWords)
+                {
+                    prefetchUsed(word+_prefetchDistance);
+                }
+
+                for (uint64_t used = bits[word]; 0 != used; used &= used-1)
+                {
+                    const uint32_t idx = word*64 + uint32_t(cnttz_u64(used));
+                    _func((const Key&)uk()[idx].m_key, objs()[idx]);
+                    left--;
+                }
+            }
+        }
+
     private:
         inline uint32_t wrapAround(uint32_t _v)
         {
             return _v&(max()-1);
         }
+
+        uint32_t nextUsed(uint32_t _idx)
+        {
+            return hashMapNextUsed(usedBits(), max(), _idx);
+        }
+
+        /// Prefetches the cache lines holding the keys and objects of the used slots of one bitmap word, each line once.
+        void prefetchUsed(uint32_t _word)
+        {
+            uintptr_t prevUkLine = 0;
+            uintptr_t prevObjLine = 0;
+            for (uint64_t used = usedBits()[_word]; 0 != used; used &= used-1)
+            {
+                const uint32_t idx = _word*64 + uint32_t(cnttz_u64(used));
+
+                const uintptr_t ukLine = uintptr_t(&uk()[idx]) & ~uintptr_t(63);
+                if (ukLine != prevUkLine)
+                {
+                    DM_PREFETCH((const void*)ukLine);
+                    prevUkLine = ukLine;
+                }
+
+                const uintptr_t objLine = uintptr_t(&objs()[idx]) & ~uintptr_t(63);
+                if (objLine != prevObjLine)
+                {
+                    DM_PREFETCH((const void*)objLine);
+                    prevObjLine = objLine;
+                }
+            }
+        }
+
+        static inline uint8_t usedFlag(uint32_t _dist)
+        {
+            return uint8_t(DM_MIN(_dist+1, uint32_t(Far)));
+        }
+
+        /// Probe distance of a used slot from the home slot of its key.
+        inline uint32_t distanceOf(uint32_t _idx)
+        {
+            const uint8_t used = uk()[_idx].m_used;
+            if (Far != used)
+            {
+                return used-1;
+            }
+
+            const uint32_t home = wrapAround(uint32_t(uk()[_idx].m_key.template hash<HashPolicyTy>()));
+            return wrapAround(_idx-home);
+        }
+
+        /// Stores '_key' at '_idx', probe distance '_dist', pushing richer entries further along.
+        /// Returns the object of '_key', left for the caller to construct.
+        ObjTy* place(uint32_t _idx, uint32_t _dist, const Key& _key)
+        {
+            const uint32_t result = _idx;
+
+            Uk carry;
+            uint8_t carryObj[sizeof(ObjTy)];
+            uint8_t displacedObj[sizeof(ObjTy)];
+            uint32_t carryDist = 0;
+
+            carry.m_used = uk()[_idx].m_used;
+            if (Unused != carry.m_used)
+            {
+                carry.m_key = uk()[_idx].m_key;
+                memcpy(carryObj, &objs()[_idx], sizeof(ObjTy));
+                carryDist = distanceOf(_idx);
+            }
+            uk()[_idx].m_key  = _key;
+            uk()[_idx].m_used = usedFlag(_dist);
+            usedBits()[_idx/64] |= UINT64_C(1) << (_idx%64);
+            _dist = carryDist;
+
+            while (Unused != carry.m_used)
+            {
+                _idx = wrapAround(_idx+1);
+                _dist++;
+
+                const uint8_t used = uk()[_idx].m_used;
+                if (Unused == used)
+                {
+                    uk()[_idx].m_key  = carry.m_key;
+                    uk()[_idx].m_used = usedFlag(_dist);
+                    memcpy(&objs()[_idx], carryObj, sizeof(ObjTy));
+                    usedBits()[_idx/64] |= UINT64_C(1) << (_idx%64);
+                    break;
+                }
+
+                const uint32_t slotDist = distanceOf(_idx);
+                if (slotDist < _dist)
+                {
+                    const Key displaced = uk()[_idx].m_key;
+                    memcpy(displacedObj, &objs()[_idx], sizeof(ObjTy));
+
+                    uk()[_idx].m_key  = carry.m_key;
+                    uk()[_idx].m_used = usedFlag(_dist);
+                    memcpy(&objs()[_idx], carryObj, sizeof(ObjTy));
+
+                    carry.m_key = displaced;
+                    memcpy(carryObj, displacedObj, sizeof(ObjTy));
+                    _dist = slotDist;
+                }
+            }
+
+            m_count++;
+            return &objs()[result];
+        }
+
+        uint32_t m_count;
     };
 
     template <uint8_t KeyLength, typename ObjTy, uint32_t MaxT_PowTwo>
@@ -262,8 +488,8 @@ namespace DM_NAMESPACE
 
         struct UsedKey
         {
-            uint8_t m_used;
-            uint8_t m_key[KeyLen];
+            HashMapKey<KeyLen> m_key;
+            uint8_t            m_used;
         };
 
         UsedKey* uk()
@@ -276,6 +502,11 @@ namespace DM_NAMESPACE
             return m_objs;
         }
 
+        uint64_t* usedBits()
+        {
+            return m_usedBits;
+        }
+
         uint32_t max()
         {
             return Max;
@@ -287,8 +518,9 @@ namespace DM_NAMESPACE
         }
 
     private:
-        UsedKey m_uk[Max];
-        ObjTy   m_objs[Max];
+        UsedKey  m_uk[Max];
+        ObjTy    m_objs[Max];
+        uint64_t m_usedBits[(Max+63)/64];
     };
 
     template <uint8_t KeyLength, typename ObjTy>
@@ -299,20 +531,21 @@ namespace DM_NAMESPACE
 
         struct UsedKey
         {
-            uint8_t m_used;
-            uint8_t m_key[KeyLen];
+            HashMapKey<KeyLen> m_key;
+            uint8_t            m_used;
         };
 
         static uint32_t sizeFor(uint32_t _maxPowTwo)
         {
             DM_CHECK(dm::isPowTwo(_maxPowTwo), "ObjHashMapStorageExt::sizeFor() - Invalid value | %d", _maxPowTwo);
 
-            return _maxPowTwo*(sizeof(UsedKey)+sizeof(ObjTy));
+            return hashMapUsedBitsSize(_maxPowTwo) + _maxPowTwo*(sizeof(UsedKey)+sizeof(ObjTy));
         }
 
         ObjHashMapStorageExt()
         {
             m_uk = NULL;
+            m_usedBits = NULL;
             m_max = 0;
         }
 
@@ -321,8 +554,9 @@ namespace DM_NAMESPACE
             DM_CHECK(dm::isPowTwo(_maxPowTwo), "ObjHashMapStorageExt::initStorage() - Invalid value | %d", _maxPowTwo);
 
             m_max = _maxPowTwo;
-            m_uk = (UsedKey*)_mem;
-            m_objs = (ObjTy*)((uint8_t*)_mem + _maxPowTwo*sizeof(UsedKey));
+            m_usedBits = (uint64_t*)_mem;
+            m_uk = (UsedKey*)(_mem + hashMapUsedBitsSize(_maxPowTwo));
+            m_objs = (ObjTy*)((uint8_t*)m_uk + _maxPowTwo*sizeof(UsedKey));
 
             return (_mem + sizeFor(_maxPowTwo));
         }
@@ -337,6 +571,11 @@ namespace DM_NAMESPACE
             return m_objs;
         }
 
+        uint64_t* usedBits()
+        {
+            return m_usedBits;
+        }
+
         uint32_t max()
         {
             return m_max;
@@ -350,33 +589,35 @@ namespace DM_NAMESPACE
     private:
         UsedKey* m_uk;
         ObjTy*   m_objs;
+        uint64_t* m_usedBits;
         uint32_t m_max;
     };
 
     extern CrtAllocator g_crtAllocator;
 
-    template <uint8_t KeyLength, typename ObjTy>
-    struct ObjHashMapStorage
+    template <uint8_t KeyLength, typename ObjTy, typename AllocPolicyTy = AllocatorIPolicy>
+    struct ObjHashMapStorage : AllocPolicyTy
     {
         enum { KeyLen = KeyLength };
         typedef ObjTy ObjectType;
 
         struct UsedKey
         {
-            uint8_t m_used;
-            uint8_t m_key[KeyLen];
+            HashMapKey<KeyLen> m_key;
+            uint8_t            m_used;
         };
 
         static uint32_t sizeFor(uint32_t _maxPowTwo)
         {
             DM_CHECK(dm::isPowTwo(_maxPowTwo), "ObjHashMapStorage::sizeFor() - Invalid value | %d", _maxPowTwo);
 
-            return _maxPowTwo*(sizeof(UsedKey)+sizeof(ObjTy));
+            return hashMapUsedBitsSize(_maxPowTwo) + _maxPowTwo*(sizeof(UsedKey)+sizeof(ObjTy));
         }
 
         ObjHashMapStorage()
         {
             m_uk = NULL;
+            m_usedBits = NULL;
             m_max = 0;
         }
 
@@ -389,20 +630,21 @@ namespace DM_NAMESPACE
         {
             DM_CHECK(dm::isPowTwo(_maxPowTwo), "ObjHashMapStorage::initStorage() - Invalid value | %d", _maxPowTwo);
 
-            uint8_t* mem = (uint8_t*)dm_alloc(sizeFor(_maxPowTwo), _allocator);
+            AllocPolicyTy::bind(_allocator);
+            uint8_t* mem = (uint8_t*)DM_ALLOC(this, sizeFor(_maxPowTwo));
 
             m_max = _maxPowTwo;
-            m_uk = (UsedKey*)mem;
-            m_objs = (ObjTy*)((uint8_t*)mem + _maxPowTwo*sizeof(UsedKey));
-
-            m_allocator = _allocator;
+            m_usedBits = (uint64_t*)mem;
+            m_uk = (UsedKey*)(mem + hashMapUsedBitsSize(_maxPowTwo));
+            m_objs = (ObjTy*)((uint8_t*)m_uk + _maxPowTwo*sizeof(UsedKey));
         }
 
         void destroy()
         {
-            if (NULL != m_uk)
+            if (NULL != m_usedBits)
             {
-                dm_free(m_uk, m_allocator);
+                DM_FREE(this, m_usedBits);
+                m_usedBits = NULL;
                 m_uk = NULL;
             }
         }
@@ -417,6 +659,11 @@ namespace DM_NAMESPACE
             return m_objs;
         }
 
+        uint64_t* usedBits()
+        {
+            return m_usedBits;
+        }
+
         uint32_t max()
         {
             return m_max;
@@ -430,14 +677,14 @@ namespace DM_NAMESPACE
     private:
         UsedKey* m_uk;
         ObjTy* m_objs;
+        uint64_t* m_usedBits;
         uint32_t m_max;
-        AllocatorI* m_allocator;
     };
 
-    template <uint8_t KeyLength, typename ObjTy, uint32_t MaxT_PowTwo>
-    struct ObjHashMapT : ObjHashMapImpl< ObjHashMapStorageT<KeyLength, ObjTy, MaxT_PowTwo> >
+    template <uint8_t KeyLength, typename ObjTy, uint32_t MaxT_PowTwo, typename HashPolicyTy = WyHashPolicy>
+    struct ObjHashMapT : ObjHashMapImpl< ObjHashMapStorageT<KeyLength, ObjTy, MaxT_PowTwo>, HashPolicyTy >
     {
-        typedef ObjHashMapImpl< ObjHashMapStorageT<KeyLength, ObjTy, MaxT_PowTwo> > Base;
+        typedef ObjHashMapImpl< ObjHashMapStorageT<KeyLength, ObjTy, MaxT_PowTwo>, HashPolicyTy > Base;
 
         ObjHashMapT() : Base()
         {
@@ -445,10 +692,10 @@ namespace DM_NAMESPACE
         }
     };
 
-    template <uint8_t KeyLength, typename ObjTy>
-    struct ObjHashMapExt : ObjHashMapImpl< ObjHashMapStorageExt<KeyLength, ObjTy> >
+    template <uint8_t KeyLength, typename ObjTy, typename HashPolicyTy = WyHashPolicy>
+    struct ObjHashMapExt : ObjHashMapImpl< ObjHashMapStorageExt<KeyLength, ObjTy>, HashPolicyTy >
     {
-        typedef ObjHashMapImpl< ObjHashMapStorageExt<KeyLength, ObjTy> > Base;
+        typedef ObjHashMapImpl< ObjHashMapStorageExt<KeyLength, ObjTy>, HashPolicyTy > Base;
 
         uint8_t* init(uint32_t _maxPowTwo, uint8_t* _mem)
         {
@@ -458,10 +705,10 @@ namespace DM_NAMESPACE
         }
     };
 
-    template <uint8_t KeyLength, typename ObjTy>
-    struct ObjHashMap : ObjHashMapImpl< ObjHashMapStorage<KeyLength, ObjTy> >
+    template <uint8_t KeyLength, typename ObjTy, typename AllocPolicyTy = AllocatorIPolicy, typename HashPolicyTy = WyHashPolicy>
+    struct ObjHashMap : ObjHashMapImpl< ObjHashMapStorage<KeyLength, ObjTy, AllocPolicyTy>, HashPolicyTy >
     {
-        typedef ObjHashMapImpl< ObjHashMapStorage<KeyLength, ObjTy> > Base;
+        typedef ObjHashMapImpl< ObjHashMapStorage<KeyLength, ObjTy, AllocPolicyTy>, HashPolicyTy > Base;
 
         void init(uint32_t _maxPowTwo, AllocatorI* _allocator = &g_crtAllocator)
         {
@@ -470,8 +717,8 @@ namespace DM_NAMESPACE
         }
     };
 
-    template <uint8_t KeyLength, typename ObjTy>
-    struct ObjHashMapH : ObjHashMapExt<KeyLength, ObjTy>
+    template <uint8_t KeyLength, typename ObjTy, typename HashPolicyTy = WyHashPolicy>
+    struct ObjHashMapH : ObjHashMapExt<KeyLength, ObjTy, HashPolicyTy>
     {
         AllocatorI* m_allocator;
     };
@@ -379,8 +379,8 @@ namespace DM_NAMESPACE
 
     extern CrtAllocator g_crtAllocator;
 
-    template <typename Ty>
-    struct SparseArrayStorage
+    template <typename Ty, typename AllocPolicyTy = AllocatorIPolicy>
+    struct SparseArrayStorage : AllocPolicyTy
     {
         typedef Ty ObjectType;
         typedef HandleAllocExt<uint32_t> HandleAllocType;
@@ -405,10 +405,17 @@ namespace DM_NAMESPACE
             m_elements = NULL;
         }
 
+        ~SparseArrayStorage()
+        {
+            destroy();
+        }
+
         void init(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
+            AllocPolicyTy::bind(_allocator);
+
             const uint32_t totalSize = sizeFor(_max);
-            void* mem = DM_ALLOC(_allocator, totalSize);
+            void* mem = DM_ALLOC(this, totalSize);
 
             uint8_t* objBegin    = (uint8_t*)mem;
             uint8_t* handleBegin = (uint8_t*)mem + _max*sizeof(Ty);
@@ -416,15 +423,13 @@ namespace DM_NAMESPACE
             m_max = _max;
             m_elements = (Ty*)objBegin;
             m_handles.init(_max, handleBegin);
-
-            m_allocator = _allocator;
         }
 
         void destroy()
         {
             if (NULL != m_elements)
             {
-                DM_FREE(m_allocator, m_elements);
+                DM_FREE(this, m_elements);
                 m_elements = NULL;
             }
         }
@@ -447,14 +452,13 @@ namespace DM_NAMESPACE
         uint32_t m_max;
         Ty* m_elements;
         HandleAllocType m_handles;
-        AllocatorI* m_allocator;
     };
 
-    template <typename Ty>
-    struct SparseArrayStorageRes
+    template <typename Ty, typename AllocPolicyTy = AllocatorIPolicy>
+    struct SparseArrayStorageRes : AllocPolicyTy
     {
         typedef Ty ObjectType;
-        typedef HandleAllocRes<uint32_t> HandleAllocType;
+        typedef HandleAllocRes<uint32_t, AllocPolicyTy> HandleAllocType;
 
         SparseArrayStorageRes()
         {
@@ -464,13 +468,13 @@ namespace DM_NAMESPACE
 
         void init(uint32_t _max, AllocatorI* _allocator = &g_crtAllocator)
         {
+            AllocPolicyTy::bind(_allocator);
+
             const uint32_t size = _max*sizeof(Ty);
 
             m_max = _max;
-            m_elements = (Ty*)DM_ALLOC(_allocator, size);
+            m_elements = (Ty*)DM_ALLOC(this, size);
             m_handles.init(_max, _allocator);
-
-            m_allocator = _allocator;
         }
 
         bool isResizable() const
@@ -482,7 +486,7 @@ namespace DM_NAMESPACE
         {
             const uint32_t size = _newMax*sizeof(Ty);
             m_max = _newMax;
-            m_elements = (Ty*)DM_REALLOC(m_allocator, m_elements, size);
+            m_elements = (Ty*)DM_REALLOC(this, m_elements, size);
             m_handles.resize(_newMax);
         }
 
@@ -490,7 +494,7 @@ namespace DM_NAMESPACE
         {
             if (NULL != m_elements)
             {
-                DM_FREE(m_allocator, m_elements);
+                DM_FREE(this, m_elements);
                 m_elements = NULL;
             }
         }
@@ -513,13 +517,12 @@ namespace DM_NAMESPACE
         uint32_t m_max;
         Ty* m_elements;
         HandleAllocType m_handles;
-        AllocatorI* m_allocator;
     };
 
     template <typename Ty, uint32_t MaxT> struct SparseArrayT   : SparseArrayImpl< SparseArrayStorageT<Ty, MaxT> > { };
     template <typename Ty>                struct SparseArrayExt : SparseArrayImpl< SparseArrayStorageExt<Ty>     > { };
-    template <typename Ty>                struct SparseArray    : SparseArrayImpl< SparseArrayStorage<Ty>        > { };
-    template <typename Ty>                struct SparseArrayRes : SparseArrayImpl< SparseArrayStorage<Ty>        > { };
+    template <typename Ty, typename AllocPolicyTy = AllocatorIPolicy> struct SparseArray    : SparseArrayImpl< SparseArrayStorage<Ty, AllocPolicyTy> > { };
+    template <typename Ty, typename AllocPolicyTy = AllocatorIPolicy> struct SparseArrayRes : SparseArrayImpl< SparseArrayStorage<Ty, AllocPolicyTy> > { };
     template <typename Ty>                struct SparseArrayH   : SparseArrayExt<Ty> { AllocatorI* m_allocator; };
 
 } // namespace DM_NAMESPACE
@@ -8,6 +8,12 @@
 /// Header includes.
 #if (DM_INCL & DM_INCL_HEADER_INCLUDES)
 #   include <stdint.h>
+#   include <string.h> // memcpy
+#   include "platform.h"
+#   if DM_COMPILER_MSVC && DM_ARCH_64BIT
+#       include <intrin.h>
+#       pragma intrinsic(_umul128)
+#   endif // DM_COMPILER_MSVC && DM_ARCH_64BIT
 #endif // (DM_INCL & DM_INCL_HEADER_INCLUDES)
 
 /// Header body.
@@ -52,6 +58,268 @@ namespace DM_NAMESPACE
         return DM_NAMESPACE::hash(reinterpret_cast<const uint8_t*>(&_val), sizeof(Ty));
     }
 
+    // 64-bit hashes.
+    //-----
+
+    DM_INLINE uint64_t hashRead64(const uint8_t* _ptr)
+    {
+        uint64_t val;
+        memcpy(&val, _ptr, sizeof(val));
+        return val;
+    }
+
+    DM_INLINE uint64_t hashRead32(const uint8_t* _ptr)
+    {
+        uint32_t val;
+        memcpy(&val, _ptr, sizeof(val));
+        return val;
+    }
+
+    DM_INLINE uint64_t hashRotl64(uint64_t _val, uint32_t _shift)
+    {
+        return (_val<<_shift) | (_val>>(64-_shift));
+    }
+
+    /// Full 64x64 -> 128 bit multiply.
+    DM_INLINE void hashMul128(uint64_t& _lo, uint64_t& _hi, uint64_t _a, uint64_t _b)
+    {
+    #if (DM_COMPILER_GCC || DM_COMPILER_CLANG) && defined(__SIZEOF_INT128__)
+        const __uint128_t res = __uint128_t(_a)*_b;
+        _lo = uint64_t(res);
+        _hi = uint64_t(res>>64);
+    #elif DM_COMPILER_MSVC && DM_ARCH_64BIT
+        _lo = _umul128(_a, _b, &_hi);
+    #else
+        const uint64_t aLo = _a&UINT32_MAX, aHi = _a>>32;
+        const uint64_t bLo = _b&UINT32_MAX, bHi = _b>>32;
+        const uint64_t ll = aLo*bLo, lh = aLo*bHi, hl = aHi*bLo, hh = aHi*bHi;
+        const uint64_t mid = (ll>>32) + (lh&UINT32_MAX) + (hl&UINT32_MAX);
+        _lo = (mid<<32) | (ll&UINT32_MAX);
+        _hi = hh + (lh>>32) + (hl>>32) + (mid>>32);
+    #endif
+    }
+
+    /// Multiplies and folds the 128 bit result.
+    DM_INLINE uint64_t hashMix64(uint64_t _a, uint64_t _b)
+    {
+        uint64_t lo, hi;
+        hashMul128(lo, hi, _a, _b);
+        return lo^hi;
+    }
+
+    /// Single 64-bit value, all input bits affect all output bits. Cheapest option for integer keys.
+    DM_INLINE uint64_t hashMix64(uint64_t _val)
+    {
+        return hashMix64(_val^UINT64_C(0x2d358dccaa6c78a5), UINT64_C(0x8bb84b93962eacc9));
+    }
+
+    /// MurmurHash3 finalizer, 64-bit multiplies only.
+    DM_INLINE uint64_t hashFmix64(uint64_t _val)
+    {
+        _val ^= _val >> 33;
+        _val *= UINT64_C(0xff51afd7ed558ccd);
+        _val ^= _val >> 33;
+        _val *= UINT64_C(0xc4ceb9fe1a85ec53);
+        _val ^= _val >> 33;
+        return _val;
+    }
+
+    ///
+    /// Multiply-fold hash in the style of wyhash. Processes 48 bytes per step in three independent lanes,
+    /// tails up to 16 bytes are read with two overlapping loads. Fastest for all key sizes.
+    ///
+    DM_INLINE uint64_t hashWy64(const void* _data, uint32_t _size, uint64_t _seed = 0)
+    {
+        const uint64_t s0 = UINT64_C(0xa0761d6478bd642f);
+        const uint64_t s1 = UINT64_C(0xe7037ed1a0b428db);
+        const uint64_t s2 = UINT64_C(0x8ebc6af09c88c6e3);
+        const uint64_t s3 = UINT64_C(0x589965cc75374cc3);
+
+        const uint8_t* ptr = (const uint8_t*)_data;
+        uint64_t seed = _seed ^ hashMix64(_seed^s0, s1);
+        uint64_t aa, bb;
+
+        if (_size <= 16)
+        {
+            if (_size >= 4)
+            {
+                const uint32_t off = (_size>>3)<<2;
+                aa = (hashRead32(ptr)<<32) | hashRead32(ptr + off);
+                bb = (hashRead32(ptr + _size - 4)<<32) | hashRead32(ptr + _size - 4 - off);
+            }
+            else if (_size > 0)
+            {
+                aa = (uint64_t(ptr[0])<<16) | (uint64_t(ptr[_size>>1])<<8) | ptr[_size-1];
+                bb = 0;
+            }
+            else
+            {
+                aa = bb = 0;
+            }
+        }
+        else
+        {
+            uint32_t size = _size;
+            if (size > 48)
+            {
+                uint64_t seed1 = seed;
+                uint64_t seed2 = seed;
+                do
+                {
+                    seed  = hashMix64(hashRead64(ptr)    ^s1, hashRead64(ptr+8) ^seed);
+                    seed1 = hashMix64(hashRead64(ptr+16) ^s2, hashRead64(ptr+24)^seed1);
+                    seed2 = hashMix64(hashRead64(ptr+32) ^s3, hashRead64(ptr+40)^seed2);
+                    ptr  += 48;
+                    size -= 48;
+                } while (size > 48);
+                seed ^= seed1^seed2;
+            }
+
+            while (size > 16)
+            {
+                seed  = hashMix64(hashRead64(ptr)^s1, hashRead64(ptr+8)^seed);
+                ptr  += 16;
+                size -= 16;
+            }
+
+            aa = hashRead64(ptr + size - 16);
+            bb = hashRead64(ptr + size - 8);
+        }
+
+        uint64_t lo, hi;
+        hashMul128(lo, hi, aa^s1, bb^seed);
+        return hashMix64(lo^s0^_size, hi^s1);
+    }
+
+    ///
+    /// Rotate-multiply hash in the style of xxHash64. Four independent lanes over 32 byte stripes.
+    /// Uses only 64-bit multiplies, preferable where a full 128 bit multiply is expensive (32-bit targets).
+    ///
+    DM_INLINE uint64_t hashXx64(const void* _data, uint32_t _size, uint64_t _seed = 0)
+    {
+        const uint64_t p1 = UINT64_C(11400714785074694791);
+        const uint64_t p2 = UINT64_C(14029467366897019727);
+        const uint64_t p3 = UINT64_C(1609587929392839161);
+        const uint64_t p4 = UINT64_C(9650029242287828579);
+        const uint64_t p5 = UINT64_C(2870177450012600261);
+
+        #define DM_XX_ROUND(_acc, _input) hashRotl64(_acc + (_input)*p2, 31)*p1
+
+        const uint8_t* ptr = (const uint8_t*)_data;
+        const uint8_t* end = ptr + _size;
+        uint64_t hh;
+
+        if (_size >= 32)
+        {
+            uint64_t v0 = _seed + p1 + p2;
+            uint64_t v1 = _seed + p2;
+            uint64_t v2 = _seed;
+            uint64_t v3 = _seed - p1;
+            do
+            {
+                v0 = DM_XX_ROUND(v0, hashRead64(ptr));
+                v1 = DM_XX_ROUND(v1, hashRead64(ptr+8));
+                v2 = DM_XX_ROUND(v2, hashRead64(ptr+16));
+                v3 = DM_XX_ROUND(v3, hashRead64(ptr+24));
+                ptr += 32;
+            } while (ptr + 32 <= end);
+
+            hh = hashRotl64(v0, 1) + hashRotl64(v1, 7) + hashRotl64(v2, 12) + hashRotl64(v3, 18);
+            hh = (hh ^ DM_XX_ROUND(0, v0))*p1 + p4;
+            hh = (hh ^ DM_XX_ROUND(0, v1))*p1 + p4;
+            hh = (hh ^ DM_XX_ROUND(0, v2))*p1 + p4;
+            hh = (hh ^ DM_XX_ROUND(0, v3))*p1 + p4;
+        }
+        else
+        {
+            hh = _seed + p5;
+        }
+
+        hh += _size;
+
+        for (; ptr + 8 <= end; ptr += 8)
+        {
+            hh ^= DM_XX_ROUND(0, hashRead64(ptr));
+            hh  = hashRotl64(hh, 27)*p1 + p4;
+        }
+
+        if (ptr + 4 <= end)
+        {
+            hh ^= hashRead32(ptr)*p1;
+            hh  = hashRotl64(hh, 23)*p2 + p3;
+            ptr += 4;
+        }
+
+        for (; ptr < end; ++ptr)
+        {
+            hh ^= (*ptr)*p5;
+            hh  = hashRotl64(hh, 11)*p1;
+        }
+
+        #undef DM_XX_ROUND
+
+        hh ^= hh >> 33;
+        hh *= p2;
+        hh ^= hh >> 29;
+        hh *= p3;
+        hh ^= hh >> 32;
+
+        return hh;
+    }
+
+    ///
+    /// Hash policies, select the hash function of a map at compile time.
+    ///
+    /// Expected interface:
+    ///
+    ///     struct HashPolicy
+    ///     {
+    ///         static uint64_t hash(const void* _data, uint32_t _size);
+    ///         static uint64_t hashInt(uint64_t _val); // Keys of 1, 2, 4 and 8 bytes, see HashMapKey.
+    ///     };
+    ///
+
+    /// Default for all maps.
+    struct WyHashPolicy
+    {
+        static DM_INLINE uint64_t hash(const void* _data, uint32_t _size)
+        {
+            return hashWy64(_data, _size);
+        }
+
+        static DM_INLINE uint64_t hashInt(uint64_t _val)
+        {
+            return hashMix64(_val);
+        }
+    };
+
+    struct XxHashPolicy
+    {
+        static DM_INLINE uint64_t hash(const void* _data, uint32_t _size)
+        {
+            return hashXx64(_data, _size);
+        }
+
+        static DM_INLINE uint64_t hashInt(uint64_t _val)
+        {
+            return hashFmix64(_val);
+        }
+    };
+
+    /// Byte-wise, kept for compatibility with hashes stored by older builds. Clusters badly with power of two tables.
+    struct SdbmHashPolicy
+    {
+        static DM_INLINE uint64_t hash(const void* _data, uint32_t _size)
+        {
+            return DM_NAMESPACE::hash(_data, _size);
+        }
+
+        static DM_INLINE uint64_t hashInt(uint64_t _val)
+        {
+            return DM_NAMESPACE::hash(_val);
+        }
+    };
+
 } // namespace DM_NAMESPACE
 #   endif // DM_HASH_H_HEADER_GUARD
 #endif // (DM_INCL & DM_INCL_HEADER_BODY)
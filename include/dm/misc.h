@@ -23,6 +23,10 @@
 #   include "platform.h" // DM_COMPILER_MSVC
 #   include "os.h"       // pwd()
 
+#   if DM_COMPILER_MSVC
+#       include <xmmintrin.h> // _mm_prefetch()
+#   endif // DM_COMPILER_MSVC
+
 #   if DM_PLATFORM_LINUX
 #      ifndef DM_REALPATH_H_INCLUDE_HEADER_GUARD
 #      define DM_REALPATH_H_INCLUDE_HEADER_GUARD
@@ -60,9 +64,11 @@ namespace DM_NAMESPACE
     #if DM_COMPILER_GCC || DM_COMPILER_CLANG
     #   define DM_ATTRIBUTE(_x) __attribute__((_x))
     #   define DM_ALIGN_DECL(_align, _decl) _decl __attribute__((aligned(_align)))
+    #   define DM_THREAD_LOCAL __thread
     #elif DM_COMPILER_MSVC
     #   define DM_ALIGN_DECL(_align, _decl) __declspec(align(_align)) _decl
     #   define DM_ATTRIBUTE(_x)
+    #   define DM_THREAD_LOCAL __declspec(thread)
     #endif // DM_COMPILER_*
 
     #define DM_STATIC_ASSERT(_expr) typedef int DM_CONCATENATE(dm_compile_time_assert_, __LINE__)[1 - 2*!(_expr)] DM_ATTRIBUTE(unused)
@@ -85,6 +91,15 @@ namespace DM_NAMESPACE
     #   define DM_UNLIKELY(x) (x)
     #endif
 
+    // Hint to start loading the cache line at _ptr, for reads that come later.
+    #if DM_COMPILER_GCC || DM_COMPILER_CLANG
+    #   define DM_PREFETCH(_ptr) __builtin_prefetch(_ptr)
+    #elif DM_COMPILER_MSVC
+    #   define DM_PREFETCH(_ptr) _mm_prefetch((const char*)(_ptr), _MM_HINT_T0)
+    #else
+    #   define DM_PREFETCH(_ptr)
+    #endif
+
     // Value.
     //-----
 
@@ -235,6 +250,22 @@ namespace DM_NAMESPACE
     #endif
     }
 
+    DM_INLINE uint64_t nextPowTwo(uint64_t _u64)
+    {
+        /// 0 -> 0 /* For 0 input, returns 0. */
+        uint64_t val = _u64;
+        --val;
+        val |= val >>  1;
+        val |= val >>  2;
+        val |= val >>  4;
+        val |= val >>  8;
+        val |= val >> 16;
+        val |= val >> 32;
+        ++val;
+
+        return val;
+    }
+
     /// Usage:
     ///   270 -> 256 /* For a non-power-of-two input, returns expected value. */
     ///   256 -> 256 /* For a power-of-two input, returns the same value. */
@@ -15,6 +15,7 @@
 #if (DM_INCL & DM_INCL_HEADER_INCLUDES)
     #if DM_PLATFORM_POSIX
     #   include <pthread.h>
+    #   include <sched.h> // sched_yield
     #   if defined(__FreeBSD__)
     #       include <pthread_np.h>
     #   endif // defined(__FreeBSD__)
@@ -97,6 +98,12 @@ namespace DM_NAMESPACE
             pthread_mutex_unlock(&m_handle);
         }
 
+        /// Returns false instead of waiting if another thread holds the mutex.
+        bool tryLock()
+        {
+            return (0 == pthread_mutex_trylock(&m_handle));
+        }
+
     private:
         pthread_mutex_t m_handle;
     };
@@ -120,6 +127,16 @@ namespace DM_NAMESPACE
 
     typedef Mutex LwMutex;
 
+    /// Gives the rest of the time slice to other threads, for spin waits.
+    inline void threadYield()
+    {
+        #if DM_PLATFORM_WINDOWS
+            SwitchToThread();
+        #else
+            sched_yield();
+        #endif // DM_PLATFORM_WINDOWS
+    }
+
     struct LwMutexScope
     {
         LwMutexScope(LwMutex& _mutex)
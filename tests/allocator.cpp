@@ -0,0 +1,1159 @@
+/*
+ * Copyright 2016 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "test.h"
+
+#include <stdlib.h>  // qsort
+#include <string.h>
+#include <sched.h>   // sched_yield
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>  // sysconf
+#include <dm/allocator/allocator.h>
+#include <dm/allocator/relocheap.h>
+
+// The allocator impl expects the user project to provide its check macro.
+// Impl is built here, so that tests can reach its internals, e.g. Memory::Heap.
+#define CS_CHECK DM_CHECK
+
+#undef DM_INCL
+#define DM_INCL DM_INCL_IMPL
+#include <dm/allocatori.h>
+#include <dm/allocator/allocator.h>
+
+using namespace dm;
+
+static bool isFilledWith(const void* _ptr, uint8_t _val, size_t _size)
+{
+    const uint8_t* bytes = (const uint8_t*)_ptr;
+    for (size_t ii = 0; ii < _size; ++ii)
+    {
+        if (bytes[ii] != _val)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void testAllocStackChunks()
+{
+    // Small fixed stack, everything past 4KB goes to overflow chunks.
+    StackAllocatorI* stack = allocCreateStack(4096);
+    TEST_CHECK(NULL != stack);
+
+    DM_PUSH(stack);
+    uint8_t* aa = (uint8_t*)DM_ALLOC(stack, 3000);
+    memset(aa, 1, 3000);
+    uint8_t* bb = (uint8_t*)DM_ALLOC(stack, 3000);
+    memset(bb, 2, 3000);
+
+    // Heap memory allocated while the chunks are alive must still report its own size.
+    void* heapPtr = DM_ALLOC(mainAlloc, 100<<10);
+    TEST_CHECK(allocSizeOf(heapPtr) >= (100<<10));
+
+    bb = (uint8_t*)DM_REALLOC(stack, bb, 6000);
+    TEST_CHECK(isFilledWith(aa, 1, 3000));
+    TEST_CHECK(isFilledWith(bb, 2, 3000));
+
+    DM_PUSH(stack);
+    uint8_t* cc = (uint8_t*)DM_ALLOC(stack, 3<<20);
+    memset(cc, 3, 3<<20);
+    TEST_CHECK(isFilledWith(bb, 2, 3000));
+    DM_POP(stack);
+
+    // Chunks popped above are released, the ones below are still usable.
+    memset(bb, 4, 6000);
+    TEST_CHECK(isFilledWith(aa, 1, 3000));
+    TEST_CHECK(allocSizeOf(heapPtr) >= (100<<10));
+    DM_POP(stack);
+
+    DM_FREE(mainAlloc, heapPtr);
+    allocFreeStack(stack);
+
+    // Global stack.
+    DM_PUSH(stackAlloc);
+    void* ptr = DM_ALLOC(stackAlloc, 100);
+    TEST_CHECK(allocSizeOf(ptr) >= 100);
+    DM_FREE(stackAlloc, ptr);
+    DM_POP(stackAlloc);
+}
+
+static void* allocFreeLoop(void* /*_arg*/)
+{
+    for (uint32_t ii = 0; ii < 2000; ++ii)
+    {
+        void* ptr = DM_ALLOC(mainAlloc, 1<<20);
+        memset(ptr, 1, 64);
+        DM_FREE(mainAlloc, ptr);
+    }
+
+    return NULL;
+}
+
+static void* freeFromBox(void* _box)
+{
+    void* volatile* box = (void* volatile*)_box;
+    for (uint32_t ii = 0; ii < 20000; ++ii)
+    {
+        void* ptr;
+        while (NULL == (ptr = atomicExchangePtr(box, NULL)))
+        {
+            sched_yield();
+        }
+        DM_FREE(mainAlloc, ptr);
+    }
+
+    return NULL;
+}
+
+static void* s_orphans[1000];
+
+static void* allocSmallAndExit(void* /*_arg*/)
+{
+    for (uint32_t ii = 0; ii < DM_COUNTOF(s_orphans); ++ii)
+    {
+        s_orphans[ii] = DM_ALLOC(mainAlloc, 48);
+    }
+
+    return NULL;
+}
+
+static void testAllocCrossThread()
+{
+    AllocStats before;
+    allocGetStats(before);
+
+    // Worker thread allocating and freeing on its own must get its memory back.
+    pthread_t thread;
+    pthread_create(&thread, NULL, allocFreeLoop, NULL);
+    pthread_join(thread, NULL);
+
+    AllocStats after;
+    allocGetStats(after);
+    const uint64_t heapAllocs = after.m_allocCount[AllocStats::Heap] - before.m_allocCount[AllocStats::Heap];
+    const uint64_t heapFrees  = after.m_freeCount[AllocStats::Heap]  - before.m_freeCount[AllocStats::Heap];
+    TEST_CHECK(2000 == heapAllocs);
+    TEST_CHECK(2000 == heapFrees);
+
+    // Allocated here, freed on another thread while this one keeps allocating.
+    allocGetStats(before);
+    void* volatile box = NULL;
+    pthread_create(&thread, NULL, freeFromBox, (void*)&box);
+    for (uint32_t ii = 0; ii < 20000; ++ii)
+    {
+        void* ptr = DM_ALLOC(mainAlloc, (ii&1) ? 48 : 3000);
+        memset(ptr, 2, 48);
+        while (NULL != atomicLoadAcquirePtr(&box))
+        {
+            sched_yield();
+        }
+        atomicExchangePtr(&box, ptr);
+    }
+    pthread_join(thread, NULL);
+    allocFlushRemoteFrees();
+
+    allocGetStats(after);
+    for (uint32_t path = AllocStats::Segregated; path <= AllocStats::Heap; ++path)
+    {
+        const uint64_t allocs = after.m_allocCount[path] - before.m_allocCount[path];
+        const uint64_t frees  = after.m_freeCount[path]  - before.m_freeCount[path];
+        TEST_CHECK(allocs == frees);
+    }
+
+    // Small blocks went back to this thread's cache, without the shared lists lock.
+    TEST_CHECK(10000 == after.m_remoteFreeCount - before.m_remoteFreeCount);
+
+    // Allocated by a thread that exited before they were freed, its spans are shared again.
+    allocGetStats(before);
+    pthread_create(&thread, NULL, allocSmallAndExit, NULL);
+    pthread_join(thread, NULL);
+    for (uint32_t ii = 0; ii < DM_COUNTOF(s_orphans); ++ii)
+    {
+        DM_FREE(mainAlloc, s_orphans[ii]);
+    }
+
+    allocGetStats(after);
+    TEST_CHECK(after.m_remoteFreeCount == before.m_remoteFreeCount);
+    TEST_CHECK(after.m_allocCount[AllocStats::Segregated] - before.m_allocCount[AllocStats::Segregated] == DM_COUNTOF(s_orphans));
+    TEST_CHECK(after.m_freeCount[AllocStats::Segregated]  - before.m_freeCount[AllocStats::Segregated]  == DM_COUNTOF(s_orphans));
+}
+
+static pthread_barrier_t s_countersBarrier;
+
+static void* allocFreeSmall(void* /*_arg*/)
+{
+    // Keep every thread alive at once, so the ones above the slot limit share a slot.
+    pthread_barrier_wait(&s_countersBarrier);
+
+    for (uint32_t ii = 0; ii < 1000; ++ii)
+    {
+        void* ptr = DM_ALLOC(mainAlloc, 32);
+        DM_FREE(mainAlloc, ptr);
+    }
+
+    return NULL;
+}
+
+static void testAllocCounters()
+{
+    AllocStats before;
+    allocGetStats(before);
+
+    // Freed bytes match allocated bytes once everything is released, in-place resize included.
+    void* small = DM_ALLOC(mainAlloc, 40);
+    void* big   = DM_ALLOC(mainAlloc, 1<<20);
+    big = DM_REALLOC(mainAlloc, big, 600<<10);
+
+    AllocStats during;
+    allocGetStats(during);
+    const uint64_t liveHeap = (during.m_allocBytes[AllocStats::Heap] - before.m_allocBytes[AllocStats::Heap])
+                            - (during.m_freeBytes[AllocStats::Heap]  - before.m_freeBytes[AllocStats::Heap]);
+    TEST_CHECK(liveHeap == allocSizeOf(big));
+
+    DM_FREE(mainAlloc, small);
+    DM_FREE(mainAlloc, big);
+
+    AllocStats after;
+    allocGetStats(after);
+    for (uint32_t path = AllocStats::Segregated; path <= AllocStats::Heap; ++path)
+    {
+        const uint64_t allocBytes = after.m_allocBytes[path] - before.m_allocBytes[path];
+        const uint64_t freeBytes  = after.m_freeBytes[path]  - before.m_freeBytes[path];
+        TEST_CHECK(0 != allocBytes);
+        TEST_CHECK(allocBytes == freeBytes);
+    }
+
+    // More threads than counter slots, twice over, so exited threads give their slots back.
+    enum { NumThreads = DM_ALLOC_COUNTERS_MAX_THREADS + 8 };
+    allocGetStats(before);
+    for (uint32_t round = 0; round < 2; ++round)
+    {
+        pthread_barrier_init(&s_countersBarrier, NULL, NumThreads);
+
+        pthread_t threads[NumThreads];
+        for (uint32_t ii = 0; ii < NumThreads; ++ii)
+        {
+            pthread_create(&threads[ii], NULL, allocFreeSmall, NULL);
+        }
+        for (uint32_t ii = 0; ii < NumThreads; ++ii)
+        {
+            pthread_join(threads[ii], NULL);
+        }
+
+        pthread_barrier_destroy(&s_countersBarrier);
+    }
+    allocGetStats(after);
+
+    const uint64_t allocs = after.m_allocCount[AllocStats::Segregated] - before.m_allocCount[AllocStats::Segregated];
+    const uint64_t frees  = after.m_freeCount[AllocStats::Segregated]  - before.m_freeCount[AllocStats::Segregated];
+    TEST_CHECK(2*NumThreads*1000 == allocs);
+    TEST_CHECK(2*NumThreads*1000 == frees);
+}
+
+static bool isResident(const void* _begin, const void* _end)
+{
+    const size_t page = size_t(sysconf(_SC_PAGESIZE));
+    uint8_t* beg = (uint8_t*)alignPtrPrev((void*)_begin, page);
+    const size_t size = size_t((const uint8_t*)_end - beg);
+    const size_t num  = (size + page - 1)/page;
+
+    unsigned char* vec = (unsigned char*)::malloc(num);
+    bool resident = (0 == mincore(beg, size, vec));
+    for (size_t ii = 0; resident && ii < num; ++ii)
+    {
+        resident = (0 != (vec[ii]&1));
+    }
+    ::free(vec);
+
+    return resident;
+}
+
+static void testAllocPrefault()
+{
+    // Spans the segregated lists, from the first list to the last one.
+    uint8_t* first = (uint8_t*)DM_ALLOC(mainAlloc, 16);
+    uint8_t* last  = (uint8_t*)DM_ALLOC(mainAlloc, DM_KILOBYTES(512));
+    TEST_CHECK(first < last);
+    memset(first, 1, 16);
+    memset(last,  2, DM_KILOBYTES(512));
+
+    // MADV_POPULATE_WRITE where supported, a single thread.
+    allocPrefault(DM_MEGABYTES(8), 1);
+    TEST_CHECK(isResident(first, last + DM_KILOBYTES(512)));
+
+    // Page by page, zero threads means one, more heap than there is.
+    allocPrefault(SIZE_MAX, 0, false);
+    uint8_t* heap = (uint8_t*)DM_ALLOC(mainAlloc, DM_MEGABYTES(16));
+    TEST_CHECK(allocContains(heap));
+    TEST_CHECK(isResident(heap, heap + DM_MEGABYTES(16)));
+    memset(heap, 3, DM_MEGABYTES(16));
+
+    // Thread count above the maximum, both ways. Contents are left as they were.
+    allocPrefault(SIZE_MAX, 1000);
+    allocPrefault(SIZE_MAX, 4, false);
+    TEST_CHECK(isFilledWith(first, 1, 16));
+    TEST_CHECK(isFilledWith(last,  2, DM_KILOBYTES(512)));
+    TEST_CHECK(isFilledWith(heap,  3, DM_MEGABYTES(16)));
+
+    DM_FREE(mainAlloc, heap);
+    DM_FREE(mainAlloc, last);
+    DM_FREE(mainAlloc, first);
+}
+
+static void testAllocHeapRegions()
+{
+    typedef Memory::Heap Heap;
+
+    Heap* heap = ::new (::calloc(1, sizeof(Heap))) Heap();
+
+    // Slot groups past UINT32_MAX, up to the 64GB region class.
+    TEST_CHECK(10*Heap::NumSubRegions     == heap->getSlotGroup(DM_GIGABYTES_ULL(2)));
+    TEST_CHECK(11*Heap::NumSubRegions     == heap->getSlotGroup(DM_GIGABYTES_ULL(4)));
+    TEST_CHECK(12*Heap::NumSubRegions + 7 == heap->getSlotGroup(DM_GIGABYTES_ULL(4) + 1));
+    TEST_CHECK(12*Heap::NumSubRegions + 6 == heap->getSlotGroup(DM_GIGABYTES_ULL(5)));
+    TEST_CHECK(14*Heap::NumSubRegions + 6 == heap->getSlotGroup(DM_GIGABYTES_ULL(20)));
+    TEST_CHECK(15*Heap::NumSubRegions + 4 == heap->getSlotGroup(DM_GIGABYTES_ULL(48)));
+    TEST_CHECK(15*Heap::NumSubRegions     == heap->getSlotGroup(Heap::BiggestRegion));
+    for (uint32_t pwr = 21; pwr <= 36; ++pwr)
+    {
+        const uint64_t size = UINT64_C(1)<<pwr;
+        TEST_CHECK(pwr - 21 == heap->getRegion(heap->getSlotGroup(size)));
+        TEST_CHECK(pwr - 21 == heap->getRegion(heap->getSlotGroup(size - size/4)));
+    }
+
+    // Free slot search compares 64-bit sizes by the sign of their difference.
+    // Address space only, untouched pages are never backed.
+    const size_t size = DM_GIGABYTES_ULL(12);
+    void* mem = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    TEST_CHECK(MAP_FAILED != mem);
+    if (MAP_FAILED != mem)
+    {
+        uint8_t* stackPtr = (uint8_t*)mem;
+        uint8_t* heapEnd  = (uint8_t*)mem + size;
+        heap->init(&stackPtr, &heapEnd);
+
+        // Same slot group, the first one freed is too small.
+        uint8_t* small = (uint8_t*)heap->alloc(DM_MEGABYTES(4710));
+        void*    guard0 = heap->alloc(DM_MEGABYTES(1));
+        uint8_t* large = (uint8_t*)heap->alloc(DM_MEGABYTES(5018));
+        void*    guard1 = heap->alloc(DM_MEGABYTES(1));
+        TEST_CHECK(NULL != small && NULL != large);
+        TEST_CHECK(heap->getSlotGroup(DM_MEGABYTES(4710)) == heap->getSlotGroup(DM_MEGABYTES(5018)));
+
+        heap->free(small);
+        heap->free(large);
+
+        TEST_CHECK(large == heap->alloc(DM_MEGABYTES(4915)));
+        TEST_CHECK(small == heap->alloc(DM_MEGABYTES(4608)));
+        TEST_CHECK(DM_MEGABYTES(4915) <= heap->getSize(large));
+
+        heap->free(guard1);
+        heap->free(guard0);
+        munmap(mem, size);
+    }
+
+    heap->~Heap();
+    ::free(heap);
+}
+
+static void* pinnedFill(RelocHeap& _heap, uint32_t _handle, uint8_t _val)
+{
+    void* ptr = _heap.pin(_handle);
+    memset(ptr, _val, _heap.sizeOf(_handle));
+    _heap.unpin(_handle);
+
+    return ptr;
+}
+
+static bool pinnedFilledWith(RelocHeap& _heap, uint32_t _handle, uint8_t _val)
+{
+    const bool filled = isFilledWith(_heap.pin(_handle), _val, _heap.sizeOf(_handle));
+    _heap.unpin(_handle);
+
+    return filled;
+}
+
+static void testRelocHeap()
+{
+    enum { BlockSize = 64, TotalSize = BlockSize + 16 }; // Block header is 16 bytes.
+
+    // Alloc, pin, unpin, free.
+    {
+        RelocHeap heap;
+        heap.init(4096, 16);
+
+        const uint32_t handle = heap.alloc(100);
+        TEST_CHECK(RelocHeap::InvalidHandle != handle);
+        TEST_CHECK(100 == heap.sizeOf(handle));
+        TEST_CHECK(16 + 112 == heap.used());
+
+        void* ptr = heap.pin(handle);
+        TEST_CHECK(0 == uintptr_t(ptr)%RelocHeap::Alignment);
+        TEST_CHECK(ptr == heap.pin(handle)); // Pins nest.
+        memset(ptr, 9, 100);
+        heap.unpin(handle);
+        heap.unpin(handle);
+        TEST_CHECK(pinnedFilledWith(heap, handle, 9));
+
+        heap.free(handle);
+        TEST_CHECK(0 == heap.used());
+        TEST_CHECK(4096 == heap.available());
+    }
+
+    // Unpinned blocks slide down, a pinned one stays and keeps the gap in front of it.
+    {
+        RelocHeap heap;
+        heap.init(4096, 16);
+
+        uint32_t handles[5];
+        void*    ptrs[5];
+        for (uint32_t ii = 0; ii < 5; ++ii)
+        {
+            handles[ii] = heap.alloc(BlockSize);
+            ptrs[ii]    = pinnedFill(heap, handles[ii], uint8_t(ii+1));
+        }
+
+        // |a|b|C|d|e| -> |b|gap|C|e|
+        heap.free(handles[0]);
+        heap.free(handles[3]);
+        void* pinned = heap.pin(handles[2]);
+        TEST_CHECK(2*TotalSize == heap.fragmented());
+
+        bool done = false;
+        for (uint32_t ii = 0; ii < 100 && !done; ++ii)
+        {
+            done = heap.compact(1000);
+        }
+        TEST_CHECK(done);
+
+        TEST_CHECK(ptrs[0] == pinnedFill(heap, handles[1], 2));
+        TEST_CHECK(pinned  == heap.pin(handles[2]));
+        TEST_CHECK(ptrs[3] == heap.pin(handles[4]));
+        TEST_CHECK(isFilledWith(pinned,  3, BlockSize));
+        TEST_CHECK(isFilledWith(ptrs[3], 5, BlockSize));
+        heap.unpin(handles[4]);
+        heap.unpin(handles[2]);
+        heap.unpin(handles[2]);
+        TEST_CHECK(TotalSize == heap.fragmented());
+
+        // Nothing pinned, the gap goes away too.
+        while (!heap.compact(1000)) {}
+        TEST_CHECK(0 == heap.fragmented());
+        TEST_CHECK(ptrs[1] == heap.pin(handles[2]));
+        heap.unpin(handles[2]);
+        TEST_CHECK(pinnedFilledWith(heap, handles[1], 2));
+        TEST_CHECK(pinnedFilledWith(heap, handles[2], 3));
+        TEST_CHECK(pinnedFilledWith(heap, handles[4], 5));
+    }
+
+    // Full top, alloc() compacts synchronously.
+    {
+        enum { NumBlocks = 12 };
+
+        RelocHeap heap;
+        heap.init(NumBlocks*TotalSize + 64, 32);
+
+        uint32_t handles[NumBlocks];
+        for (uint32_t ii = 0; ii < NumBlocks; ++ii)
+        {
+            handles[ii] = heap.alloc(BlockSize);
+            pinnedFill(heap, handles[ii], uint8_t(ii+1));
+        }
+        for (uint32_t ii = 0; ii < NumBlocks; ii += 2)
+        {
+            heap.free(handles[ii]);
+        }
+        TEST_CHECK(NumBlocks/2*TotalSize == heap.fragmented());
+
+        const uint32_t big = heap.alloc(NumBlocks/2*TotalSize);
+        TEST_CHECK(RelocHeap::InvalidHandle != big);
+        TEST_CHECK(0 == heap.fragmented());
+        pinnedFill(heap, big, 0xee);
+        for (uint32_t ii = 1; ii < NumBlocks; ii += 2)
+        {
+            TEST_CHECK(pinnedFilledWith(heap, handles[ii], uint8_t(ii+1)));
+        }
+
+        // No room even after compaction.
+        TEST_CHECK(RelocHeap::InvalidHandle == heap.alloc(4*TotalSize));
+    }
+
+    // Handle exhaustion.
+    {
+        RelocHeap heap;
+        heap.init(4096, 4);
+
+        uint32_t handles[4];
+        for (uint32_t ii = 0; ii < 4; ++ii)
+        {
+            handles[ii] = heap.alloc(16);
+            TEST_CHECK(RelocHeap::InvalidHandle != handles[ii]);
+        }
+        TEST_CHECK(RelocHeap::InvalidHandle == heap.alloc(16));
+
+        heap.free(handles[1]);
+        TEST_CHECK(RelocHeap::InvalidHandle != heap.alloc(16));
+        TEST_CHECK(RelocHeap::InvalidHandle == heap.alloc(16));
+    }
+}
+
+static uint32_t s_typedAlive = 0;
+
+template <uint32_t SizeT>
+struct Typed
+{
+    Typed()
+    {
+        memset(m_data, 0xab, sizeof(m_data));
+        s_typedAlive++;
+    }
+
+    ~Typed()
+    {
+        s_typedAlive--;
+    }
+
+    uint8_t m_data[SizeT];
+};
+
+template <uint32_t SizeT>
+static void checkAllocT(size_t _classSize)
+{
+    Typed<SizeT>* obj = allocT< Typed<SizeT> >();
+    TEST_CHECK(NULL != obj);
+    TEST_CHECK(1 == s_typedAlive);
+    TEST_CHECK(isFilledWith(obj->m_data, 0xab, SizeT));
+    TEST_CHECK(allocContains(obj));
+    TEST_CHECK(_classSize == allocSizeOf(obj));
+
+    freeT(obj);
+    TEST_CHECK(0 == s_typedAlive);
+}
+
+static void testAllocTyped()
+{
+    TEST_CHECK(0  == AllocSizeClass<1>::Index);
+    TEST_CHECK(0  == AllocSizeClass<16>::Index);
+    TEST_CHECK(1  == AllocSizeClass<17>::Index);
+    TEST_CHECK(3  == AllocSizeClass<65>::Index);
+    TEST_CHECK(9  == AllocSizeClass<DM_KILOBYTES(512)>::Index);
+    TEST_CHECK(10 == AllocSizeClass<DM_KILOBYTES(512)+1>::Index);
+
+    checkAllocT<8>(16);
+    checkAllocT<24>(32);
+    checkAllocT<40>(64);
+    checkAllocT<200>(256);
+    checkAllocT<1000>(DM_KILOBYTES(1));
+    checkAllocT<DM_KILOBYTES(2)>(DM_KILOBYTES(16));
+
+    // Past all lists, served from the heap.
+    Typed<DM_KILOBYTES(600)>* big = allocT< Typed<DM_KILOBYTES(600)> >();
+    TEST_CHECK(NULL != big);
+    TEST_CHECK(1 == s_typedAlive);
+    TEST_CHECK(allocSizeOf(big) >= DM_KILOBYTES(600));
+    freeT(big);
+    TEST_CHECK(0 == s_typedAlive);
+
+    freeT((Typed<8>*)NULL);
+}
+
+static void* allocFreeInstance(void* _instance)
+{
+    AllocatorI* instance = (AllocatorI*)_instance;
+    for (uint32_t ii = 0; ii < 20000; ++ii)
+    {
+        void* ptr = DM_ALLOC(instance, 48 + ii%2000);
+        memset(ptr, 1, 48);
+        DM_FREE(instance, ptr);
+    }
+
+    return NULL;
+}
+
+static void testAllocInstance()
+{
+    // Released instances give all of their memory back, create a few in a row.
+    for (uint32_t round = 0; round < 3; ++round)
+    {
+        AllocatorI* instance = allocCreateInstance(16<<20);
+        TEST_CHECK(NULL != instance);
+
+        enum { NumPtrs = 2000 };
+        static void* ptrs[NumPtrs];
+        for (uint32_t ii = 0; ii < NumPtrs; ++ii)
+        {
+            ptrs[ii] = DM_ALLOC(instance, 16 + ii*5);
+            memset(ptrs[ii], uint8_t(ii), 16);
+        }
+
+        // Bigger than the instance arena, served from a chunk of the instance.
+        uint8_t* big = (uint8_t*)DM_ALLOC(instance, 32<<20);
+        TEST_CHECK(NULL != big);
+        TEST_CHECK(!allocContains(big));
+        memset(big, 3, 32<<20);
+
+        pthread_t threads[4];
+        for (uint32_t ii = 0; ii < DM_COUNTOF(threads); ++ii)
+        {
+            pthread_create(&threads[ii], NULL, allocFreeInstance, (void*)instance);
+        }
+        for (uint32_t ii = 0; ii < DM_COUNTOF(threads); ++ii)
+        {
+            pthread_join(threads[ii], NULL);
+        }
+
+        ptrs[0] = DM_REALLOC(instance, ptrs[0], 1<<20);
+        TEST_CHECK(isFilledWith(ptrs[0], 0, 16));
+        for (uint32_t ii = 1; ii < NumPtrs; ++ii)
+        {
+            TEST_CHECK(isFilledWith(ptrs[ii], uint8_t(ii), 16));
+        }
+        TEST_CHECK(isFilledWith(big, 3, 32<<20));
+
+        allocReleaseInstance(instance);
+    }
+
+    // Lists are scaled to the instance, classes left without slots are served from its heap.
+    AllocatorI* tiny = allocCreateInstance(1<<20);
+    TEST_CHECK(NULL != tiny);
+    for (uint32_t size = 16; size <= DM_KILOBYTES(512); size *= 2)
+    {
+        void* ptr = DM_ALLOC(tiny, size);
+        TEST_CHECK(NULL != ptr);
+        memset(ptr, 7, size);
+        DM_FREE(tiny, ptr);
+    }
+    allocReleaseInstance(tiny);
+
+    // Main allocator is not affected.
+    void* ptr = DM_ALLOC(mainAlloc, 100);
+    TEST_CHECK(allocContains(ptr));
+    DM_FREE(mainAlloc, ptr);
+}
+
+struct PersistentRoot
+{
+    uint32_t* m_values;
+    char*     m_name;
+};
+
+static void testAllocPersistent()
+{
+    const char*  path = "/tmp/dmtests_persistent.bin";
+    const size_t size = 256<<20;
+    enum { NumValues = 100000 };
+
+    remove(path);
+
+    // Any address that is free in this process.
+    void* address = ::mmap(NULL, size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    TEST_CHECK(MAP_FAILED != address);
+    ::munmap(address, size);
+
+    bool restored = true;
+    AllocatorI* persistent = allocOpenPersistent(path, address, size, &restored);
+    TEST_CHECK(NULL != persistent);
+    if (NULL == persistent)
+    {
+        return;
+    }
+    TEST_CHECK(!restored);
+    TEST_CHECK(NULL == allocPersistentRoot(persistent));
+
+    PersistentRoot* root = (PersistentRoot*)DM_ALLOC(persistent, sizeof(PersistentRoot));
+    root->m_values = (uint32_t*)DM_ALLOC(persistent, NumValues*sizeof(uint32_t));
+    for (uint32_t ii = 0; ii < NumValues; ++ii)
+    {
+        root->m_values[ii] = ii*3;
+    }
+    root->m_name = (char*)DM_ALLOC(persistent, 64);
+    strcpy(root->m_name, "persisted");
+
+    // Leave some holes behind.
+    for (uint32_t ii = 0; ii < 1000; ++ii)
+    {
+        void* ptr = DM_ALLOC(persistent, 1000 + ii*100);
+        if (ii&1)
+        {
+            DM_FREE(persistent, ptr);
+        }
+    }
+
+    allocSetPersistentRoot(persistent, root);
+    allocClosePersistent(persistent);
+
+    // Mapping it elsewhere would break the pointers inside.
+    void* other = (uint8_t*)address + (64<<20);
+    TEST_CHECK(NULL == allocOpenPersistent(path, other, size, &restored));
+
+    persistent = allocOpenPersistent(path, address, size, &restored);
+    TEST_CHECK(NULL != persistent);
+    if (NULL == persistent)
+    {
+        return;
+    }
+    TEST_CHECK(restored);
+
+    root = (PersistentRoot*)allocPersistentRoot(persistent);
+    TEST_CHECK(NULL != root);
+    TEST_CHECK(0 == strcmp(root->m_name, "persisted"));
+
+    // Restored heap keeps handing out memory without touching the live blocks.
+    root->m_values = (uint32_t*)DM_REALLOC(persistent, root->m_values, 2*NumValues*sizeof(uint32_t));
+    for (uint32_t ii = 0; ii < 1000; ++ii)
+    {
+        void* ptr = DM_ALLOC(persistent, 1000 + ii*100);
+        TEST_CHECK(NULL != ptr);
+        memset(ptr, 0xff, 1000);
+        DM_FREE(persistent, ptr);
+    }
+
+    uint32_t numBad = 0;
+    for (uint32_t ii = 0; ii < NumValues; ++ii)
+    {
+        numBad += (root->m_values[ii] != ii*3);
+    }
+    TEST_CHECK(0 == numBad);
+    TEST_CHECK(0 == strcmp(root->m_name, "persisted"));
+
+    allocClosePersistent(persistent);
+
+    // File written by a build with a different allocator layout. Stamp follows the 8 byte magic.
+    FILE* file = fopen(path, "r+b");
+    TEST_CHECK(NULL != file);
+    if (NULL != file)
+    {
+        const uint64_t layout = 0;
+        fseek(file, sizeof(uint64_t), SEEK_SET);
+        fwrite(&layout, sizeof(layout), 1, file);
+        fclose(file);
+
+        TEST_CHECK(NULL == allocOpenPersistent(path, address, size, &restored));
+    }
+
+    remove(path);
+}
+
+struct BudgetEvents
+{
+    uint32_t m_soft;
+    uint32_t m_hard;
+    uint64_t m_bytes;
+};
+
+static void onBudget(uint8_t /*_tag*/, uint64_t _bytes, bool _hardLimit, void* _userData)
+{
+    BudgetEvents* events = (BudgetEvents*)_userData;
+    events->m_soft  += !_hardLimit;
+    events->m_hard  +=  _hardLimit;
+    events->m_bytes  =  _bytes;
+}
+
+static void* allocFreeTagged(void* _alloc)
+{
+    AllocatorI* alloc = (AllocatorI*)_alloc;
+
+    void* ptrs[100];
+    for (uint32_t round = 0; round < 100; ++round)
+    {
+        for (uint32_t ii = 0; ii < DM_COUNTOF(ptrs); ++ii)
+        {
+            ptrs[ii] = DM_ALLOC(alloc, 100 + ii);
+        }
+        for (uint32_t ii = 0; ii < DM_COUNTOF(ptrs); ++ii)
+        {
+            ptrs[ii] = DM_REALLOC(alloc, ptrs[ii], 300);
+        }
+        for (uint32_t ii = 0; ii < DM_COUNTOF(ptrs); ++ii)
+        {
+            DM_FREE(alloc, ptrs[ii]);
+        }
+    }
+
+    return NULL;
+}
+
+static void testAllocTags()
+{
+    enum { TagCache = 1, TagNet = 2 };
+    TaggedAllocator cacheAlloc(TagCache, mainAlloc);
+    TaggedAllocator netAlloc(TagNet, mainAlloc);
+
+    BudgetEvents events = { 0, 0, 0 };
+    allocSetTagBudget(TagCache, 1000, 2000, onBudget, &events);
+
+    void* aa = DM_ALLOC(&cacheAlloc, 900);
+    TEST_CHECK(NULL != aa);
+    TEST_CHECK(0 == events.m_soft);
+
+    void* bb = DM_ALLOC(&cacheAlloc, 200);
+    TEST_CHECK(NULL != bb);
+    TEST_CHECK(1 == events.m_soft && 1100 == events.m_bytes);
+
+    // Over the hard budget, refused and nothing is accounted.
+    TEST_CHECK(NULL == DM_ALLOC(&cacheAlloc, 1000));
+    TEST_CHECK(1 == events.m_hard);
+    TEST_CHECK(1100 == allocTagBytes(TagCache));
+
+    // Growing counts only the difference, a refused realloc keeps the block.
+    bb = DM_REALLOC(&cacheAlloc, bb, 1100);
+    TEST_CHECK(NULL != bb);
+    TEST_CHECK(2000 == allocTagBytes(TagCache));
+    TEST_CHECK(NULL == DM_REALLOC(&cacheAlloc, bb, 1200));
+    TEST_CHECK(2 == events.m_hard);
+    TEST_CHECK(2000 == allocTagBytes(TagCache));
+    TEST_CHECK(1 == events.m_soft);
+
+    DM_FREE(&cacheAlloc, aa);
+    DM_FREE(&cacheAlloc, bb);
+    TEST_CHECK(0 == allocTagBytes(TagCache));
+    allocSetTagBudget(TagCache, 0, 0);
+
+    // Tags without a budget are still counted, from any thread.
+    AllocStats before;
+    allocGetStats(before);
+
+    pthread_t threads[4];
+    for (uint32_t ii = 0; ii < DM_COUNTOF(threads); ++ii)
+    {
+        pthread_create(&threads[ii], NULL, allocFreeTagged, (void*)&netAlloc);
+    }
+    for (uint32_t ii = 0; ii < DM_COUNTOF(threads); ++ii)
+    {
+        pthread_join(threads[ii], NULL);
+    }
+
+    void* keep = DM_ALLOC(&netAlloc, 777);
+    TEST_CHECK(777 == allocTagBytes(TagNet));
+
+    AllocStats after;
+    allocGetStats(after);
+    TEST_CHECK(777 == after.m_tagBytes[TagNet]);
+    TEST_CHECK(4*100*100 + 1 == after.m_tagAllocCount[TagNet] - before.m_tagAllocCount[TagNet]);
+    TEST_CHECK(4*100*100     == after.m_tagFreeCount[TagNet]  - before.m_tagFreeCount[TagNet]);
+
+    DM_FREE(&netAlloc, keep);
+    TEST_CHECK(0 == allocTagBytes(TagNet));
+}
+
+struct SnapshotUsage
+{
+    uint64_t m_used[AllocSnapshotExtent::KindCount];
+    bool     m_valid;
+};
+
+static int compareExtents(const void* _a, const void* _b)
+{
+    const AllocSnapshotExtent* aa = (const AllocSnapshotExtent*)_a;
+    const AllocSnapshotExtent* bb = (const AllocSnapshotExtent*)_b;
+    if (aa->m_chunk != bb->m_chunk)
+    {
+        return aa->m_chunk < bb->m_chunk ? -1 : 1;
+    }
+    return (aa->m_offset < bb->m_offset) ? -1 : (aa->m_offset > bb->m_offset);
+}
+
+static SnapshotUsage readSnapshot(const char* _path)
+{
+    SnapshotUsage usage;
+    memset(&usage, 0, sizeof(usage));
+
+    FILE* file = fopen(_path, "rb");
+    if (NULL == file)
+    {
+        return usage;
+    }
+
+    AllocSnapshotHeader header;
+    usage.m_valid = (1 == fread(&header, sizeof(header), 1, file))
+                 && (0 == memcmp(header.m_magic, "DMSS", 4))
+                 && (AllocSnapshotHeader::Version == header.m_version)
+                 && (0 != header.m_numExtents);
+
+    AllocSnapshotExtent* extents = NULL;
+    if (usage.m_valid)
+    {
+        extents = (AllocSnapshotExtent*)::malloc(header.m_numExtents*sizeof(AllocSnapshotExtent));
+        usage.m_valid = (header.m_numExtents == fread(extents, sizeof(AllocSnapshotExtent), header.m_numExtents, file))
+                     && (0 == fread(&header, 1, 1, file)); // Nothing past the last extent.
+    }
+    fclose(file);
+
+    if (usage.m_valid)
+    {
+        // Extents of the same chunk never overlap, arena extents stay within the arena.
+        qsort(extents, header.m_numExtents, sizeof(AllocSnapshotExtent), compareExtents);
+        for (uint32_t ii = 0; ii < header.m_numExtents; ++ii)
+        {
+            const AllocSnapshotExtent& extent = extents[ii];
+            const uint64_t end = extent.m_offset + extent.m_size;
+
+            usage.m_valid &= (extent.m_kind < AllocSnapshotExtent::KindCount) && (0 != extent.m_size);
+            usage.m_valid &= (0 != extent.m_chunk || end <= header.m_arenaSize);
+            if (ii+1 < header.m_numExtents && extents[ii+1].m_chunk == extent.m_chunk)
+            {
+                usage.m_valid &= (end <= extents[ii+1].m_offset);
+            }
+
+            if (extent.m_used && extent.m_kind < AllocSnapshotExtent::KindCount)
+            {
+                usage.m_used[extent.m_kind] += extent.m_size;
+            }
+        }
+    }
+
+    ::free(extents);
+
+    return usage;
+}
+
+static void testAllocSnapshot()
+{
+    const char* path = "/tmp/dmtests_snapshot.bin";
+
+    TEST_CHECK(allocDumpSnapshot(path));
+    const SnapshotUsage before = readSnapshot(path);
+    TEST_CHECK(before.m_valid);
+
+    enum { NumSmall = 100 };
+    void* small[NumSmall];
+    for (uint32_t ii = 0; ii < NumSmall; ++ii)
+    {
+        small[ii] = DM_ALLOC(mainAlloc, 64);
+    }
+    void* big = DM_ALLOC(mainAlloc, 2<<20);
+    TEST_CHECK(NULL != DM_ALLOC(staticAlloc, 1000));
+
+    TEST_CHECK(allocDumpSnapshot(path));
+    const SnapshotUsage during = readSnapshot(path);
+    TEST_CHECK(during.m_valid);
+    TEST_CHECK(during.m_used[AllocSnapshotExtent::Segregated] >= before.m_used[AllocSnapshotExtent::Segregated] + NumSmall*64);
+    TEST_CHECK(during.m_used[AllocSnapshotExtent::Heap]       >= before.m_used[AllocSnapshotExtent::Heap] + (2<<20));
+    TEST_CHECK(during.m_used[AllocSnapshotExtent::Static]     >= before.m_used[AllocSnapshotExtent::Static] + 1000);
+
+    for (uint32_t ii = 0; ii < NumSmall; ++ii)
+    {
+        DM_FREE(mainAlloc, small[ii]);
+    }
+    DM_FREE(mainAlloc, big);
+
+    TEST_CHECK(allocDumpSnapshot(path));
+    const SnapshotUsage after = readSnapshot(path);
+    TEST_CHECK(after.m_valid);
+    TEST_CHECK(after.m_used[AllocSnapshotExtent::Segregated] == before.m_used[AllocSnapshotExtent::Segregated]);
+    TEST_CHECK(after.m_used[AllocSnapshotExtent::Heap]       == before.m_used[AllocSnapshotExtent::Heap]);
+
+    remove(path);
+}
+
+static void* allocBigBlocks(void* _failed)
+{
+    enum { NumBlocks = 3, BlockSize = DM_MEM_CHUNK_SIZE/4*3 };
+
+    void* blocks[NumBlocks];
+    for (uint32_t ii = 0; ii < NumBlocks; ++ii)
+    {
+        blocks[ii] = DM_ALLOC(mainAlloc, BlockSize);
+        memset(blocks[ii], int(ii), 4096);
+        sched_yield();
+    }
+
+    // Lookups of chunks added by other threads in the meantime.
+    for (uint32_t ii = 0; ii < NumBlocks; ++ii)
+    {
+        if (!allocContains(blocks[ii])
+        ||  !allocContains((uint8_t*)blocks[ii] + BlockSize - 1)
+        ||  allocSizeOf(blocks[ii]) < BlockSize
+        ||  !isFilledWith(blocks[ii], uint8_t(ii), 4096))
+        {
+            atomicFetchAndAdd((volatile uint32_t*)_failed, 1u);
+        }
+    }
+
+    for (uint32_t ii = 0; ii < NumBlocks; ++ii)
+    {
+        DM_FREE(mainAlloc, blocks[ii]);
+    }
+
+    return NULL;
+}
+
+static void testAllocChunks()
+{
+    // More than the arena can hold, threads add chunks concurrently.
+    enum { NumThreads = 4 };
+
+    volatile uint32_t failed = 0;
+    pthread_t threads[NumThreads];
+    for (uint32_t ii = 0; ii < NumThreads; ++ii)
+    {
+        pthread_create(&threads[ii], NULL, allocBigBlocks, (void*)&failed);
+    }
+    for (uint32_t ii = 0; ii < NumThreads; ++ii)
+    {
+        pthread_join(threads[ii], NULL);
+    }
+    TEST_CHECK(0 == failed);
+
+    // Chunk memory is reused once freed.
+    void* ptr = DM_ALLOC(mainAlloc, DM_MEM_CHUNK_SIZE/2);
+    TEST_CHECK(allocContains(ptr));
+    DM_FREE(mainAlloc, ptr);
+}
+
+static void testAllocExternal()
+{
+    // Pointers that did not come from the allocator are handed back to the CRT.
+    uint8_t* foreign = (uint8_t*)::malloc(100);
+    memset(foreign, 5, 100);
+    TEST_CHECK(0 == allocSizeOf(foreign));
+    foreign = (uint8_t*)DM_REALLOC(mainAlloc, foreign, 200);
+    TEST_CHECK(isFilledWith(foreign, 5, 100));
+    TEST_CHECK(0 == allocSizeOf(foreign));
+    DM_FREE(mainAlloc, foreign);
+
+    // Fill the arena and all of its chunks, leftovers included, so that 1MB and up goes external.
+    enum { MaxFill = 4096 };
+    static void* fill[MaxFill];
+    uint32_t numFill = 0;
+    const size_t fillSizes[] = { DM_MEM_CHUNK_SIZE, DM_MEM_CHUNK_SIZE/16, 1<<20 };
+    for (uint32_t ii = 0; ii < uint32_t(DM_COUNTOF(fillSizes)); ++ii)
+    {
+        while (numFill < MaxFill)
+        {
+            void* ptr = DM_ALLOC(mainAlloc, fillSizes[ii]);
+            TEST_CHECK(NULL != ptr);
+            fill[numFill++] = ptr;
+
+            if (!allocContains(ptr))
+            {
+                TEST_CHECK(allocSizeOf(ptr) == fillSizes[ii]);
+                break;
+            }
+        }
+    }
+    TEST_CHECK(numFill < MaxFill);
+
+    AllocStats before;
+    allocGetStats(before);
+
+    // Small sizes still fit the segregated lists, anything bigger is mapped.
+    uint8_t* small = (uint8_t*)DM_ALLOC(mainAlloc, 1<<20);
+    uint8_t* big   = (uint8_t*)DM_ALLOC(mainAlloc, 3<<20);
+    TEST_CHECK(!allocContains(small) && !allocContains(big));
+    TEST_CHECK(allocSizeOf(small) == (1<<20));
+    memset(small, 7, 100);
+    memset(big, 9, 3<<20);
+
+    small = (uint8_t*)DM_REALLOC(mainAlloc, small, 600<<10);
+    big   = (uint8_t*)DM_REALLOC(mainAlloc, big, 300<<20);
+    TEST_CHECK(isFilledWith(small, 7, 100));
+    TEST_CHECK(isFilledWith(big, 9, 3<<20));
+    TEST_CHECK(allocSizeOf(small) == (600<<10));
+    TEST_CHECK(allocSizeOf(big) == (300<<20));
+
+    DM_FREE(mainAlloc, small);
+    DM_FREE(mainAlloc, big);
+
+    AllocStats after;
+    allocGetStats(after);
+    TEST_CHECK(2 == after.m_freeCount[AllocStats::External] - before.m_freeCount[AllocStats::External]);
+    TEST_CHECK(after.m_externalBytes == before.m_externalBytes);
+    TEST_CHECK(after.m_allocBytes[AllocStats::External] - before.m_allocBytes[AllocStats::External]
+            == after.m_freeBytes[AllocStats::External]  - before.m_freeBytes[AllocStats::External]);
+
+    for (uint32_t ii = 0; ii < numFill; ++ii)
+    {
+        DM_FREE(mainAlloc, fill[ii]);
+    }
+}
+
+static uint32_t readProfile(const char* _path, char* _header, size_t _headerSize)
+{
+    FILE* file = fopen(_path, "r");
+    if (NULL == file)
+    {
+        return 0;
+    }
+
+    _header[0] = '\0';
+    uint32_t numSites = 0;
+
+    char line[1024];
+    while (NULL != fgets(line, sizeof(line), file))
+    {
+        if ('#' != line[0])
+        {
+            ++numSites;
+        }
+        else if ('\0' == _header[0])
+        {
+            strncpy(_header, line, _headerSize-1);
+            _header[_headerSize-1] = '\0';
+        }
+    }
+    fclose(file);
+
+    return numSites;
+}
+
+static void testAllocProfiler()
+{
+    const char* path = "/tmp/dmtests_profile.txt";
+    char header[256];
+
+    // Every allocation is sampled.
+    allocProfilerStart(1);
+    void* ptr = DM_ALLOC(mainAlloc, 4096);
+
+    // Runs after testAllocExternal(), chunks are all taken and the mapping fails, so does the realloc.
+    void* failed = DM_REALLOC(mainAlloc, ptr, size_t(1)<<50);
+    TEST_CHECK(NULL == failed);
+
+    // Moved block is sampled at its new address, the old sample is gone.
+    ptr = DM_REALLOC(mainAlloc, ptr, 8192);
+    TEST_CHECK(NULL != ptr);
+
+    // Sampled frees leave no tombstones behind that would fill the table.
+    for (uint32_t ii = 0; ii < 50000; ++ii)
+    {
+        DM_FREE(mainAlloc, DM_ALLOC(mainAlloc, 64));
+    }
+
+    allocProfilerStart(0);
+
+    // The block is still alive, so is its sample. Interval is the one used for sampling.
+    TEST_CHECK(allocProfilerDump(path));
+    TEST_CHECK(1 == readProfile(path, header, sizeof(header)));
+    TEST_CHECK(NULL != strstr(header, "one sample per 1 bytes"));
+
+    DM_FREE(mainAlloc, ptr);
+    TEST_CHECK(allocProfilerDump(path));
+    TEST_CHECK(0 == readProfile(path, header, sizeof(header)));
+
+    remove(path);
+}
+
+void testAllocator()
+{
+    testAllocStackChunks();
+    testAllocPrefault();
+    testAllocHeapRegions();
+    testAllocCrossThread();
+    testAllocCounters();
+    testAllocTyped();
+    testAllocInstance();
+    testAllocPersistent();
+    testAllocTags();
+    testAllocSnapshot();
+    testAllocChunks();
+    testAllocExternal();
+    testAllocProfiler();
+    testRelocHeap();
+}
+
+/* vim: set sw=4 ts=4 expandtab: */
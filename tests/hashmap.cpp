@@ -0,0 +1,998 @@
+/*
+ * Copyright 2016 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "test.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <pthread.h>
+#include <stdlib.h> // malloc
+#include <dm/allocatori.h>
+#include <dm/allocator/allocator.h> // TaggedAllocator
+#include <dm/hash.h>
+#include <dm/datastructures/hashmap.h>
+#include <dm/datastructures/objhashmap.h>
+#include <dm/datastructures/hashmapfrozen.h>
+
+using namespace dm;
+
+// Maps are checked against std::unordered_map over the same sequence of random operations.
+
+typedef std::unordered_map<uint32_t, uint32_t> RefMap;
+
+/// xorshift32, same sequence on every run.
+struct Rng
+{
+    Rng(uint32_t _seed)
+    {
+        m_state = _seed;
+    }
+
+    uint32_t next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    uint32_t m_state;
+};
+
+enum
+{
+    NumOps    = 200000,
+    CheckStep = 16384, // Full comparison every CheckStep operations.
+};
+
+/// Every key of '_ref' is found with its value and nothing outside of it is. Returns the number of mismatches.
+template <typename MapTy>
+static uint32_t compareAll(MapTy& _map, const RefMap& _ref, uint32_t _keyRange)
+{
+    uint32_t mismatches = (_map.count() != _ref.size());
+    for (uint32_t key = 0; key < _keyRange; ++key)
+    {
+        RefMap::const_iterator it = _ref.find(key);
+        const uint32_t expected = (_ref.end() != it) ? it->second : TyInfo<uint32_t>::Max();
+        mismatches += (_map.find(key) != expected);
+    }
+
+    return mismatches;
+}
+
+/// For maps with bool insert(key, val) that overwrites, ValTy find(key) and bool remove(key).
+/// '_keyRange' bounds the keys, so after the map fills up inserts and removes keep churning the same slots.
+template <typename MapTy>
+static void checkAgainstRef(MapTy& _map, uint32_t _seed, uint32_t _keyRange)
+{
+    RefMap ref;
+    Rng rng(_seed);
+
+    uint32_t mismatches = 0;
+    for (uint32_t op = 0; op < NumOps; ++op)
+    {
+        const uint32_t key = rng.next()%_keyRange;
+        const uint32_t val = rng.next()>>1;
+
+        switch (rng.next()%4)
+        {
+        case 0:
+        case 1:
+            {
+                const bool added = ref.insert(RefMap::value_type(key, val)).second;
+                ref[key] = val;
+                mismatches += (_map.insert(key, val) != added);
+            }
+            break;
+
+        case 2:
+            mismatches += (_map.remove(key) != (1 == ref.erase(key)));
+            break;
+
+        default:
+            {
+                RefMap::const_iterator it = ref.find(key);
+                const uint32_t expected = (ref.end() != it) ? it->second : TyInfo<uint32_t>::Max();
+                mismatches += (_map.find(key) != expected);
+            }
+            break;
+        }
+
+        if (0 == (op+1)%CheckStep)
+        {
+            mismatches += compareAll(_map, ref, _keyRange);
+        }
+    }
+
+    mismatches += compareAll(_map, ref, _keyRange);
+    TEST_CHECK(0 == mismatches);
+
+    // Emptied.
+    for (RefMap::const_iterator it = ref.begin(), end = ref.end(); it != end; ++it)
+    {
+        mismatches += !_map.remove(it->first);
+    }
+    ref.clear();
+    mismatches += compareAll(_map, ref, _keyRange);
+    TEST_CHECK(0 == mismatches);
+}
+
+static void testHash()
+{
+    uint8_t data[64];
+    for (uint32_t ii = 0; ii < DM_COUNTOF(data); ++ii)
+    {
+        data[ii] = uint8_t(ii*31 + 7);
+    }
+
+    // Pin the output, a change here invalidates hashes that were stored or persisted. hashXx64 is XXH64 and
+    // matches the reference implementation, hashWy64 has no reference. Values are for little endian loads.
+    struct Known
+    {
+        uint32_t m_size;
+        uint64_t m_wy;
+        uint64_t m_xx;
+    };
+
+    const Known known[] =
+    {
+        {  0, UINT64_C(0x0409638ee2bde459), UINT64_C(0xef46db3751d8e999) },
+        {  1, UINT64_C(0xfddeeeea8cc2709c), UINT64_C(0xa96c7f0ce858bbb7) },
+        {  3, UINT64_C(0xaa4dada6d17eebb0), UINT64_C(0x56e6957632a487f9) },
+        {  4, UINT64_C(0x8d9d4657e96cc294), UINT64_C(0xc60d15b1e3ff8f04) },
+        {  8, UINT64_C(0x9654832f28858268), UINT64_C(0x3da5c7aa269683e0) },
+        { 16, UINT64_C(0x36b53f8551944db0), UINT64_C(0xa19ad429b02bc413) },
+        { 17, UINT64_C(0x904849bdd1e93c7c), UINT64_C(0xfe9f0feb7eeedc09) },
+        { 32, UINT64_C(0x4d1435b5e345c9cb), UINT64_C(0x8d57d6a4671cc43d) },
+        { 48, UINT64_C(0x3ec1b034dbe02bd7), UINT64_C(0x9f31c521803da811) },
+        { 49, UINT64_C(0x30161cb91c8df53e), UINT64_C(0x9f787017de727118) },
+    };
+
+    for (uint32_t ii = 0; ii < DM_COUNTOF(known); ++ii)
+    {
+        const uint32_t size = known[ii].m_size;
+        TEST_CHECK(known[ii].m_wy == hashWy64(data, size));
+        TEST_CHECK(known[ii].m_xx == hashXx64(data, size));
+
+        // Same bytes at every alignment and with garbage past the end hash the same.
+        uint8_t copy[64+8];
+        for (uint32_t offset = 1; offset < 8; ++offset)
+        {
+            memset(copy, 0xcd, sizeof(copy));
+            memcpy(&copy[offset], data, size);
+            TEST_CHECK(known[ii].m_wy == hashWy64(&copy[offset], size));
+            TEST_CHECK(known[ii].m_xx == hashXx64(&copy[offset], size));
+        }
+
+        // The seed and the last byte change the result.
+        TEST_CHECK(known[ii].m_wy != hashWy64(data, size, 1));
+        TEST_CHECK(known[ii].m_xx != hashXx64(data, size, 1));
+        if (0 != size)
+        {
+            memcpy(copy, data, size);
+            copy[size-1] ^= 1;
+            TEST_CHECK(known[ii].m_wy != hashWy64(copy, size));
+            TEST_CHECK(known[ii].m_xx != hashXx64(copy, size));
+        }
+    }
+}
+
+static void testHashMapGrowable()
+{
+    // Integer keys and byte keys, starting from the smallest table so that it grows and rebuilds many times.
+    {
+        HashMapGrowable<sizeof(uint32_t), uint32_t> map;
+        map.init();
+        checkAgainstRef(map, 0x9e3779b9, 100);
+        checkAgainstRef(map, 0x2545f491, 50000);
+    }
+
+    {
+        HashMapGrowable<12, uint32_t> map;
+        map.init(16, &g_crtAllocator, 90);
+        checkAgainstRef(map, 0x6c078965, 3000);
+    }
+
+    // Moving to the new table spans several calls at any load factor, a grow never finds the previous one unfinished.
+    const uint8_t loads[] = { 10, 30, 75, 95 };
+    for (uint32_t ii = 0; ii < DM_COUNTOF(loads); ++ii)
+    {
+        HashMapGrowable<sizeof(uint32_t), uint32_t> map;
+        map.init(1024, &g_crtAllocator, loads[ii]);
+
+        uint32_t growths  = 0;
+        uint32_t oneCall  = 0;
+        uint32_t overlaps = 0;
+        uint32_t span     = 0;
+        for (uint32_t key = 0; key < 50000; ++key)
+        {
+            const bool     wasGrowing = map.isGrowing();
+            const uint32_t prevMax    = map.max();
+            map.insert(key, key);
+
+            overlaps += (wasGrowing && prevMax != map.max());
+            if (map.isGrowing())
+            {
+                span++;
+            }
+            else if (wasGrowing)
+            {
+                growths++;
+                oneCall += (span < 2);
+                span = 0;
+            }
+        }
+
+        TEST_CHECK(0 != growths);
+        TEST_CHECK(0 == oneCall);
+        TEST_CHECK(0 == overlaps);
+    }
+}
+
+static void testHashMapSwiss()
+{
+    {
+        HashMapSwiss<sizeof(uint32_t), uint32_t> map;
+        map.init();
+        checkAgainstRef(map, 0x9e3779b9, 100);
+        checkAgainstRef(map, 0x2545f491, 50000);
+    }
+
+    {
+        HashMapSwiss<12, uint32_t> map;
+        map.init(64);
+        checkAgainstRef(map, 0x6c078965, 3000);
+    }
+}
+
+/// Few home slots for all keys, so probe distances go past what fits the used byte (HashMapImpl::Far).
+struct ClusteredHashPolicy
+{
+    static uint64_t hash(const void* _data, uint32_t /*_size*/)
+    {
+        return (*(const uint8_t*)_data)&3;
+    }
+
+    static uint64_t hashInt(uint64_t _val)
+    {
+        return _val&3;
+    }
+};
+
+struct RobinHoodObj
+{
+    uint32_t m_key;
+    uint32_t m_val;
+};
+
+/// Integer keys and the first bytes of byte keys hold the uint32_t the entry was inserted with.
+template <typename KeyTy>
+static uint32_t keyOf(const KeyTy& _key)
+{
+    uint32_t key;
+    memcpy(&key, &_key, sizeof(key));
+    return key;
+}
+
+/// Collects the entries an iteration visits. Each entry of the reference must be visited once, with its value, and nothing else.
+struct IterationVisits
+{
+    IterationVisits(const RefMap& _ref)
+    {
+        m_ref = &_ref;
+        m_mismatches = 0;
+    }
+
+    void visit(uint32_t _key, uint32_t _val)
+    {
+        RefMap::const_iterator it = m_ref->find(_key);
+        m_mismatches += (m_ref->end() == it || _val != it->second);
+        m_mismatches += !m_seen.insert(_key).second;
+    }
+
+    uint32_t mismatches() const
+    {
+        return m_mismatches + (m_seen.size() != m_ref->size());
+    }
+
+    const RefMap* m_ref;
+    std::unordered_set<uint32_t> m_seen;
+    uint32_t m_mismatches;
+};
+
+/// forEach() takes its function by value, visits go through a pointer.
+struct VisitEntry
+{
+    template <typename KeyTy>
+    void operator()(const KeyTy& _key, uint32_t& _val)
+    {
+        m_visits->visit(keyOf(_key), _val);
+    }
+
+    template <typename KeyTy>
+    void operator()(const KeyTy& _key, RobinHoodObj& _obj)
+    {
+        m_visits->visit(keyOf(_key), (keyOf(_key) == _obj.m_key) ? _obj.m_val : TyInfo<uint32_t>::Max());
+    }
+
+    IterationVisits* m_visits;
+};
+
+/// first()/next() and forEach() of HashMapImpl and ObjHashMapImpl, with the handle getter of each.
+template <typename MapTy, typename GetTy>
+static uint32_t compareIteration(MapTy& _map, const RefMap& _ref, GetTy _get)
+{
+    IterationVisits handles(_ref);
+    for (uint32_t handle = _map.first(); MapTy::InvalidHandle != handle; handle = _map.next(handle))
+    {
+        handles.visit(keyOf(_map.getKeyOf(handle)), _get(_map, handle));
+    }
+
+    IterationVisits forEachVisits(_ref);
+    VisitEntry visitEntry = { &forEachVisits };
+    _map.forEach(visitEntry);
+
+    IterationVisits noPrefetchVisits(_ref);
+    VisitEntry noPrefetchEntry = { &noPrefetchVisits };
+    _map.forEach(noPrefetchEntry, 0);
+
+    return handles.mismatches() + forEachVisits.mismatches() + noPrefetchVisits.mismatches();
+}
+
+/// Gives HashMapImpl the interface checkAgainstRef() expects. Its insert() does not look for the key, insertHandleDup() does.
+template <typename HashMapTy>
+struct RobinHoodMap
+{
+    bool insert(uint32_t _key, uint32_t _val)
+    {
+        const typename HashMapTy::IdxDuplicate result = m_map.insertHandleDup(_key, _val);
+        m_map.ukv()[result.m_idx].m_val = _val;
+        return !result.isDuplicate();
+    }
+
+    uint32_t find(uint32_t _key)
+    {
+        return m_map.find(_key);
+    }
+
+    bool remove(uint32_t _key)
+    {
+        return m_map.remove(_key);
+    }
+
+    uint32_t count() const
+    {
+        return m_map.count();
+    }
+
+    static uint32_t valueOf(HashMapTy& _map, uint32_t _handle)
+    {
+        return _map.getValueOf(_handle);
+    }
+
+    uint32_t iterationMismatches(const RefMap& _ref)
+    {
+        return compareIteration(m_map, _ref, valueOf);
+    }
+
+    HashMapTy m_map;
+};
+
+/// Same for ObjHashMapImpl, objects keep a copy of their key so that keys and objects moved out of step show up.
+template <typename ObjHashMapTy>
+struct RobinHoodObjMap
+{
+    typedef typename ObjHashMapTy::ObjTy Obj;
+
+    bool insert(uint32_t _key, uint32_t _val)
+    {
+        const typename ObjHashMapTy::ObjDuplicate result = m_map.insertHandleDup(_key);
+        result.m_obj->m_key = _key;
+        result.m_obj->m_val = _val;
+        return !result.m_duplicate;
+    }
+
+    uint32_t find(uint32_t _key)
+    {
+        const Obj* obj = m_map.find(_key);
+        if (NULL == obj)
+        {
+            return TyInfo<uint32_t>::Max();
+        }
+
+        return (_key == obj->m_key) ? obj->m_val : TyInfo<uint32_t>::Max()-1;
+    }
+
+    bool remove(uint32_t _key)
+    {
+        return m_map.remove(_key);
+    }
+
+    uint32_t count() const
+    {
+        return m_map.count();
+    }
+
+    static uint32_t valueOf(ObjHashMapTy& _map, uint32_t _handle)
+    {
+        const Obj* obj = _map.getObjOf(_handle);
+        return (keyOf(_map.getKeyOf(_handle)) == obj->m_key) ? obj->m_val : TyInfo<uint32_t>::Max();
+    }
+
+    uint32_t iterationMismatches(const RefMap& _ref)
+    {
+        return compareIteration(m_map, _ref, valueOf);
+    }
+
+    ObjHashMapTy m_map;
+};
+
+/// Random inserts and removes, iteration compared with '_ref' every CheckStep operations and once emptied.
+template <typename MapTy>
+static void checkIteration(MapTy& _map, uint32_t _seed, uint32_t _keyRange)
+{
+    RefMap ref;
+    Rng rng(_seed);
+
+    uint32_t mismatches = 0;
+    for (uint32_t op = 0; op < NumOps; ++op)
+    {
+        const uint32_t key = rng.next()%_keyRange;
+        const uint32_t val = rng.next()>>1;
+
+        if (0 != rng.next()%3)
+        {
+            ref[key] = val;
+            _map.insert(key, val);
+        }
+        else
+        {
+            ref.erase(key);
+            _map.remove(key);
+        }
+
+        if (0 == (op+1)%CheckStep)
+        {
+            mismatches += _map.iterationMismatches(ref);
+        }
+    }
+
+    mismatches += _map.iterationMismatches(ref);
+
+    for (RefMap::const_iterator it = ref.begin(), end = ref.end(); it != end; ++it)
+    {
+        _map.remove(it->first);
+    }
+    ref.clear();
+    mismatches += _map.iterationMismatches(ref);
+    TEST_CHECK(0 == mismatches);
+}
+
+static void testHashMapRobinHood()
+{
+    // Fixed size, key ranges stay below max() so that the map gets close to full without overflowing.
+    {
+        RobinHoodMap< HashMap<sizeof(uint32_t), uint32_t> > map;
+        map.m_map.init(1024);
+        checkAgainstRef(map, 0x9e3779b9, 100);
+        checkAgainstRef(map, 0x2545f491, 1000);
+    }
+
+    {
+        RobinHoodMap< HashMap<12, uint32_t> > map;
+        map.m_map.init(256);
+        checkAgainstRef(map, 0x6c078965, 250);
+    }
+
+    {
+        RobinHoodMap< HashMap<sizeof(uint32_t), uint32_t, AllocatorIPolicy, ClusteredHashPolicy> > map;
+        map.m_map.init(512);
+        checkAgainstRef(map, 0x2545f491, 500);
+    }
+
+    {
+        RobinHoodObjMap< ObjHashMap<sizeof(uint32_t), RobinHoodObj> > map;
+        map.m_map.init(1024);
+        checkAgainstRef(map, 0x9e3779b9, 1000);
+    }
+
+    {
+        RobinHoodObjMap< ObjHashMap<12, RobinHoodObj, AllocatorIPolicy, ClusteredHashPolicy> > map;
+        map.m_map.init(512);
+        checkAgainstRef(map, 0x6c078965, 500);
+    }
+
+    // Iteration over the used slots bitmap: dense, sparse (mostly empty bitmap words) and clustered tables.
+    {
+        RobinHoodMap< HashMap<sizeof(uint32_t), uint32_t> > map;
+        map.m_map.init(1024);
+        checkIteration(map, 0x9e3779b9, 1000);
+    }
+
+    {
+        RobinHoodMap< HashMap<12, uint32_t> > map;
+        map.m_map.init(1<<16);
+        checkIteration(map, 0x2545f491, 200);
+    }
+
+    {
+        RobinHoodMap< HashMap<sizeof(uint32_t), uint32_t, AllocatorIPolicy, ClusteredHashPolicy> > map;
+        map.m_map.init(512);
+        checkIteration(map, 0x6c078965, 500);
+    }
+
+    {
+        RobinHoodObjMap< ObjHashMap<sizeof(uint32_t), RobinHoodObj> > map;
+        map.m_map.init(1<<16);
+        checkIteration(map, 0x9e3779b9, 200);
+    }
+
+    {
+        RobinHoodObjMap< ObjHashMap<12, RobinHoodObj, AllocatorIPolicy, ClusteredHashPolicy> > map;
+        map.m_map.init(512);
+        checkIteration(map, 0x2545f491, 500);
+    }
+}
+
+/// Every hash policy behind the same maps, the byte keys go through hash() and the integer keys through hashInt().
+template <typename HashPolicyTy>
+static void checkHashPolicy(uint32_t _seed)
+{
+    {
+        RobinHoodMap< HashMap<sizeof(uint32_t), uint32_t, AllocatorIPolicy, HashPolicyTy> > map;
+        map.m_map.init(4096);
+        checkAgainstRef(map, _seed, 3000);
+    }
+
+    {
+        RobinHoodMap< HashMap<12, uint32_t, AllocatorIPolicy, HashPolicyTy> > map;
+        map.m_map.init(4096);
+        checkAgainstRef(map, _seed, 3000);
+    }
+
+    {
+        HashMapGrowable<sizeof(uint32_t), uint32_t, AllocatorIPolicy, HashPolicyTy> map;
+        map.init();
+        checkAgainstRef(map, _seed, 50000);
+    }
+
+    {
+        HashMapSwiss<12, uint32_t, AllocatorIPolicy, HashPolicyTy> map;
+        map.init(64);
+        checkAgainstRef(map, _seed, 3000);
+    }
+}
+
+static void testHashMapPolicies()
+{
+    checkHashPolicy<XxHashPolicy>(0x9e3779b9);
+    checkHashPolicy<SdbmHashPolicy>(0x2545f491);
+}
+
+struct ConcurrentArgs
+{
+    typedef HashMapConcurrent<sizeof(uint32_t), uint32_t> MapTy;
+
+    MapTy*            m_map;
+    volatile uint32_t m_nextWriter;
+    volatile uint32_t m_writersLeft;
+    volatile uint32_t m_failures;
+};
+
+enum
+{
+    NumStableKeys = 1000,
+    NumChurnKeys  = 100,
+    NumChurnOps   = 250000,
+};
+
+/// Keeps NumChurnKeys keys alive, always inserting new ones and removing the oldest.
+/// Removed slots pile up and the table is rebuilt at the same size over and over.
+static void* churnConcurrent(void* _args)
+{
+    ConcurrentArgs* args = (ConcurrentArgs*)_args;
+
+    const uint32_t first = NumStableKeys + atomicFetchAndAdd(&args->m_nextWriter, 1u)*NumChurnOps;
+    for (uint32_t ii = 0; ii < NumChurnOps; ++ii)
+    {
+        args->m_map->insert(first + ii, ii);
+        if (ii >= NumChurnKeys)
+        {
+            args->m_map->remove(first + ii - NumChurnKeys);
+        }
+    }
+    for (uint32_t ii = NumChurnOps - NumChurnKeys; ii < NumChurnOps; ++ii)
+    {
+        args->m_map->remove(first + ii);
+    }
+
+    atomicFetchAndAdd(&args->m_writersLeft, uint32_t(-1));
+    return NULL;
+}
+
+/// Keys inserted up front are never removed, they have to be found in whichever table is current.
+static void* readConcurrent(void* _args)
+{
+    ConcurrentArgs* args = (ConcurrentArgs*)_args;
+
+    uint32_t failures = 0;
+    while (0 != atomicLoadAcquire(&args->m_writersLeft))
+    {
+        for (uint32_t key = 0; key < NumStableKeys; ++key)
+        {
+            failures += (args->m_map->find(key) != key*7);
+        }
+    }
+
+    atomicFetchAndAdd(&args->m_failures, failures);
+    return NULL;
+}
+
+static void testHashMapConcurrent()
+{
+    {
+        HashMapConcurrent<sizeof(uint32_t), uint32_t> map;
+        map.init();
+        checkAgainstRef(map, 0x9e3779b9, 100);
+        checkAgainstRef(map, 0x2545f491, 50000);
+    }
+
+    {
+        HashMapConcurrent<12, uint32_t> map;
+        map.init();
+        checkAgainstRef(map, 0x6c078965, 3000);
+    }
+
+    // Readers running through resizes, replaced tables are freed as soon as no reader can be in them.
+    enum { NumWriters = 2, NumReaders = 2, Tag = 3 };
+    TaggedAllocator tagged(Tag, mainAlloc);
+
+    ConcurrentArgs::MapTy map;
+    map.init(ConcurrentArgs::MapTy::MinMax, &tagged);
+    for (uint32_t key = 0; key < NumStableKeys; ++key)
+    {
+        map.insert(key, key*7);
+    }
+
+    // Only the current table is held, the same bytes per slot before and after all the resizes.
+    const uint64_t bytesPerSlot = allocTagBytes(Tag)/map.max();
+
+    ConcurrentArgs args;
+    args.m_map = &map;
+    args.m_nextWriter = 0;
+    args.m_writersLeft = NumWriters;
+    args.m_failures = 0;
+
+    pthread_t writers[NumWriters];
+    pthread_t readers[NumReaders];
+    for (uint32_t ii = 0; ii < NumWriters; ++ii)
+    {
+        pthread_create(&writers[ii], NULL, churnConcurrent, &args);
+    }
+    for (uint32_t ii = 0; ii < NumReaders; ++ii)
+    {
+        pthread_create(&readers[ii], NULL, readConcurrent, &args);
+    }
+    for (uint32_t ii = 0; ii < NumWriters; ++ii)
+    {
+        pthread_join(writers[ii], NULL);
+    }
+    for (uint32_t ii = 0; ii < NumReaders; ++ii)
+    {
+        pthread_join(readers[ii], NULL);
+    }
+
+    TEST_CHECK(0 == args.m_failures);
+    TEST_CHECK(NumStableKeys == map.count());
+    TEST_CHECK(allocTagBytes(Tag)/map.max() == bytesPerSlot);
+
+    map.destroy();
+    TEST_CHECK(0 == allocTagBytes(Tag));
+}
+
+/// Keys inserted by insertBatch() are found by findBatch(), with their values, keys never inserted are not.
+template <typename HashMapTy>
+static void checkBatch(HashMapTy& _map, uint32_t _seed)
+{
+    enum { NumKeys = 3000, NumMissing = 1000 };
+
+    static uint32_t keys[NumKeys+NumMissing];
+    static uint32_t vals[NumKeys];
+    static uint32_t handles[NumKeys+NumMissing];
+
+    RefMap ref;
+    Rng rng(_seed);
+    for (uint32_t ii = 0; ii < NumKeys+NumMissing; )
+    {
+        const uint32_t key = rng.next();
+        if (ref.insert(RefMap::value_type(key, rng.next()>>1)).second)
+        {
+            keys[ii] = key;
+            if (ii < NumKeys)
+            {
+                vals[ii] = ref[key];
+            }
+            ++ii;
+        }
+    }
+
+    TEST_CHECK(NumKeys == _map.insertBatch(keys, vals, NumKeys));
+    TEST_CHECK(NumKeys == _map.count());
+
+    _map.findBatch(keys, NumKeys+NumMissing, handles);
+
+    uint32_t mismatches = 0;
+    for (uint32_t ii = 0; ii < NumKeys; ++ii)
+    {
+        mismatches += (HashMapTy::InvalidHandle == handles[ii] || _map.getValueOf(handles[ii]) != vals[ii]);
+    }
+    for (uint32_t ii = NumKeys; ii < NumKeys+NumMissing; ++ii)
+    {
+        mismatches += (HashMapTy::InvalidHandle != handles[ii]);
+    }
+    TEST_CHECK(0 == mismatches);
+}
+
+static void testHashMapBatch()
+{
+    {
+        HashMap<sizeof(uint32_t), uint32_t> map;
+        map.init(4096);
+        checkBatch(map, 0x9e3779b9);
+    }
+
+    {
+        HashMap<12, uint32_t> map;
+        map.init(4096);
+        checkBatch(map, 0x2545f491);
+    }
+
+    {
+        HashMap<sizeof(uint32_t), uint32_t, AllocatorIPolicy, ClusteredHashPolicy> map;
+        map.init(4096);
+        checkBatch(map, 0x6c078965);
+    }
+}
+
+/// Gives HashMapString the interface checkAgainstRef() expects, each number maps to a string of 1 to 70 characters.
+template <typename HashMapStringTy>
+struct StringKeyMap
+{
+    static uint32_t toString(uint32_t _key, char* _str)
+    {
+        uint32_t len = 0;
+        for (uint32_t ii = 0, end = 1 + _key%7; ii < end; ++ii)
+        {
+            len += sprintf(&_str[len], "%u.", _key);
+        }
+        return len - (0 == _key%3); // Some without the trailing dot.
+    }
+
+    bool insert(uint32_t _key, uint32_t _val)
+    {
+        char str[128];
+        return m_map.insert(str, toString(_key, str), _val);
+    }
+
+    uint32_t find(uint32_t _key)
+    {
+        char str[128];
+        return m_map.find(str, toString(_key, str));
+    }
+
+    bool remove(uint32_t _key)
+    {
+        char str[128];
+        return m_map.remove(str, toString(_key, str));
+    }
+
+    uint32_t count() const
+    {
+        return m_map.count();
+    }
+
+    HashMapStringTy m_map;
+};
+
+static void testHashMapString()
+{
+    StringKeyMap< HashMapString<uint32_t> > map;
+    map.m_map.init();
+    checkAgainstRef(map, 0x9e3779b9, 100);
+
+    // Keys of removed entries do not pile up in the arena.
+    TEST_CHECK(map.m_map.keyBytes() <= 2*100*128);
+
+    checkAgainstRef(map, 0x2545f491, 50000);
+
+    StringKeyMap< HashMapString<uint32_t, AllocatorIPolicy, ClusteredHashPolicy> > clustered;
+    clustered.m_map.init();
+    checkAgainstRef(clustered, 0x6c078965, 500);
+}
+
+/// Builds a frozen table from '_ref' and looks up every key of '_keyRange' in it, through init() and through a saved file.
+template <uint8_t KeyLen>
+static void checkFrozen(const RefMap& _ref, uint32_t _keyRange)
+{
+    HashMapFrozenBuilder<KeyLen, uint32_t> builder;
+    builder.init(16);
+    for (RefMap::const_iterator it = _ref.begin(), end = _ref.end(); it != end; ++it)
+    {
+        builder.add(it->first, it->second);
+    }
+    TEST_CHECK(builder.build());
+
+    HashMapFrozen<KeyLen, uint32_t> map;
+    TEST_CHECK(map.init(builder.data(), builder.size()));
+    TEST_CHECK(map.validate());
+    TEST_CHECK(compareAll(map, _ref, _keyRange) == 0);
+
+    const char* path = "/tmp/dmtests_frozen.bin";
+    TEST_CHECK(builder.save(path));
+
+    HashMapFrozen<KeyLen, uint32_t> mapped;
+    TEST_CHECK(mapped.open(path));
+    TEST_CHECK(mapped.validate());
+    TEST_CHECK(compareAll(mapped, _ref, _keyRange) == 0);
+    mapped.close();
+    remove(path);
+}
+
+/// Copy of a built table with one field changed, has to be refused by init() or validate().
+struct FrozenCorruption
+{
+    FrozenCorruption(const void* _data, uint64_t _size)
+    {
+        m_size = _size;
+        m_mem = (uint64_t*)malloc(size_t(_size));
+        memcpy(m_mem, _data, size_t(_size));
+    }
+
+    ~FrozenCorruption()
+    {
+        free(m_mem);
+    }
+
+    HashMapFrozenHeader& header()
+    {
+        return *(HashMapFrozenHeader*)m_mem;
+    }
+
+    bool accepted()
+    {
+        HashMapFrozen<sizeof(uint32_t), uint32_t> map;
+        return map.init(m_mem, m_size);
+    }
+
+    bool validated()
+    {
+        HashMapFrozen<sizeof(uint32_t), uint32_t> map;
+        return map.init(m_mem, m_size) && map.validate();
+    }
+
+    uint64_t* m_mem;
+    uint64_t m_size;
+};
+
+static void testHashMapFrozen()
+{
+    // Random key sets of a few sizes, every other key of the range missing on average.
+    const uint32_t counts[] = { 0, 1, 7, 1000, 50000 };
+    for (uint32_t ii = 0; ii < DM_COUNTOF(counts); ++ii)
+    {
+        RefMap ref;
+        Rng rng(0x9e3779b9 + ii);
+        const uint32_t keyRange = counts[ii]*2 + 1;
+        while (ref.size() < counts[ii])
+        {
+            ref[rng.next()%keyRange] = rng.next()>>1;
+        }
+
+        checkFrozen<sizeof(uint32_t)>(ref, keyRange);
+        checkFrozen<12>(ref, keyRange);
+    }
+
+    // Repeated keys.
+    {
+        HashMapFrozenBuilder<sizeof(uint32_t), uint32_t> builder;
+        builder.init();
+        builder.add(uint32_t(1), 10);
+        builder.add(uint32_t(2), 20);
+        builder.add(uint32_t(1), 30);
+        TEST_CHECK(!builder.build());
+    }
+
+    // Truncated and corrupted tables.
+    HashMapFrozenBuilder<sizeof(uint32_t), uint32_t> builder;
+    builder.init();
+    for (uint32_t key = 0; key < 1000; ++key)
+    {
+        builder.add(key, key*3);
+    }
+    TEST_CHECK(builder.build());
+
+    const uint64_t size = builder.size();
+    const HashMapFrozenHeader& built = *(const HashMapFrozenHeader*)builder.data();
+    {
+        FrozenCorruption table(builder.data(), size);
+        TEST_CHECK(table.accepted());
+        TEST_CHECK(table.validated());
+    }
+    {
+        FrozenCorruption table(builder.data(), size);
+        table.m_size = size-1;
+        TEST_CHECK(!table.accepted());
+    }
+    {
+        // Size in the header agrees with the truncated length, the entries do not fit anymore.
+        FrozenCorruption table(builder.data(), size);
+        table.header().m_size = built.m_entriesOffset + 8;
+        table.m_size = table.header().m_size;
+        TEST_CHECK(!table.accepted());
+    }
+    {
+        FrozenCorruption table(builder.data(), size);
+        table.header().m_pilotsOffset = UINT64_MAX & ~UINT64_C(63);
+        TEST_CHECK(!table.accepted());
+    }
+    {
+        FrozenCorruption table(builder.data(), size);
+        table.header().m_wordsOffset = size;
+        TEST_CHECK(!table.accepted());
+    }
+    {
+        FrozenCorruption table(builder.data(), size);
+        table.header().m_ranksOffset = 0;
+        TEST_CHECK(!table.accepted());
+    }
+    {
+        FrozenCorruption table(builder.data(), size);
+        table.header().m_entriesOffset = size - 64;
+        TEST_CHECK(!table.accepted());
+    }
+    {
+        FrozenCorruption table(builder.data(), size);
+        table.header().m_numBuckets = UINT32_MAX;
+        TEST_CHECK(!table.accepted());
+    }
+    {
+        FrozenCorruption table(builder.data(), size);
+        table.header().m_numPositions = built.m_numWords*64 + 1;
+        TEST_CHECK(!table.accepted());
+    }
+    {
+        FrozenCorruption table(builder.data(), size);
+        table.header().m_numWords = 0;
+        TEST_CHECK(!table.accepted());
+    }
+    {
+        FrozenCorruption table(builder.data(), size);
+        table.header().m_count = built.m_count+1;
+        TEST_CHECK(!table.validated());
+    }
+    {
+        // Rank pointing past the entries.
+        FrozenCorruption table(builder.data(), size);
+        uint32_t* ranks = (uint32_t*)((uint8_t*)table.m_mem + built.m_ranksOffset);
+        ranks[built.m_numWords-1] += 64;
+        TEST_CHECK(table.accepted());
+        TEST_CHECK(!table.validated());
+    }
+}
+
+void testHashMapsAgainstStd()
+{
+    testHash();
+    testHashMapGrowable();
+    testHashMapSwiss();
+    testHashMapRobinHood();
+    testHashMapPolicies();
+    testHashMapBatch();
+    testHashMapConcurrent();
+    testHashMapString();
+    testHashMapFrozen();
+}
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,30 @@
+/*
+ * Copyright 2016 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "test.h"
+
+#include <dm/allocator/allocator.h>
+
+uint32_t g_testFailures = 0;
+
+int main()
+{
+    dm::allocInit();
+
+    testApi();
+    testAllocator();
+    testHashMapsAgainstStd();
+
+    if (0 != g_testFailures)
+    {
+        fprintf(stderr, "%d test check(s) failed.\n", g_testFailures);
+        return 1;
+    }
+
+    printf("All tests passed.\n");
+    return 0;
+}
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2016 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef DM_TESTS_TEST_H_HEADER_GUARD
+#define DM_TESTS_TEST_H_HEADER_GUARD
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Smaller arena than the default, so that tests can fill it and all of its chunks quickly.
+#define DM_MEM_MIN_SIZE     DM_MEGABYTES(256)
+#define DM_MEM_DEFAULT_SIZE DM_MEGABYTES(256)
+#define DM_MEM_CHUNK_SIZE   DM_MEGABYTES(64)
+#define DM_MEM_MAX_CHUNKS   16
+
+extern uint32_t g_testFailures;
+
+/// Reports the failed condition and keeps going, main() returns non-zero if anything failed.
+#define TEST_CHECK(_cond)                                                  \
+    do                                                                     \
+    {                                                                      \
+        if (!(_cond))                                                      \
+        {                                                                  \
+            fprintf(stderr, "%s(%d): TEST_CHECK(%s) failed.\n", __FILE__, __LINE__, #_cond); \
+            g_testFailures++;                                              \
+        }                                                                  \
+    } while (0)
+
+void testApi();
+void testAllocator();
+void testHashMapsAgainstStd();
+
+#endif // DM_TESTS_TEST_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
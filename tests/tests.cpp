@@ -1,37 +1,29 @@
-#if 0
-    g++ -I../include/ tests.cpp -o tests && ./tests && rm tests
-    #g++ -g -I../include/ tests.cpp -o tests && gdb --eval-command="run" tests && rm tests
-    exit
-#endif
-
 /*
  * Copyright 2016 Dario Manesku. All rights reserved.
  * License: http://www.opensource.org/licenses/BSD-2-Clause
  */
 
-#include <stdio.h>
-
-#define DM_DEFINE_TYPES
-#include <dm/ng/types.h>
+#include "test.h"
 
-#include <dm/ng/allocator.h>
-#include <dm/ng/datastructures/array.h>
-#include <dm/ng/datastructures/linkedlist.h>
-#include <dm/ng/datastructures/handlealloc.h>
-#include <dm/ng/datastructures/idxalloc.h>
-#include <dm/ng/datastructures/denseset.h>
-#include <dm/ng/datastructures/sparsearray.h>
-#include <dm/ng/datastructures/bitarray.h>
-#include <dm/ng/datastructures/hashmap.h>
-#include <dm/ng/datastructures/objhashmap.h>
-#include <dm/ng/datastructures/common.h>
+#include <dm/allocatori.h>
+#include <dm/allocator/allocator.h>
+#include <dm/datastructures/array.h>
+#include <dm/datastructures/linkedlist.h>
+#include <dm/datastructures/handlealloc.h>
+#include <dm/datastructures/idxalloc.h>
+#include <dm/datastructures/denseset.h>
+#include <dm/datastructures/sparsearray.h>
+#include <dm/datastructures/bitarray.h>
+#include <dm/datastructures/hashmap.h>
+#include <dm/datastructures/objhashmap.h>
+#include <dm/datastructures/common.h>
 
-using namespace dm::ng;
+using namespace dm;
 
 struct Foo
 {
-    u32 m_a;
-    u32 m_b;
+    uint32_t m_a;
+    uint32_t m_b;
 };
 
 template <typename ArrayTy>
@@ -40,7 +32,7 @@ void testArrayApi(ArrayTy& _array)
     _array.zero();
     _array.fillWith(1);
 
-    u32* nums = _array.addNew(5);
+    uint32_t* nums = _array.addNew(5);
     nums[0] = 12;
     nums[1] = 44;
     nums[2] = 66;
@@ -53,7 +45,7 @@ void testArrayApi(ArrayTy& _array)
     _array.remove(0);
     _array.removeSwap(1);
 
-    u32 g0 = _array.get(0);
+    uint32_t g0 = _array.get(0);
     _array[1]++;
 
     printf("Array out %d %d\n", g0, _array.count());
@@ -62,30 +54,47 @@ void testArrayApi(ArrayTy& _array)
 void testArrays()
 {
     // Array with fixed size inline memory.
-    typedef ArrayT<u32, 64> TestArrayT;
+    typedef ArrayT<uint32_t, 64> TestArrayT;
     TestArrayT array0;
     testArrayApi(array0);
 
     // Array with external memory.
-    typedef ArrayExt<u32> TestArrayExt;
+    typedef ArrayExt<uint32_t> TestArrayExt;
     TestArrayExt array1;
-    u32 size = TestArrayExt::sizeFor(64);
-    void* mem = dm_alloc(size, &::realloc);
+    uint32_t size = TestArrayExt::sizeFor(64);
+    void* mem = DM_ALLOC(&g_crtAllocator, size);
     array1.init(64, (uint8_t*)mem);
     testArrayApi(array1);
 
     // Array with allocator.
-    typedef Array<u32> TestArray;
+    typedef Array<uint32_t> TestArray;
     TestArray array2;
-    array2.init(64, &::realloc);
+    array2.init(64);
     testArrayApi(array2);
 
+    // Array with allocator bound at compile time, no allocator pointer is stored.
+    typedef Array<uint32_t, CrtAllocPolicy> TestArrayCrt;
+    TestArrayCrt array4;
+    array4.init(64);
+    testArrayApi(array4);
+
+    typedef Array<uint32_t, MainAllocPolicy> TestArrayMain;
+    TestArrayMain array5;
+    array5.init(64);
+    testArrayApi(array5);
+    TEST_CHECK(allocContains(array5.elements()));
+
+    TEST_CHECK(sizeof(TestArrayCrt)  + sizeof(AllocatorI*) == sizeof(TestArray));
+    TEST_CHECK(sizeof(TestArrayMain) + sizeof(AllocatorI*) == sizeof(TestArray));
+
     // Array as ptr.
-    typedef ArrayH<u32> TestArrayH;
+    typedef ArrayH<uint32_t> TestArrayH;
     TestArrayH* array3;
-    array3 = create<TestArrayH>(64, &::realloc);
+    array3 = create<TestArrayH>(64);
     testArrayApi(*array3);
     destroy(array3);
+
+    DM_FREE(&g_crtAllocator, mem);
 }
 
 template <typename FooObjArrayTy>
@@ -124,23 +133,25 @@ void testObjArrays()
     // ObjArray with external memory.
     typedef ObjArrayExt<Foo> TestObjArrayExt;
     TestObjArrayExt oa1;
-    u32 size = TestObjArrayExt::sizeFor(64);
-    void* mem = dm_alloc(size, &::realloc);
+    uint32_t size = TestObjArrayExt::sizeFor(64);
+    void* mem = DM_ALLOC(&g_crtAllocator, size);
     oa1.init(64, (uint8_t*)mem);
     testObjArrayApi(oa1);
 
     // ObjArray with allocator.
     typedef ObjArray<Foo> TestObjArray;
     TestObjArray oa2;
-    oa2.init(64, &::realloc);
+    oa2.init(64);
     testObjArrayApi(oa2);
 
     // ObjArray as ptr.
     typedef ObjArrayH<Foo> TestObjArrayH;
     TestObjArrayH* oa3;
-    oa3 = create<TestObjArrayH>(64, &::realloc);
+    oa3 = create<TestObjArrayH>(64);
     testObjArrayApi(*oa3);
     destroy(oa3);
+
+    DM_FREE(&g_crtAllocator, mem);
 }
 
 template <typename HandleAllocTy>
@@ -150,13 +161,13 @@ void testHandleAlloc(HandleAllocTy& _ha)
     _ha.alloc();
     _ha.alloc();
     _ha.alloc();
-    u32 h0 = _ha.alloc();
+    uint32_t h0 = _ha.alloc();
     bool contains = _ha.contains(h0);
     _ha.free(h0);
 
-    u32 h1 = _ha.getHandleAt(1);
-    u32 h2 = _ha.getIdxOf(h1);
-    u32 count = _ha.count();
+    uint32_t h1 = _ha.getHandleAt(1);
+    uint32_t h2 = _ha.getIdxOf(h1);
+    uint32_t count = _ha.count();
 
     printf("HandleAlloc out %d %d %d %d %d\n", contains, h0, h1, h2, count);
 }
@@ -169,25 +180,27 @@ void testHandleAllocs()
     testHandleAlloc(ha0);
 
     // HandleAlloc with external memory.
-    typedef HandleAllocExt<u16> TestHandleAllocExt;
+    typedef HandleAllocExt<uint16_t> TestHandleAllocExt;
     TestHandleAllocExt ha1;
-    u32 size = TestHandleAllocExt::sizeFor(64);
-    void* mem = dm_alloc(size, &::realloc);
+    uint32_t size = TestHandleAllocExt::sizeFor(64);
+    void* mem = DM_ALLOC(&g_crtAllocator, size);
     ha1.init(64, (uint8_t*)mem);
     testHandleAlloc(ha1);
 
     // HandleAlloc with allocator.
-    typedef HandleAlloc<u16> TestHandleAlloc;
+    typedef HandleAlloc<uint16_t> TestHandleAlloc;
     TestHandleAlloc ha2;
-    ha2.init(64, &::realloc);
+    ha2.init(64);
     testHandleAlloc(ha2);
 
     // HandleAlloc as ptr.
-    typedef HandleAllocH<u16> TestHandleAllocH;
+    typedef HandleAllocH<uint16_t> TestHandleAllocH;
     TestHandleAllocH* ha3;
-    ha3 = create<TestHandleAllocH>(64, &::realloc);
+    ha3 = create<TestHandleAllocH>(64);
     testHandleAlloc(*ha3);
     destroy(ha3);
+
+    DM_FREE(&g_crtAllocator, mem);
 }
 
 template <typename IdxAllocTy>
@@ -200,7 +213,7 @@ void testIdxAlloc(IdxAllocTy& _ia)
     _ia.removeAt(1);
     _ia.alloc();
     _ia.alloc();
-    u32 count = _ia.count();
+    TEST_CHECK(3 == _ia.count());
 
     printf("IdxAlloc out %d %d %d |"
           , _ia[0]
@@ -225,25 +238,27 @@ void testIdxAllocs()
     testIdxAlloc(ha0);
 
     // IdxAlloc with external memory.
-    typedef IdxAllocExt<u16> TestIdxAllocExt;
+    typedef IdxAllocExt<uint16_t> TestIdxAllocExt;
     TestIdxAllocExt ha1;
-    u32 size = TestIdxAllocExt::sizeFor(64);
-    void* mem = dm_alloc(size, &::realloc);
+    uint32_t size = TestIdxAllocExt::sizeFor(64);
+    void* mem = DM_ALLOC(&g_crtAllocator, size);
     ha1.init(64, (uint8_t*)mem);
     testIdxAlloc(ha1);
 
     // IdxAlloc with allocator.
-    typedef IdxAlloc<u16> TestIdxAlloc;
+    typedef IdxAlloc<uint16_t> TestIdxAlloc;
     TestIdxAlloc ha2;
-    ha2.init(64, &::realloc);
+    ha2.init(64);
     testIdxAlloc(ha2);
 
     // IdxAlloc as ptr.
-    typedef IdxAllocH<u16> TestIdxAllocH;
+    typedef IdxAllocH<uint16_t> TestIdxAllocH;
     TestIdxAllocH* ha3;
-    ha3 = create<TestIdxAllocH>(64, &::realloc);
+    ha3 = create<TestIdxAllocH>(64);
     testIdxAlloc(*ha3);
     destroy(ha3);
+
+    DM_FREE(&g_crtAllocator, mem);
 }
 
 template <typename BitArrayTy>
@@ -265,14 +280,14 @@ void testBitArrayApi(BitArrayTy& _ba)
     _ba.toggle(63);
     _ba.toggle(0);
 
-    u32 first = _ba.setFirst();
-    u32 any   = _ba.setAny();
+    uint32_t first = _ba.setFirst();
+    uint32_t any   = _ba.setAny();
 
-    u32 firstSet   = _ba.getFirstSetBit();
-    u32 firstUnset = _ba.getFirstSetBit();
+    uint32_t firstSet   = _ba.getFirstSetBit();
+    uint32_t firstUnset = _ba.getFirstSetBit();
 
-    u32 lastSet   = _ba.getLastSetBit();
-    u32 lastUnset = _ba.getLastUnsetBit();
+    uint32_t lastSet   = _ba.getLastSetBit();
+    uint32_t lastUnset = _ba.getLastUnsetBit();
 
     bool b0 = _ba.isSet(0);
     bool b1 = _ba.isSet(1);
@@ -280,7 +295,7 @@ void testBitArrayApi(BitArrayTy& _ba)
     bool b3 = _ba.isSet(23);
     bool b4 = _ba.isSet(63);
 
-    u32 count = _ba.doCount();
+    uint32_t count = _ba.doCount();
 
     printf("Bit Array out %d %d | %d %d %d %d %d | %d %d %d %d | %d\n"
           , first, any
@@ -303,23 +318,40 @@ void testBitArrays()
     // BitArray with external memory.
     typedef BitArrayExt TestBitArrayExt;
     TestBitArrayExt ba1;
-    u32 size = TestBitArrayExt::sizeFor(64);
-    void* mem = dm_alloc(size, &::realloc);
+    uint32_t size = TestBitArrayExt::sizeFor(64);
+    void* mem = DM_ALLOC(&g_crtAllocator, size);
     ba1.init(64, (uint8_t*)mem);
     testBitArrayApi(ba1);
 
     // BitArray with allocator.
     typedef BitArray TestBitArray;
     TestBitArray ba2;
-    ba2.init(64, &::realloc);
+    ba2.init(64);
     testBitArrayApi(ba2);
 
+    // BitArray with allocator bound at compile time.
+    typedef BitArrayA<CrtAllocPolicy> TestBitArrayCrt;
+    TestBitArrayCrt ba4;
+    ba4.init(64);
+    testBitArrayApi(ba4);
+
+    typedef BitArrayA<MainAllocPolicy> TestBitArrayMain;
+    TestBitArrayMain ba5;
+    ba5.init(64);
+    testBitArrayApi(ba5);
+    TEST_CHECK(allocContains(ba5.bits()));
+
+    TEST_CHECK(sizeof(TestBitArrayCrt)  + sizeof(AllocatorI*) == sizeof(TestBitArray));
+    TEST_CHECK(sizeof(TestBitArrayMain) + sizeof(AllocatorI*) == sizeof(TestBitArray));
+
     // BitArray as ptr.
     typedef BitArrayH TestBitArrayH;
     TestBitArrayH* ba3;
-    ba3 = create<TestBitArrayH>(64, &::realloc);
+    ba3 = create<TestBitArrayH>(64);
     testBitArrayApi(*ba3);
     destroy(ba3);
+
+    DM_FREE(&g_crtAllocator, mem);
 }
 
 template <typename DenseSetTy>
@@ -334,7 +366,7 @@ void testDenseSetApi(DenseSetTy& _set)
     _set.remove(55);
 
     _set.safeInsert(234);
-    _set.safeInsert(20394);
+    _set.safeInsert(200);
     _set.safeInsert(11);
 
     bool s0 = _set.contains(12);
@@ -343,9 +375,9 @@ void testDenseSetApi(DenseSetTy& _set)
     bool s3 = _set.contains(1);
     bool s4 = _set.contains(22);
 
-    u32 count = _set.count();
-    u32 idx = _set.indexOf(22);
-    u32 val = _set.getValueAt(2);
+    uint32_t count = _set.count();
+    uint32_t idx = _set.indexOf(22);
+    uint32_t val = _set.getValueAt(2);
 
     printf("DenseSet output %d %d %d %d %d | %d %d %d\n"
           , s0, s1, s2, s3, s4
@@ -363,25 +395,27 @@ void testDenseSets()
     testDenseSetApi(set0);
 
     // DenseSet with external memory.
-    typedef DenseSetExt TestDenseSetExt;
+    typedef DenseSetExt<uint16_t> TestDenseSetExt;
     TestDenseSetExt set1;
-    u32 size = TestDenseSetExt::sizeFor(64);
-    void* mem = dm_alloc(size, &::realloc);
+    uint32_t size = TestDenseSetExt::sizeFor(64);
+    void* mem = DM_ALLOC(&g_crtAllocator, size);
     set1.init(64, (uint8_t*)mem);
     testDenseSetApi(set1);
 
     // DenseSet with allocator.
-    typedef DenseSet TestDenseSet;
+    typedef DenseSet<uint16_t> TestDenseSet;
     TestDenseSet set2;
-    set2.init(64, &::realloc);
+    set2.init(64);
     testDenseSetApi(set2);
 
     // DenseSet as ptr.
-    typedef DenseSetH TestDenseSetH;
+    typedef DenseSetH<uint16_t> TestDenseSetH;
     TestDenseSetH* set3;
-    set3 = create<TestDenseSetH>(64, &::realloc);
+    set3 = create<TestDenseSetH>(64);
     testDenseSetApi(*set3);
     destroy(set3);
+
+    DM_FREE(&g_crtAllocator, mem);
 }
 
 template <typename SparseArrayTy>
@@ -397,15 +431,15 @@ void testSparseArrayApi(SparseArrayTy& _sa)
     foo->m_b = 444;
 
     Foo ff = { 23, 55 };
-    _sa.addCopy(&ff);
+    _sa.addObj(&ff);
 
     const bool b0 = _sa.contains(foo);
-    u32c idx = _sa.getHandleOf(foo);
+    uint32_t const idx = _sa.getHandleOf(foo);
 
     printf("SparseArray");
     for (uint32_t hh = 0, end = _sa.count(); hh < end; ++hh)
     {
-        Foo* foo = _sa.getFromHandleAt(hh);
+        Foo* foo = _sa.getObjFromHandleAt(hh);
         printf(" %u/%u", foo->m_a, foo->m_b);
     }
     printf(" |");
@@ -413,14 +447,14 @@ void testSparseArrayApi(SparseArrayTy& _sa)
     _sa.removeFromHandleAt(0);
     for (uint32_t hh = 0, end = _sa.count(); hh < end; ++hh)
     {
-        Foo* foo = _sa.getFromHandleAt(hh);
+        Foo* foo = _sa.getObjFromHandleAt(hh);
         printf(" %u/%u", foo->m_a, foo->m_b);
     }
 
     printf(" | at");
     for (uint32_t ii = 0, end = 3; ii < end; ++ii)
     {
-        Foo* foo = _sa.get(ii);
+        Foo* foo = _sa.getObj(ii);
         printf(" %u/%u", foo->m_a, foo->m_b);
     }
 
@@ -428,11 +462,11 @@ void testSparseArrayApi(SparseArrayTy& _sa)
     printf(" | comp");
     for (uint32_t ii = 0, end = 3; ii < end; ++ii)
     {
-        Foo* foo = _sa.getFromHandleAt(ii);
+        Foo* foo = _sa.getObjFromHandleAt(ii);
         printf(" %u/%u", foo->m_a, foo->m_b);
     }
 
-    u32 cnt = _sa.count();
+    uint32_t cnt = _sa.count();
     printf(" # %d %d %d\n", b0, idx, cnt);
 }
 
@@ -446,23 +480,25 @@ void testSparseArrays()
     // SparseArray with external memory.
     typedef SparseArrayExt<Foo> TestSparseArrayExt;
     TestSparseArrayExt list1;
-    u32 size = TestSparseArrayExt::sizeFor(64);
-    void* mem = dm_alloc(size, &::realloc);
+    uint32_t size = TestSparseArrayExt::sizeFor(64);
+    void* mem = DM_ALLOC(&g_crtAllocator, size);
     list1.init(64, (uint8_t*)mem);
     testSparseArrayApi(list1);
 
     // SparseArray with allocator.
     typedef SparseArray<Foo> TestSparseArray;
     TestSparseArray list2;
-    list2.init(64, &::realloc);
+    list2.init(64);
     testSparseArrayApi(list2);
 
     // SparseArray as ptr.
     typedef SparseArrayH<Foo> TestSparseArrayH;
     TestSparseArrayH* list3;
-    list3 = create<TestSparseArrayH>(64, &::realloc);
+    list3 = create<TestSparseArrayH>(64);
     testSparseArrayApi(*list3);
     destroy(list3);
+
+    DM_FREE(&g_crtAllocator, mem);
 }
 
 template <typename LinkedListTy>
@@ -471,7 +507,7 @@ void testLinkedListApi(LinkedListTy& _ll)
     Foo foo = { 22, 33 };
 
     Foo* f0 = _ll.addNew();
-    u16 handle = _ll.getHandle(f0);
+    uint16_t handle = _ll.getHandle(f0);
 
     Foo* f1 = _ll.insertAfter(handle);
     f1->m_a = 55;
@@ -484,20 +520,20 @@ void testLinkedListApi(LinkedListTy& _ll)
     Foo* f3 = _ll.next(f1);
     Foo* f4 = _ll.prev(f1);
 
-    u16 f5 = _ll.next(handle);
-    u16 f6 = _ll.prev(handle);
+    uint16_t f5 = _ll.next(handle);
+    uint16_t f6 = _ll.prev(handle);
 
     Foo* f7 = _ll.lastElem();
     Foo* f8 = _ll.firstElem();
 
-    u16 h0 = _ll.firstHandle();
-    u16 h1 = _ll.lastHandle();
+    uint16_t h0 = _ll.firstHandle();
+    uint16_t h1 = _ll.lastHandle();
 
     Foo* f9  = _ll.getObj(h0);
     Foo* f10 = _ll.getObjAt(0);
 
     _ll[0]->m_a = 63;
-    u32 val = _ll[0]->m_a;
+    uint32_t val = _ll[0]->m_a;
 
     (void)f0; (void)f1; (void)f2; (void)f3; (void)f4;
     (void)f5; (void)f6; (void)f7; (void)f8; (void)f9;
@@ -507,7 +543,7 @@ void testLinkedListApi(LinkedListTy& _ll)
 
     bool b0 = _ll.contains(handle);
     bool b1 = _ll.contains(f0);
-    u32 count = _ll.count();
+    uint32_t count = _ll.count();
 
     printf("Linked List out %d %d %d %d %d\n", f1->m_a, val, count, b0, b1);
 }
@@ -522,23 +558,25 @@ void testLinkedLists()
     // LinkedList with external memory.
     typedef LinkedListExt<Foo> TestLinkedListExt;
     TestLinkedListExt list1;
-    u32 size = TestLinkedListExt::sizeFor(64);
-    void* mem = dm_alloc(size, &::realloc);
+    uint32_t size = TestLinkedListExt::sizeFor(64);
+    void* mem = DM_ALLOC(&g_crtAllocator, size);
     list1.init(64, (uint8_t*)mem);
     testLinkedListApi(list1);
 
     // LinkedList with allocator.
     typedef LinkedList<Foo> TestLinkedList;
     TestLinkedList list2;
-    list2.init(64, &::realloc);
+    list2.init(64);
     testLinkedListApi(list2);
 
     // LinkedList as ptr.
     typedef LinkedListH<Foo> TestLinkedListH;
     TestLinkedListH* list3;
-    list3 = create<TestLinkedListH>(64, &::realloc);
+    list3 = create<TestLinkedListH>(64);
     testLinkedListApi(*list3);
     destroy(list3);
+
+    DM_FREE(&g_crtAllocator, mem);
 }
 
 template <typename HashMapTy>
@@ -549,11 +587,11 @@ void testHashMapApi(HashMapTy& _hm)
     _hm.insertHandleDup(1.7f, 333);
     _hm.insertHandleDup("qwer", 444);
 
-    u32 handle = _hm.findHandleOf(1.5f);
-    u32 val0 = _hm.getValueOf(handle);
+    uint32_t handle = _hm.findHandleOf(1.5f);
+    uint32_t val0 = _hm.getValueOf(handle);
 
-    u32 val1 = _hm.find(1.5f);
-    u32 val2 = _hm.find("asdf");
+    uint32_t val1 = _hm.find(1.5f);
+    uint32_t val2 = _hm.find("asdf");
     bool rem = _hm.remove(1.5f);
 
     printf("Hash Map out: %d %d %d %d %d\n", handle, val0, val1, val2, rem);
@@ -569,23 +607,40 @@ void testHashMaps()
     // HashMap with external memory.
     typedef HashMapExt<sizeof(float), uint32_t> TestHashMapExt;
     TestHashMapExt hm1;
-    u32 size = TestHashMapExt::sizeFor(256);
-    void* mem = dm_alloc(size, &::realloc);
+    uint32_t size = TestHashMapExt::sizeFor(256);
+    void* mem = DM_ALLOC(&g_crtAllocator, size);
     hm1.init(256, (uint8_t*)mem);
     testHashMapApi(hm1);
 
     // HashMap with allocator.
     typedef HashMap<sizeof(float), uint32_t> TestHashMap;
     TestHashMap hm2;
-    hm2.init(256, &::realloc);
+    hm2.init(256);
     testHashMapApi(hm2);
 
+    // HashMap with allocator bound at compile time.
+    typedef HashMap<sizeof(float), uint32_t, CrtAllocPolicy> TestHashMapCrt;
+    TestHashMapCrt hm4;
+    hm4.init(256);
+    testHashMapApi(hm4);
+
+    typedef HashMap<sizeof(float), uint32_t, MainAllocPolicy> TestHashMapMain;
+    TestHashMapMain hm5;
+    hm5.init(256);
+    testHashMapApi(hm5);
+    TEST_CHECK(allocContains(hm5.usedBits()));
+
+    TEST_CHECK(sizeof(TestHashMapCrt)  + sizeof(AllocatorI*) == sizeof(TestHashMap));
+    TEST_CHECK(sizeof(TestHashMapMain) + sizeof(AllocatorI*) == sizeof(TestHashMap));
+
     // HashMap as ptr.
     typedef HashMapH<sizeof(float), uint32_t> TestHashMapH;
     TestHashMapH* hm3;
-    hm3 = create<TestHashMapH>(256, &::realloc);
+    hm3 = create<TestHashMapH>(256);
     testHashMapApi(*hm3);
     destroy(hm3);
+
+    DM_FREE(&g_crtAllocator, mem);
 }
 
 template <typename FooHashMapTy>
@@ -599,8 +654,8 @@ void testObjHashMapApi(FooHashMapTy& _ohm)
 
     Foo* f4 = _ohm.find(1.5f);
     Foo* f5 = _ohm.find("asdf");
-    u32 val0 = f4->m_a;
-    u32 val1 = f5->m_a;
+    uint32_t val0 = f4->m_a;
+    uint32_t val1 = f5->m_a;
 
     bool rem = _ohm.remove(1.5f);
 
@@ -617,23 +672,25 @@ void testObjHashMaps()
     // ObjHashMap with external memory.
     typedef ObjHashMapExt<sizeof(float), Foo> TestObjHashMapExt;
     TestObjHashMapExt ohm1;
-    u32 size = TestObjHashMapExt::sizeFor(256);
-    void* mem = dm_alloc(size, &::realloc);
+    uint32_t size = TestObjHashMapExt::sizeFor(256);
+    void* mem = DM_ALLOC(&g_crtAllocator, size);
     ohm1.init(256, (uint8_t*)mem);
     testObjHashMapApi(ohm1);
 
     // ObjHashMap with allocator.
     typedef ObjHashMap<sizeof(float), Foo> TestObjHashMap;
     TestObjHashMap ohm2;
-    ohm2.init(256, &::realloc);
+    ohm2.init(256);
     testObjHashMapApi(ohm2);
 
     // ObjHashMap as ptr.
     typedef ObjHashMapH<sizeof(float), Foo> TestObjHashMapH;
     TestObjHashMapH* ohm3;
-    ohm3 = create<TestObjHashMapH>(256, &::realloc);
+    ohm3 = create<TestObjHashMapH>(256);
     testObjHashMapApi(*ohm3);
     destroy(ohm3);
+
+    DM_FREE(&g_crtAllocator, mem);
 }
 
 void testApi()
@@ -650,8 +707,4 @@ void testApi()
     testObjHashMaps();
 }
 
-int main()
-{
-    testApi();
-    return 0;
-}
+/* vim: set sw=4 ts=4 expandtab: */
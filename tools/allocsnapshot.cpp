@@ -0,0 +1,204 @@
+#if 0
+    g++ -I../include/ allocsnapshot.cpp -o allocsnapshot
+    # ./allocsnapshot snapshot.bin
+    exit
+#endif
+
+/*
+ * Copyright 2016 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+// Renders fragmentation of a snapshot written by dm::allocDumpSnapshot().
+
+#include <stdio.h>
+#include <string.h>
+
+#include <dm/allocator/allocator.h>
+
+struct Usage
+{
+    uint64_t m_used;
+    uint64_t m_free;
+    uint64_t m_largestFree;
+    uint32_t m_usedCount;
+    uint32_t m_freeCount;
+};
+
+static void addExtent(Usage& _usage, const dm::AllocSnapshotExtent& _extent)
+{
+    if (_extent.m_used)
+    {
+        _usage.m_used += _extent.m_size;
+        _usage.m_usedCount++;
+    }
+    else
+    {
+        _usage.m_free += _extent.m_size;
+        _usage.m_freeCount++;
+        _usage.m_largestFree = DM_MAX(_usage.m_largestFree, _extent.m_size);
+    }
+}
+
+// Share of free memory that is not part of the largest free extent.
+static double fragmentation(const Usage& _usage)
+{
+    return (0 != _usage.m_free) ? 100.0*double(_usage.m_free - _usage.m_largestFree)/double(_usage.m_free) : 0.0;
+}
+
+static void printUsage(const char* _name, const Usage& _usage)
+{
+    printf("%-16s used %10.2fMB (%7u) free %10.2fMB (%7u) largest free %10.2fMB fragmentation %5.1f%%\n"
+          , _name
+          , double(_usage.m_used)/(1024.0*1024.0), _usage.m_usedCount
+          , double(_usage.m_free)/(1024.0*1024.0), _usage.m_freeCount
+          , double(_usage.m_largestFree)/(1024.0*1024.0)
+          , fragmentation(_usage)
+          );
+}
+
+int main(int _argc, const char* _argv[])
+{
+    if (_argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <snapshot>\n", _argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(_argv[1], "rb");
+    if (NULL == file)
+    {
+        fprintf(stderr, "Unable to open '%s'.\n", _argv[1]);
+        return 1;
+    }
+
+    dm::AllocSnapshotHeader header;
+    if (1 != fread(&header, sizeof(header), 1, file)
+    ||  0 != memcmp(header.m_magic, "DMSS", 4)
+    ||  dm::AllocSnapshotHeader::Version != header.m_version)
+    {
+        fprintf(stderr, "'%s' is not a snapshot or was written by a different version.\n", _argv[1]);
+        fclose(file);
+        return 1;
+    }
+
+    enum { MaxRegions = 64, MaxChunks = 256 };
+    const uint32_t numRegions = DM_MIN(header.m_numRegions, uint32_t(MaxRegions));
+
+    static const char* s_kindNames[dm::AllocSnapshotExtent::KindCount] =
+    {
+        "Static",
+        "Segregated",
+        "Stack",
+        "Heap",
+        "Unused",
+    };
+
+    Usage kinds[dm::AllocSnapshotExtent::KindCount];
+    Usage chunks[MaxChunks];
+    Usage classes[MaxRegions];
+    uint64_t regionBytes[MaxRegions];
+    uint32_t regionCount[MaxRegions];
+    memset(kinds,       0, sizeof(kinds));
+    memset(chunks,      0, sizeof(chunks));
+    memset(classes,     0, sizeof(classes));
+    memset(regionBytes, 0, sizeof(regionBytes));
+    memset(regionCount, 0, sizeof(regionCount));
+
+    uint32_t numClasses = 0;
+    uint32_t numChunks  = 0;
+
+    for (uint32_t ii = 0; ii < header.m_numExtents; ++ii)
+    {
+        dm::AllocSnapshotExtent extent;
+        if (1 != fread(&extent, sizeof(extent), 1, file))
+        {
+            fprintf(stderr, "Snapshot is truncated, %u/%u extents read.\n", ii, header.m_numExtents);
+            break;
+        }
+
+        if (extent.m_kind >= dm::AllocSnapshotExtent::KindCount)
+        {
+            continue;
+        }
+
+        addExtent(kinds[extent.m_kind], extent);
+
+        if (dm::AllocSnapshotExtent::Segregated == extent.m_kind && extent.m_class < MaxRegions)
+        {
+            addExtent(classes[extent.m_class], extent);
+            numClasses = DM_MAX(numClasses, extent.m_class+1);
+        }
+
+        if (dm::AllocSnapshotExtent::Heap == extent.m_kind || dm::AllocSnapshotExtent::Unused == extent.m_kind)
+        {
+            if (extent.m_chunk < MaxChunks)
+            {
+                addExtent(chunks[extent.m_chunk], extent);
+                numChunks = DM_MAX(numChunks, uint32_t(extent.m_chunk)+1);
+            }
+        }
+
+        // Free heap blocks, grouped by the same regions the heap uses for its free slots.
+        if (dm::AllocSnapshotExtent::Heap == extent.m_kind && !extent.m_used && 0 != numRegions)
+        {
+            uint32_t region = 0;
+            for (uint64_t size = header.m_smallestRegion; size < extent.m_size && region < numRegions-1; size <<= 1)
+            {
+                ++region;
+            }
+
+            regionBytes[region] += extent.m_size;
+            regionCount[region]++;
+        }
+    }
+    fclose(file);
+
+    printf("Arena: %.2fMB, %u extents.\n\n", double(header.m_arenaSize)/(1024.0*1024.0), header.m_numExtents);
+
+    printf("Regions:\n");
+    for (uint32_t ii = 0; ii < dm::AllocSnapshotExtent::KindCount; ++ii)
+    {
+        printUsage(s_kindNames[ii], kinds[ii]);
+    }
+
+    printf("\nSegregated lists:\n");
+    for (uint32_t ii = 0; ii < numClasses; ++ii)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "#%u", ii);
+        printUsage(name, classes[ii]);
+    }
+
+    printf("\nHeaps (including space left for growth):\n");
+    for (uint32_t ii = 0; ii < numChunks; ++ii)
+    {
+        char name[32];
+        if (0 == ii)
+        {
+            snprintf(name, sizeof(name), "Arena");
+        }
+        else
+        {
+            snprintf(name, sizeof(name), "Chunk %u", ii-1);
+        }
+        printUsage(name, chunks[ii]);
+    }
+
+    printf("\nFree heap blocks per region:\n");
+    for (uint32_t ii = 0; ii < numRegions; ++ii)
+    {
+        if (0 != regionCount[ii])
+        {
+            printf("<= %6lluMB: %7u blocks, %10.2fMB\n"
+                  , (unsigned long long)((header.m_smallestRegion<<ii)>>20)
+                  , regionCount[ii]
+                  , double(regionBytes[ii])/(1024.0*1024.0)
+                  );
+        }
+    }
+
+    return 0;
+}
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,221 @@
+#if 0
+    g++ -O2 -I../include/ hashbench.cpp -o hashbench && ./hashbench && rm hashbench
+    exit
+#endif
+
+/*
+ * Copyright 2016 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+// Hash quality and throughput of the hash policies, over key distributions typical for our maps.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <dm/hash.h>
+#include <dm/timer.h>
+
+enum
+{
+    NumKeys    = 1<<16,
+    TableSize  = 1<<17, // Filled to 1/2, then to 3/4 by NumKeys*3/2 keys.
+    MaxKeySize = 128,
+};
+
+struct Keys
+{
+    const char* m_name;
+    uint8_t  m_data[NumKeys*3/2][MaxKeySize];
+    uint32_t m_size[NumKeys*3/2];
+};
+
+static uint64_t s_rng = UINT64_C(0x9e3779b97f4a7c15);
+static volatile uint64_t s_sink;
+static uint64_t rand64()
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 7;
+    s_rng ^= s_rng << 17;
+    return s_rng;
+}
+
+static void genKeys(Keys& _keys, uint32_t _type)
+{
+    for (uint32_t ii = 0; ii < NumKeys*3/2; ++ii)
+    {
+        uint8_t* data = _keys.m_data[ii];
+        switch (_type)
+        {
+        case 0: // Indices and handles.
+            {
+                _keys.m_name = "sequential u32";
+                memcpy(data, &ii, sizeof(ii));
+                _keys.m_size[ii] = sizeof(uint32_t);
+            }
+            break;
+
+        case 1: // Heap pointers, 16 byte aligned.
+            {
+                _keys.m_name = "pointers";
+                const uint64_t ptr = UINT64_C(0x00007f3a12000000) + uint64_t(ii)*48;
+                memcpy(data, &ptr, sizeof(ptr));
+                _keys.m_size[ii] = sizeof(uint64_t);
+            }
+            break;
+
+        case 2: // Float keys.
+            {
+                _keys.m_name = "floats";
+                const float val = float(ii)*0.25f;
+                memcpy(data, &val, sizeof(val));
+                _keys.m_size[ii] = sizeof(float);
+            }
+            break;
+
+        case 3: // Names.
+            {
+                _keys.m_name = "short strings";
+                _keys.m_size[ii] = uint32_t(snprintf((char*)data, MaxKeySize, "entity_%u", ii));
+            }
+            break;
+
+        case 4: // Asset paths.
+            {
+                _keys.m_name = "paths";
+                _keys.m_size[ii] = uint32_t(snprintf((char*)data, MaxKeySize, "assets/textures/level_%03u/material_%05u_diffuse.dds", ii%97, ii));
+            }
+            break;
+
+        default: // Random blobs.
+            {
+                _keys.m_name = "random 64B";
+                for (uint32_t jj = 0; jj < 64; jj += 8)
+                {
+                    const uint64_t val = rand64();
+                    memcpy(&data[jj], &val, sizeof(val));
+                }
+                _keys.m_size[ii] = 64;
+            }
+            break;
+        }
+    }
+}
+
+/// Average probe length of a linear probing table masked with the low bits, at '_count' keys.
+template <typename HashPolicyTy>
+static double probeLength(const Keys& _keys, uint32_t _count)
+{
+    static uint8_t s_used[TableSize];
+    memset(s_used, 0, sizeof(s_used));
+
+    uint64_t probes = 0;
+    for (uint32_t ii = 0; ii < _count; ++ii)
+    {
+        uint32_t idx = uint32_t(HashPolicyTy::hash(_keys.m_data[ii], _keys.m_size[ii]))&(TableSize-1);
+        for (probes++; s_used[idx]; probes++)
+        {
+            idx = (idx+1)&(TableSize-1);
+        }
+        s_used[idx] = 1;
+    }
+
+    return double(probes)/double(_count);
+}
+
+/// Average number of low 32 output bits changed when one input bit is flipped, ideal is 16.
+template <typename HashPolicyTy>
+static double avalanche(const Keys& _keys)
+{
+    uint64_t changed = 0;
+    uint64_t count = 0;
+    for (uint32_t ii = 0; ii < 256; ++ii)
+    {
+        uint8_t key[MaxKeySize];
+        const uint32_t size = _keys.m_size[ii];
+        memcpy(key, _keys.m_data[ii], size);
+
+        const uint32_t hash = uint32_t(HashPolicyTy::hash(key, size));
+        for (uint32_t bit = 0; bit < size*8; ++bit)
+        {
+            key[bit>>3] ^= uint8_t(1<<(bit&7));
+            for (uint32_t diff = hash ^ uint32_t(HashPolicyTy::hash(key, size)); 0 != diff; diff &= diff-1)
+            {
+                changed++;
+            }
+            key[bit>>3] ^= uint8_t(1<<(bit&7));
+            count++;
+        }
+    }
+
+    return double(changed)/double(count);
+}
+
+template <typename HashPolicyTy>
+static void quality(const char* _name, const Keys& _keys)
+{
+    printf("    %-6s probes at 1/2 load %6.2f, at 3/4 load %6.2f, avalanche %5.2f/16\n"
+          , _name
+          , probeLength<HashPolicyTy>(_keys, TableSize/2)
+          , probeLength<HashPolicyTy>(_keys, TableSize*3/4)
+          , avalanche<HashPolicyTy>(_keys)
+          );
+}
+
+template <typename HashPolicyTy>
+static void throughput(const char* _name)
+{
+    static uint8_t s_data[4096+16];
+    for (uint32_t ii = 0; ii < sizeof(s_data); ++ii)
+    {
+        s_data[ii] = uint8_t(rand64());
+    }
+
+    printf("    %-6s", _name);
+
+    static const uint32_t s_sizes[] = { 4, 8, 16, 32, 64, 256, 4096 };
+    for (uint32_t ii = 0; ii < sizeof(s_sizes)/sizeof(s_sizes[0]); ++ii)
+    {
+        const uint32_t size = s_sizes[ii];
+        const uint32_t iterations = (1<<26)/(size+16);
+
+        uint64_t sum = 0;
+        const int64_t begin = dm::getHPCounter();
+        for (uint32_t jj = 0; jj < iterations; ++jj)
+        {
+            // Dependency on the previous result keeps calls from overlapping, which measures latency as maps see it.
+            sum += HashPolicyTy::hash(&s_data[sum&15], size);
+        }
+        const int64_t end = dm::getHPCounter();
+        s_sink = sum;
+
+        const double ns = double(end-begin)*1e9/double(dm::getHPFrequency())/double(iterations);
+        printf(" %5uB %6.2fns", size, ns);
+    }
+    printf("\n");
+}
+
+int main()
+{
+    static Keys s_keys;
+
+    printf("Quality (table of %u slots, ideal linear probing: 1.50 at 1/2, 2.50 at 3/4 load):\n", TableSize);
+    for (uint32_t type = 0; type < 6; ++type)
+    {
+        genKeys(s_keys, type);
+        printf("  %s:\n", s_keys.m_name);
+        quality<dm::WyHashPolicy>("wy",   s_keys);
+        quality<dm::XxHashPolicy>("xx",   s_keys);
+        quality<dm::SdbmHashPolicy>("sdbm", s_keys);
+    }
+
+    printf("\nThroughput (per hash, by key size):\n");
+    throughput<dm::WyHashPolicy>("wy");
+    throughput<dm::XxHashPolicy>("xx");
+    throughput<dm::SdbmHashPolicy>("sdbm");
+
+    return 0;
+}
+
+/* vim: set sw=4 ts=4 expandtab: */